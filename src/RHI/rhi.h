@@ -1,6 +1,7 @@
 #ifndef SPARROWENGINE_RHI_H
 #define SPARROWENGINE_RHI_H
 
+#include <functional>
 #include <memory>
 #include <span>
 #include <vector>
@@ -10,6 +11,14 @@ namespace Sparrow {
 class WindowSystem;
 struct RHIInitInfo {
   std::shared_ptr<WindowSystem> windowSystem;
+  // Falls back to fifo, which is always supported, if unavailable.
+  RHIPresentMode presentMode = RHIPresentMode::Mailbox;
+  // 0 picks one more than the surface minimum. Clamped to what the
+  // surface supports.
+  uint32_t swapChainImageCount = 0;
+  uint32_t maxFramesInFlight = 3;
+  // Keeps at most one frame queued on the GPU, see waitForNextFrame.
+  bool lowLatency = false;
 };
 
 class RHI {
@@ -27,6 +36,24 @@ class RHI {
       std::span<char> shader_code) = 0;
   virtual std::unique_ptr<RHIPipeline> createGraphicsPipeline(
       const RHIGraphicsPipelineCreateInfo& createInfo) = 0;
+  virtual std::unique_ptr<RHIPipeline> createComputePipeline(
+      const RHIComputePipelineCreateInfo& createInfo) = 0;
+  // Compiles only the state of the given parts into a library, other
+  // state in createInfo is ignored. Needs supportsGraphicsPipelineLibrary.
+  virtual std::unique_ptr<RHIPipeline> createGraphicsPipelineLibrary(
+      const RHIGraphicsPipelineCreateInfo& createInfo,
+      RHIGraphicsPipelineLibraryFlag parts) = 0;
+  // Links libraries covering all four parts into a pipeline. Without
+  // optimize the link is cheap enough for the render thread, with it the
+  // driver optimizes across the parts like a monolithic pipeline. The
+  // libraries must stay alive while linking.
+  virtual std::unique_ptr<RHIPipeline> linkGraphicsPipelineLibraries(
+      std::span<RHIPipeline* const> libraries,
+      RHIPipelineLayout* pipelineLayout,
+      bool optimize) = 0;
+  // Needs supportsShaderObject.
+  virtual std::unique_ptr<RHIShaderObject> createShaderObject(
+      const RHIShaderObjectCreateInfo& createInfo) = 0;
   virtual std::unique_ptr<RHIRenderPass> createRenderPass(
       const RHIRenderPassCreateInfo& createInfo) = 0;
   virtual std::unique_ptr<RHIPipelineLayout> createPipelineLayout(
@@ -44,6 +71,8 @@ class RHI {
   createImageAndCopyData(const RHIImageCreateInfo& createInfo,
                          void* data,
                          size_t dataSize) = 0;
+  virtual std::unique_ptr<RHIImageView> createImageView(
+      const RHIImageViewCreateInfo& createInfo) = 0;
   virtual std::unique_ptr<RHISampler> createSampler(
       const RHISamplerCreateInfo& createInfo) = 0;
   virtual std::unique_ptr<RHIDescriptorSetLayout> createDescriptorSetLayout(
@@ -61,14 +90,59 @@ class RHI {
   virtual uint32_t getCurrentSwapChainImageIndex() = 0;
   virtual RHISwapChainInfo getSwapChainInfo() = 0;
   virtual RHIImageView* getSwapChainImageView(size_t index) = 0;
+  virtual RHIImage* getSwapChainImage(size_t index) = 0;
   virtual RHIDepthImageInfo getDepthImageInfo() = 0;
+  virtual std::vector<RHIPresentMode> getSupportedPresentModes() = 0;
+  virtual RHIFrameLatencyStatistics getFrameLatencyStatistics() = 0;
+  // Whether cmdDrawIndexedIndirectCount can be used.
+  virtual bool supportsDrawIndirectCount() = 0;
+  // Whether cmdBeginRendering and pipelines with renderingCreateInfo can
+  // be used.
+  virtual bool supportsDynamicRendering() = 0;
+  // Whether graphics pipelines can be built from separately compiled
+  // vertex input, pre-rasterization, fragment shader and fragment output
+  // libraries.
+  virtual bool supportsGraphicsPipelineLibrary() = 0;
+  // The states that can be made dynamic on top of viewport and scissor.
+  virtual RHIExtendedDynamicStateSupport getExtendedDynamicStateSupport() = 0;
+  // Whether draws can use shader objects with all state set while
+  // recording instead of pipelines. Implies dynamic rendering.
+  virtual bool supportsShaderObject() = 0;
+  // Offsets of uniform buffer descriptors, dynamic ones included, must be
+  // multiples of it.
+  virtual RHIDeviceSize getMinUniformBufferOffsetAlignment() = 0;
+  // Barriers recorded for the previous frame.
+  virtual RHIBarrierStatistics getBarrierStatistics() = 0;
   virtual RHICommandBuffer* getCurrentCommandBuffer() = 0;
   virtual std::span<RHICommandBuffer> getCommandBuffers() = 0;
 
+  /*** Configuration ***/
+  // The swapchain is recreated with the new mode at the next frame.
+  virtual void setPresentMode(RHIPresentMode presentMode) = 0;
+  virtual void setLowLatency(bool enabled) = 0;
+  // Exchanges the pipelines the two objects wrap, so holders of either
+  // pointer see the other pipeline. Not synchronized with recording.
+  virtual void swapPipelines(RHIPipeline* first, RHIPipeline* second) = 0;
+
   /*** Destory ***/
   virtual void destoryBuffer(RHIBuffer* buffer) = 0;
+  virtual void destoryImage(RHIImage* image) = 0;
+  virtual void destoryImageView(RHIImageView* imageView) = 0;
   virtual void destoryDescriptorSetLayout(
       RHIDescriptorSetLayout* descriptorSetLayout) = 0;
+  virtual void destoryFramebuffer(RHIFramebuffer* framebuffer) = 0;
+  // Pipelines created from the module stay valid.
+  virtual void destoryShaderModule(RHIShader* shader) = 0;
+  virtual void destoryPipeline(RHIPipeline* pipeline) = 0;
+  virtual void destoryShaderObject(RHIShaderObject* shaderObject) = 0;
+
+  /*** Event ***/
+  // The listener is called with every image view right before it is
+  // destroyed, including the swapchain and depth views on resize, so
+  // objects referencing it can be dropped.
+  virtual uint32_t addImageViewDestroyListener(
+      std::function<void(RHIImageView*)> listener) = 0;
+  virtual void removeImageViewDestroyListener(uint32_t listenerId) = 0;
 
   /*** Command ***/
   virtual bool beginCommandBuffer(
@@ -76,8 +150,17 @@ class RHI {
       RHICommandBufferBeginInfo* commandBufferBeginInfo) = 0;
   virtual bool endCommandBuffer(RHICommandBuffer* commandBuffer) = 0;
   virtual std::unique_ptr<RHICommandBuffer> beginOneTimeCommandBuffer() = 0;
+  // Submits and waits for the command buffer to finish.
   virtual bool endOneTimeCommandBuffer(RHICommandBuffer* commandBuffer) = 0;
-  virtual void beforePass() = 0;
+  // Returns once the next frame can start recording. Input should be
+  // sampled right after, the frame's latency is measured from here. In
+  // low latency mode it waits for the GPU to finish every submitted frame
+  // so that input is as fresh as possible when the frame is recorded.
+  virtual void waitForNextFrame() = 0;
+  // Acquires the next swapchain image, recreating the swapchain first if
+  // it is out of date. Returns false if no image could be acquired, the
+  // frame has to be skipped then.
+  virtual bool beforePass() = 0;
   virtual void waitIdle() = 0;
   virtual void submitRendering() = 0;
 
@@ -85,9 +168,27 @@ class RHI {
                                   RHIRenderPassBeginInfo* beginInfo,
                                   RHISubpassContents contents) = 0;
   virtual void cmdEndRenderPass(RHICommandBuffer* commandBuffer) = 0;
+  // Begins rendering to attachments given at record time, without render
+  // pass and framebuffer objects. Attachments are transitioned with
+  // cmdTransitionResources first.
+  virtual void cmdBeginRendering(RHICommandBuffer* commandBuffer,
+                                 const RHIRenderingInfo* renderingInfo) = 0;
+  virtual void cmdEndRendering(RHICommandBuffer* commandBuffer) = 0;
   virtual void cmdBindPipeline(RHICommandBuffer* commandBuffer,
                                RHIPipelineBindPoint bindPoint,
                                RHIPipeline* pipeline) = 0;
+  // Binds shader objects for the following draws in place of a pipeline, a
+  // null shader unbinds its stage. Graphics stages not given are unbound.
+  virtual void cmdBindShaders(RHICommandBuffer* commandBuffer,
+                              std::span<const RHIShaderStageFlag> stages,
+                              std::span<RHIShaderObject* const> shaders) = 0;
+  // Sets all fixed function state of createInfo while recording, as
+  // drawing with shader objects needs. Viewports and scissors are set
+  // when given. Stages, layout, render targets and the dynamic state
+  // list are ignored.
+  virtual void cmdSetGraphicsState(
+      RHICommandBuffer* commandBuffer,
+      const RHIGraphicsPipelineCreateInfo& createInfo) = 0;
   virtual void cmdBindVertexBuffers(RHICommandBuffer* commandBuffer,
                                     uint32_t firstBinding,
                                     uint32_t bindingCount,
@@ -105,6 +206,14 @@ class RHI {
                                      const RHIDescriptorSet* descriptorSets,
                                      uint32_t dynamicOffsetCount,
                                      const uint32_t* dynamicOffsets) = 0;
+  // Writes size bytes at offset of the layout's push constant ranges for
+  // the given stages. Every device supports at least 128 bytes.
+  virtual void cmdPushConstants(RHICommandBuffer* commandBuffer,
+                                const RHIPipelineLayout* layout,
+                                RHIShaderStageFlag stageFlags,
+                                uint32_t offset,
+                                uint32_t size,
+                                const void* values) = 0;
   virtual void cmdDraw(RHICommandBuffer* commandBuffer,
                        uint32_t vertexCount,
                        uint32_t instanceCount,
@@ -116,6 +225,17 @@ class RHI {
                               uint32_t firstIndex,
                               int32_t vertexOffset,
                               uint32_t firstInstance) = 0;
+  virtual void cmdDrawIndexedIndirectCount(RHICommandBuffer* commandBuffer,
+                                           RHIBuffer* buffer,
+                                           RHIDeviceSize offset,
+                                           RHIBuffer* countBuffer,
+                                           RHIDeviceSize countBufferOffset,
+                                           uint32_t maxDrawCount,
+                                           uint32_t stride) = 0;
+  virtual void cmdDispatch(RHICommandBuffer* commandBuffer,
+                           uint32_t groupCountX,
+                           uint32_t groupCountY,
+                           uint32_t groupCountZ) = 0;
   virtual void cmdSetViewport(RHICommandBuffer* commandBuffer,
                               uint32_t firstViewport,
                               uint32_t viewportCount,
@@ -124,10 +244,54 @@ class RHI {
                              uint32_t firstScissor,
                              uint32_t scissorCount,
                              const RHIRect2D* pScissors) = 0;
+  // Extended dynamic state, for pipelines created with the matching
+  // RHIDynamicState. See getExtendedDynamicStateSupport.
+  virtual void cmdSetCullMode(RHICommandBuffer* commandBuffer,
+                              RHICullMode cullMode) = 0;
+  virtual void cmdSetFrontFace(RHICommandBuffer* commandBuffer,
+                               RHIFrontFace frontFace) = 0;
+  // Only switches within the topology class the pipeline was created with.
+  virtual void cmdSetPrimitiveTopology(RHICommandBuffer* commandBuffer,
+                                       RHIPrimitiveTopology topology) = 0;
+  virtual void cmdSetDepthTestEnable(RHICommandBuffer* commandBuffer,
+                                     bool enabled) = 0;
+  virtual void cmdSetDepthWriteEnable(RHICommandBuffer* commandBuffer,
+                                      bool enabled) = 0;
+  virtual void cmdSetDepthCompareOp(RHICommandBuffer* commandBuffer,
+                                    RHICompareOp compareOp) = 0;
+  virtual void cmdSetPrimitiveRestartEnable(RHICommandBuffer* commandBuffer,
+                                            bool enabled) = 0;
+  virtual void cmdSetColorBlendEnable(RHICommandBuffer* commandBuffer,
+                                      uint32_t firstAttachment,
+                                      uint32_t attachmentCount,
+                                      const RHIBool32* enables) = 0;
   virtual void cmdCopyBuffer(RHICommandBuffer* commandBuffer,
                              RHIBuffer* srcBuffer,
                              RHIBuffer* dstBuffer,
                              std::span<RHIBufferCopy> copyRegions) = 0;
+  virtual void cmdFillBuffer(RHICommandBuffer* commandBuffer,
+                             RHIBuffer* dstBuffer,
+                             RHIDeviceSize dstOffset,
+                             RHIDeviceSize size,
+                             uint32_t data) = 0;
+  // Declares how the following commands use these resources. The RHI
+  // tracks the layout and last accesses of every image subresource and
+  // buffer and records only the barriers that are needed, batched into
+  // one command right before the next draw, dispatch, copy or render pass.
+  virtual void cmdTransitionResources(
+      RHICommandBuffer* commandBuffer,
+      std::span<const RHIImageTransition> imageTransitions,
+      std::span<const RHIBufferTransition> bufferTransitions) = 0;
+  // Records the state an image was left in by something the RHI does not
+  // track, like the final layout of a render pass.
+  virtual void setImageUsage(RHIImage* image,
+                             const RHIImageSubresourceRange& range,
+                             RHIResourceUsage usage) = 0;
+  /*** Synchronization ***/
+  // Runs the callback once the frame being recorded, or the next one if
+  // none is, finished on the GPU. For releasing resources it may use.
+  virtual void deferRelease(std::function<void()> release) = 0;
+
   /*** Memory ***/
   virtual void* mapMemory(RHIDeviceMemory* deviceMemory,
                           RHIDeviceSize offset,
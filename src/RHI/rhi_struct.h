@@ -7,6 +7,7 @@
 
 #include <array>
 #include <cstdint>
+#include <span>
 #include "function/render_enum.h"
 
 
@@ -16,8 +17,12 @@ using RHIBool32 = uint32_t;
 static constexpr RHIBool32 RHIFalse = 0U;
 static constexpr RHIBool32 RHITrue = 1U;
 static constexpr uint32_t RHISubpassExternal =  (~0U);
+static constexpr uint32_t RHIQueueFamilyIgnored = (~0U);
+static constexpr uint32_t RHIRemainingMipLevels = (~0U);
+static constexpr uint32_t RHIRemainingArrayLayers = (~0U);
 
 using RHIDeviceSize = uint64_t;
+static constexpr RHIDeviceSize RHIWholeSize = (~0ULL);
 
 #pragma region Command
 struct RHICommandBufferInheritanceInfo;
@@ -33,6 +38,7 @@ using RHIArray = std::array<T, Size>;
 
 class RHIPipeline {};
 class RHIShader {};
+class RHIShaderObject {};
 class RHIPipelineLayout {};
 class RHIRenderPass {};
 class RHIFramebuffer {};
@@ -78,6 +84,7 @@ struct RHIStencilOpState;
 struct RHIColorBlendAttachmentState;
 
 struct RHIPushConstantRange;
+struct RHIPipelineRenderingCreateInfo;
 
 struct RHIAttachmentDescription;
 struct RHISubpassDescription;
@@ -102,6 +109,9 @@ struct RHIGraphicsPipelineCreateInfo {
   uint32_t subpass;
   RHIPipeline* basePipelineHandle;
   int32_t basePipelineIndex;
+  // Attachment formats for dynamic rendering, renderPass is ignored when
+  // set.
+  const RHIPipelineRenderingCreateInfo* renderingCreateInfo = {};
 };
 
 struct RHIPipelineShaderStageCreateInfo {
@@ -122,6 +132,11 @@ struct RHISpecializationMapEntry {
   size_t size = {};
 };
 
+struct RHIComputePipelineCreateInfo {
+  RHIPipelineShaderStageCreateInfo stage = {};
+  RHIPipelineLayout* pipelineLayout = {};
+};
+
 struct RHIDynamicStateCreateInfo {
   uint32_t dynamicStateCount = {};
   const RHIDynamicState* dynamicStates = {};
@@ -240,7 +255,8 @@ struct RHIColorBlendAttachmentState {
 
 struct RHIPipelineLayoutCreateInfo {
   uint32_t setLayoutCount = {};
-  const RHIDescriptorSetLayout* setLayouts = {};
+  // One per set, unlike RHIDescriptorSetAllocateInfo the layouts differ.
+  RHIDescriptorSetLayout* const* setLayouts = {};
   uint32_t pushConstantRangeCount = {};
   const RHIPushConstantRange* pushConstantRanges = {};
 };
@@ -250,6 +266,31 @@ struct RHIPushConstantRange {
   uint32_t size = {};
 };
 
+// One stage compiled on its own, drawn with by binding it instead of a
+// pipeline. Set layouts and push constant ranges have to match the
+// pipeline layout descriptor sets are bound with.
+struct RHIShaderObjectCreateInfo {
+  RHIShaderStageFlag stage = RHIShaderStageFlag::Vertex;
+  // Stages that may be bound after this one, e.g. Fragment for a vertex
+  // shader.
+  RHIShaderStageFlag nextStage = {};
+  // SPIR-V.
+  std::span<const char> code;
+  const char* name = "main";
+  uint32_t setLayoutCount = {};
+  RHIDescriptorSetLayout* const* setLayouts = {};
+  uint32_t pushConstantRangeCount = {};
+  const RHIPushConstantRange* pushConstantRanges = {};
+  const RHISpecializationInfo* specializationInfo = {};
+};
+
+struct RHIPipelineRenderingCreateInfo {
+  uint32_t colorAttachmentCount = {};
+  const RHIFormat* colorAttachmentFormats = {};
+  RHIFormat depthAttachmentFormat = RHIFormat::Undefined;
+  RHIFormat stencilAttachmentFormat = RHIFormat::Undefined;
+};
+
 struct RHIRenderPassCreateInfo {
   uint32_t attachmentCount = {};
   const RHIAttachmentDescription* attachments = {};
@@ -306,6 +347,26 @@ struct RHISwapChainInfo {
   RHIFormat imageFormat;
   RHIImageView* imageViews;
   size_t imageViewsSize;
+  RHIPresentMode presentMode;
+};
+
+struct RHIFrameLatencyStatistics {
+  // From sampling input for a frame until the CPU saw the GPU finish it,
+  // right before presentation. Exact in low latency mode, which waits for
+  // every frame; otherwise late by up to the time between checks.
+  float lastInputToPresentMs = 0.0f;
+  float averageInputToPresentMs = 0.0f;
+  uint64_t measuredFrameCount = 0;
+};
+
+// Groups of fixed function state the device can set while recording.
+struct RHIExtendedDynamicStateSupport {
+  // Cull mode, front face, topology and the depth and stencil tests.
+  bool extendedDynamicState = false;
+  // Depth bias, primitive restart and rasterizer discard enables.
+  bool extendedDynamicState2 = false;
+  // Per attachment blend enable.
+  bool colorBlend = false;
 };
 
 struct RHIDepthImageInfo {
@@ -349,6 +410,22 @@ struct RHIRenderPassBeginInfo {
   const RHIClearValue* clearValue;
 };
 
+struct RHIRenderingAttachmentInfo {
+  RHIImageView* imageView = {};
+  RHIImageLayout imageLayout = RHIImageLayout::Undefined;
+  RHIAttachmentLoadOp loadOp = RHIAttachmentLoadOp::Load;
+  RHIAttachmentStoreOp storeOp = RHIAttachmentStoreOp::Store;
+  RHIClearValue clearValue = {};
+};
+struct RHIRenderingInfo {
+  RHIRect2D renderArea = {};
+  uint32_t layerCount = 1;
+  uint32_t colorAttachmentCount = {};
+  const RHIRenderingAttachmentInfo* colorAttachments = {};
+  const RHIRenderingAttachmentInfo* depthAttachment = {};
+  const RHIRenderingAttachmentInfo* stencilAttachment = {};
+};
+
 struct RHIFramebufferCreateInfo {
   RHIRenderPass* renderPass;
   uint32_t attachmentCount;
@@ -372,6 +449,47 @@ struct RHIBufferCopy {
   RHIDeviceSize size = {};
 };
 
+struct RHIDrawIndexedIndirectCommand {
+  uint32_t indexCount = {};
+  uint32_t instanceCount = {};
+  uint32_t firstIndex = {};
+  int32_t vertexOffset = {};
+  uint32_t firstInstance = {};
+};
+
+struct RHIImageSubresourceRange {
+  RHIImageAspectFlag aspectMask = RHIImageAspectFlag::Color;
+  uint32_t baseMipLevel = {};
+  uint32_t levelCount = RHIRemainingMipLevels;
+  uint32_t baseArrayLayer = {};
+  uint32_t layerCount = RHIRemainingArrayLayers;
+};
+
+struct RHIImageTransition {
+  RHIImage* image = {};
+  RHIImageSubresourceRange subresourceRange = {};
+  RHIResourceUsage usage = RHIResourceUsage::Undefined;
+  // The current contents are not needed, a layout transition may drop them.
+  bool discard = false;
+};
+
+struct RHIBufferTransition {
+  RHIBuffer* buffer = {};
+  RHIResourceUsage usage = RHIResourceUsage::Undefined;
+};
+
+struct RHIBarrierStatistics {
+  // Image subresources and buffers a usage was declared for.
+  uint32_t transitionCount = 0;
+  // Barriers recorded.
+  uint32_t barrierCount = 0;
+  // Declarations that needed no barrier of their own: the state already
+  // covered them, or they were folded into another pending barrier.
+  uint32_t mergedCount = 0;
+  // Barrier commands the barriers were batched into.
+  uint32_t batchCount = 0;
+};
+
 struct RHIDescriptorSetLayoutBinding {
   uint32_t binding = {};
   RHIDescriptorType descriptorType = RHIDescriptorType::Sampler;
@@ -426,6 +544,13 @@ struct RHIImageCreateInfo {
   uint32_t mipLevels;
 };
 
+struct RHIImageViewCreateInfo {
+  RHIImage* image = {};
+  RHIImageViewType viewType = RHIImageViewType::Type2D;
+  RHIFormat format = {};
+  RHIImageSubresourceRange subresourceRange = {};
+};
+
 struct RHISamplerCreateInfo {
   RHIFilter magFilter = RHIFilter::Nearest;
   RHIFilter minFilter = RHIFilter::Nearest;
@@ -0,0 +1,450 @@
+#include "vulkan_resource_tracker.h"
+#include <algorithm>
+#include <iostream>
+#include <utility>
+#include "utils/log.h"
+#include "vulkan_utils.h"
+
+namespace Sparrow {
+
+namespace {
+struct UsageInfo {
+  vk::PipelineStageFlags2 stages = {};
+  vk::AccessFlags2 readAccess = {};
+  vk::AccessFlags2 writeAccess = {};
+  // Only meaningful for images.
+  vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+};
+
+UsageInfo getUsageInfo(RHIResourceUsage usage) {
+  using Stage = vk::PipelineStageFlagBits2;
+  using Access = vk::AccessFlagBits2;
+  using Layout = vk::ImageLayout;
+  switch (usage) {
+    case RHIResourceUsage::Undefined:
+      return {};
+    case RHIResourceUsage::TransferSrc:
+      return {Stage::eTransfer, Access::eTransferRead, {},
+              Layout::eTransferSrcOptimal};
+    case RHIResourceUsage::TransferDst:
+      return {Stage::eTransfer, {}, Access::eTransferWrite,
+              Layout::eTransferDstOptimal};
+    case RHIResourceUsage::IndirectArgument:
+      return {Stage::eDrawIndirect, Access::eIndirectCommandRead};
+    case RHIResourceUsage::VertexBuffer:
+      return {Stage::eVertexInput, Access::eVertexAttributeRead};
+    case RHIResourceUsage::IndexBuffer:
+      return {Stage::eVertexInput, Access::eIndexRead};
+    case RHIResourceUsage::UniformBuffer:
+      return {Stage::eVertexShader | Stage::eFragmentShader |
+                  Stage::eComputeShader,
+              Access::eUniformRead};
+    case RHIResourceUsage::VertexShaderRead:
+      return {Stage::eVertexShader, Access::eShaderRead, {},
+              Layout::eShaderReadOnlyOptimal};
+    case RHIResourceUsage::FragmentShaderSampled:
+      return {Stage::eFragmentShader, Access::eShaderRead, {},
+              Layout::eShaderReadOnlyOptimal};
+    case RHIResourceUsage::ComputeShaderRead:
+      return {Stage::eComputeShader, Access::eShaderRead, {},
+              Layout::eGeneral};
+    case RHIResourceUsage::ComputeShaderWrite:
+      return {Stage::eComputeShader, {}, Access::eShaderWrite,
+              Layout::eGeneral};
+    case RHIResourceUsage::ComputeShaderReadWrite:
+      return {Stage::eComputeShader, Access::eShaderRead, Access::eShaderWrite,
+              Layout::eGeneral};
+    case RHIResourceUsage::ComputeShaderSampledDepth:
+      return {Stage::eComputeShader, Access::eShaderRead, {},
+              Layout::eDepthStencilReadOnlyOptimal};
+    case RHIResourceUsage::ColorAttachment:
+      return {Stage::eColorAttachmentOutput, Access::eColorAttachmentRead,
+              Access::eColorAttachmentWrite, Layout::eColorAttachmentOptimal};
+    case RHIResourceUsage::DepthAttachment:
+      return {Stage::eEarlyFragmentTests | Stage::eLateFragmentTests,
+              Access::eDepthStencilAttachmentRead,
+              Access::eDepthStencilAttachmentWrite,
+              Layout::eDepthStencilAttachmentOptimal};
+    case RHIResourceUsage::Present:
+      // The acquire semaphore waits at color attachment output, so the
+      // transition away from present must wait for that stage.
+      return {Stage::eColorAttachmentOutput, {}, {}, Layout::ePresentSrcKHR};
+  }
+  return {};
+}
+
+uint32_t resolveCount(uint32_t count, uint32_t base, uint32_t total) {
+  if (base >= total) {
+    return 0;
+  }
+  return std::min(count, total - base);
+}
+}  // namespace
+
+void VulkanResourceTracker::registerImage(vk::Image image,
+                                          uint32_t mipLevels,
+                                          uint32_t arrayLayers) {
+  forgetImage(image);
+  images[static_cast<VkImage>(image)] = ImageState{
+      .mipLevels = mipLevels,
+      .arrayLayers = arrayLayers,
+      .subresources = std::vector<AccessState>(mipLevels * arrayLayers),
+  };
+}
+
+void VulkanResourceTracker::forgetImage(vk::Image image) {
+  auto entry = images.find(static_cast<VkImage>(image));
+  if (entry == images.end()) {
+    return;
+  }
+  if (std::erase_if(pendingImageBarriers, [image](const auto& pending) {
+        return pending.image == image;
+      }) > 0) {
+    for (auto i = 0U; i < pendingImageBarriers.size(); i++) {
+      pendingImageBarriers[i].state->pendingBarrier = static_cast<int32_t>(i);
+    }
+  }
+  images.erase(entry);
+}
+
+void VulkanResourceTracker::forgetBuffer(vk::Buffer buffer) {
+  auto entry = buffers.find(static_cast<VkBuffer>(buffer));
+  if (entry == buffers.end()) {
+    return;
+  }
+  if (std::erase_if(pendingBufferBarriers, [buffer](const auto& pending) {
+        return pending.buffer == buffer;
+      }) > 0) {
+    for (auto i = 0U; i < pendingBufferBarriers.size(); i++) {
+      pendingBufferBarriers[i].state->pendingBarrier = static_cast<int32_t>(i);
+    }
+  }
+  buffers.erase(entry);
+}
+
+bool VulkanResourceTracker::access(AccessState& state,
+                                   RHIResourceUsage usage,
+                                   bool discard,
+                                   bool hasLayout,
+                                   PendingBarrier& barrier) {
+  if (usage == RHIResourceUsage::Undefined) {
+    return false;
+  }
+  const auto info = getUsageInfo(usage);
+  const auto layout = hasLayout ? info.layout : vk::ImageLayout::eUndefined;
+  const auto layoutChange = layout != state.layout;
+
+  if (!info.writeAccess && !layoutChange) {
+    // Reads only wait for the last write, and only once per stage.
+    const auto visible =
+        !(info.stages & ~state.visibleStages) &&
+        !(info.readAccess & ~state.visibleAccess);
+    state.readStages |= info.stages;
+    if (!state.writeStages || visible) {
+      return false;
+    }
+    barrier = PendingBarrier{
+        .srcStages = state.writeStages,
+        .srcAccess = state.writeAccess,
+        .dstStages = info.stages,
+        .dstAccess = info.readAccess,
+        .oldLayout = state.layout,
+        .newLayout = state.layout,
+    };
+    state.visibleStages |= info.stages;
+    state.visibleAccess |= info.readAccess;
+    return true;
+  }
+
+  // Writes and layout transitions wait for every earlier access.
+  barrier = PendingBarrier{
+      .srcStages = state.writeStages | state.readStages,
+      .srcAccess = state.writeAccess,
+      .dstStages = info.stages,
+      .dstAccess = info.readAccess | info.writeAccess,
+      .oldLayout = discard ? vk::ImageLayout::eUndefined : state.layout,
+      .newLayout = layout,
+  };
+  const auto needsBarrier = layoutChange || barrier.srcStages;
+  // A layout transition counts as a write at the new stages, so later
+  // reads at other stages wait for it.
+  state.layout = layout;
+  state.writeStages = info.stages;
+  state.writeAccess = info.writeAccess;
+  state.readStages = {};
+  state.visibleStages = info.writeAccess ? vk::PipelineStageFlags2{}
+                                         : info.stages;
+  state.visibleAccess = info.writeAccess ? vk::AccessFlags2{}
+                                         : info.readAccess;
+  return needsBarrier;
+}
+
+void VulkanResourceTracker::merge(PendingBarrier& pending,
+                                  const PendingBarrier& barrier) {
+  // Nothing runs between the two, so one barrier from the first source to
+  // both destinations ends in the same state.
+  pending.srcStages |= barrier.srcStages;
+  pending.srcAccess |= barrier.srcAccess;
+  pending.dstStages |= barrier.dstStages;
+  pending.dstAccess |= barrier.dstAccess;
+  if (barrier.oldLayout == vk::ImageLayout::eUndefined) {
+    pending.oldLayout = vk::ImageLayout::eUndefined;
+  }
+  pending.newLayout = barrier.newLayout;
+}
+
+void VulkanResourceTracker::transitionImage(
+    vk::Image image,
+    const RHIImageSubresourceRange& range,
+    RHIResourceUsage usage,
+    bool discard) {
+  auto entry = images.find(static_cast<VkImage>(image));
+  if (entry == images.end()) {
+    LOG_ERROR("VulkanResourceTracker::transitionImage unknown image.");
+    return;
+  }
+  auto& imageState = entry->second;
+  const auto levelCount = resolveCount(range.levelCount, range.baseMipLevel,
+                                       imageState.mipLevels);
+  const auto layerCount = resolveCount(
+      range.layerCount, range.baseArrayLayer, imageState.arrayLayers);
+  const auto aspect = Cast<vk::ImageAspectFlags>(range.aspectMask);
+
+  for (auto layer = range.baseArrayLayer;
+       layer < range.baseArrayLayer + layerCount; layer++) {
+    for (auto mip = range.baseMipLevel; mip < range.baseMipLevel + levelCount;
+         mip++) {
+      auto& state =
+          imageState.subresources[layer * imageState.mipLevels + mip];
+      statistics.transitionCount++;
+      auto barrier = PendingBarrier{};
+      if (!access(state, usage, discard, true, barrier)) {
+        statistics.mergedCount++;
+        continue;
+      }
+      if (state.pendingBarrier >= 0) {
+        merge(pendingImageBarriers[state.pendingBarrier].barrier, barrier);
+        statistics.mergedCount++;
+        continue;
+      }
+      state.pendingBarrier =
+          static_cast<int32_t>(pendingImageBarriers.size());
+      pendingImageBarriers.push_back(PendingImageBarrier{
+          .barrier = barrier,
+          .image = image,
+          .aspect = aspect,
+          .mipLevel = mip,
+          .arrayLayer = layer,
+          .state = &state,
+      });
+    }
+  }
+}
+
+void VulkanResourceTracker::transitionBuffer(vk::Buffer buffer,
+                                             RHIResourceUsage usage) {
+  auto& state = buffers[static_cast<VkBuffer>(buffer)];
+  statistics.transitionCount++;
+  auto barrier = PendingBarrier{};
+  if (!access(state, usage, false, false, barrier)) {
+    statistics.mergedCount++;
+    return;
+  }
+  if (state.pendingBarrier >= 0) {
+    merge(pendingBufferBarriers[state.pendingBarrier].barrier, barrier);
+    statistics.mergedCount++;
+    return;
+  }
+  state.pendingBarrier = static_cast<int32_t>(pendingBufferBarriers.size());
+  pendingBufferBarriers.push_back(PendingBufferBarrier{
+      .barrier = barrier,
+      .buffer = buffer,
+      .state = &state,
+  });
+}
+
+void VulkanResourceTracker::setImageUsage(
+    vk::Image image,
+    const RHIImageSubresourceRange& range,
+    RHIResourceUsage usage) {
+  auto entry = images.find(static_cast<VkImage>(image));
+  if (entry == images.end()) {
+    LOG_ERROR("VulkanResourceTracker::setImageUsage unknown image.");
+    return;
+  }
+  auto& imageState = entry->second;
+  const auto levelCount = resolveCount(range.levelCount, range.baseMipLevel,
+                                       imageState.mipLevels);
+  const auto layerCount = resolveCount(
+      range.layerCount, range.baseArrayLayer, imageState.arrayLayers);
+  const auto info = getUsageInfo(usage);
+  for (auto layer = range.baseArrayLayer;
+       layer < range.baseArrayLayer + layerCount; layer++) {
+    for (auto mip = range.baseMipLevel; mip < range.baseMipLevel + levelCount;
+         mip++) {
+      auto& state =
+          imageState.subresources[layer * imageState.mipLevels + mip];
+      state.layout = info.layout;
+      state.writeStages = info.stages;
+      state.writeAccess = info.writeAccess;
+      state.readStages = {};
+      state.visibleStages = {};
+      state.visibleAccess = {};
+    }
+  }
+}
+
+void VulkanResourceTracker::flush(vk::CommandBuffer commandBuffer) {
+  if (!hasPendingBarriers()) {
+    return;
+  }
+  if (synchronization2) {
+    flushSynchronization2(commandBuffer);
+  } else {
+    flushLegacy(commandBuffer);
+  }
+  statistics.batchCount++;
+  clearPending();
+}
+
+void VulkanResourceTracker::flushSynchronization2(
+    vk::CommandBuffer commandBuffer) {
+  std::vector<vk::ImageMemoryBarrier2> imageBarriers;
+  imageBarriers.reserve(pendingImageBarriers.size());
+  const PendingImageBarrier* last = nullptr;
+  for (const auto& pending : pendingImageBarriers) {
+    const auto& barrier = pending.barrier;
+    // Barriers of the next mip level of the same layer with the same masks
+    // and layouts extend the previous one.
+    if (last && last->image == pending.image &&
+        last->aspect == pending.aspect &&
+        last->arrayLayer == pending.arrayLayer &&
+        last->barrier.srcStages == barrier.srcStages &&
+        last->barrier.srcAccess == barrier.srcAccess &&
+        last->barrier.dstStages == barrier.dstStages &&
+        last->barrier.dstAccess == barrier.dstAccess &&
+        last->barrier.oldLayout == barrier.oldLayout &&
+        last->barrier.newLayout == barrier.newLayout) {
+      auto& range = imageBarriers.back().subresourceRange;
+      if (range.baseMipLevel + range.levelCount == pending.mipLevel) {
+        range.levelCount++;
+        last = &pending;
+        statistics.mergedCount++;
+        continue;
+      }
+    }
+    imageBarriers.push_back(
+        vk::ImageMemoryBarrier2()
+            .setSrcStageMask(barrier.srcStages)
+            .setSrcAccessMask(barrier.srcAccess)
+            .setDstStageMask(barrier.dstStages)
+            .setDstAccessMask(barrier.dstAccess)
+            .setOldLayout(barrier.oldLayout)
+            .setNewLayout(barrier.newLayout)
+            .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+            .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+            .setImage(pending.image)
+            .setSubresourceRange(vk::ImageSubresourceRange(
+                pending.aspect, pending.mipLevel, 1, pending.arrayLayer, 1)));
+    last = &pending;
+  }
+
+  std::vector<vk::BufferMemoryBarrier2> bufferBarriers;
+  bufferBarriers.reserve(pendingBufferBarriers.size());
+  for (const auto& pending : pendingBufferBarriers) {
+    const auto& barrier = pending.barrier;
+    bufferBarriers.push_back(
+        vk::BufferMemoryBarrier2()
+            .setSrcStageMask(barrier.srcStages)
+            .setSrcAccessMask(barrier.srcAccess)
+            .setDstStageMask(barrier.dstStages)
+            .setDstAccessMask(barrier.dstAccess)
+            .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+            .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+            .setBuffer(pending.buffer)
+            .setOffset(0)
+            .setSize(VK_WHOLE_SIZE));
+  }
+
+  commandBuffer.pipelineBarrier2(vk::DependencyInfo()
+                                     .setImageMemoryBarriers(imageBarriers)
+                                     .setBufferMemoryBarriers(bufferBarriers));
+  statistics.barrierCount +=
+      static_cast<uint32_t>(imageBarriers.size() + bufferBarriers.size());
+}
+
+void VulkanResourceTracker::flushLegacy(vk::CommandBuffer commandBuffer) {
+  // Without synchronization2 stages are per command, so the batch waits
+  // for the union of its sources. All tracked stages and accesses are
+  // legacy bits, which have the same values in the 64-bit flags.
+  auto toStages = [](vk::PipelineStageFlags2 stages) {
+    return vk::PipelineStageFlags(static_cast<VkPipelineStageFlags>(
+        static_cast<VkPipelineStageFlags2>(stages)));
+  };
+  auto toAccess = [](vk::AccessFlags2 access) {
+    return vk::AccessFlags(
+        static_cast<VkAccessFlags>(static_cast<VkAccessFlags2>(access)));
+  };
+
+  auto srcStages = vk::PipelineStageFlags2{};
+  auto dstStages = vk::PipelineStageFlags2{};
+  std::vector<vk::ImageMemoryBarrier> imageBarriers;
+  imageBarriers.reserve(pendingImageBarriers.size());
+  for (const auto& pending : pendingImageBarriers) {
+    const auto& barrier = pending.barrier;
+    srcStages |= barrier.srcStages;
+    dstStages |= barrier.dstStages;
+    imageBarriers.push_back(
+        vk::ImageMemoryBarrier()
+            .setSrcAccessMask(toAccess(barrier.srcAccess))
+            .setDstAccessMask(toAccess(barrier.dstAccess))
+            .setOldLayout(barrier.oldLayout)
+            .setNewLayout(barrier.newLayout)
+            .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+            .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+            .setImage(pending.image)
+            .setSubresourceRange(vk::ImageSubresourceRange(
+                pending.aspect, pending.mipLevel, 1, pending.arrayLayer, 1)));
+  }
+  std::vector<vk::BufferMemoryBarrier> bufferBarriers;
+  bufferBarriers.reserve(pendingBufferBarriers.size());
+  for (const auto& pending : pendingBufferBarriers) {
+    const auto& barrier = pending.barrier;
+    srcStages |= barrier.srcStages;
+    dstStages |= barrier.dstStages;
+    bufferBarriers.push_back(
+        vk::BufferMemoryBarrier()
+            .setSrcAccessMask(toAccess(barrier.srcAccess))
+            .setDstAccessMask(toAccess(barrier.dstAccess))
+            .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+            .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+            .setBuffer(pending.buffer)
+            .setOffset(0)
+            .setSize(VK_WHOLE_SIZE));
+  }
+
+  commandBuffer.pipelineBarrier(
+      srcStages ? toStages(srcStages) : vk::PipelineStageFlagBits::eTopOfPipe,
+      dstStages ? toStages(dstStages)
+                : vk::PipelineStageFlagBits::eBottomOfPipe,
+      {}, nullptr, bufferBarriers, imageBarriers);
+  statistics.barrierCount +=
+      static_cast<uint32_t>(imageBarriers.size() + bufferBarriers.size());
+}
+
+void VulkanResourceTracker::clearPending() {
+  for (auto& pending : pendingImageBarriers) {
+    pending.state->pendingBarrier = -1;
+  }
+  for (auto& pending : pendingBufferBarriers) {
+    pending.state->pendingBarrier = -1;
+  }
+  pendingImageBarriers.clear();
+  pendingBufferBarriers.clear();
+}
+
+RHIBarrierStatistics VulkanResourceTracker::takeStatistics() {
+  return std::exchange(statistics, RHIBarrierStatistics{});
+}
+
+}  // namespace Sparrow
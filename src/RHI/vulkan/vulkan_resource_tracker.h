@@ -0,0 +1,115 @@
+#ifndef SPARROWENGINE_VULKAN_RESOURCE_TRACKER_H
+#define SPARROWENGINE_VULKAN_RESOURCE_TRACKER_H
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "RHI/rhi_struct.h"
+
+namespace Sparrow {
+
+// Tracks the layout and the last accesses of every image subresource and
+// every buffer, and turns usage declarations into the barriers they need.
+// Barriers are collected until flush, which records them in one command.
+// A pending barrier a later declaration touches again is widened instead
+// of adding a second one, adjacent mip levels with equal barriers share
+// one.
+//
+// State is global rather than per command buffer, so command buffers must
+// be submitted in the order they were recorded in.
+class VulkanResourceTracker {
+ public:
+  void setSynchronization2(bool enabled) { synchronization2 = enabled; }
+
+  void registerImage(vk::Image image, uint32_t mipLevels, uint32_t arrayLayers);
+  void forgetImage(vk::Image image);
+  void forgetBuffer(vk::Buffer buffer);
+
+  void transitionImage(vk::Image image,
+                       const RHIImageSubresourceRange& range,
+                       RHIResourceUsage usage,
+                       bool discard);
+  void transitionBuffer(vk::Buffer buffer, RHIResourceUsage usage);
+  // Records the state without a barrier, for transitions done elsewhere.
+  void setImageUsage(vk::Image image,
+                     const RHIImageSubresourceRange& range,
+                     RHIResourceUsage usage);
+
+  bool hasPendingBarriers() const {
+    return !pendingImageBarriers.empty() || !pendingBufferBarriers.empty();
+  }
+  void flush(vk::CommandBuffer commandBuffer);
+
+  // Statistics since the last call.
+  RHIBarrierStatistics takeStatistics();
+
+ private:
+  struct AccessState {
+    vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+    // Stages and accesses a later write or layout change must wait for.
+    vk::PipelineStageFlags2 writeStages = {};
+    vk::AccessFlags2 writeAccess = {};
+    vk::PipelineStageFlags2 readStages = {};
+    // Stages and accesses the last write is already visible to.
+    vk::PipelineStageFlags2 visibleStages = {};
+    vk::AccessFlags2 visibleAccess = {};
+    // Index into the pending barriers, -1 when there is none.
+    int32_t pendingBarrier = -1;
+  };
+
+  struct ImageState {
+    uint32_t mipLevels = 1;
+    uint32_t arrayLayers = 1;
+    // Layer major, mip levels of a layer are adjacent.
+    std::vector<AccessState> subresources;
+  };
+
+  struct PendingBarrier {
+    vk::PipelineStageFlags2 srcStages = {};
+    vk::AccessFlags2 srcAccess = {};
+    vk::PipelineStageFlags2 dstStages = {};
+    vk::AccessFlags2 dstAccess = {};
+    vk::ImageLayout oldLayout = vk::ImageLayout::eUndefined;
+    vk::ImageLayout newLayout = vk::ImageLayout::eUndefined;
+  };
+
+  struct PendingImageBarrier {
+    PendingBarrier barrier;
+    vk::Image image;
+    vk::ImageAspectFlags aspect;
+    uint32_t mipLevel = 0;
+    uint32_t arrayLayer = 0;
+    AccessState* state = nullptr;
+  };
+
+  struct PendingBufferBarrier {
+    PendingBarrier barrier;
+    vk::Buffer buffer;
+    AccessState* state = nullptr;
+  };
+
+  // Updates the state for the usage. Returns the barrier it needs, or
+  // false if the state already covers it.
+  bool access(AccessState& state,
+              RHIResourceUsage usage,
+              bool discard,
+              bool hasLayout,
+              PendingBarrier& barrier);
+  static void merge(PendingBarrier& pending, const PendingBarrier& barrier);
+  void flushSynchronization2(vk::CommandBuffer commandBuffer);
+  void flushLegacy(vk::CommandBuffer commandBuffer);
+  void clearPending();
+
+  bool synchronization2 = false;
+  std::unordered_map<VkImage, ImageState> images;
+  std::unordered_map<VkBuffer, AccessState> buffers;
+  std::vector<PendingImageBarrier> pendingImageBarriers;
+  std::vector<PendingBufferBarrier> pendingBufferBarriers;
+  RHIBarrierStatistics statistics;
+};
+
+}  // namespace Sparrow
+
+#endif  // SPARROWENGINE_VULKAN_RESOURCE_TRACKER_H
@@ -8,6 +8,8 @@
 #include <limits>
 #include <ranges>
 #include <set>
+#include <string_view>
+#include <utility>
 #include <vector>
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
@@ -33,6 +35,10 @@ static constexpr bool enableValidationLayers = true;
 
 void VulkanRHI::initialize(const RHIInitInfo& initInfo) {
   init(initInfo.windowSystem.get());
+  requestedPresentMode = Cast<vk::PresentModeKHR>(initInfo.presentMode);
+  requestedSwapChainImageCount = initInfo.swapChainImageCount;
+  maxFramesInFlight = std::max(initInfo.maxFramesInFlight, 1U);
+  lowLatency = initInfo.lowLatency;
   createInstance();
   setupDebugMessenger();
   createSurface();
@@ -133,9 +139,120 @@ void VulkanRHI::createLogicalDevice() {
   }
   auto feature = vk::PhysicalDeviceFeatures()
                      .setGeometryShader(VK_TRUE)
-                     .setSamplerAnisotropy(VK_TRUE);
+                     .setSamplerAnisotropy(VK_TRUE)
+                     .setMultiDrawIndirect(VK_TRUE)
+                     .setDrawIndirectFirstInstance(VK_TRUE);
+  // Dynamic rendering and synchronization2 are core in Vulkan 1.3, older
+  // devices keep using render pass objects and legacy barriers.
+  const auto supportedFeatures =
+      gpu.getFeatures2<vk::PhysicalDeviceFeatures2,
+                       vk::PhysicalDeviceVulkan12Features,
+                       vk::PhysicalDeviceVulkan13Features>();
+  const auto& supported12Features =
+      supportedFeatures.get<vk::PhysicalDeviceVulkan12Features>();
+  const auto& supported13Features =
+      supportedFeatures.get<vk::PhysicalDeviceVulkan13Features>();
+  const auto apiVersion = gpu.getProperties().apiVersion;
+  const auto isVulkan13 = apiVersion >= VK_API_VERSION_1_3;
+  // Frames and deferred releases are tracked on a timeline semaphore.
+  if (apiVersion < VK_API_VERSION_1_2 ||
+      !supported12Features.timelineSemaphore) {
+    throw std::runtime_error("Timeline semaphores are unsupported.");
+  }
+  // Without draw counts read from a buffer the renderer culls on the CPU.
+  drawIndirectCountSupported = apiVersion >= VK_API_VERSION_1_2 &&
+                               supported12Features.drawIndirectCount;
+  dynamicRenderingSupported =
+      isVulkan13 && supported13Features.dynamicRendering;
+  synchronization2Supported =
+      isVulkan13 && supported13Features.synchronization2;
+  resourceTracker.setSynchronization2(synchronization2Supported);
+  auto vulkan13Features =
+      vk::PhysicalDeviceVulkan13Features()
+          .setDynamicRendering(dynamicRenderingSupported)
+          .setSynchronization2(synchronization2Supported);
+  auto vulkan12Features =
+      vk::PhysicalDeviceVulkan12Features()
+          .setDrawIndirectCount(drawIndirectCountSupported)
+          .setTimelineSemaphore(VK_TRUE);
+  if (dynamicRenderingSupported || synchronization2Supported) {
+    vulkan12Features.setPNext(&vulkan13Features);
+  }
   deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 
+  // Graphics pipeline libraries let pipelines be linked from parts compiled
+  // ahead of time, devices without them create every pipeline whole.
+  const auto availableExtensions = gpu.enumerateDeviceExtensionProperties();
+  auto hasExtension = [&availableExtensions](std::string_view name) {
+    return std::ranges::any_of(availableExtensions, [name](const auto& ext) {
+      return name == ext.extensionName.data();
+    });
+  };
+  if (hasExtension(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME) &&
+      hasExtension(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME)) {
+    const auto libraryFeatures = gpu.getFeatures2<
+        vk::PhysicalDeviceFeatures2,
+        vk::PhysicalDeviceGraphicsPipelineLibraryFeaturesEXT>();
+    graphicsPipelineLibrarySupported =
+        libraryFeatures
+            .get<vk::PhysicalDeviceGraphicsPipelineLibraryFeaturesEXT>()
+            .graphicsPipelineLibrary;
+  }
+
+  // Extended dynamic state 1 and 2 are core in Vulkan 1.3, the blend state
+  // of 3 is an extension.
+  extendedDynamicStateSupport.extendedDynamicState = isVulkan13;
+  extendedDynamicStateSupport.extendedDynamicState2 = isVulkan13;
+  if (hasExtension(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME)) {
+    const auto dynamicStateFeatures = gpu.getFeatures2<
+        vk::PhysicalDeviceFeatures2,
+        vk::PhysicalDeviceExtendedDynamicState3FeaturesEXT>();
+    const auto& dynamicState3Features =
+        dynamicStateFeatures
+            .get<vk::PhysicalDeviceExtendedDynamicState3FeaturesEXT>();
+    extendedDynamicStateSupport.colorBlend =
+        dynamicState3Features.extendedDynamicState3ColorBlendEnable;
+  }
+
+  // Shader objects are drawn with inside dynamic rendering only.
+  if (dynamicRenderingSupported &&
+      hasExtension(VK_EXT_SHADER_OBJECT_EXTENSION_NAME)) {
+    const auto supportedShaderObjectFeatures =
+        gpu.getFeatures2<vk::PhysicalDeviceFeatures2,
+                         vk::PhysicalDeviceShaderObjectFeaturesEXT>();
+    shaderObjectSupported =
+        supportedShaderObjectFeatures
+            .get<vk::PhysicalDeviceShaderObjectFeaturesEXT>()
+            .shaderObject;
+  }
+
+  // Optional features are chained in front of the core ones.
+  void* deviceFeatures = &vulkan12Features;
+  auto graphicsPipelineLibraryFeatures =
+      vk::PhysicalDeviceGraphicsPipelineLibraryFeaturesEXT()
+          .setGraphicsPipelineLibrary(VK_TRUE);
+  if (graphicsPipelineLibrarySupported) {
+    graphicsPipelineLibraryFeatures.setPNext(deviceFeatures);
+    deviceFeatures = &graphicsPipelineLibraryFeatures;
+    deviceExtensions.push_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+    deviceExtensions.push_back(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+  }
+  auto dynamicState3Features =
+      vk::PhysicalDeviceExtendedDynamicState3FeaturesEXT()
+          .setExtendedDynamicState3ColorBlendEnable(VK_TRUE);
+  if (extendedDynamicStateSupport.colorBlend) {
+    dynamicState3Features.setPNext(deviceFeatures);
+    deviceFeatures = &dynamicState3Features;
+    deviceExtensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME);
+  }
+  auto shaderObjectFeatures =
+      vk::PhysicalDeviceShaderObjectFeaturesEXT().setShaderObject(VK_TRUE);
+  if (shaderObjectSupported) {
+    shaderObjectFeatures.setPNext(deviceFeatures);
+    deviceFeatures = &shaderObjectFeatures;
+    deviceExtensions.push_back(VK_EXT_SHADER_OBJECT_EXTENSION_NAME);
+  }
+
   std::vector<vk::DeviceQueueCreateInfo> queueCreateInfos;
   std::set<uint32_t> uniqueQueueFamilies = {
       queueFamilyIndices.graphicsFamily.value(),
@@ -150,11 +267,15 @@ void VulkanRHI::createLogicalDevice() {
   }
 
   auto deviceInfo = vk::DeviceCreateInfo()
+                        .setPNext(deviceFeatures)
                         .setQueueCreateInfos(queueCreateInfos)
                         .setPEnabledExtensionNames(deviceExtensions)
                         .setPEnabledFeatures(&feature);
 
   device = gpu.createDevice(deviceInfo);
+  // Extension commands are not exported by the loader.
+  deviceDispatch = vk::DispatchLoaderDynamic(instance, vkGetInstanceProcAddr,
+                                             device, vkGetDeviceProcAddr);
   presentQueue = device.getQueue(queueFamilyIndices.presentFamily.value(), 0);
   depthImageFormat = findDepthFormat();
 }
@@ -171,38 +292,55 @@ void VulkanRHI::createCommandBuffers() {
   auto allocInfo = vk::CommandBufferAllocateInfo()
                        .setCommandPool(commandPool)
                        .setLevel(vk::CommandBufferLevel::ePrimary)
-                       .setCommandBufferCount(MAX_FRAMES_IN_FLIGHT);
+                       .setCommandBufferCount(maxFramesInFlight);
   commandBuffers = device.allocateCommandBuffers(allocInfo);
 }
 
 void VulkanRHI::createDescriptorPool() {
-  std::array<vk::DescriptorPoolSize, 2> poolSizes;
+  // Room for the forward pass and the compute passes, each of which
+  // allocates one set per frame in flight, plus one set per level of the
+  // depth pyramid and frame in flight.
+  const uint32_t maxSets = maxFramesInFlight * 24;
+  const uint32_t descriptorCount = maxFramesInFlight * 32;
+  std::array<vk::DescriptorPoolSize, 5> poolSizes;
 
   poolSizes[0] = vk::DescriptorPoolSize()
                      .setType(vk::DescriptorType::eUniformBuffer)
-                     .setDescriptorCount(MAX_FRAMES_IN_FLIGHT);
+                     .setDescriptorCount(descriptorCount);
   poolSizes[1] = vk::DescriptorPoolSize()
                      .setType(vk::DescriptorType::eCombinedImageSampler)
-                     .setDescriptorCount(MAX_FRAMES_IN_FLIGHT);
+                     .setDescriptorCount(descriptorCount);
+  poolSizes[2] = vk::DescriptorPoolSize()
+                     .setType(vk::DescriptorType::eStorageBuffer)
+                     .setDescriptorCount(descriptorCount);
+  poolSizes[3] = vk::DescriptorPoolSize()
+                     .setType(vk::DescriptorType::eStorageImage)
+                     .setDescriptorCount(descriptorCount);
+  poolSizes[4] = vk::DescriptorPoolSize()
+                     .setType(vk::DescriptorType::eUniformBufferDynamic)
+                     .setDescriptorCount(descriptorCount);
 
   const auto poolCreateInfo = vk::DescriptorPoolCreateInfo()
                                   .setPoolSizeCount(poolSizes.size())
                                   .setPPoolSizes(poolSizes.data())
-                                  .setMaxSets(MAX_FRAMES_IN_FLIGHT);
+                                  .setMaxSets(maxSets);
   descriptorPool = device.createDescriptorPool(poolCreateInfo);
 }
 
 void VulkanRHI::createSyncPrimitives() {
+  // The swapchain only takes binary semaphores, frame pacing and
+  // everything else waits on the graphics queue timeline.
   auto semaphoreInfo = vk::SemaphoreCreateInfo();
-  auto fenceInfo =
-      vk::FenceCreateInfo().setFlags(vk::FenceCreateFlagBits::eSignaled);
-  for (auto i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+  imageAvailableForRenderSemaphores.resize(maxFramesInFlight);
+  imageFinishedForPresentationSemaphores.resize(maxFramesInFlight);
+  frameTimelineValues.assign(maxFramesInFlight, 0);
+  for (auto i = 0U; i < maxFramesInFlight; i++) {
     imageAvailableForRenderSemaphores[i] =
         device.createSemaphore(semaphoreInfo);
     imageFinishedForPresentationSemaphores[i] =
         device.createSemaphore(semaphoreInfo);
-    isFrameInFlightFences[i] = device.createFence(fenceInfo);
   }
+  graphicsTimeline.initialize(device);
 }
 
 void VulkanRHI::createSwapChain() {
@@ -213,7 +351,10 @@ void VulkanRHI::createSwapChain() {
   swapChainImageFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
   swapChainExtent = chooseSwapExtent(capabilities);
 
-  uint32_t imageCount = capabilities.minImageCount + 1;
+  uint32_t imageCount = requestedSwapChainImageCount > 0
+                            ? std::max(requestedSwapChainImageCount,
+                                       capabilities.minImageCount)
+                            : capabilities.minImageCount + 1;
   if (capabilities.maxImageCount > 0 &&
       imageCount > capabilities.maxImageCount) {
     imageCount = capabilities.maxImageCount;
@@ -246,7 +387,9 @@ void VulkanRHI::createSwapChain() {
           .setPreTransform(swapChainSupport.capabilities.currentTransform)
           .setCompositeAlpha(vk::CompositeAlphaFlagBitsKHR::eOpaque)
           .setPresentMode(presentMode)
-          .setClipped(true);
+          .setClipped(true)
+          // Retired by the new one, null on first creation.
+          .setOldSwapchain(swapChain);
   swapChain = device.createSwapchainKHR(swapChainInfo);
 }
 
@@ -258,21 +401,31 @@ void VulkanRHI::recreateSwapChain() {
     glfwWaitEvents();
   }
   width = _width, height = _height;
-
-  device.waitIdle();
-
-  if (device.waitForFences(1, &isFrameInFlightFences[currentFrameIndex],
-                           VK_TRUE, UINT64_MAX) != vk::Result::eSuccess) {
-    LOG_ERROR("WaitForFences failed.")
-    return;
+  swapChainSettingsChanged = false;
+
+  // Frames in flight may still render to and present the old images, so
+  // instead of idling the device they are destroyed once the next frame
+  // finished. Listeners drop what they built on the old views right away.
+  notifyImageViewDestroy(reinterpret_cast<RHIImageView*>(&depthImageView));
+  resourceTracker.forgetImage(depthImage);
+  for (auto& imageView : swapChainImagesViews) {
+    notifyImageViewDestroy(reinterpret_cast<RHIImageView*>(&imageView));
   }
-
-  device.destroyImageView(depthImageView);
-  device.destroyImage(depthImage);
-  for (auto imageView : swapChainImagesViews) {
-    device.destroyImageView(imageView);
+  for (auto image : swapChainImages) {
+    resourceTracker.forgetImage(image);
   }
-  device.destroySwapchainKHR(swapChain);
+  deferRelease([device = device, oldSwapChain = swapChain,
+                oldImageViews = swapChainImagesViews,
+                oldDepthImageView = depthImageView, oldDepthImage = depthImage,
+                oldDepthMemory = depthDeviceMemory] {
+    device.destroyImageView(oldDepthImageView);
+    device.destroyImage(oldDepthImage);
+    device.freeMemory(oldDepthMemory);
+    for (auto imageView : oldImageViews) {
+      device.destroyImageView(imageView);
+    }
+    device.destroySwapchainKHR(oldSwapChain);
+  });
 
   createSwapChain();
   createSwapChainImageView();
@@ -285,6 +438,7 @@ void VulkanRHI::createSwapChainImageView() {
 
   swapChainImagesViews.resize(frameCount);
   for (uint32_t i = 0; i < frameCount; i++) {
+    resourceTracker.registerImage(swapChainImages[i], 1, 1);
     auto createImageViewInfo =
         vk::ImageViewCreateInfo()
             .setImage(swapChainImages[i])
@@ -332,9 +486,11 @@ void VulkanRHI::createFramebufferImageAndView() {
                            vk::ImageTiling::eOptimal,
                            vk::ImageUsageFlagBits::eInputAttachment |
                                vk::ImageUsageFlagBits::eDepthStencilAttachment |
-                               vk::ImageUsageFlagBits::eTransferSrc,
+                               vk::ImageUsageFlagBits::eTransferSrc |
+                               vk::ImageUsageFlagBits::eSampled,
                            vk::MemoryPropertyFlagBits::eDeviceLocal,
                            std::nullopt, 1, 1, depthImage, depthDeviceMemory);
+  resourceTracker.registerImage(depthImage, 1, 1);
   depthImageView = VulkanUtils::createImageView(
       device, depthImage, depthImageFormat, vk::ImageAspectFlagBits::eDepth,
       vk::ImageViewType::e2D, 1, 1);
@@ -358,8 +514,63 @@ std::unique_ptr<RHIShader> VulkanRHI::createShaderModule(
   return vulkanShader;
 }
 
+std::unique_ptr<RHIShaderObject> VulkanRHI::createShaderObject(
+    const RHIShaderObjectCreateInfo& createInfo) {
+  if (!shaderObjectSupported) {
+    LOG_ERROR("CreateShaderObject unsupported.")
+    return nullptr;
+  }
+  std::vector<vk::DescriptorSetLayout> setLayouts(createInfo.setLayoutCount);
+  for (auto i = 0U; i < createInfo.setLayoutCount; i++) {
+    setLayouts[i] =
+        GetResource<VulkanDescriptorSetLayout>(createInfo.setLayouts[i]);
+  }
+  auto shaderCreateInfo =
+      vk::ShaderCreateInfoEXT()
+          .setStage(Cast<vk::ShaderStageFlagBits>(createInfo.stage))
+          .setNextStage(Cast<vk::ShaderStageFlags>(createInfo.nextStage))
+          .setCodeType(vk::ShaderCodeTypeEXT::eSpirv)
+          .setCodeSize(createInfo.code.size())
+          .setPCode(createInfo.code.data())
+          .setPName(createInfo.name)
+          .setSetLayoutCount(createInfo.setLayoutCount)
+          .setPSetLayouts(setLayouts.data())
+          .setPushConstantRangeCount(createInfo.pushConstantRangeCount)
+          .setPPushConstantRanges(
+              Cast<vk::PushConstantRange>(createInfo.pushConstantRanges))
+          .setPSpecializationInfo(
+              Cast<vk::SpecializationInfo>(createInfo.specializationInfo));
+
+  vk::ShaderEXT vkShader;
+  if (device.createShadersEXT(1, &shaderCreateInfo, nullptr, &vkShader,
+                              deviceDispatch) != vk::Result::eSuccess) {
+    LOG_ERROR("CreateShaderObject failed.")
+    return nullptr;
+  }
+  auto shaderObject = std::make_unique<VulkanShaderObject>();
+  shaderObject->setResource(vkShader);
+  return shaderObject;
+}
+
 std::unique_ptr<RHIPipeline> VulkanRHI::createGraphicsPipeline(
     const RHIGraphicsPipelineCreateInfo& createInfo) {
+  return createGraphicsPipeline(createInfo, std::nullopt);
+}
+
+std::unique_ptr<RHIPipeline> VulkanRHI::createGraphicsPipelineLibrary(
+    const RHIGraphicsPipelineCreateInfo& createInfo,
+    RHIGraphicsPipelineLibraryFlag parts) {
+  if (!graphicsPipelineLibrarySupported) {
+    LOG_ERROR("CreateGraphicsPipelineLibrary unsupported.")
+    return nullptr;
+  }
+  return createGraphicsPipeline(
+      createInfo, Cast<vk::GraphicsPipelineLibraryFlagsEXT>(parts));
+}
+
+std::unique_ptr<RHIPipeline> VulkanRHI::createGraphicsPipeline(
+    const RHIGraphicsPipelineCreateInfo& createInfo,
+    std::optional<vk::GraphicsPipelineLibraryFlagsEXT> libraryParts) {
   const auto shaderStageCount = createInfo.stageCount;
   const auto& rhiShaderStages = createInfo.shaderStageCreateInfo;
   const auto& rhiDynamicState = createInfo.dynamicStateCreateInfo;
@@ -371,19 +582,35 @@ std::unique_ptr<RHIPipeline> VulkanRHI::createGraphicsPipeline(
   const auto& rhiDepthStencilState = createInfo.depthStencilStateCreateInfo;
   const auto& rhiColorBlendState = createInfo.colorBlendStateCreateInfo;
 
-  std::vector<vk::PipelineShaderStageCreateInfo> shaderStageCreateInfos(
-      shaderStageCount);
+  // A library only takes the shaders of the parts it is built for.
+  auto includesStage = [&libraryParts](vk::ShaderStageFlagBits stage) {
+    if (!libraryParts) {
+      return true;
+    }
+    return stage == vk::ShaderStageFlagBits::eFragment
+               ? static_cast<bool>(
+                     *libraryParts &
+                     vk::GraphicsPipelineLibraryFlagBitsEXT::eFragmentShader)
+               : static_cast<bool>(*libraryParts &
+                                   vk::GraphicsPipelineLibraryFlagBitsEXT::
+                                       ePreRasterizationShaders);
+  };
+  std::vector<vk::PipelineShaderStageCreateInfo> shaderStageCreateInfos;
 
   for (auto i = 0; i < shaderStageCount; i++) {
     const auto& rhiShaderStage = rhiShaderStages[i];
-    auto& shaderStageCreateInfo = shaderStageCreateInfos[i];
+    const auto stage = Cast<vk::ShaderStageFlagBits>(rhiShaderStage.stage);
+    if (!includesStage(stage)) {
+      continue;
+    }
 
-    shaderStageCreateInfo
-        .setStage(Cast<vk::ShaderStageFlagBits>(rhiShaderStage.stage))
-        .setPName(rhiShaderStage.name)
-        .setModule(GetResource<VulkanShader>(rhiShaderStage.module))
-        .setPSpecializationInfo(
-            Cast<vk::SpecializationInfo>(rhiShaderStage.specializationInfo));
+    shaderStageCreateInfos.push_back(
+        vk::PipelineShaderStageCreateInfo()
+            .setStage(stage)
+            .setPName(rhiShaderStage.name)
+            .setModule(GetResource<VulkanShader>(rhiShaderStage.module))
+            .setPSpecializationInfo(Cast<vk::SpecializationInfo>(
+                rhiShaderStage.specializationInfo)));
   }
 
   auto dynamicStateCreateInfo =
@@ -469,10 +696,24 @@ std::unique_ptr<RHIPipeline> VulkanRHI::createGraphicsPipeline(
               rhiColorBlendState->attachments))
           .setBlendConstants(rhiColorBlendState->blendConstants);
 
+  // With dynamic rendering the attachment formats replace the render pass.
+  std::vector<vk::Format> colorAttachmentFormats;
+  auto renderingCreateInfo = vk::PipelineRenderingCreateInfo();
+  if (const auto* rhiRendering = createInfo.renderingCreateInfo) {
+    for (auto i = 0U; i < rhiRendering->colorAttachmentCount; i++) {
+      colorAttachmentFormats.push_back(
+          Cast<vk::Format>(rhiRendering->colorAttachmentFormats[i]));
+    }
+    renderingCreateInfo.setColorAttachmentFormats(colorAttachmentFormats)
+        .setDepthAttachmentFormat(
+            Cast<vk::Format>(rhiRendering->depthAttachmentFormat))
+        .setStencilAttachmentFormat(
+            Cast<vk::Format>(rhiRendering->stencilAttachmentFormat));
+  }
+
   auto graphicsPipelineCreateInfo =
       vk::GraphicsPipelineCreateInfo()
-          .setStageCount(shaderStageCount)
-          .setPStages(shaderStageCreateInfos.data())
+          .setStages(shaderStageCreateInfos)
           .setPVertexInputState(&vertexInputStateCreateInfo)
           .setPInputAssemblyState(&inputAssemblyStateCreateInfo)
           .setPViewportState(&viewportStateCreateInfo)
@@ -484,13 +725,38 @@ std::unique_ptr<RHIPipeline> VulkanRHI::createGraphicsPipeline(
           .setPDynamicState(&dynamicStateCreateInfo)
           .setLayout(
               GetResource<VulkanPipelineLayout>(createInfo.pipelineLayout))
-          .setRenderPass(GetResource<VulkanRenderPass>(createInfo.renderPass))
+          .setRenderPass(
+              createInfo.renderingCreateInfo
+                  ? nullptr
+                  : GetResource<VulkanRenderPass>(createInfo.renderPass))
           .setSubpass(createInfo.subpass)
           .setBasePipelineHandle(
               createInfo.basePipelineHandle
                   ? GetResource<VulkanPipeline>(createInfo.basePipelineHandle)
                   : nullptr)
           .setBasePipelineIndex(createInfo.basePipelineIndex);
+  if (createInfo.renderingCreateInfo) {
+    graphicsPipelineCreateInfo.setPNext(&renderingCreateInfo);
+  }
+  // Link time optimization information is retained so an optimized link
+  // of the library can still be requested later.
+  auto libraryCreateInfo = vk::GraphicsPipelineLibraryCreateInfoEXT();
+  if (libraryParts) {
+    libraryCreateInfo.setFlags(*libraryParts)
+        .setPNext(graphicsPipelineCreateInfo.pNext);
+    graphicsPipelineCreateInfo.setPNext(&libraryCreateInfo)
+        .setFlags(
+            vk::PipelineCreateFlagBits::eLibraryKHR |
+            vk::PipelineCreateFlagBits::eRetainLinkTimeOptimizationInfoEXT)
+        .setBasePipelineHandle(nullptr);
+    const auto hasShaders =
+        *libraryParts &
+        (vk::GraphicsPipelineLibraryFlagBitsEXT::ePreRasterizationShaders |
+         vk::GraphicsPipelineLibraryFlagBitsEXT::eFragmentShader);
+    if (!hasShaders) {
+      graphicsPipelineCreateInfo.setLayout(nullptr);
+    }
+  }
 
   vk::Pipeline vkGraphicsPipeline;
   if (auto pipelineCreateResult =
@@ -504,6 +770,68 @@ std::unique_ptr<RHIPipeline> VulkanRHI::createGraphicsPipeline(
   return pipeline;
 }
 
+std::unique_ptr<RHIPipeline> VulkanRHI::linkGraphicsPipelineLibraries(
+    std::span<RHIPipeline* const> libraries,
+    RHIPipelineLayout* pipelineLayout,
+    bool optimize) {
+  std::vector<vk::Pipeline> vkLibraries;
+  for (auto* library : libraries) {
+    vkLibraries.push_back(GetResource<VulkanPipeline>(library));
+  }
+  auto libraryCreateInfo =
+      vk::PipelineLibraryCreateInfoKHR().setLibraries(vkLibraries);
+  auto graphicsPipelineCreateInfo =
+      vk::GraphicsPipelineCreateInfo()
+          .setPNext(&libraryCreateInfo)
+          .setLayout(GetResource<VulkanPipelineLayout>(pipelineLayout));
+  if (optimize) {
+    graphicsPipelineCreateInfo.setFlags(
+        vk::PipelineCreateFlagBits::eLinkTimeOptimizationEXT);
+  }
+
+  vk::Pipeline vkGraphicsPipeline;
+  if (device.createGraphicsPipelines(graphicsPipelineCache, 1,
+                                     &graphicsPipelineCreateInfo, nullptr,
+                                     &vkGraphicsPipeline) !=
+      vk::Result::eSuccess) {
+    LOG_ERROR("LinkGraphicsPipelineLibraries failed.")
+    return nullptr;
+  }
+  auto pipeline = std::make_unique<VulkanPipeline>();
+  pipeline->setResource(vkGraphicsPipeline);
+  return pipeline;
+}
+
+std::unique_ptr<RHIPipeline> VulkanRHI::createComputePipeline(
+    const RHIComputePipelineCreateInfo& createInfo) {
+  const auto& rhiShaderStage = createInfo.stage;
+  auto shaderStageCreateInfo =
+      vk::PipelineShaderStageCreateInfo()
+          .setStage(Cast<vk::ShaderStageFlagBits>(rhiShaderStage.stage))
+          .setPName(rhiShaderStage.name)
+          .setModule(GetResource<VulkanShader>(rhiShaderStage.module))
+          .setPSpecializationInfo(
+              Cast<vk::SpecializationInfo>(rhiShaderStage.specializationInfo));
+
+  auto computePipelineCreateInfo =
+      vk::ComputePipelineCreateInfo()
+          .setStage(shaderStageCreateInfo)
+          .setLayout(
+              GetResource<VulkanPipelineLayout>(createInfo.pipelineLayout));
+
+  vk::Pipeline vkComputePipeline;
+  if (device.createComputePipelines(graphicsPipelineCache, 1,
+                                    &computePipelineCreateInfo, nullptr,
+                                    &vkComputePipeline) !=
+      vk::Result::eSuccess) {
+    LOG_ERROR("CreateComputePipelines failed.")
+    return nullptr;
+  }
+  auto pipeline = std::make_unique<VulkanPipeline>();
+  pipeline->setResource(vkComputePipeline);
+  return pipeline;
+}
+
 std::unique_ptr<RHIRenderPass> VulkanRHI::createRenderPass(
     const RHIRenderPassCreateInfo& createInfo) {
   auto renderPassCreateInfo =
@@ -512,7 +840,10 @@ std::unique_ptr<RHIRenderPass> VulkanRHI::createRenderPass(
           .setPAttachments(
               Cast<vk::AttachmentDescription>(createInfo.attachments))
           .setSubpassCount(createInfo.subpassCount)
-          .setPSubpasses(Cast<vk::SubpassDescription>(createInfo.subpasses));
+          .setPSubpasses(Cast<vk::SubpassDescription>(createInfo.subpasses))
+          .setDependencyCount(createInfo.dependencyCount)
+          .setPDependencies(
+              Cast<vk::SubpassDependency>(createInfo.dependencies));
 
   vk::RenderPass vkRenderPass;
   if (device.createRenderPass(&renderPassCreateInfo, nullptr, &vkRenderPass) !=
@@ -526,10 +857,15 @@ std::unique_ptr<RHIRenderPass> VulkanRHI::createRenderPass(
 
 std::unique_ptr<RHIPipelineLayout> VulkanRHI::createPipelineLayout(
     const RHIPipelineLayoutCreateInfo& createInfo) {
+  std::vector<vk::DescriptorSetLayout> setLayouts(createInfo.setLayoutCount);
+  for (auto i = 0U; i < createInfo.setLayoutCount; i++) {
+    setLayouts[i] =
+        GetResource<VulkanDescriptorSetLayout>(createInfo.setLayouts[i]);
+  }
   auto pipelineLayoutCreateInfo =
       vk::PipelineLayoutCreateInfo()
           .setSetLayoutCount(createInfo.setLayoutCount)
-          .setPSetLayouts(Cast<vk::DescriptorSetLayout>(createInfo.setLayouts))
+          .setPSetLayouts(setLayouts.data())
           .setPushConstantRangeCount(createInfo.pushConstantRangeCount)
           .setPPushConstantRanges(
               Cast<vk::PushConstantRange>(createInfo.pushConstantRanges));
@@ -571,6 +907,8 @@ VulkanRHI::createImage(const RHIImageCreateInfo& createInfo) {
       Cast<vk::MemoryPropertyFlags>(createInfo.memoryPropertyFlags),
       Cast<vk::ImageCreateFlags>(createInfo.imageCreateFlags),
       createInfo.arrayLayers, createInfo.mipLevels, vkImage, vkDeviceMemory);
+  resourceTracker.registerImage(vkImage, createInfo.mipLevels,
+                                createInfo.arrayLayers);
   auto image = std::make_unique<VulkanImage>();
   auto deviceMemory = std::make_unique<VulkanDeviceMemory>();
   image->setResource(vkImage);
@@ -602,16 +940,24 @@ VulkanRHI::createImageAndCopyData(const RHIImageCreateInfo& createInfo,
   auto [image, imageMemory] = createImage(createInfo);
   auto vkImage = GetResource<VulkanImage>(image.get());
 
-  VulkanUtils::transitionImageLayout(this, vkImage, vk::Format::eR8G8B8A8Srgb,
-                                     vk::ImageLayout::eUndefined,
-                                     vk::ImageLayout::eTransferDstOptimal);
-
-  VulkanUtils::copyBufferToImage(this, stagingBuffer, vkImage, createInfo.width,
-                                 createInfo.height);
-
-  VulkanUtils::transitionImageLayout(
-      this, GetResource<VulkanImage>(image.get()), vk::Format::eR8G8B8A8Srgb,
-      vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eReadOnlyOptimal);
+  // Upload and both transitions share one command buffer.
+  auto commandBuffer = beginOneTimeCommandBuffer();
+  auto vkCommandBuffer = GetResource<VulkanCommandBuffer>(commandBuffer.get());
+  const auto firstMip = RHIImageSubresourceRange{.levelCount = 1};
+  resourceTracker.transitionImage(vkImage, firstMip,
+                                  RHIResourceUsage::TransferDst, true);
+  resourceTracker.flush(vkCommandBuffer);
+  auto region = vk::BufferImageCopy()
+                    .setImageSubresource(vk::ImageSubresourceLayers(
+                        vk::ImageAspectFlagBits::eColor, 0, 0, 1))
+                    .setImageExtent(
+                        vk::Extent3D{createInfo.width, createInfo.height, 1});
+  vkCommandBuffer.copyBufferToImage(
+      stagingBuffer, vkImage, vk::ImageLayout::eTransferDstOptimal, region);
+  resourceTracker.transitionImage(vkImage, firstMip,
+                                  RHIResourceUsage::FragmentShaderSampled,
+                                  false);
+  endOneTimeCommandBuffer(commandBuffer.get());
 
   auto vkImageView = VulkanUtils::createImageView(
       device, vkImage, Cast<vk::Format>(createInfo.format),
@@ -627,6 +973,29 @@ VulkanRHI::createImageAndCopyData(const RHIImageCreateInfo& createInfo,
                          std::move(imageMemory));
 }
 
+std::unique_ptr<RHIImageView> VulkanRHI::createImageView(
+    const RHIImageViewCreateInfo& createInfo) {
+  const auto& range = createInfo.subresourceRange;
+  auto imageViewCreateInfo =
+      vk::ImageViewCreateInfo()
+          .setImage(GetResource<VulkanImage>(createInfo.image))
+          .setViewType(Cast<vk::ImageViewType>(createInfo.viewType))
+          .setFormat(Cast<vk::Format>(createInfo.format))
+          .setSubresourceRange(vk::ImageSubresourceRange(
+              Cast<vk::ImageAspectFlags>(range.aspectMask), range.baseMipLevel,
+              range.levelCount, range.baseArrayLayer, range.layerCount));
+
+  vk::ImageView vkImageView;
+  if (device.createImageView(&imageViewCreateInfo, nullptr, &vkImageView) !=
+      vk::Result::eSuccess) {
+    LOG_ERROR("CreateImageView failed.")
+    return nullptr;
+  }
+  auto imageView = std::make_unique<VulkanImageView>();
+  imageView->setResource(vkImageView);
+  return imageView;
+}
+
 std::unique_ptr<RHISampler> VulkanRHI::createSampler(
     const RHISamplerCreateInfo& createInfo) {
   auto properties = gpu.getProperties();
@@ -657,9 +1026,56 @@ std::unique_ptr<RHISampler> VulkanRHI::createSampler(
 }
 
 void VulkanRHI::destoryBuffer(RHIBuffer* buffer) {
+  resourceTracker.forgetBuffer(GetResource<VulkanBuffer>(buffer));
   device.destroyBuffer(GetResource<VulkanBuffer>(buffer));
 }
 
+void VulkanRHI::destoryImage(RHIImage* image) {
+  resourceTracker.forgetImage(GetResource<VulkanImage>(image));
+  device.destroyImage(GetResource<VulkanImage>(image));
+}
+
+void VulkanRHI::destoryImageView(RHIImageView* imageView) {
+  notifyImageViewDestroy(imageView);
+  device.destroyImageView(GetResource<VulkanImageView>(imageView));
+}
+
+void VulkanRHI::destoryFramebuffer(RHIFramebuffer* framebuffer) {
+  device.destroyFramebuffer(GetResource<VulkanFramebuffer>(framebuffer));
+}
+
+void VulkanRHI::destoryShaderModule(RHIShader* shader) {
+  device.destroyShaderModule(GetResource<VulkanShader>(shader));
+}
+
+void VulkanRHI::destoryPipeline(RHIPipeline* pipeline) {
+  device.destroyPipeline(GetResource<VulkanPipeline>(pipeline));
+}
+
+void VulkanRHI::destoryShaderObject(RHIShaderObject* shaderObject) {
+  device.destroyShaderEXT(GetResource<VulkanShaderObject>(shaderObject),
+                          nullptr, deviceDispatch);
+}
+
+uint32_t VulkanRHI::addImageViewDestroyListener(
+    std::function<void(RHIImageView*)> listener) {
+  const auto listenerId = nextImageViewDestroyListenerId++;
+  imageViewDestroyListeners.emplace_back(listenerId, std::move(listener));
+  return listenerId;
+}
+
+void VulkanRHI::removeImageViewDestroyListener(uint32_t listenerId) {
+  std::erase_if(imageViewDestroyListeners, [listenerId](const auto& entry) {
+    return entry.first == listenerId;
+  });
+}
+
+void VulkanRHI::notifyImageViewDestroy(RHIImageView* imageView) {
+  for (const auto& [listenerId, listener] : imageViewDestroyListeners) {
+    listener(imageView);
+  }
+}
+
 std::unique_ptr<RHIDescriptorSetLayout> VulkanRHI::createDescriptorSetLayout(
     RHIDescriptorSetLayoutCreateInfo& createInfo) {
   auto layoutInfo = vk::DescriptorSetLayoutCreateInfo()
@@ -737,7 +1153,9 @@ void VulkanRHI::updateDescriptorSets(
           vk::DescriptorImageInfo()
               .setImageLayout(Cast<vk::ImageLayout>(imageInfo->imageLayout))
               .setImageView(GetResource<VulkanImageView>(imageInfo->imageView))
-              .setSampler(GetResource<VulkanSampler>(imageInfo->sampler));
+              .setSampler(imageInfo->sampler
+                              ? GetResource<VulkanSampler>(imageInfo->sampler)
+                              : vk::Sampler());
     }
 
     const auto& descriptorSet = writeDescritorSets[i];
@@ -758,7 +1176,7 @@ void VulkanRHI::updateDescriptorSets(
 }
 
 uint8_t VulkanRHI::getMaxFramesInFlight() {
-  return MAX_FRAMES_IN_FLIGHT;
+  return static_cast<uint8_t>(maxFramesInFlight);
 }
 
 uint8_t VulkanRHI::getCurrentFrameIndex() {
@@ -780,6 +1198,7 @@ RHISwapChainInfo VulkanRHI::getSwapChainInfo() {
       .imageViews =
           reinterpret_cast<RHIImageView*>(swapChainImagesViews.data()),
       .imageViewsSize = swapChainImagesViews.size(),
+      .presentMode = Cast<RHIPresentMode>(presentMode),
   };
 }
 
@@ -787,6 +1206,10 @@ RHIImageView * VulkanRHI::getSwapChainImageView(size_t index) {
   return reinterpret_cast<RHIImageView*>(&swapChainImagesViews[index]);
 }
 
+RHIImage* VulkanRHI::getSwapChainImage(size_t index) {
+  return reinterpret_cast<RHIImage*>(&swapChainImages[index]);
+}
+
 RHIDepthImageInfo VulkanRHI::getDepthImageInfo() {
   return RHIDepthImageInfo {
     .format = Cast<RHIFormat>(depthImageFormat),
@@ -795,6 +1218,70 @@ RHIDepthImageInfo VulkanRHI::getDepthImageInfo() {
   };
 }
 
+bool VulkanRHI::supportsDrawIndirectCount() {
+  return drawIndirectCountSupported;
+}
+
+bool VulkanRHI::supportsDynamicRendering() {
+  return dynamicRenderingSupported;
+}
+
+bool VulkanRHI::supportsGraphicsPipelineLibrary() {
+  return graphicsPipelineLibrarySupported;
+}
+
+RHIExtendedDynamicStateSupport VulkanRHI::getExtendedDynamicStateSupport() {
+  return extendedDynamicStateSupport;
+}
+
+bool VulkanRHI::supportsShaderObject() {
+  return shaderObjectSupported;
+}
+
+RHIDeviceSize VulkanRHI::getMinUniformBufferOffsetAlignment() {
+  return gpu.getProperties().limits.minUniformBufferOffsetAlignment;
+}
+
+std::vector<RHIPresentMode> VulkanRHI::getSupportedPresentModes() {
+  std::vector<RHIPresentMode> presentModes;
+  for (auto mode : gpu.getSurfacePresentModesKHR(surface)) {
+    // Shared presentable image modes are not used.
+    if (mode == vk::PresentModeKHR::eImmediate ||
+        mode == vk::PresentModeKHR::eMailbox ||
+        mode == vk::PresentModeKHR::eFifo ||
+        mode == vk::PresentModeKHR::eFifoRelaxed) {
+      presentModes.push_back(Cast<RHIPresentMode>(mode));
+    }
+  }
+  return presentModes;
+}
+
+RHIFrameLatencyStatistics VulkanRHI::getFrameLatencyStatistics() {
+  return latencyStatistics;
+}
+
+void VulkanRHI::setPresentMode(RHIPresentMode mode) {
+  const auto vkMode = Cast<vk::PresentModeKHR>(mode);
+  if (vkMode == requestedPresentMode) {
+    return;
+  }
+  requestedPresentMode = vkMode;
+  swapChainSettingsChanged = true;
+}
+
+void VulkanRHI::setLowLatency(bool enabled) {
+  lowLatency = enabled;
+}
+
+void VulkanRHI::swapPipelines(RHIPipeline* first, RHIPipeline* second) {
+  std::swap(CastResource<VulkanPipeline>(first)->getResourceRef(),
+            CastResource<VulkanPipeline>(second)->getResourceRef());
+}
+
+RHIBarrierStatistics VulkanRHI::getBarrierStatistics() {
+  return lastBarrierStatistics;
+}
+
 RHICommandBuffer* VulkanRHI::getCurrentCommandBuffer() {
   return reinterpret_cast<VulkanCommandBuffer*>(
       &commandBuffers[currentFrameIndex]);
@@ -847,6 +1334,7 @@ std::unique_ptr<RHICommandBuffer> VulkanRHI::beginOneTimeCommandBuffer() {
 
 bool VulkanRHI::endCommandBuffer(RHICommandBuffer* commandBuffer) {
   auto vkCommandBuffer = GetResource<VulkanCommandBuffer>(commandBuffer);
+  resourceTracker.flush(vkCommandBuffer);
   try {
     vkCommandBuffer.end();
   } catch (std::runtime_error e) {
@@ -857,26 +1345,45 @@ bool VulkanRHI::endCommandBuffer(RHICommandBuffer* commandBuffer) {
 }
 
 bool VulkanRHI::endOneTimeCommandBuffer(RHICommandBuffer* commandBuffer) {
+  const auto value = submitOneTimeCommandBuffer(commandBuffer);
+  if (value == 0 || !graphicsTimeline.wait(value)) {
+    return false;
+  }
+  graphicsTimeline.collect();
+  return true;
+}
+
+uint64_t VulkanRHI::submitOneTimeCommandBuffer(
+    RHICommandBuffer* commandBuffer) {
   auto vkCommandBuffer = GetResource<VulkanCommandBuffer>(commandBuffer);
+  resourceTracker.flush(vkCommandBuffer);
   vkCommandBuffer.end();
 
-  auto submitInfo =
-      vk::SubmitInfo().setCommandBufferCount(1).setPCommandBuffers(
-          &vkCommandBuffer);
+  const auto signalValue = graphicsTimeline.getNextValue();
+  const auto timelineSemaphore = graphicsTimeline.getSemaphore();
+  auto timelineSubmitInfo =
+      vk::TimelineSemaphoreSubmitInfo().setSignalSemaphoreValues(signalValue);
+  auto submitInfo = vk::SubmitInfo()
+                        .setPNext(&timelineSubmitInfo)
+                        .setCommandBuffers(vkCommandBuffer)
+                        .setSignalSemaphores(timelineSemaphore);
   if (presentQueue.submit(1, &submitInfo, nullptr) != vk::Result::eSuccess) {
-    LOG_ERROR("VulkanRHI::endOneTimeCommandBuffer queueSubmit failed.\n")
-    return false;
+    LOG_ERROR("VulkanRHI::submitOneTimeCommandBuffer queueSubmit failed.")
+    device.free(commandPool, 1, &vkCommandBuffer);
+    return 0;
   }
-  presentQueue.waitIdle();
-  device.free(commandPool, 1, &vkCommandBuffer);
-
-  return true;
+  graphicsTimeline.markSubmitted(signalValue);
+  graphicsTimeline.enqueue(signalValue, [this, vkCommandBuffer]() {
+    device.free(commandPool, 1, &vkCommandBuffer);
+  });
+  return signalValue;
 }
 
 void VulkanRHI::cmdBeginRenderPass(RHICommandBuffer* commandBuffer,
                                    RHIRenderPassBeginInfo* beginInfo,
                                    RHISubpassContents contents) {
   auto vkCommandBuffer = GetResource<VulkanCommandBuffer>(commandBuffer);
+  resourceTracker.flush(vkCommandBuffer);
 
   auto renderPassBeginInfo = vk::RenderPassBeginInfo();
 
@@ -898,6 +1405,50 @@ void VulkanRHI::cmdEndRenderPass(RHICommandBuffer* commandBuffer) {
   vkCommandBuffer.endRenderPass();
 }
 
+void VulkanRHI::cmdBeginRendering(RHICommandBuffer* commandBuffer,
+                                  const RHIRenderingInfo* renderingInfo) {
+  auto vkCommandBuffer = GetResource<VulkanCommandBuffer>(commandBuffer);
+  resourceTracker.flush(vkCommandBuffer);
+  auto toVulkan = [](const RHIRenderingAttachmentInfo& attachment) {
+    return vk::RenderingAttachmentInfo()
+        .setImageView(GetResource<VulkanImageView>(attachment.imageView))
+        .setImageLayout(Cast<vk::ImageLayout>(attachment.imageLayout))
+        .setLoadOp(Cast<vk::AttachmentLoadOp>(attachment.loadOp))
+        .setStoreOp(Cast<vk::AttachmentStoreOp>(attachment.storeOp))
+        .setClearValue(*Cast<vk::ClearValue>(&attachment.clearValue));
+  };
+
+  std::vector<vk::RenderingAttachmentInfo> colorAttachments;
+  colorAttachments.reserve(renderingInfo->colorAttachmentCount);
+  for (auto i = 0U; i < renderingInfo->colorAttachmentCount; i++) {
+    colorAttachments.push_back(toVulkan(renderingInfo->colorAttachments[i]));
+  }
+  auto depthAttachment = vk::RenderingAttachmentInfo();
+  if (renderingInfo->depthAttachment) {
+    depthAttachment = toVulkan(*renderingInfo->depthAttachment);
+  }
+  auto stencilAttachment = vk::RenderingAttachmentInfo();
+  if (renderingInfo->stencilAttachment) {
+    stencilAttachment = toVulkan(*renderingInfo->stencilAttachment);
+  }
+
+  auto vkRenderingInfo =
+      vk::RenderingInfo()
+          .setRenderArea(Cast<vk::Rect2D>(renderingInfo->renderArea))
+          .setLayerCount(renderingInfo->layerCount)
+          .setColorAttachments(colorAttachments)
+          .setPDepthAttachment(
+              renderingInfo->depthAttachment ? &depthAttachment : nullptr)
+          .setPStencilAttachment(
+              renderingInfo->stencilAttachment ? &stencilAttachment : nullptr);
+  vkCommandBuffer.beginRendering(vkRenderingInfo);
+}
+
+void VulkanRHI::cmdEndRendering(RHICommandBuffer* commandBuffer) {
+  auto vkCommandBuffer = GetResource<VulkanCommandBuffer>(commandBuffer);
+  vkCommandBuffer.endRendering();
+}
+
 void VulkanRHI::cmdBindPipeline(RHICommandBuffer* commandBuffer,
                                 RHIPipelineBindPoint bindPoint,
                                 RHIPipeline* pipeline) {
@@ -906,6 +1457,165 @@ void VulkanRHI::cmdBindPipeline(RHICommandBuffer* commandBuffer,
                                GetResource<VulkanPipeline>(pipeline));
 }
 
+void VulkanRHI::cmdBindShaders(RHICommandBuffer* commandBuffer,
+                               std::span<const RHIShaderStageFlag> stages,
+                               std::span<RHIShaderObject* const> shaders) {
+  auto vkCommandBuffer = GetResource<VulkanCommandBuffer>(commandBuffer);
+  std::vector<vk::ShaderStageFlagBits> vkStages;
+  std::vector<vk::ShaderEXT> vkShaders;
+  auto bindsGraphics = false;
+  for (auto i = 0U; i < stages.size(); i++) {
+    const auto stage = Cast<vk::ShaderStageFlagBits>(stages[i]);
+    vkStages.push_back(stage);
+    vkShaders.push_back(shaders[i]
+                            ? GetResource<VulkanShaderObject>(shaders[i])
+                            : vk::ShaderEXT());
+    bindsGraphics |= stage != vk::ShaderStageFlagBits::eCompute;
+  }
+  // Every stage of an enabled feature must have something bound, the
+  // geometry shader feature is on. Tessellation is not enabled.
+  if (bindsGraphics) {
+    for (auto stage : {vk::ShaderStageFlagBits::eVertex,
+                       vk::ShaderStageFlagBits::eGeometry,
+                       vk::ShaderStageFlagBits::eFragment}) {
+      if (std::ranges::find(vkStages, stage) == vkStages.end()) {
+        vkStages.push_back(stage);
+        vkShaders.push_back(vk::ShaderEXT());
+      }
+    }
+  }
+  vkCommandBuffer.bindShadersEXT(vkStages, vkShaders, deviceDispatch);
+}
+
+void VulkanRHI::cmdSetGraphicsState(
+    RHICommandBuffer* commandBuffer,
+    const RHIGraphicsPipelineCreateInfo& createInfo) {
+  auto vkCommandBuffer = GetResource<VulkanCommandBuffer>(commandBuffer);
+
+  std::vector<vk::VertexInputBindingDescription2EXT> bindings;
+  std::vector<vk::VertexInputAttributeDescription2EXT> attributes;
+  if (const auto* vertexInput = createInfo.vertexInputStateCreateInfo) {
+    for (auto i = 0U; i < vertexInput->vertexBindingDescriptionCount; i++) {
+      const auto& binding = vertexInput->vertexBindingDescriptions[i];
+      bindings.push_back(vk::VertexInputBindingDescription2EXT(
+          binding.binding, binding.stride,
+          Cast<vk::VertexInputRate>(binding.inputRate), 1));
+    }
+    for (auto i = 0U; i < vertexInput->vertexAttributeDescriptionCount; i++) {
+      const auto& attribute = vertexInput->vertexAttributeDescriptions[i];
+      attributes.push_back(vk::VertexInputAttributeDescription2EXT(
+          attribute.location, attribute.binding,
+          Cast<vk::Format>(attribute.format), attribute.offset));
+    }
+  }
+  vkCommandBuffer.setVertexInputEXT(bindings, attributes, deviceDispatch);
+
+  if (const auto* inputAssembly = createInfo.inputAssemblyStateCreateInfo) {
+    vkCommandBuffer.setPrimitiveTopology(
+        Cast<vk::PrimitiveTopology>(inputAssembly->topology));
+    vkCommandBuffer.setPrimitiveRestartEnable(
+        inputAssembly->primitiveRestartEnabled);
+  }
+
+  if (const auto* viewport = createInfo.viewportStateCreateInfo) {
+    if (viewport->viewports) {
+      vkCommandBuffer.setViewportWithCount(
+          viewport->viewportCount, Cast<vk::Viewport>(viewport->viewports));
+    }
+    if (viewport->scissors) {
+      vkCommandBuffer.setScissorWithCount(
+          viewport->scissorCount, Cast<vk::Rect2D>(viewport->scissors));
+    }
+  }
+
+  // Depth clamp, alpha to one and logic op are features the device is
+  // created without, their state is left unset.
+  if (const auto* rasterization = createInfo.rasterizationStateCreateInfo) {
+    vkCommandBuffer.setRasterizerDiscardEnable(
+        rasterization->rasterizerDiscardEnable);
+    vkCommandBuffer.setCullMode(
+        Cast<vk::CullModeFlagBits>(rasterization->cullMode));
+    vkCommandBuffer.setFrontFace(
+        Cast<vk::FrontFace>(rasterization->frontFace));
+    vkCommandBuffer.setDepthBiasEnable(rasterization->depthBiasEnable);
+    if (rasterization->depthBiasEnable) {
+      vkCommandBuffer.setDepthBias(rasterization->depthBiasConstantFactor,
+                                   rasterization->depthBiasClamp,
+                                   rasterization->depthBiasSlopeFactor);
+    }
+    vkCommandBuffer.setPolygonModeEXT(
+        Cast<vk::PolygonMode>(rasterization->polygonMode), deviceDispatch);
+    vkCommandBuffer.setLineWidth(rasterization->lineWidth);
+  }
+
+  const auto* multisample = createInfo.multisampleStateCreateInfo;
+  const auto samples =
+      multisample ? Cast<vk::SampleCountFlagBits>(
+                        multisample->rasterizationSamples)
+                  : vk::SampleCountFlagBits::e1;
+  // Enough words for the largest sample count.
+  constexpr std::array<vk::SampleMask, 2> allSamples = {~0U, ~0U};
+  vkCommandBuffer.setRasterizationSamplesEXT(samples, deviceDispatch);
+  vkCommandBuffer.setSampleMaskEXT(
+      samples,
+      multisample && multisample->sampleMask ? multisample->sampleMask
+                                             : allSamples.data(),
+      deviceDispatch);
+  vkCommandBuffer.setAlphaToCoverageEnableEXT(
+      multisample && multisample->alphaToCoverageEnable, deviceDispatch);
+
+  const auto* depthStencil = createInfo.depthStencilStateCreateInfo;
+  vkCommandBuffer.setDepthTestEnable(depthStencil &&
+                                     depthStencil->depthTestEnable);
+  vkCommandBuffer.setDepthWriteEnable(depthStencil &&
+                                      depthStencil->depthWriteEnable);
+  vkCommandBuffer.setDepthCompareOp(
+      depthStencil ? Cast<vk::CompareOp>(depthStencil->depthCompareOp)
+                   : vk::CompareOp::eNever);
+  vkCommandBuffer.setDepthBoundsTestEnable(
+      depthStencil && depthStencil->depthBoundsTestEnable);
+  vkCommandBuffer.setStencilTestEnable(depthStencil &&
+                                       depthStencil->stencilTestEnable);
+  if (depthStencil && depthStencil->depthBoundsTestEnable) {
+    vkCommandBuffer.setDepthBounds(depthStencil->minDepthBounds,
+                                   depthStencil->maxDepthBounds);
+  }
+  if (depthStencil && depthStencil->stencilTestEnable) {
+    auto setStencil = [&vkCommandBuffer](vk::StencilFaceFlags face,
+                                         const RHIStencilOpState& state) {
+      vkCommandBuffer.setStencilOp(face, Cast<vk::StencilOp>(state.failOp),
+                                   Cast<vk::StencilOp>(state.passOp),
+                                   Cast<vk::StencilOp>(state.depthFailOp),
+                                   Cast<vk::CompareOp>(state.compareOp));
+      vkCommandBuffer.setStencilCompareMask(face, state.compareMask);
+      vkCommandBuffer.setStencilWriteMask(face, state.writeMask);
+      vkCommandBuffer.setStencilReference(face, state.reference);
+    };
+    setStencil(vk::StencilFaceFlagBits::eFront, depthStencil->front);
+    setStencil(vk::StencilFaceFlagBits::eBack, depthStencil->back);
+  }
+
+  if (const auto* colorBlend = createInfo.colorBlendStateCreateInfo) {
+    for (auto i = 0U; i < colorBlend->attachmentCount; i++) {
+      const auto& attachment = colorBlend->attachments[i];
+      const vk::Bool32 blendEnable = attachment.blendEnable;
+      const auto writeMask =
+          Cast<vk::ColorComponentFlags>(attachment.colorWriteMask);
+      const auto equation = vk::ColorBlendEquationEXT(
+          Cast<vk::BlendFactor>(attachment.srcColorBlendFactor),
+          Cast<vk::BlendFactor>(attachment.dstColorBlendFactor),
+          Cast<vk::BlendOp>(attachment.colorBlendOp),
+          Cast<vk::BlendFactor>(attachment.srcAlphaBlendFactor),
+          Cast<vk::BlendFactor>(attachment.dstAlphaBlendFactor),
+          Cast<vk::BlendOp>(attachment.alphaBlendOp));
+      vkCommandBuffer.setColorBlendEnableEXT(i, blendEnable, deviceDispatch);
+      vkCommandBuffer.setColorWriteMaskEXT(i, writeMask, deviceDispatch);
+      vkCommandBuffer.setColorBlendEquationEXT(i, equation, deviceDispatch);
+    }
+    vkCommandBuffer.setBlendConstants(colorBlend->blendConstants.data());
+  }
+}
+
 void VulkanRHI::cmdBindVertexBuffers(RHICommandBuffer* commandBuffer,
                                      uint32_t firstBinding,
                                      uint32_t bindingCount,
@@ -951,12 +1661,25 @@ void VulkanRHI::cmdBindDescriptorSets(RHICommandBuffer* commandBuffer,
       vkDesciptorSets.data(), dynamicOffsetCount, dynamicOffsets);
 }
 
+void VulkanRHI::cmdPushConstants(RHICommandBuffer* commandBuffer,
+                                 const RHIPipelineLayout* layout,
+                                 RHIShaderStageFlag stageFlags,
+                                 uint32_t offset,
+                                 uint32_t size,
+                                 const void* values) {
+  auto vkCommandBuffer = GetResource<VulkanCommandBuffer>(commandBuffer);
+  vkCommandBuffer.pushConstants(GetResource<VulkanPipelineLayout>(layout),
+                                Cast<vk::ShaderStageFlags>(stageFlags), offset,
+                                size, values);
+}
+
 void VulkanRHI::cmdDraw(RHICommandBuffer* commandBuffer,
                         uint32_t vertexCount,
                         uint32_t instanceCount,
                         uint32_t firstVertex,
                         uint32_t firstInstance) {
   auto vkCommandBuffer = GetResource<VulkanCommandBuffer>(commandBuffer);
+  resourceTracker.flush(vkCommandBuffer);
   vkCommandBuffer.draw(vertexCount, instanceCount, firstVertex, firstInstance);
 }
 
@@ -967,10 +1690,35 @@ void VulkanRHI::cmdDrawIndexed(RHICommandBuffer* commandBuffer,
                                int32_t vertexOffset,
                                uint32_t firstInstance) {
   auto vkCommandBuffer = GetResource<VulkanCommandBuffer>(commandBuffer);
+  resourceTracker.flush(vkCommandBuffer);
   vkCommandBuffer.drawIndexed(indexCount, instanceCount, firstIndex,
                               vertexOffset, firstInstance);
 }
 
+void VulkanRHI::cmdDrawIndexedIndirectCount(RHICommandBuffer* commandBuffer,
+                                            RHIBuffer* buffer,
+                                            RHIDeviceSize offset,
+                                            RHIBuffer* countBuffer,
+                                            RHIDeviceSize countBufferOffset,
+                                            uint32_t maxDrawCount,
+                                            uint32_t stride) {
+  auto vkCommandBuffer = GetResource<VulkanCommandBuffer>(commandBuffer);
+  resourceTracker.flush(vkCommandBuffer);
+  vkCommandBuffer.drawIndexedIndirectCount(
+      GetResource<VulkanBuffer>(buffer), offset,
+      GetResource<VulkanBuffer>(countBuffer), countBufferOffset, maxDrawCount,
+      stride);
+}
+
+void VulkanRHI::cmdDispatch(RHICommandBuffer* commandBuffer,
+                            uint32_t groupCountX,
+                            uint32_t groupCountY,
+                            uint32_t groupCountZ) {
+  auto vkCommandBuffer = GetResource<VulkanCommandBuffer>(commandBuffer);
+  resourceTracker.flush(vkCommandBuffer);
+  vkCommandBuffer.dispatch(groupCountX, groupCountY, groupCountZ);
+}
+
 void VulkanRHI::cmdSetViewport(RHICommandBuffer* commandBuffer,
                                uint32_t firstViewport,
                                uint32_t viewportCount,
@@ -990,57 +1738,192 @@ void VulkanRHI::cmdSetScissor(RHICommandBuffer* commandBuffer,
                              Cast<vk::Rect2D>(pScissors));
 }
 
+void VulkanRHI::cmdSetCullMode(RHICommandBuffer* commandBuffer,
+                               RHICullMode cullMode) {
+  auto vkCommandBuffer = GetResource<VulkanCommandBuffer>(commandBuffer);
+  vkCommandBuffer.setCullMode(Cast<vk::CullModeFlagBits>(cullMode));
+}
+
+void VulkanRHI::cmdSetFrontFace(RHICommandBuffer* commandBuffer,
+                                RHIFrontFace frontFace) {
+  auto vkCommandBuffer = GetResource<VulkanCommandBuffer>(commandBuffer);
+  vkCommandBuffer.setFrontFace(Cast<vk::FrontFace>(frontFace));
+}
+
+void VulkanRHI::cmdSetPrimitiveTopology(RHICommandBuffer* commandBuffer,
+                                        RHIPrimitiveTopology topology) {
+  auto vkCommandBuffer = GetResource<VulkanCommandBuffer>(commandBuffer);
+  vkCommandBuffer.setPrimitiveTopology(Cast<vk::PrimitiveTopology>(topology));
+}
+
+void VulkanRHI::cmdSetDepthTestEnable(RHICommandBuffer* commandBuffer,
+                                      bool enabled) {
+  auto vkCommandBuffer = GetResource<VulkanCommandBuffer>(commandBuffer);
+  vkCommandBuffer.setDepthTestEnable(enabled);
+}
+
+void VulkanRHI::cmdSetDepthWriteEnable(RHICommandBuffer* commandBuffer,
+                                       bool enabled) {
+  auto vkCommandBuffer = GetResource<VulkanCommandBuffer>(commandBuffer);
+  vkCommandBuffer.setDepthWriteEnable(enabled);
+}
+
+void VulkanRHI::cmdSetDepthCompareOp(RHICommandBuffer* commandBuffer,
+                                     RHICompareOp compareOp) {
+  auto vkCommandBuffer = GetResource<VulkanCommandBuffer>(commandBuffer);
+  vkCommandBuffer.setDepthCompareOp(Cast<vk::CompareOp>(compareOp));
+}
+
+void VulkanRHI::cmdSetPrimitiveRestartEnable(RHICommandBuffer* commandBuffer,
+                                             bool enabled) {
+  auto vkCommandBuffer = GetResource<VulkanCommandBuffer>(commandBuffer);
+  vkCommandBuffer.setPrimitiveRestartEnable(enabled);
+}
+
+void VulkanRHI::cmdSetColorBlendEnable(RHICommandBuffer* commandBuffer,
+                                       uint32_t firstAttachment,
+                                       uint32_t attachmentCount,
+                                       const RHIBool32* enables) {
+  auto vkCommandBuffer = GetResource<VulkanCommandBuffer>(commandBuffer);
+  vkCommandBuffer.setColorBlendEnableEXT(
+      firstAttachment, attachmentCount, Cast<vk::Bool32>(enables),
+      deviceDispatch);
+}
+
 void VulkanRHI::cmdCopyBuffer(RHICommandBuffer* commandBuffer,
                               RHIBuffer* srcBuffer,
                               RHIBuffer* dstBuffer,
                               std::span<RHIBufferCopy> copyRegions) {
   auto vkCommandBuffer = GetResource<VulkanCommandBuffer>(commandBuffer);
+  resourceTracker.flush(vkCommandBuffer);
   auto vkSrcBuffer = GetResource<VulkanBuffer>(srcBuffer);
   auto vkDstBuffer = GetResource<VulkanBuffer>(dstBuffer);
   vkCommandBuffer.copyBuffer(vkSrcBuffer, vkDstBuffer, copyRegions.size(),
                              Cast<vk::BufferCopy>(copyRegions.data()));
 }
 
-void VulkanRHI::beforePass() {
-  if (device.waitForFences(1, &isFrameInFlightFences[currentFrameIndex],
-                           VK_TRUE, UINT64_MAX) != vk::Result::eSuccess) {
-    LOG_ERROR("WaitForFences failed.")
+void VulkanRHI::cmdFillBuffer(RHICommandBuffer* commandBuffer,
+                              RHIBuffer* dstBuffer,
+                              RHIDeviceSize dstOffset,
+                              RHIDeviceSize size,
+                              uint32_t data) {
+  auto vkCommandBuffer = GetResource<VulkanCommandBuffer>(commandBuffer);
+  resourceTracker.flush(vkCommandBuffer);
+  vkCommandBuffer.fillBuffer(GetResource<VulkanBuffer>(dstBuffer), dstOffset,
+                             size, data);
+}
+
+void VulkanRHI::cmdTransitionResources(
+    RHICommandBuffer* commandBuffer,
+    std::span<const RHIImageTransition> imageTransitions,
+    std::span<const RHIBufferTransition> bufferTransitions) {
+  for (const auto& transition : imageTransitions) {
+    resourceTracker.transitionImage(GetResource<VulkanImage>(transition.image),
+                                    transition.subresourceRange,
+                                    transition.usage, transition.discard);
+  }
+  for (const auto& transition : bufferTransitions) {
+    resourceTracker.transitionBuffer(
+        GetResource<VulkanBuffer>(transition.buffer), transition.usage);
   }
+}
+
+void VulkanRHI::setImageUsage(RHIImage* image,
+                              const RHIImageSubresourceRange& range,
+                              RHIResourceUsage usage) {
+  resourceTracker.setImageUsage(GetResource<VulkanImage>(image), range, usage);
+}
 
-  auto acuqireRet = device.acquireNextImageKHR(
-      swapChain, UINT64_MAX,
-      imageAvailableForRenderSemaphores[currentFrameIndex], VK_NULL_HANDLE,
-      &currentSwapChainImageIndex);
-  if (acuqireRet == vk::Result::eErrorOutOfDateKHR) {
+void VulkanRHI::waitForNextFrame() {
+  // Normally only the frame that last used the next frame's command buffer
+  // and semaphores has to be done, later ones may still be running.
+  const auto value = lowLatency ? graphicsTimeline.getSubmittedValue()
+                                : frameTimelineValues[currentFrameIndex];
+  if (!graphicsTimeline.wait(value)) {
+    LOG_ERROR("Wait for frame timeline value failed.")
+  }
+  updateFrameLatency();
+  inputSampleTime = std::chrono::steady_clock::now();
+}
+
+bool VulkanRHI::beforePass() {
+  // Returns right away if waitForNextFrame already waited.
+  if (!graphicsTimeline.wait(frameTimelineValues[currentFrameIndex])) {
+    LOG_ERROR("Wait for frame timeline value failed.")
+  }
+  updateFrameLatency();
+  graphicsTimeline.collect();
+  lastBarrierStatistics = resourceTracker.takeStatistics();
+
+  // Not every platform reports the swapchain out of date after a resize.
+  int framebufferWidth, framebufferHeight;
+  glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+  if (static_cast<uint32_t>(framebufferWidth) != width ||
+      static_cast<uint32_t>(framebufferHeight) != height) {
+    swapChainSettingsChanged = true;
+  }
+  if (swapChainSettingsChanged) {
     recreateSwapChain();
-    return;
-  } else if (acuqireRet != vk::Result::eSuccess &&
-             acuqireRet != vk::Result::eSuboptimalKHR) {
-    LOG_ERROR("AcquireNextImage failed.");
   }
-  if (device.resetFences(1, &isFrameInFlightFences[currentFrameIndex]) !=
-      vk::Result::eSuccess) {
-    LOG_ERROR("ResetFences failed.");
+
+  auto acquireNextImage = [this] {
+    return device.acquireNextImageKHR(
+        swapChain, UINT64_MAX,
+        imageAvailableForRenderSemaphores[currentFrameIndex], VK_NULL_HANDLE,
+        &currentSwapChainImageIndex);
+  };
+  auto acquireResult = acquireNextImage();
+  if (acquireResult == vk::Result::eErrorOutOfDateKHR) {
+    // Retried with the new swapchain so that the frame is not dropped.
+    recreateSwapChain();
+    acquireResult = acquireNextImage();
+  }
+  if (acquireResult == vk::Result::eSuboptimalKHR) {
+    // The image is acquired and has to be presented, the swapchain is
+    // recreated before the next frame.
+    swapChainSettingsChanged = true;
+  } else if (acquireResult != vk::Result::eSuccess) {
+    LOG_ERROR("AcquireNextImage failed.");
+    return false;
   }
   commandBuffers[currentFrameIndex].reset();
+  return true;
 }
 
 void VulkanRHI::waitIdle() {
   device.waitIdle();
+  // Nothing is in flight anymore, so releases waiting for the next frame
+  // can run as well.
+  for (auto& release : std::exchange(pendingFrameReleases, {})) {
+    graphicsTimeline.enqueue(graphicsTimeline.getSubmittedValue(),
+                             std::move(release));
+  }
+  graphicsTimeline.collect();
 }
 
 void VulkanRHI::submitRendering() {
+  const auto waitStage =
+      vk::PipelineStageFlags(vk::PipelineStageFlagBits::eColorAttachmentOutput);
+  const auto signalValue = graphicsTimeline.getNextValue();
+  const std::array<vk::Semaphore, 2> signalSemaphores = {
+      imageFinishedForPresentationSemaphores[currentFrameIndex],
+      graphicsTimeline.getSemaphore(),
+  };
+  // Binary semaphores ignore their value.
+  const std::array<uint64_t, 2> signalValues = {0, signalValue};
+  auto timelineSubmitInfo =
+      vk::TimelineSemaphoreSubmitInfo().setSignalSemaphoreValues(signalValues);
   auto submitInfo =
       vk::SubmitInfo()
+          .setPNext(&timelineSubmitInfo)
           .setWaitSemaphoreCount(1)
           .setPWaitSemaphores(
               &imageAvailableForRenderSemaphores[currentFrameIndex])
+          .setPWaitDstStageMask(&waitStage)
           .setCommandBufferCount(1)
           .setPCommandBuffers(
               Cast<vk::CommandBuffer>(&commandBuffers[currentFrameIndex]))
-          .setSignalSemaphoreCount(1)
-          .setPSignalSemaphores(
-              &imageFinishedForPresentationSemaphores[currentFrameIndex]);
+          .setSignalSemaphores(signalSemaphores);
 
   auto presentInfo =
       vk::PresentInfoKHR()
@@ -1051,24 +1934,63 @@ void VulkanRHI::submitRendering() {
           .setPSwapchains(&swapChain)
           .setPImageIndices(&currentSwapChainImageIndex);
 
-  if (device.resetFences(1, &isFrameInFlightFences[currentFrameIndex]) !=
-      vk::Result::eSuccess) {
-    LOG_ERROR("DeviceResetFences failed.")
+  if (presentQueue.submit(1, &submitInfo, nullptr) != vk::Result::eSuccess) {
+    LOG_ERROR("QueueSubmit failed.")
     return;
   }
-
-  if (presentQueue.submit(1, &submitInfo,
-                          isFrameInFlightFences[currentFrameIndex]) !=
-      vk::Result::eSuccess) {
-    LOG_ERROR("QueueResetFences failed.")
-    return;
+  graphicsTimeline.markSubmitted(signalValue);
+  frameTimelineValues[currentFrameIndex] = signalValue;
+  if (inputSampleTime) {
+    pendingLatencySamples.push_back(FrameLatencySample{
+        .timelineValue = signalValue,
+        .inputSampleTime = *inputSampleTime,
+    });
+    inputSampleTime.reset();
+  }
+  for (auto& release : std::exchange(pendingFrameReleases, {})) {
+    graphicsTimeline.enqueue(signalValue, std::move(release));
   }
 
-  if (presentQueue.presentKHR(presentInfo) != vk::Result::eSuccess) {
+  // The frame is submitted either way, so the next one moves on to the
+  // next semaphores and command buffer even if presenting failed.
+  currentFrameIndex = (currentFrameIndex + 1) % maxFramesInFlight;
+  const auto presentResult = presentQueue.presentKHR(&presentInfo);
+  if (presentResult == vk::Result::eErrorOutOfDateKHR ||
+      presentResult == vk::Result::eSuboptimalKHR) {
+    swapChainSettingsChanged = true;
+  } else if (presentResult != vk::Result::eSuccess) {
     LOG_ERROR("QueuePresentKHR failed.")
+  }
+}
+
+void VulkanRHI::updateFrameLatency() {
+  if (pendingLatencySamples.empty()) {
     return;
   }
-  currentFrameIndex = (currentFrameIndex + 1) % MAX_FRAMES_IN_FLIGHT;
+  const auto completedValue = graphicsTimeline.getCompletedValue();
+  const auto now = std::chrono::steady_clock::now();
+  while (!pendingLatencySamples.empty() &&
+         pendingLatencySamples.front().timelineValue <= completedValue) {
+    const auto& sample = pendingLatencySamples.front();
+    const auto latencyMs =
+        std::chrono::duration<float, std::milli>(now - sample.inputSampleTime)
+            .count();
+    auto& statistics = latencyStatistics;
+    statistics.lastInputToPresentMs = latencyMs;
+    // Exponential moving average over roughly the last ten frames.
+    statistics.averageInputToPresentMs =
+        statistics.measuredFrameCount == 0
+            ? latencyMs
+            : statistics.averageInputToPresentMs * 0.9f + latencyMs * 0.1f;
+    statistics.measuredFrameCount++;
+    pendingLatencySamples.pop_front();
+  }
+}
+
+void VulkanRHI::deferRelease(std::function<void()> release) {
+  // Attached to the next frame submission rather than the next timeline
+  // value, one-time submissions in between would signal that one early.
+  pendingFrameReleases.push_back(std::move(release));
 }
 
 void* VulkanRHI::mapMemory(RHIDeviceMemory* deviceMemory,
@@ -1159,11 +2081,20 @@ vk::SurfaceFormatKHR VulkanRHI::chooseSwapSurfaceFormat(
 }
 
 vk::PresentModeKHR VulkanRHI::chooseSwapPresentMode(
-    const std::vector<vk::PresentModeKHR>& availablePresentModes) {
-  for (const auto& availablePresentMode : availablePresentModes) {
-    if (availablePresentMode == vk::PresentModeKHR::eMailbox) {
-      return availablePresentMode;
-    }
+    const std::vector<vk::PresentModeKHR>& availablePresentModes) const {
+  auto isAvailable = [&availablePresentModes](vk::PresentModeKHR mode) {
+    return std::find(availablePresentModes.begin(),
+                     availablePresentModes.end(),
+                     mode) != availablePresentModes.end();
+  };
+  if (isAvailable(requestedPresentMode)) {
+    return requestedPresentMode;
+  }
+  // Immediate asked for no waiting on vblank, mailbox comes closest
+  // without tearing.
+  if (requestedPresentMode == vk::PresentModeKHR::eImmediate &&
+      isAvailable(vk::PresentModeKHR::eMailbox)) {
+    return vk::PresentModeKHR::eMailbox;
   }
   return vk::PresentModeKHR::eFifo;
 }
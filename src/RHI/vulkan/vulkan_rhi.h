@@ -6,8 +6,12 @@
 #define VK_USE_PLATFORM_WIN32_KHR
 #include <vulkan/vulkan.hpp>
 
+#include <chrono>
+#include <deque>
 #include <memory>
 #include <optional>
+#include "vulkan_resource_tracker.h"
+#include "vulkan_timeline.h"
 
 struct GLFWwindow;
 
@@ -45,6 +49,17 @@ class VulkanRHI : public RHI {
       std::span<char> shader_code) override;
   std::unique_ptr<RHIPipeline> createGraphicsPipeline(
       const RHIGraphicsPipelineCreateInfo& createInfo) override;
+  std::unique_ptr<RHIPipeline> createComputePipeline(
+      const RHIComputePipelineCreateInfo& createInfo) override;
+  std::unique_ptr<RHIPipeline> createGraphicsPipelineLibrary(
+      const RHIGraphicsPipelineCreateInfo& createInfo,
+      RHIGraphicsPipelineLibraryFlag parts) override;
+  std::unique_ptr<RHIPipeline> linkGraphicsPipelineLibraries(
+      std::span<RHIPipeline* const> libraries,
+      RHIPipelineLayout* pipelineLayout,
+      bool optimize) override;
+  std::unique_ptr<RHIShaderObject> createShaderObject(
+      const RHIShaderObjectCreateInfo& createInfo) override;
   std::unique_ptr<RHIRenderPass> createRenderPass(
       const RHIRenderPassCreateInfo& createInfo) override;
   std::unique_ptr<RHIPipelineLayout> createPipelineLayout(
@@ -60,13 +75,31 @@ class VulkanRHI : public RHI {
   createImageAndCopyData(const RHIImageCreateInfo& createInfo,
                          void* data,
                          size_t dataSize) override;
+  std::unique_ptr<RHIImageView> createImageView(
+      const RHIImageViewCreateInfo& createInfo) override;
   std::unique_ptr<RHISampler> createSampler(
       const RHISamplerCreateInfo& createInfo) override;
+  /* Configuration */
+  void setPresentMode(RHIPresentMode presentMode) override;
+  void setLowLatency(bool enabled) override;
+  void swapPipelines(RHIPipeline* first, RHIPipeline* second) override;
+
   void destoryBuffer(RHIBuffer* buffer) override;
+  void destoryImage(RHIImage* image) override;
+  void destoryImageView(RHIImageView* imageView) override;
   std::unique_ptr<RHIDescriptorSetLayout> createDescriptorSetLayout(
       RHIDescriptorSetLayoutCreateInfo& createInfo) override;
   void destoryDescriptorSetLayout(
       RHIDescriptorSetLayout* descriptorSetLayout) override;
+  void destoryFramebuffer(RHIFramebuffer* framebuffer) override;
+  void destoryShaderModule(RHIShader* shader) override;
+  void destoryPipeline(RHIPipeline* pipeline) override;
+  void destoryShaderObject(RHIShaderObject* shaderObject) override;
+
+  /*** Event ***/
+  uint32_t addImageViewDestroyListener(
+      std::function<void(RHIImageView*)> listener) override;
+  void removeImageViewDestroyListener(uint32_t listenerId) override;
   std::vector<std::unique_ptr<RHIDescriptorSet>> allocateDescriptorSets(
       const RHIDescriptorSetAllocateInfo& allocateInfo) override;
 
@@ -80,7 +113,17 @@ class VulkanRHI : public RHI {
   uint32_t getCurrentSwapChainImageIndex() override;
   RHISwapChainInfo getSwapChainInfo() override;
   RHIImageView * getSwapChainImageView(size_t index) override;
+  RHIImage* getSwapChainImage(size_t index) override;
   RHIDepthImageInfo getDepthImageInfo() override;
+  std::vector<RHIPresentMode> getSupportedPresentModes() override;
+  RHIFrameLatencyStatistics getFrameLatencyStatistics() override;
+  bool supportsDrawIndirectCount() override;
+  bool supportsDynamicRendering() override;
+  bool supportsGraphicsPipelineLibrary() override;
+  RHIExtendedDynamicStateSupport getExtendedDynamicStateSupport() override;
+  bool supportsShaderObject() override;
+  RHIDeviceSize getMinUniformBufferOffsetAlignment() override;
+  RHIBarrierStatistics getBarrierStatistics() override;
   RHICommandBuffer* getCurrentCommandBuffer() override;
   std::span<RHICommandBuffer> getCommandBuffers() override;
 
@@ -96,9 +139,18 @@ class VulkanRHI : public RHI {
                           RHIRenderPassBeginInfo* beginInfo,
                           RHISubpassContents contents) override;
   void cmdEndRenderPass(RHICommandBuffer* commandBuffer) override;
+  void cmdBeginRendering(RHICommandBuffer* commandBuffer,
+                         const RHIRenderingInfo* renderingInfo) override;
+  void cmdEndRendering(RHICommandBuffer* commandBuffer) override;
   void cmdBindPipeline(RHICommandBuffer* commandBuffer,
                        RHIPipelineBindPoint bindPoint,
                        RHIPipeline* pipeline) override;
+  void cmdBindShaders(RHICommandBuffer* commandBuffer,
+                      std::span<const RHIShaderStageFlag> stages,
+                      std::span<RHIShaderObject* const> shaders) override;
+  void cmdSetGraphicsState(
+      RHICommandBuffer* commandBuffer,
+      const RHIGraphicsPipelineCreateInfo& createInfo) override;
   void cmdBindVertexBuffers(RHICommandBuffer* commandBuffer,
                             uint32_t firstBinding,
                             uint32_t bindingCount,
@@ -116,6 +168,12 @@ class VulkanRHI : public RHI {
                              const RHIDescriptorSet* descriptorSets,
                              uint32_t dynamicOffsetCount,
                              const uint32_t* dynamicOffsets) override;
+  void cmdPushConstants(RHICommandBuffer* commandBuffer,
+                        const RHIPipelineLayout* layout,
+                        RHIShaderStageFlag stageFlags,
+                        uint32_t offset,
+                        uint32_t size,
+                        const void* values) override;
   void cmdDraw(RHICommandBuffer* commandBuffer,
                uint32_t vertexCount,
                uint32_t instanceCount,
@@ -127,6 +185,17 @@ class VulkanRHI : public RHI {
                       uint32_t firstIndex,
                       int32_t vertexOffset,
                       uint32_t firstInstance) override;
+  void cmdDrawIndexedIndirectCount(RHICommandBuffer* commandBuffer,
+                                   RHIBuffer* buffer,
+                                   RHIDeviceSize offset,
+                                   RHIBuffer* countBuffer,
+                                   RHIDeviceSize countBufferOffset,
+                                   uint32_t maxDrawCount,
+                                   uint32_t stride) override;
+  void cmdDispatch(RHICommandBuffer* commandBuffer,
+                   uint32_t groupCountX,
+                   uint32_t groupCountY,
+                   uint32_t groupCountZ) override;
   void cmdSetViewport(RHICommandBuffer* commandBuffer,
                       uint32_t firstViewport,
                       uint32_t viewportCount,
@@ -135,15 +204,49 @@ class VulkanRHI : public RHI {
                      uint32_t firstScissor,
                      uint32_t scissorCount,
                      const RHIRect2D* pScissors) override;
+  void cmdSetCullMode(RHICommandBuffer* commandBuffer,
+                      RHICullMode cullMode) override;
+  void cmdSetFrontFace(RHICommandBuffer* commandBuffer,
+                       RHIFrontFace frontFace) override;
+  void cmdSetPrimitiveTopology(RHICommandBuffer* commandBuffer,
+                               RHIPrimitiveTopology topology) override;
+  void cmdSetDepthTestEnable(RHICommandBuffer* commandBuffer,
+                             bool enabled) override;
+  void cmdSetDepthWriteEnable(RHICommandBuffer* commandBuffer,
+                              bool enabled) override;
+  void cmdSetDepthCompareOp(RHICommandBuffer* commandBuffer,
+                            RHICompareOp compareOp) override;
+  void cmdSetPrimitiveRestartEnable(RHICommandBuffer* commandBuffer,
+                                    bool enabled) override;
+  void cmdSetColorBlendEnable(RHICommandBuffer* commandBuffer,
+                              uint32_t firstAttachment,
+                              uint32_t attachmentCount,
+                              const RHIBool32* enables) override;
   void cmdCopyBuffer(RHICommandBuffer* commandBuffer,
                      RHIBuffer* srcBuffer,
                      RHIBuffer* dstBuffer,
                      std::span<RHIBufferCopy> copyRegions) override;
+  void cmdFillBuffer(RHICommandBuffer* commandBuffer,
+                     RHIBuffer* dstBuffer,
+                     RHIDeviceSize dstOffset,
+                     RHIDeviceSize size,
+                     uint32_t data) override;
+  void cmdTransitionResources(
+      RHICommandBuffer* commandBuffer,
+      std::span<const RHIImageTransition> imageTransitions,
+      std::span<const RHIBufferTransition> bufferTransitions) override;
+  void setImageUsage(RHIImage* image,
+                     const RHIImageSubresourceRange& range,
+                     RHIResourceUsage usage) override;
 
-  void beforePass() override;
+  void waitForNextFrame() override;
+  bool beforePass() override;
   void waitIdle() override;
   void submitRendering() override;
 
+  /*** Synchronization ***/
+  void deferRelease(std::function<void()> release) override;
+
   /*** Memory ***/
   void* mapMemory(RHIDeviceMemory* deviceMemory,
                   RHIDeviceSize offset,
@@ -183,10 +286,20 @@ class VulkanRHI : public RHI {
       vk::PhysicalDevice physical_device);
   static vk::SurfaceFormatKHR chooseSwapSurfaceFormat(
       const std::vector<vk::SurfaceFormatKHR>& availableFormats);
-  static vk::PresentModeKHR chooseSwapPresentMode(
-      const std::vector<vk::PresentModeKHR>& availablePresentModes);
+  vk::PresentModeKHR chooseSwapPresentMode(
+      const std::vector<vk::PresentModeKHR>& availablePresentModes) const;
   vk::Extent2D chooseSwapExtent(const vk::SurfaceCapabilitiesKHR& capabilities);
   vk::Format findDepthFormat();
+  // A library of the given parts when set, otherwise a complete pipeline.
+  std::unique_ptr<RHIPipeline> createGraphicsPipeline(
+      const RHIGraphicsPipelineCreateInfo& createInfo,
+      std::optional<vk::GraphicsPipelineLibraryFlagsEXT> libraryParts);
+  void notifyImageViewDestroy(RHIImageView* imageView);
+  void updateFrameLatency();
+  // Submits without waiting. Returns the timeline value reached once the
+  // command buffer finished, or 0 if submission failed. The command
+  // buffer is freed by then.
+  uint64_t submitOneTimeCommandBuffer(RHICommandBuffer* commandBuffer);
 
  private:
   // Instance
@@ -201,6 +314,14 @@ class VulkanRHI : public RHI {
   std::vector<const char*> deviceExtensions;
   vk::Queue presentQueue;
   QueueFamilyIndices queueFamilyIndices;
+  bool drawIndirectCountSupported = false;
+  bool dynamicRenderingSupported = false;
+  bool synchronization2Supported = false;
+  bool graphicsPipelineLibrarySupported = false;
+  RHIExtendedDynamicStateSupport extendedDynamicStateSupport;
+  bool shaderObjectSupported = false;
+  // Dispatches device extension commands.
+  vk::DispatchLoaderDynamic deviceDispatch;
 
   // Command pool and command buffers
   vk::CommandPool commandPool;
@@ -209,6 +330,10 @@ class VulkanRHI : public RHI {
   // Surface
   vk::SurfaceKHR surface;
   vk::PresentModeKHR presentMode;
+  vk::PresentModeKHR requestedPresentMode = vk::PresentModeKHR::eMailbox;
+  uint32_t requestedSwapChainImageCount = 0;
+  // Set when the swapchain has to be recreated before the next frame.
+  bool swapChainSettingsChanged = false;
 
   // Swapchain
   vk::SwapchainKHR swapChain;
@@ -228,11 +353,14 @@ class VulkanRHI : public RHI {
   vk::DeviceMemory depthDeviceMemory;
 
   // Sync Primitives
-  static constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 3;
+  uint32_t maxFramesInFlight = 3;
   uint8_t currentFrameIndex = 0;
-  vk::Semaphore imageAvailableForRenderSemaphores[MAX_FRAMES_IN_FLIGHT];
-  vk::Semaphore imageFinishedForPresentationSemaphores[MAX_FRAMES_IN_FLIGHT];
-  vk::Fence isFrameInFlightFences[MAX_FRAMES_IN_FLIGHT];
+  std::vector<vk::Semaphore> imageAvailableForRenderSemaphores;
+  std::vector<vk::Semaphore> imageFinishedForPresentationSemaphores;
+  VulkanTimeline graphicsTimeline;
+  // Timeline value each frame's last submission signals.
+  std::vector<uint64_t> frameTimelineValues;
+  std::vector<std::function<void()>> pendingFrameReleases;
 
   // Descriptor pool
   vk::DescriptorPool descriptorPool;
@@ -240,6 +368,25 @@ class VulkanRHI : public RHI {
   // pipeline
   vk::PipelineCache graphicsPipelineCache;
 
+  // Resource states and pending barriers
+  VulkanResourceTracker resourceTracker;
+  RHIBarrierStatistics lastBarrierStatistics;
+
+  // Image view destroy listeners by id
+  std::vector<std::pair<uint32_t, std::function<void(RHIImageView*)>>>
+      imageViewDestroyListeners;
+  uint32_t nextImageViewDestroyListenerId = 0;
+
+  // Frame pacing and latency
+  struct FrameLatencySample {
+    uint64_t timelineValue = 0;
+    std::chrono::steady_clock::time_point inputSampleTime;
+  };
+  bool lowLatency = false;
+  std::optional<std::chrono::steady_clock::time_point> inputSampleTime;
+  std::deque<FrameLatencySample> pendingLatencySamples;
+  RHIFrameLatencyStatistics latencyStatistics;
+
   // GLFW
   GLFWwindow* window = nullptr;
   uint32_t width = 0, height = 0;
@@ -0,0 +1,92 @@
+#include "vulkan_timeline.h"
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+#include "utils/log.h"
+
+namespace Sparrow {
+
+void VulkanTimeline::initialize(vk::Device vkDevice) {
+  device = vkDevice;
+  auto typeCreateInfo = vk::SemaphoreTypeCreateInfo()
+                            .setSemaphoreType(vk::SemaphoreType::eTimeline)
+                            .setInitialValue(0);
+  semaphore = device.createSemaphore(
+      vk::SemaphoreCreateInfo().setPNext(&typeCreateInfo));
+  submittedValue = 0;
+  completedValue = 0;
+}
+
+void VulkanTimeline::destroy() {
+  if (semaphore) {
+    device.destroySemaphore(semaphore);
+    semaphore = nullptr;
+  }
+  pendingCallbacks.clear();
+}
+
+uint64_t VulkanTimeline::getCompletedValue() {
+  if (completedValue < submittedValue) {
+    completedValue = device.getSemaphoreCounterValue(semaphore);
+  }
+  return completedValue;
+}
+
+bool VulkanTimeline::isCompleted(uint64_t value) {
+  return value <= completedValue || value <= getCompletedValue();
+}
+
+bool VulkanTimeline::wait(uint64_t value, uint64_t timeout) {
+  if (isCompleted(value)) {
+    return true;
+  }
+  if (value > submittedValue) {
+    LOG_ERROR("VulkanTimeline::wait value was never submitted.");
+    return false;
+  }
+  auto waitInfo = vk::SemaphoreWaitInfo()
+                      .setSemaphoreCount(1)
+                      .setPSemaphores(&semaphore)
+                      .setPValues(&value);
+  const auto result = device.waitSemaphores(waitInfo, timeout);
+  if (result == vk::Result::eTimeout) {
+    return false;
+  }
+  if (result != vk::Result::eSuccess) {
+    LOG_ERROR("VulkanTimeline::wait waitSemaphores failed.");
+    return false;
+  }
+  completedValue = std::max(completedValue, value);
+  return true;
+}
+
+void VulkanTimeline::enqueue(uint64_t value, std::function<void()> callback) {
+  pendingCallbacks.push_back(PendingCallback{
+      .value = value,
+      .callback = std::move(callback),
+  });
+}
+
+void VulkanTimeline::collect() {
+  if (pendingCallbacks.empty()) {
+    return;
+  }
+  const auto completed = getCompletedValue();
+  // Callbacks may enqueue more, so the finished ones are moved out first.
+  auto finished = std::stable_partition(
+      pendingCallbacks.begin(), pendingCallbacks.end(),
+      [completed](const auto& pending) { return pending.value > completed; });
+  std::vector<PendingCallback> ready(std::make_move_iterator(finished),
+                                     std::make_move_iterator(
+                                         pendingCallbacks.end()));
+  pendingCallbacks.erase(finished, pendingCallbacks.end());
+  std::stable_sort(ready.begin(), ready.end(),
+                   [](const auto& left, const auto& right) {
+                     return left.value < right.value;
+                   });
+  for (auto& pending : ready) {
+    pending.callback();
+  }
+}
+
+}  // namespace Sparrow
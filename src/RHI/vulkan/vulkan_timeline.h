@@ -0,0 +1,55 @@
+#ifndef SPARROWENGINE_VULKAN_TIMELINE_H
+#define SPARROWENGINE_VULKAN_TIMELINE_H
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace Sparrow {
+
+// The GPU timeline of one queue: a timeline semaphore every submission
+// signals with the next value. Work submitted earlier always has a lower
+// value, so a single value tells whether everything up to some submission
+// finished, on the CPU by waiting for it and on other queues by waiting
+// for it in their submissions.
+class VulkanTimeline {
+ public:
+  void initialize(vk::Device device);
+  void destroy();
+
+  vk::Semaphore getSemaphore() const { return semaphore; }
+
+  // The value the next submission signals, recorded with markSubmitted
+  // once the submission succeeded.
+  uint64_t getNextValue() const { return submittedValue + 1; }
+  void markSubmitted(uint64_t value) { submittedValue = value; }
+  uint64_t getSubmittedValue() const { return submittedValue; }
+  // Queries the semaphore, values up to the result have finished.
+  uint64_t getCompletedValue();
+  bool isCompleted(uint64_t value);
+  // Returns false if the timeout elapsed first.
+  bool wait(uint64_t value, uint64_t timeout = UINT64_MAX);
+
+  // Runs the callback from collect once the timeline reached value.
+  void enqueue(uint64_t value, std::function<void()> callback);
+  // Runs the callbacks whose value was reached, in value order.
+  void collect();
+
+ private:
+  struct PendingCallback {
+    uint64_t value = 0;
+    std::function<void()> callback;
+  };
+
+  vk::Device device;
+  vk::Semaphore semaphore;
+  uint64_t submittedValue = 0;
+  uint64_t completedValue = 0;
+  std::vector<PendingCallback> pendingCallbacks;
+};
+
+}  // namespace Sparrow
+
+#endif  // SPARROWENGINE_VULKAN_TIMELINE_H
@@ -4,9 +4,7 @@
 
 #include "vulkan_utils.h"
 #include <iostream>
-#include "RHI/rhi.h"
 #include "RHI/rhi_struct.h"
-#include "RHI/vulkan/vulkan_rhi_resource.h"
 #include "utils/log.h"
 
 namespace Sparrow {
@@ -67,81 +65,6 @@ uint32_t VulkanUtils::findMemoryType(
   throw std::runtime_error("VulkanUtils::findMemoryType");
 }
 
-void VulkanUtils::transitionImageLayout(class RHI* rhi,
-                                        vk::Image image,
-                                        vk::Format format,
-                                        vk::ImageLayout oldLayout,
-                                        vk::ImageLayout newLayout) {
-  auto commandBuffer = rhi->beginOneTimeCommandBuffer();
-  auto vkCommandBuffer = GetResource<VulkanCommandBuffer>(commandBuffer.get());
-
-  auto barrier = vk::ImageMemoryBarrier()
-                     .setOldLayout(oldLayout)
-                     .setNewLayout(newLayout)
-                     .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
-                     .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
-                     .setImage(image)
-                     .setSubresourceRange(
-                         vk::ImageSubresourceRange()
-                             .setAspectMask(vk::ImageAspectFlagBits::eColor)
-                             .setBaseMipLevel(0)
-                             .setLevelCount(1)
-                             .setBaseArrayLayer(0)
-                             .setLayerCount(1));
-
-  vk::PipelineStageFlags srcStage;
-  vk::PipelineStageFlags dstStage;
-
-  if (oldLayout == vk::ImageLayout::eUndefined &&
-      newLayout == vk::ImageLayout::eTransferDstOptimal) {
-    barrier.setSrcAccessMask(vk::AccessFlagBits::eNone)
-        .setDstAccessMask(vk::AccessFlagBits::eTransferWrite);
-    srcStage = vk::PipelineStageFlagBits::eTopOfPipe;
-    dstStage = vk::PipelineStageFlagBits::eTransfer;
-  } else if (oldLayout == vk::ImageLayout::eTransferDstOptimal &&
-             newLayout == vk::ImageLayout::eReadOnlyOptimal) {
-    barrier.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
-        .setDstAccessMask(vk::AccessFlagBits::eShaderRead);
-    srcStage = vk::PipelineStageFlagBits::eTransfer;
-    dstStage = vk::PipelineStageFlagBits::eFragmentShader;
-  } else {
-    LOG_ERROR("Unsupport layout transition.");
-    throw std::runtime_error("Unsupport layout transition.");
-  }
-
-  vkCommandBuffer.pipelineBarrier(srcStage, dstStage,
-                                  NullFlag<vk::DependencyFlags>(), 0, nullptr,
-                                  0, nullptr, 1, &barrier);
-
-  rhi->endOneTimeCommandBuffer(commandBuffer.get());
-}
-
-void VulkanUtils::copyBufferToImage(class RHI* rhi,
-                                    vk::Buffer buffer,
-                                    vk::Image image,
-                                    uint32_t width,
-                                    uint32_t height) {
-  auto commandBuffer = rhi->beginOneTimeCommandBuffer();
-  auto vkCommandBuffer = GetResource<VulkanCommandBuffer>(commandBuffer.get());
-
-  auto region = vk::BufferImageCopy()
-                    .setBufferOffset(0)
-                    .setBufferRowLength(0)
-                    .setBufferImageHeight(0)
-                    .setImageSubresource(
-                        vk::ImageSubresourceLayers()
-                            .setAspectMask(vk::ImageAspectFlagBits::eColor)
-                            .setMipLevel(0)
-                            .setBaseArrayLayer(0)
-                            .setLayerCount(1))
-                    .setImageOffset({0, 0, 0})
-                    .setImageExtent(vk::Extent3D{width, height, 1});
-  vkCommandBuffer.copyBufferToImage(
-      buffer, image, vk::ImageLayout::eTransferDstOptimal, 1, &region);
-
-  rhi->endOneTimeCommandBuffer(commandBuffer.get());
-}
-
 vk::ImageView VulkanUtils::createImageView(vk::Device device,
                                            vk::Image& image,
                                            vk::Format format,
@@ -72,16 +72,6 @@ class VulkanUtils {
   static uint32_t findMemoryType(vk::PhysicalDevice physicalDevice,
                                  uint32_t typeFilter,
                                  vk::MemoryPropertyFlags memoryPropertyFlags);
-  static void transitionImageLayout(class RHI* rhi,
-                                    vk::Image image,
-                                    vk::Format format,
-                                    vk::ImageLayout oldLayout,
-                                    vk::ImageLayout newLayout);
-  static void copyBufferToImage(class RHI* rhi,
-                                vk::Buffer buffer,
-                                vk::Image image,
-                                uint32_t width,
-                                uint32_t height);
 };
 
 }  // namespace Sparrow
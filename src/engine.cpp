@@ -14,6 +14,14 @@ void Engine::startEngine() {
   mainLoop();
 }
 
+void Engine::runBenchmarks() {
+  gContext.initialize();
+  gContext.renderSystem->waitForNextFrame();
+  gContext.windowSystem->pollEvents();
+  tick(calcOneFrameDeltaTime());
+  gContext.renderSystem->runBenchmarks();
+}
+
 void Engine::tick(float deltaTime) {
   logicalTick(deltaTime);
   renderTick(deltaTime);
@@ -33,8 +41,11 @@ float Engine::calcOneFrameDeltaTime() const {
 
 void Engine::mainLoop() {
   while (!gContext.windowSystem->shouldClose()) {
-    tick(calcOneFrameDeltaTime());
+    // Waiting for the GPU before polling keeps the input the frame is
+    // recorded from as fresh as possible.
+    gContext.renderSystem->waitForNextFrame();
     gContext.windowSystem->pollEvents();
+    tick(calcOneFrameDeltaTime());
   }
 }
 
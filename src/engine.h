@@ -9,6 +9,9 @@ namespace Sparrow {
 class Engine {
  public:
   void startEngine();
+  // Renders one frame and runs the renderer's benchmarks on it instead of
+  // the main loop.
+  void runBenchmarks();
   void tick(float deltaTime);
   void shutdown();
 
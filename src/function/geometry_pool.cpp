@@ -0,0 +1,251 @@
+#include "geometry_pool.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include "RHI/rhi.h"
+#include "utils/log.h"
+
+namespace Sparrow {
+
+void GeometryPool::initialize(const GeometryPoolInitInfo& initInfo) {
+  rhi = initInfo.rhi;
+  vertexStride = initInfo.vertexStride;
+  indexType = initInfo.indexType;
+  indexSize =
+      indexType == RHIIndexType::Uint16 ? sizeof(uint16_t) : sizeof(uint32_t);
+  vertexAllocator.reset(0);
+  indexAllocator.reset(0);
+  rebuild(std::max(initInfo.vertexCapacity, 1U),
+          std::max(initInfo.indexCapacity, 1U));
+}
+
+GeometryHandle GeometryPool::allocate(std::span<const std::byte> vertexData,
+                                      std::span<const uint32_t> indices) {
+  const auto vertexCount =
+      static_cast<uint32_t>(vertexData.size() / vertexStride);
+  const auto indexCount = static_cast<uint32_t>(indices.size());
+  if (vertexCount == 0 || indexCount == 0) {
+    LOG_ERROR("GeometryPool::allocate empty mesh.");
+    return InvalidHandle;
+  }
+  if (indexType == RHIIndexType::Uint16 &&
+      vertexCount > std::numeric_limits<uint16_t>::max()) {
+    LOG_ERROR_FMT("GeometryPool::allocate {} vertices exceed 16-bit indices.",
+                  vertexCount);
+    return InvalidHandle;
+  }
+
+  auto vertexOffset = vertexAllocator.allocate(vertexCount);
+  auto firstIndex = indexAllocator.allocate(indexCount);
+  if (vertexOffset == RangeAllocator::InvalidOffset ||
+      firstIndex == RangeAllocator::InvalidOffset) {
+    if (vertexOffset != RangeAllocator::InvalidOffset) {
+      vertexAllocator.free(vertexOffset);
+    }
+    if (firstIndex != RangeAllocator::InvalidOffset) {
+      indexAllocator.free(firstIndex);
+    }
+    auto newVertexCapacity = vertexAllocator.getCapacity();
+    while (newVertexCapacity - vertexAllocator.getUsedSize() < vertexCount) {
+      newVertexCapacity *= 2;
+    }
+    auto newIndexCapacity = indexAllocator.getCapacity();
+    while (newIndexCapacity - indexAllocator.getUsedSize() < indexCount) {
+      newIndexCapacity *= 2;
+    }
+    // Compacted, so the free space is one range at the end.
+    rebuild(newVertexCapacity, newIndexCapacity);
+    vertexOffset = vertexAllocator.allocate(vertexCount);
+    firstIndex = indexAllocator.allocate(indexCount);
+  }
+
+  upload(vertexBuffer.get(),
+         static_cast<RHIDeviceSize>(vertexOffset) * vertexStride,
+         vertexData.first(static_cast<size_t>(vertexCount) * vertexStride));
+  const auto indexBufferOffset =
+      static_cast<RHIDeviceSize>(firstIndex) * indexSize;
+  if (indexType == RHIIndexType::Uint16) {
+    std::vector<uint16_t> narrowIndices(indices.begin(), indices.end());
+    upload(indexBuffer.get(), indexBufferOffset,
+           std::as_bytes(std::span(narrowIndices)));
+  } else {
+    upload(indexBuffer.get(), indexBufferOffset, std::as_bytes(indices));
+  }
+
+  GeometryHandle handle;
+  if (freeHandles.empty()) {
+    handle = static_cast<GeometryHandle>(allocations.size());
+    allocations.emplace_back();
+    allocationsAlive.push_back(true);
+  } else {
+    handle = freeHandles.back();
+    freeHandles.pop_back();
+    allocationsAlive[handle] = true;
+  }
+  allocations[handle] = GeometryAllocation{
+      .vertexOffset = static_cast<int32_t>(vertexOffset),
+      .vertexCount = vertexCount,
+      .firstIndex = firstIndex,
+      .indexCount = indexCount,
+  };
+  return handle;
+}
+
+void GeometryPool::free(GeometryHandle handle) {
+  if (handle >= allocations.size() || !allocationsAlive[handle]) {
+    return;
+  }
+  const auto& allocation = allocations[handle];
+  vertexAllocator.free(static_cast<uint32_t>(allocation.vertexOffset));
+  indexAllocator.free(allocation.firstIndex);
+  allocationsAlive[handle] = false;
+  freeHandles.push_back(handle);
+}
+
+void GeometryPool::compact() {
+  if (vertexAllocator.isCompact() && indexAllocator.isCompact()) {
+    return;
+  }
+  rebuild(vertexAllocator.getCapacity(), indexAllocator.getCapacity());
+}
+
+void GeometryPool::bind(RHICommandBuffer* commandBuffer) {
+  RHIBuffer* vertexBuffers[] = {vertexBuffer.get()};
+  RHIDeviceSize offsets[] = {0};
+  rhi->cmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+  rhi->cmdBindIndexBuffer(commandBuffer, indexBuffer.get(), 0, indexType);
+}
+
+GeometryPoolStatistics GeometryPool::getStatistics() const {
+  return GeometryPoolStatistics{
+      .meshCount = vertexAllocator.getAllocationCount(),
+      .usedVertices = vertexAllocator.getUsedSize(),
+      .vertexCapacity = vertexAllocator.getCapacity(),
+      .vertexFreeRanges = vertexAllocator.getFreeRangeCount(),
+      .usedIndices = indexAllocator.getUsedSize(),
+      .indexCapacity = indexAllocator.getCapacity(),
+      .indexFreeRanges = indexAllocator.getFreeRangeCount(),
+  };
+}
+
+void GeometryPool::rebuild(uint32_t newVertexCapacity,
+                           uint32_t newIndexCapacity) {
+  auto [newVertexBuffer, newVertexBufferMemory] = rhi->createBuffer(
+      RHIBufferCreateInfo{
+          .size = static_cast<RHIDeviceSize>(newVertexCapacity) * vertexStride,
+          .usage = RHIBufferUsageFlag::VertexBuffer |
+                   RHIBufferUsageFlag::TransferDst |
+                   RHIBufferUsageFlag::TransferSrc,
+          .sharingMode = RHISharingMode::Exclusive,
+      },
+      RHIMemoryPropertyFlag::DeviceLocal);
+  auto [newIndexBuffer, newIndexBufferMemory] = rhi->createBuffer(
+      RHIBufferCreateInfo{
+          .size = static_cast<RHIDeviceSize>(newIndexCapacity) * indexSize,
+          .usage = RHIBufferUsageFlag::IndexBuffer |
+                   RHIBufferUsageFlag::TransferDst |
+                   RHIBufferUsageFlag::TransferSrc,
+          .sharingMode = RHISharingMode::Exclusive,
+      },
+      RHIMemoryPropertyFlag::DeviceLocal);
+
+  // Live meshes are packed in their current order, so the copies read
+  // and write disjoint ranges of different buffers.
+  std::vector<GeometryHandle> liveHandles;
+  for (auto handle = 0U; handle < allocations.size(); handle++) {
+    if (allocationsAlive[handle]) {
+      liveHandles.push_back(handle);
+    }
+  }
+  std::sort(liveHandles.begin(), liveHandles.end(),
+            [this](GeometryHandle a, GeometryHandle b) {
+              return allocations[a].firstIndex < allocations[b].firstIndex;
+            });
+
+  vertexAllocator.reset(newVertexCapacity);
+  indexAllocator.reset(newIndexCapacity);
+  std::vector<RHIBufferCopy> vertexCopies, indexCopies;
+  for (auto handle : liveHandles) {
+    auto& allocation = allocations[handle];
+    const auto vertexOffset = vertexAllocator.allocate(allocation.vertexCount);
+    const auto firstIndex = indexAllocator.allocate(allocation.indexCount);
+    const auto stride = static_cast<RHIDeviceSize>(vertexStride);
+    const auto oldVertexOffset =
+        static_cast<RHIDeviceSize>(allocation.vertexOffset);
+    vertexCopies.push_back(RHIBufferCopy{
+        .srcOffset = oldVertexOffset * stride,
+        .dstOffset = vertexOffset * stride,
+        .size = allocation.vertexCount * stride,
+    });
+    const auto size = static_cast<RHIDeviceSize>(indexSize);
+    indexCopies.push_back(RHIBufferCopy{
+        .srcOffset = allocation.firstIndex * size,
+        .dstOffset = firstIndex * size,
+        .size = allocation.indexCount * size,
+    });
+    allocation.vertexOffset = static_cast<int32_t>(vertexOffset);
+    allocation.firstIndex = firstIndex;
+  }
+
+  if (!liveHandles.empty()) {
+    auto oneTimeCommandBuffer = rhi->beginOneTimeCommandBuffer();
+    rhi->cmdCopyBuffer(oneTimeCommandBuffer.get(), vertexBuffer.get(),
+                       newVertexBuffer.get(), vertexCopies);
+    rhi->cmdCopyBuffer(oneTimeCommandBuffer.get(), indexBuffer.get(),
+                       newIndexBuffer.get(), indexCopies);
+    rhi->endOneTimeCommandBuffer(oneTimeCommandBuffer.get());
+  }
+  // Frames in flight may still have the old buffers bound.
+  if (vertexBuffer) {
+    std::shared_ptr<RHIBuffer> oldVertexBuffer = std::move(vertexBuffer);
+    std::shared_ptr<RHIDeviceMemory> oldVertexBufferMemory =
+        std::move(vertexBufferMemory);
+    std::shared_ptr<RHIBuffer> oldIndexBuffer = std::move(indexBuffer);
+    std::shared_ptr<RHIDeviceMemory> oldIndexBufferMemory =
+        std::move(indexBufferMemory);
+    rhi->deferRelease([rhi = rhi.get(), oldVertexBuffer,
+                       oldVertexBufferMemory, oldIndexBuffer,
+                       oldIndexBufferMemory] {
+      rhi->destoryBuffer(oldVertexBuffer.get());
+      rhi->freeMemory(oldVertexBufferMemory.get());
+      rhi->destoryBuffer(oldIndexBuffer.get());
+      rhi->freeMemory(oldIndexBufferMemory.get());
+    });
+  }
+
+  vertexBuffer = std::move(newVertexBuffer);
+  vertexBufferMemory = std::move(newVertexBufferMemory);
+  indexBuffer = std::move(newIndexBuffer);
+  indexBufferMemory = std::move(newIndexBufferMemory);
+  generation++;
+}
+
+void GeometryPool::upload(RHIBuffer* buffer,
+                          RHIDeviceSize offset,
+                          std::span<const std::byte> data) {
+  auto stagingBufferCreateInfo = RHIBufferCreateInfo{
+      .size = data.size(),
+      .usage = RHIBufferUsageFlag::TransferSrc,
+      .sharingMode = RHISharingMode::Exclusive,
+  };
+  auto [stagingBuffer, stagingBufferMemory] = rhi->createBuffer(
+      stagingBufferCreateInfo,
+      RHIMemoryPropertyFlag::HostVisible | RHIMemoryPropertyFlag::HostCoherent);
+  auto stagingBufferMappedMemory = rhi->mapMemory(stagingBufferMemory.get(), 0,
+                                                  stagingBufferCreateInfo.size);
+  std::memcpy(stagingBufferMappedMemory, data.data(), data.size());
+  rhi->unmapMemory(stagingBufferMemory.get());
+
+  auto copyRegion = RHIBufferCopy{.srcOffset = 0,
+                                  .dstOffset = offset,
+                                  .size = stagingBufferCreateInfo.size};
+
+  auto oneTimeCommandBuffer = rhi->beginOneTimeCommandBuffer();
+  rhi->cmdCopyBuffer(oneTimeCommandBuffer.get(), stagingBuffer.get(), buffer,
+                     {&copyRegion, 1});
+  rhi->endOneTimeCommandBuffer(oneTimeCommandBuffer.get());
+  rhi->destoryBuffer(stagingBuffer.get());
+  rhi->freeMemory(stagingBufferMemory.get());
+}
+
+}  // namespace Sparrow
@@ -0,0 +1,105 @@
+#ifndef SPARROWENGINE_GEOMETRY_POOL_H
+#define SPARROWENGINE_GEOMETRY_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <span>
+#include <vector>
+#include "RHI/rhi_struct.h"
+#include "utils/range_allocator.h"
+
+namespace Sparrow {
+class RHI;
+
+struct GeometryPoolInitInfo {
+  std::shared_ptr<RHI> rhi;
+  uint32_t vertexStride = 0;
+  // Indices are local to their mesh, so 16-bit indices work for any pool
+  // size as long as each mesh has fewer than 65535 vertices. One type
+  // serves the whole pool, a mesh cooked with a narrower one is widened
+  // and a mesh needing a wider one is rejected.
+  RHIIndexType indexType = RHIIndexType::Uint32;
+  // Initial capacities, the pool grows by doubling.
+  uint32_t vertexCapacity = 1 << 16;
+  uint32_t indexCapacity = 1 << 18;
+};
+
+using GeometryHandle = uint32_t;
+
+// Where a mesh lives in the pool, to be used as a draw's vertexOffset and
+// firstIndex.
+struct GeometryAllocation {
+  int32_t vertexOffset = 0;
+  uint32_t vertexCount = 0;
+  uint32_t firstIndex = 0;
+  uint32_t indexCount = 0;
+};
+
+struct GeometryPoolStatistics {
+  uint32_t meshCount = 0;
+  uint32_t usedVertices = 0;
+  uint32_t vertexCapacity = 0;
+  uint32_t vertexFreeRanges = 0;
+  uint32_t usedIndices = 0;
+  uint32_t indexCapacity = 0;
+  uint32_t indexFreeRanges = 0;
+};
+
+// One vertex buffer and one index buffer shared by every mesh, so a frame
+// binds geometry once and any draw, direct or indirect, only differs in
+// its vertexOffset and firstIndex. Ranges come from a free-list allocator.
+// When an allocation does not fit, the pool is rebuilt larger, which also
+// compacts it. Rebuilding moves meshes, callers compare `getGeneration`
+// to know when to refresh the allocations they copied.
+class GeometryPool {
+ public:
+  static constexpr GeometryHandle InvalidHandle =
+      std::numeric_limits<GeometryHandle>::max();
+
+  void initialize(const GeometryPoolInitInfo& initInfo);
+
+  // Uploads a mesh, `vertexData` holding whole vertices of the pool's
+  // stride. Returns InvalidHandle if its indices do not fit the index type.
+  GeometryHandle allocate(std::span<const std::byte> vertexData,
+                          std::span<const uint32_t> indices);
+  void free(GeometryHandle handle);
+  const GeometryAllocation& getAllocation(GeometryHandle handle) const {
+    return allocations[handle];
+  }
+
+  // Moves every mesh to the front of the buffers, in their current order.
+  // Waits for the GPU, must not be called while recording a frame.
+  void compact();
+
+  void bind(RHICommandBuffer* commandBuffer);
+
+  RHIIndexType getIndexType() const { return indexType; }
+  uint32_t getGeneration() const { return generation; }
+  GeometryPoolStatistics getStatistics() const;
+
+ private:
+  void rebuild(uint32_t newVertexCapacity, uint32_t newIndexCapacity);
+  void upload(RHIBuffer* buffer,
+              RHIDeviceSize offset,
+              std::span<const std::byte> data);
+
+  std::shared_ptr<RHI> rhi;
+  uint32_t vertexStride = 0;
+  RHIIndexType indexType = RHIIndexType::Uint32;
+  uint32_t indexSize = sizeof(uint32_t);
+  uint32_t generation = 0;
+
+  std::unique_ptr<RHIBuffer> vertexBuffer, indexBuffer;
+  std::unique_ptr<RHIDeviceMemory> vertexBufferMemory, indexBufferMemory;
+  RangeAllocator vertexAllocator, indexAllocator;
+
+  std::vector<GeometryAllocation> allocations;
+  std::vector<bool> allocationsAlive;
+  std::vector<GeometryHandle> freeHandles;
+};
+
+}  // namespace Sparrow
+
+#endif  // SPARROWENGINE_GEOMETRY_POOL_H
@@ -0,0 +1,424 @@
+#include "mesh_lod.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+
+namespace Sparrow {
+
+namespace {
+// Boundary edges get a plane perpendicular to their triangle, weighted this
+// much more than surface planes so open borders do not shrink.
+constexpr double BorderWeight = 10.0;
+// Levels that keep more than this share of their parent's triangles are
+// not worth a separate index range.
+constexpr float MinReduction = 0.9f;
+
+struct Quadric {
+  double a2 = 0.0, ab = 0.0, ac = 0.0, ad = 0.0;
+  double b2 = 0.0, bc = 0.0, bd = 0.0;
+  double c2 = 0.0, cd = 0.0;
+  double d2 = 0.0;
+
+  static Quadric fromPlane(const glm::dvec3& normal,
+                           double distance,
+                           double weight) {
+    const auto a = normal.x, b = normal.y, c = normal.z, d = distance;
+    return Quadric{
+        .a2 = weight * a * a, .ab = weight * a * b, .ac = weight * a * c,
+        .ad = weight * a * d, .b2 = weight * b * b, .bc = weight * b * c,
+        .bd = weight * b * d, .c2 = weight * c * c, .cd = weight * c * d,
+        .d2 = weight * d * d,
+    };
+  }
+
+  Quadric& operator+=(const Quadric& other) {
+    a2 += other.a2, ab += other.ab, ac += other.ac, ad += other.ad;
+    b2 += other.b2, bc += other.bc, bd += other.bd;
+    c2 += other.c2, cd += other.cd;
+    d2 += other.d2;
+    return *this;
+  }
+
+  // Sum of weighted squared distances from `p` to the accumulated planes.
+  double evaluate(const glm::dvec3& p) const {
+    const auto x = p.x, y = p.y, z = p.z;
+    const auto error = a2 * x * x + 2.0 * ab * x * y + 2.0 * ac * x * z +
+                       2.0 * ad * x + b2 * y * y + 2.0 * bc * y * z +
+                       2.0 * bd * y + c2 * z * z + 2.0 * cd * z + d2;
+    return std::max(error, 0.0);
+  }
+};
+
+struct Collapse {
+  uint32_t from;
+  uint32_t to;
+  double cost;
+};
+
+uint64_t edgeKey(uint32_t a, uint32_t b) {
+  return (static_cast<uint64_t>(a) << 32) | b;
+}
+
+class MeshSimplifier {
+ public:
+  MeshSimplifier(std::span<const Vertex> vertices,
+                 std::span<const uint32_t> indices,
+                 const MeshLODSettings& settings)
+      : vertices(vertices), settings(settings) {
+    buildPositionRemap();
+
+    auto boundsMin = glm::vec3(std::numeric_limits<float>::max());
+    auto boundsMax = glm::vec3(std::numeric_limits<float>::lowest());
+    for (const auto& vertex : vertices) {
+      boundsMin = glm::min(boundsMin, vertex.position);
+      boundsMax = glm::max(boundsMax, vertex.position);
+    }
+    extent = vertices.empty() ? 0.0f : glm::distance(boundsMin, boundsMax);
+
+    buildQuadrics(indices);
+  }
+
+  float getExtent() const { return extent; }
+
+  // Collapses edges of `indices` in place until at most `targetTriangles`
+  // remain or the next collapse would exceed `maxError`. Returns the
+  // largest error reached, quadrics keep accumulating across calls so the
+  // error is relative to the original mesh.
+  float simplify(std::vector<uint32_t>& indices,
+                 size_t targetTriangles,
+                 float maxError) {
+    const auto maxCost = static_cast<double>(maxError) * maxError;
+    while (indices.size() / 3 > targetTriangles) {
+      const auto collapsed = collapsePass(indices, targetTriangles, maxCost);
+      removeDegenerateTriangles(indices);
+      if (!collapsed) {
+        break;
+      }
+    }
+    return static_cast<float>(std::sqrt(reachedCost));
+  }
+
+ private:
+  void buildPositionRemap() {
+    std::unordered_map<uint64_t, uint32_t> firstVertexAtPosition;
+    positionRemap.resize(vertices.size());
+    seams.assign(vertices.size(), false);
+
+    auto hashPosition = [](const glm::vec3& p) {
+      auto hash = static_cast<uint64_t>(std::bit_cast<uint32_t>(p.x));
+      hash = hash * 0x9E3779B97F4A7C15ULL ^ std::bit_cast<uint32_t>(p.y);
+      hash = hash * 0x9E3779B97F4A7C15ULL ^ std::bit_cast<uint32_t>(p.z);
+      return hash;
+    };
+    for (auto i = 0U; i < vertices.size(); i++) {
+      const auto& position = vertices[i].position;
+      auto key = hashPosition(position);
+      // Linear probing over hash collisions between different positions.
+      while (true) {
+        auto [it, inserted] = firstVertexAtPosition.try_emplace(key, i);
+        if (inserted || vertices[it->second].position == position) {
+          positionRemap[i] = it->second;
+          break;
+        }
+        key++;
+      }
+      if (positionRemap[i] != i) {
+        seams[i] = true;
+        seams[positionRemap[i]] = true;
+      }
+    }
+  }
+
+  void buildQuadrics(std::span<const uint32_t> indices) {
+    quadrics.assign(vertices.size(), Quadric{});
+
+    std::unordered_map<uint64_t, uint32_t> directedEdges;
+    for (auto i = 0U; i + 2 < indices.size(); i += 3) {
+      for (auto k = 0; k < 3; k++) {
+        const auto a = positionRemap[indices[i + k]];
+        const auto b = positionRemap[indices[i + (k + 1) % 3]];
+        directedEdges[edgeKey(a, b)]++;
+      }
+    }
+
+    for (auto i = 0U; i + 2 < indices.size(); i += 3) {
+      const uint32_t triangle[3] = {positionRemap[indices[i]],
+                                    positionRemap[indices[i + 1]],
+                                    positionRemap[indices[i + 2]]};
+      const auto p0 = glm::dvec3(vertices[triangle[0]].position);
+      const auto p1 = glm::dvec3(vertices[triangle[1]].position);
+      const auto p2 = glm::dvec3(vertices[triangle[2]].position);
+      const auto crossProduct = glm::cross(p1 - p0, p2 - p0);
+      const auto doubleArea = glm::length(crossProduct);
+      if (doubleArea == 0.0) {
+        continue;
+      }
+      const auto normal = crossProduct / doubleArea;
+      const auto plane =
+          Quadric::fromPlane(normal, -glm::dot(normal, p0), doubleArea * 0.5);
+      for (auto vertex : triangle) {
+        quadrics[vertex] += plane;
+      }
+
+      for (auto k = 0; k < 3; k++) {
+        const auto a = triangle[k];
+        const auto b = triangle[(k + 1) % 3];
+        if (directedEdges.contains(edgeKey(b, a))) {
+          continue;
+        }
+        const auto pa = glm::dvec3(vertices[a].position);
+        const auto edge = glm::dvec3(vertices[b].position) - pa;
+        const auto edgeLength = glm::length(edge);
+        if (edgeLength == 0.0) {
+          continue;
+        }
+        const auto borderNormal = glm::normalize(glm::cross(edge, normal));
+        const auto borderPlane =
+            Quadric::fromPlane(borderNormal, -glm::dot(borderNormal, pa),
+                               BorderWeight * edgeLength * edgeLength);
+        quadrics[a] += borderPlane;
+        quadrics[b] += borderPlane;
+      }
+    }
+  }
+
+  double attributeCost(uint32_t from, uint32_t to) const {
+    const auto& a = vertices[from];
+    const auto& b = vertices[to];
+    const auto colorDistance = glm::dot(a.color - b.color, a.color - b.color);
+    const auto texCoordDistance =
+        glm::dot(a.texCoord - b.texCoord, a.texCoord - b.texCoord);
+    const auto normalDistance =
+        glm::dot(a.normal - b.normal, a.normal - b.normal);
+    return static_cast<double>(settings.attributeWeight) * extent * extent *
+           (colorDistance + texCoordDistance + normalDistance);
+  }
+
+  bool collapsePass(std::vector<uint32_t>& indices,
+                    size_t targetTriangles,
+                    double maxCost) {
+    const auto triangleCount = indices.size() / 3;
+
+    // Triangles around each vertex.
+    std::vector<uint32_t> triangleOffsets(vertices.size() + 1, 0);
+    for (auto index : indices) {
+      triangleOffsets[index + 1]++;
+    }
+    for (auto i = 0U; i < vertices.size(); i++) {
+      triangleOffsets[i + 1] += triangleOffsets[i];
+    }
+    std::vector<uint32_t> vertexTriangles(indices.size());
+    auto fill = std::vector<uint32_t>(triangleOffsets.begin(),
+                                      triangleOffsets.end() - 1);
+    for (auto i = 0U; i < indices.size(); i++) {
+      vertexTriangles[fill[indices[i]]++] = i / 3;
+    }
+
+    // Border edges of the current mesh, on positions.
+    std::unordered_map<uint64_t, uint32_t> directedEdges;
+    for (auto i = 0U; i < indices.size(); i += 3) {
+      for (auto k = 0; k < 3; k++) {
+        directedEdges[edgeKey(positionRemap[indices[i + k]],
+                              positionRemap[indices[i + (k + 1) % 3]])]++;
+      }
+    }
+    auto isBorderEdge = [&](uint32_t a, uint32_t b) {
+      return !directedEdges.contains(
+          edgeKey(positionRemap[b], positionRemap[a]));
+    };
+    std::vector<bool> borders(vertices.size(), false);
+    for (auto i = 0U; i < indices.size(); i += 3) {
+      for (auto k = 0; k < 3; k++) {
+        const auto a = indices[i + k];
+        const auto b = indices[i + (k + 1) % 3];
+        if (isBorderEdge(a, b)) {
+          borders[a] = borders[b] = true;
+        }
+      }
+    }
+
+    std::vector<Collapse> candidates;
+    candidates.reserve(indices.size() * 2);
+    for (auto i = 0U; i < indices.size(); i += 3) {
+      for (auto k = 0; k < 3; k++) {
+        const auto a = indices[i + k];
+        const auto b = indices[i + (k + 1) % 3];
+        for (auto [from, to] : {std::pair(a, b), std::pair(b, a)}) {
+          // Seam vertices carry the attribute discontinuities, border
+          // vertices may only slide along the border.
+          if (seams[from] || positionRemap[from] == positionRemap[to]) {
+            continue;
+          }
+          if (borders[from] && !isBorderEdge(a, b)) {
+            continue;
+          }
+          const auto cost =
+              quadrics[positionRemap[from]].evaluate(
+                  glm::dvec3(vertices[to].position)) +
+              attributeCost(from, to);
+          candidates.push_back(Collapse{from, to, cost});
+        }
+      }
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [](const Collapse& a, const Collapse& b) {
+                return a.cost < b.cost;
+              });
+
+    std::vector<bool> lockedThisPass(vertices.size(), false);
+    auto remainingTriangles = triangleCount;
+    auto collapsed = false;
+    for (const auto& candidate : candidates) {
+      if (remainingTriangles <= targetTriangles || candidate.cost > maxCost) {
+        break;
+      }
+      const auto from = candidate.from;
+      const auto to = candidate.to;
+      if (lockedThisPass[from] || lockedThisPass[to]) {
+        continue;
+      }
+
+      auto removedTriangles = 0U;
+      auto flips = false;
+      for (auto t = triangleOffsets[from]; t < triangleOffsets[from + 1];
+           t++) {
+        const auto triangle = vertexTriangles[t] * 3;
+        const auto* corners = &indices[triangle];
+        if (corners[0] == to || corners[1] == to || corners[2] == to) {
+          removedTriangles++;
+          continue;
+        }
+        glm::vec3 before[3], after[3];
+        for (auto k = 0; k < 3; k++) {
+          before[k] = vertices[corners[k]].position;
+          after[k] = corners[k] == from ? vertices[to].position : before[k];
+        }
+        const auto normalBefore =
+            glm::cross(before[1] - before[0], before[2] - before[0]);
+        const auto normalAfter =
+            glm::cross(after[1] - after[0], after[2] - after[0]);
+        if (glm::dot(normalBefore, normalAfter) <= 0.0f) {
+          flips = true;
+          break;
+        }
+      }
+      if (flips || removedTriangles == 0) {
+        continue;
+      }
+
+      // Everything around the collapse is frozen until the next pass, so
+      // the flip test above sees final positions.
+      for (auto t = triangleOffsets[from]; t < triangleOffsets[from + 1];
+           t++) {
+        const auto triangle = vertexTriangles[t] * 3;
+        for (auto k = 0; k < 3; k++) {
+          lockedThisPass[indices[triangle + k]] = true;
+        }
+      }
+      for (auto t = triangleOffsets[from]; t < triangleOffsets[from + 1];
+           t++) {
+        auto triangle = vertexTriangles[t] * 3;
+        for (auto k = 0; k < 3; k++) {
+          if (indices[triangle + k] == from) {
+            indices[triangle + k] = to;
+          }
+        }
+      }
+      quadrics[positionRemap[to]] += quadrics[positionRemap[from]];
+      reachedCost = std::max(reachedCost, candidate.cost);
+      remainingTriangles -= removedTriangles;
+      collapsed = true;
+    }
+    return collapsed;
+  }
+
+  static void removeDegenerateTriangles(std::vector<uint32_t>& indices) {
+    auto write = 0U;
+    for (auto read = 0U; read + 2 < indices.size(); read += 3) {
+      const auto a = indices[read], b = indices[read + 1],
+                 c = indices[read + 2];
+      if (a == b || b == c || c == a) {
+        continue;
+      }
+      indices[write++] = a;
+      indices[write++] = b;
+      indices[write++] = c;
+    }
+    indices.resize(write);
+  }
+
+  std::span<const Vertex> vertices;
+  const MeshLODSettings& settings;
+  float extent = 0.0f;
+  double reachedCost = 0.0;
+  // First vertex sharing each vertex's position.
+  std::vector<uint32_t> positionRemap;
+  std::vector<bool> seams;
+  // Indexed by remapped position.
+  std::vector<Quadric> quadrics;
+};
+}  // namespace
+
+MeshLODChain generateMeshLODChain(std::span<const Vertex> vertices,
+                                  std::span<const uint32_t> indices,
+                                  const MeshLODSettings& settings) {
+  auto chain = MeshLODChain{};
+  chain.indices.emplace_back(indices.begin(), indices.end());
+  chain.errors.push_back(0.0f);
+  if (vertices.empty() || indices.size() < 3) {
+    return chain;
+  }
+
+  auto simplifier = MeshSimplifier(vertices, indices, settings);
+  const auto maxError = settings.maxError * simplifier.getExtent();
+  while (chain.indices.size() < settings.maxLODCount) {
+    const auto& previous = chain.indices.back();
+    const auto previousTriangles = previous.size() / 3;
+    const auto targetTriangles = static_cast<size_t>(
+        static_cast<float>(previousTriangles) * settings.reductionRatio);
+
+    auto lodIndices = previous;
+    const auto error =
+        simplifier.simplify(lodIndices, targetTriangles, maxError);
+    const auto triangles = lodIndices.size() / 3;
+    if (triangles == 0 ||
+        static_cast<float>(triangles) >
+            static_cast<float>(previousTriangles) * MinReduction) {
+      break;
+    }
+    chain.indices.push_back(std::move(lodIndices));
+    chain.errors.push_back(std::max(error, chain.errors.back()));
+  }
+  return chain;
+}
+
+uint32_t selectMeshLOD(std::span<const MeshLOD> lods,
+                       float pixelsPerUnit,
+                       uint32_t currentLOD,
+                       const MeshLODSelectionSettings& settings) {
+  if (lods.empty()) {
+    return 0;
+  }
+  const auto lastLOD = static_cast<uint32_t>(lods.size() - 1);
+  currentLOD = std::min(currentLOD, lastLOD);
+
+  // Errors grow with the level, so the coarsest level under a threshold is
+  // found by walking up from the finest.
+  auto coarsestBelow = [&](float threshold, uint32_t from) {
+    auto lod = from;
+    while (lod < lastLOD && lods[lod + 1].error * pixelsPerUnit <= threshold) {
+      lod++;
+    }
+    return lod;
+  };
+
+  if (lods[currentLOD].error * pixelsPerUnit > settings.errorThreshold) {
+    return coarsestBelow(settings.errorThreshold, 0);
+  }
+  return coarsestBelow(settings.errorThreshold * (1.0f - settings.hysteresis),
+                       currentLOD);
+}
+
+}  // namespace Sparrow
@@ -0,0 +1,54 @@
+#ifndef SPARROWENGINE_MESH_LOD_H
+#define SPARROWENGINE_MESH_LOD_H
+
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "render_mesh.h"
+
+namespace Sparrow {
+
+struct MeshLODSettings {
+  uint32_t maxLODCount = 6;
+  // Triangle count of each level relative to the previous one.
+  float reductionRatio = 0.5f;
+  // Largest error allowed for any level, relative to the mesh's bounding
+  // box diagonal.
+  float maxError = 0.05f;
+  // Weight of color, texture coordinate and normal changes against the
+  // geometric error, both measured relative to the mesh size.
+  float attributeWeight = 1.0f;
+};
+
+struct MeshLODSelectionSettings {
+  // Largest projected geometric error, in pixels, that is accepted.
+  float errorThreshold = 1.0f;
+  // Switching to a coarser level needs the error to drop this fraction
+  // below the threshold, so objects near a boundary do not flicker.
+  float hysteresis = 0.25f;
+};
+
+struct MeshLODChain {
+  // LOD 0 first. All levels index the same vertex buffer.
+  std::vector<std::vector<uint32_t>> indices;
+  // Object-space error of each level, non-decreasing.
+  std::vector<float> errors;
+};
+
+// Simplifies a triangle list by quadric error half-edge collapse. Vertices
+// are only ever removed, never moved or blended, and vertices on attribute
+// seams are kept, so colors and texture coordinates survive every level.
+MeshLODChain generateMeshLODChain(std::span<const Vertex> vertices,
+                                  std::span<const uint32_t> indices,
+                                  const MeshLODSettings& settings = {});
+
+// Picks the level for an object whose error of one object-space unit spans
+// `pixelsPerUnit` pixels on screen, given the level it used last frame.
+uint32_t selectMeshLOD(std::span<const MeshLOD> lods,
+                       float pixelsPerUnit,
+                       uint32_t currentLOD,
+                       const MeshLODSelectionSettings& settings = {});
+
+}  // namespace Sparrow
+
+#endif  // SPARROWENGINE_MESH_LOD_H
@@ -0,0 +1,324 @@
+#include "mesh_optimizer.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+
+namespace Sparrow {
+
+namespace {
+constexpr uint32_t InvalidIndex = std::numeric_limits<uint32_t>::max();
+
+// Forsyth's scoring parameters, the cache being modeled as LRU.
+constexpr uint32_t MaxCacheSize = 32;
+constexpr float CacheDecayPower = 1.5f;
+constexpr float LastTriangleScore = 0.75f;
+constexpr float ValenceBoostScale = 2.0f;
+constexpr float ValenceBoostPower = 0.5f;
+
+float computeVertexScore(int32_t cachePosition, uint32_t remainingTriangles) {
+  if (remainingTriangles == 0) {
+    return -1.0f;
+  }
+  auto score = 0.0f;
+  if (cachePosition >= 0) {
+    if (cachePosition < 3) {
+      // Vertices of the triangle just emitted, using them again does not
+      // help as much as the decay would suggest.
+      score = LastTriangleScore;
+    } else {
+      const auto scale = 1.0f / static_cast<float>(MaxCacheSize - 3);
+      score = std::pow(1.0f - static_cast<float>(cachePosition - 3) * scale,
+                       CacheDecayPower);
+    }
+  }
+  // Vertices with few triangles left are finished off first so they leave
+  // the cache for good.
+  return score +
+         ValenceBoostScale * std::pow(static_cast<float>(remainingTriangles),
+                                      -ValenceBoostPower);
+}
+}  // namespace
+
+VertexCacheStatistics analyzeVertexCache(std::span<const uint32_t> indices,
+                                         size_t vertexCount,
+                                         uint32_t cacheSize) {
+  auto statistics = VertexCacheStatistics{};
+  if (indices.empty() || vertexCount == 0) {
+    return statistics;
+  }
+
+  // Timestamps of the cache insertion, a vertex is cached while fewer than
+  // `cacheSize` vertices were inserted after it.
+  std::vector<uint32_t> insertedAt(vertexCount, 0);
+  std::vector<bool> referenced(vertexCount, false);
+  auto timestamp = cacheSize + 1;
+  for (auto index : indices) {
+    referenced[index] = true;
+    if (timestamp - insertedAt[index] > cacheSize) {
+      insertedAt[index] = timestamp++;
+      statistics.vertexTransformCount++;
+    }
+  }
+
+  const auto referencedCount =
+      std::count(referenced.begin(), referenced.end(), true);
+  statistics.acmr = static_cast<float>(statistics.vertexTransformCount) /
+                    static_cast<float>(indices.size() / 3);
+  statistics.atvr = static_cast<float>(statistics.vertexTransformCount) /
+                    static_cast<float>(referencedCount);
+  return statistics;
+}
+
+void optimizeVertexCache(std::span<uint32_t> indices, size_t vertexCount) {
+  const auto triangleCount = static_cast<uint32_t>(indices.size() / 3);
+  if (triangleCount == 0) {
+    return;
+  }
+
+  // Live triangles around each vertex, emitted ones are swapped past
+  // `liveTriangleCounts`.
+  std::vector<uint32_t> triangleOffsets(vertexCount + 1, 0);
+  for (auto index : indices) {
+    triangleOffsets[index + 1]++;
+  }
+  for (auto i = 0U; i < vertexCount; i++) {
+    triangleOffsets[i + 1] += triangleOffsets[i];
+  }
+  std::vector<uint32_t> liveTriangleCounts(vertexCount, 0);
+  std::vector<uint32_t> vertexTriangles(indices.size());
+  for (auto i = 0U; i < indices.size(); i++) {
+    const auto vertex = indices[i];
+    vertexTriangles[triangleOffsets[vertex] + liveTriangleCounts[vertex]++] =
+        i / 3;
+  }
+
+  std::vector<int32_t> cachePositions(vertexCount, -1);
+  std::vector<float> vertexScores(vertexCount);
+  for (auto i = 0U; i < vertexCount; i++) {
+    vertexScores[i] = computeVertexScore(-1, liveTriangleCounts[i]);
+  }
+
+  auto triangleScore = [&](uint32_t triangle) {
+    return vertexScores[indices[triangle * 3]] +
+           vertexScores[indices[triangle * 3 + 1]] +
+           vertexScores[indices[triangle * 3 + 2]];
+  };
+  std::vector<bool> emitted(triangleCount, false);
+  auto bestTriangle = 0U;
+  auto bestScore = triangleScore(0);
+  for (auto t = 1U; t < triangleCount; t++) {
+    const auto score = triangleScore(t);
+    if (score > bestScore) {
+      bestTriangle = t;
+      bestScore = score;
+    }
+  }
+
+  std::vector<uint32_t> result;
+  result.reserve(indices.size());
+  std::vector<uint32_t> cache, nextCache;
+  cache.reserve(MaxCacheSize + 3);
+  nextCache.reserve(MaxCacheSize + 3);
+  auto inputCursor = 0U;
+
+  while (result.size() < indices.size()) {
+    if (bestTriangle == InvalidIndex) {
+      // Nothing in the cache has triangles left, restart from the next
+      // triangle in input order.
+      while (emitted[inputCursor]) {
+        inputCursor++;
+      }
+      bestTriangle = inputCursor;
+    }
+
+    const uint32_t triangle[3] = {indices[bestTriangle * 3],
+                                  indices[bestTriangle * 3 + 1],
+                                  indices[bestTriangle * 3 + 2]};
+    result.insert(result.end(), triangle, triangle + 3);
+    emitted[bestTriangle] = true;
+
+    for (auto vertex : triangle) {
+      const auto first = triangleOffsets[vertex];
+      const auto last = first + liveTriangleCounts[vertex] - 1;
+      for (auto t = first; t <= last; t++) {
+        if (vertexTriangles[t] == bestTriangle) {
+          std::swap(vertexTriangles[t], vertexTriangles[last]);
+          break;
+        }
+      }
+      liveTriangleCounts[vertex]--;
+    }
+
+    nextCache.assign(triangle, triangle + 3);
+    for (auto vertex : cache) {
+      if (vertex != triangle[0] && vertex != triangle[1] &&
+          vertex != triangle[2]) {
+        nextCache.push_back(vertex);
+      }
+    }
+    std::swap(cache, nextCache);
+
+    for (auto i = 0U; i < cache.size(); i++) {
+      const auto vertex = cache[i];
+      cachePositions[vertex] = i < MaxCacheSize ? static_cast<int32_t>(i) : -1;
+      vertexScores[vertex] = computeVertexScore(cachePositions[vertex],
+                                                liveTriangleCounts[vertex]);
+    }
+
+    bestTriangle = InvalidIndex;
+    bestScore = 0.0f;
+    const auto cachedCount =
+        std::min(static_cast<uint32_t>(cache.size()), MaxCacheSize);
+    for (auto i = 0U; i < cachedCount; i++) {
+      const auto vertex = cache[i];
+      const auto first = triangleOffsets[vertex];
+      for (auto t = first; t < first + liveTriangleCounts[vertex]; t++) {
+        const auto candidate = vertexTriangles[t];
+        const auto score = triangleScore(candidate);
+        if (bestTriangle == InvalidIndex || score > bestScore) {
+          bestTriangle = candidate;
+          bestScore = score;
+        }
+      }
+    }
+    cache.resize(cachedCount);
+  }
+
+  std::copy(result.begin(), result.end(), indices.begin());
+}
+
+void optimizeOverdraw(std::span<uint32_t> indices,
+                      std::span<const Vertex> vertices,
+                      uint32_t cacheSize) {
+  const auto triangleCount = static_cast<uint32_t>(indices.size() / 3);
+  if (triangleCount < 2) {
+    return;
+  }
+
+  // A cluster starts wherever a triangle misses the cache with all three
+  // vertices, moving it elsewhere costs nothing more.
+  std::vector<uint32_t> clusterStarts;
+  std::vector<uint32_t> insertedAt(vertices.size(), 0);
+  auto timestamp = cacheSize + 1;
+  for (auto t = 0U; t < triangleCount; t++) {
+    auto misses = 0U;
+    for (auto k = 0; k < 3; k++) {
+      const auto vertex = indices[t * 3 + k];
+      if (timestamp - insertedAt[vertex] > cacheSize) {
+        insertedAt[vertex] = timestamp++;
+        misses++;
+      }
+    }
+    if (misses == 3) {
+      clusterStarts.push_back(t);
+    }
+  }
+  if (clusterStarts.size() < 2) {
+    return;
+  }
+  clusterStarts.push_back(triangleCount);
+
+  struct Cluster {
+    uint32_t firstTriangle;
+    uint32_t triangleCount;
+    float sortKey;
+  };
+  std::vector<Cluster> clusters;
+  std::vector<glm::vec3> clusterCentroids, clusterNormals;
+  clusters.reserve(clusterStarts.size() - 1);
+
+  auto meshCentroid = glm::vec3(0.0f);
+  auto meshArea = 0.0f;
+  for (auto c = 0U; c + 1 < clusterStarts.size(); c++) {
+    auto centroid = glm::vec3(0.0f);
+    auto normal = glm::vec3(0.0f);
+    auto area = 0.0f;
+    for (auto t = clusterStarts[c]; t < clusterStarts[c + 1]; t++) {
+      const auto& p0 = vertices[indices[t * 3]].position;
+      const auto& p1 = vertices[indices[t * 3 + 1]].position;
+      const auto& p2 = vertices[indices[t * 3 + 2]].position;
+      const auto areaNormal = glm::cross(p1 - p0, p2 - p0);
+      const auto triangleArea = glm::length(areaNormal);
+      centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+      normal += areaNormal;
+      area += triangleArea;
+    }
+    meshCentroid += centroid;
+    meshArea += area;
+    clusterCentroids.push_back(area > 0.0f ? centroid / area : centroid);
+    clusterNormals.push_back(normal);
+    clusters.push_back(Cluster{
+        .firstTriangle = clusterStarts[c],
+        .triangleCount = clusterStarts[c + 1] - clusterStarts[c],
+    });
+  }
+  if (meshArea > 0.0f) {
+    meshCentroid = meshCentroid / meshArea;
+  }
+
+  // Clusters facing away from the center are on the outside of the mesh
+  // and likely occlude the others from any view they are visible in.
+  for (auto c = 0U; c < clusters.size(); c++) {
+    const auto normalLength = glm::length(clusterNormals[c]);
+    clusters[c].sortKey =
+        normalLength > 0.0f
+            ? glm::dot(clusterCentroids[c] - meshCentroid, clusterNormals[c]) /
+                  normalLength
+            : 0.0f;
+  }
+  std::stable_sort(clusters.begin(), clusters.end(),
+                   [](const Cluster& a, const Cluster& b) {
+                     return a.sortKey > b.sortKey;
+                   });
+
+  std::vector<uint32_t> result;
+  result.reserve(indices.size());
+  for (const auto& cluster : clusters) {
+    const auto first = indices.begin() + cluster.firstTriangle * 3;
+    result.insert(result.end(), first, first + cluster.triangleCount * 3);
+  }
+  std::copy(result.begin(), result.end(), indices.begin());
+}
+
+size_t optimizeVertexFetch(std::vector<Vertex>& vertices,
+                           std::span<uint32_t> indices) {
+  std::vector<uint32_t> remap(vertices.size(), InvalidIndex);
+  std::vector<Vertex> result;
+  result.reserve(vertices.size());
+  for (auto& index : indices) {
+    if (remap[index] == InvalidIndex) {
+      remap[index] = static_cast<uint32_t>(result.size());
+      result.push_back(vertices[index]);
+    }
+    index = remap[index];
+  }
+  vertices = std::move(result);
+  return vertices.size();
+}
+
+RHIIndexType selectIndexType(size_t vertexCount) {
+  // 0xFFFF is left free as the primitive restart index.
+  return vertexCount <= std::numeric_limits<uint16_t>::max()
+             ? RHIIndexType::Uint16
+             : RHIIndexType::Uint32;
+}
+
+MeshCookStatistics cookMesh(std::vector<Vertex>& vertices,
+                            std::vector<uint32_t>& indices) {
+  auto statistics = MeshCookStatistics{
+      .before = analyzeVertexCache(indices, vertices.size()),
+      .vertexCountBefore = static_cast<uint32_t>(vertices.size()),
+  };
+
+  optimizeVertexCache(indices, vertices.size());
+  optimizeOverdraw(indices, vertices);
+  optimizeVertexFetch(vertices, indices);
+
+  statistics.after = analyzeVertexCache(indices, vertices.size());
+  statistics.vertexCountAfter = static_cast<uint32_t>(vertices.size());
+  statistics.indexType = selectIndexType(vertices.size());
+  return statistics;
+}
+
+}  // namespace Sparrow
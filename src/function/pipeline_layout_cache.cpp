@@ -0,0 +1,108 @@
+#include "pipeline_layout_cache.h"
+#include <iostream>
+#include "RHI/rhi.h"
+#include "function/shader_reflection.h"
+#include "utils/log.h"
+#include "utils/state_key_writer.h"
+
+namespace Sparrow {
+
+namespace {
+void writeSetLayoutBindings(
+    StateKeyWriter& writer,
+    std::span<const RHIDescriptorSetLayoutBinding> bindings) {
+  writer.write(bindings.size());
+  for (const auto& binding : bindings) {
+    writer.write(binding.binding);
+    writer.write(binding.descriptorType);
+    writer.write(binding.descriptorCount);
+    writer.write(binding.stageFlags);
+  }
+}
+}  // namespace
+
+PipelineLayoutCache::PipelineLayoutCache(std::shared_ptr<RHI> rhi)
+    : rhi(std::move(rhi)) {}
+
+ReflectedPipelineLayout PipelineLayoutCache::getOrCreate(
+    const ShaderReflection& reflection) {
+  const auto setCount = reflection.getSetCount();
+  std::vector<std::vector<RHIDescriptorSetLayoutBinding>> setBindings(
+      setCount);
+  auto writer = StateKeyWriter{};
+  writer.write(setCount);
+  for (auto set = 0U; set < setCount; set++) {
+    setBindings[set] = reflection.getSetLayoutBindings(set);
+    writeSetLayoutBindings(writer, setBindings[set]);
+  }
+  writer.write(reflection.pushConstantRanges.size());
+  for (const auto& range : reflection.pushConstantRanges) {
+    writer.write(range.stageFlags);
+    writer.write(range.offset);
+    writer.write(range.size);
+  }
+  auto key = writer.take();
+
+  std::lock_guard lock(mutex);
+  if (auto entry = pipelineLayouts.find(key); entry != pipelineLayouts.end()) {
+    hits++;
+    return entry->second;
+  }
+
+  ReflectedPipelineLayout layout;
+  for (auto& bindings : setBindings) {
+    auto* setLayout = getOrCreateSetLayout(bindings);
+    if (!setLayout) {
+      return {};
+    }
+    layout.setLayouts.push_back(setLayout);
+  }
+  auto pipelineLayout = rhi->createPipelineLayout(RHIPipelineLayoutCreateInfo{
+      .setLayoutCount = static_cast<uint32_t>(layout.setLayouts.size()),
+      .setLayouts = layout.setLayouts.data(),
+      .pushConstantRangeCount =
+          static_cast<uint32_t>(reflection.pushConstantRanges.size()),
+      .pushConstantRanges = reflection.pushConstantRanges.data(),
+  });
+  if (!pipelineLayout) {
+    LOG_ERROR("PipelineLayoutCache::getOrCreate create layout failed.");
+    return {};
+  }
+  layout.pipelineLayout = pipelineLayout.get();
+  ownedPipelineLayouts.push_back(std::move(pipelineLayout));
+  pipelineLayouts.emplace(std::move(key), layout);
+  return layout;
+}
+
+RHIDescriptorSetLayout* PipelineLayoutCache::getOrCreateSetLayout(
+    std::span<RHIDescriptorSetLayoutBinding> bindings) {
+  auto writer = StateKeyWriter{};
+  writeSetLayoutBindings(writer, bindings);
+  auto key = writer.take();
+  if (auto entry = setLayouts.find(key); entry != setLayouts.end()) {
+    return entry->second.get();
+  }
+
+  auto createInfo = RHIDescriptorSetLayoutCreateInfo{
+      .bindingCount = static_cast<uint32_t>(bindings.size()),
+      .bindings = bindings.data(),
+  };
+  auto setLayout = rhi->createDescriptorSetLayout(createInfo);
+  if (!setLayout) {
+    return nullptr;
+  }
+  auto* result = setLayout.get();
+  setLayouts.emplace(std::move(key), std::move(setLayout));
+  return result;
+}
+
+PipelineLayoutCacheStatistics PipelineLayoutCache::getStatistics() const {
+  std::lock_guard lock(mutex);
+  return PipelineLayoutCacheStatistics{
+      .hits = hits,
+      .setLayoutCount = static_cast<uint32_t>(setLayouts.size()),
+      .pipelineLayoutCount = static_cast<uint32_t>(pipelineLayouts.size()),
+  };
+}
+
+}  // namespace Sparrow
@@ -0,0 +1,57 @@
+#ifndef SPARROWENGINE_PIPELINE_LAYOUT_CACHE_H
+#define SPARROWENGINE_PIPELINE_LAYOUT_CACHE_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "RHI/rhi_struct.h"
+
+namespace Sparrow {
+class RHI;
+struct ShaderReflection;
+
+// Owned by the PipelineLayoutCache.
+struct ReflectedPipelineLayout {
+  RHIPipelineLayout* pipelineLayout = nullptr;
+  // Indexed by set, sets no stage uses get an empty layout.
+  std::vector<RHIDescriptorSetLayout*> setLayouts;
+};
+
+struct PipelineLayoutCacheStatistics {
+  uint64_t hits = 0;
+  uint32_t setLayoutCount = 0;
+  uint32_t pipelineLayoutCount = 0;
+};
+
+// Builds descriptor set and pipeline layouts from shader reflection.
+// Reflections declaring the same bindings and push constants get the same
+// objects, and set layouts are shared between pipeline layouts using them.
+class PipelineLayoutCache {
+ public:
+  explicit PipelineLayoutCache(std::shared_ptr<RHI> rhi);
+
+  // pipelineLayout is null if creating a layout failed.
+  ReflectedPipelineLayout getOrCreate(const ShaderReflection& reflection);
+
+  PipelineLayoutCacheStatistics getStatistics() const;
+
+ private:
+  RHIDescriptorSetLayout* getOrCreateSetLayout(
+      std::span<RHIDescriptorSetLayoutBinding> bindings);
+
+  std::shared_ptr<RHI> rhi;
+  mutable std::mutex mutex;
+  std::unordered_map<std::string, std::unique_ptr<RHIDescriptorSetLayout>>
+      setLayouts;
+  std::unordered_map<std::string, ReflectedPipelineLayout> pipelineLayouts;
+  std::vector<std::unique_ptr<RHIPipelineLayout>> ownedPipelineLayouts;
+  uint64_t hits = 0;
+};
+
+}  // namespace Sparrow
+
+#endif  // SPARROWENGINE_PIPELINE_LAYOUT_CACHE_H
@@ -0,0 +1,734 @@
+#include "pipeline_state_cache.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include "RHI/rhi.h"
+#include "utils/log.h"
+#include "utils/state_key_writer.h"
+#include "utils/thread_pool.h"
+
+namespace Sparrow {
+
+namespace {
+// dynamicStates is sorted.
+bool isDynamic(std::span<const RHIDynamicState> dynamicStates,
+               RHIDynamicState state) {
+  return std::binary_search(dynamicStates.begin(), dynamicStates.end(),
+                            state);
+}
+
+// State set while recording does not make pipelines differ.
+template <typename T>
+void writeUnlessDynamic(StateKeyWriter& writer,
+                        std::span<const RHIDynamicState> dynamicStates,
+                        RHIDynamicState state,
+                        T value) {
+  if (!isDynamic(dynamicStates, state)) {
+    writer.write(value);
+  }
+}
+
+// A dynamic topology may only change within the class of the pipeline's.
+uint32_t getTopologyClass(RHIPrimitiveTopology topology) {
+  switch (topology) {
+    case RHIPrimitiveTopology::PointList:
+      return 0;
+    case RHIPrimitiveTopology::LineList:
+    case RHIPrimitiveTopology::LineStrip:
+    case RHIPrimitiveTopology::LineListWithAdjacency:
+    case RHIPrimitiveTopology::LineStripWithAdjacency:
+      return 1;
+    case RHIPrimitiveTopology::PatchList:
+      return 3;
+    default:
+      return 2;
+  }
+}
+
+void writeStencilOpState(StateKeyWriter& writer,
+                         const RHIStencilOpState& state,
+                         std::span<const RHIDynamicState> dynamicStates) {
+  if (!isDynamic(dynamicStates, RHIDynamicState::StencilOp)) {
+    writer.write(state.failOp);
+    writer.write(state.passOp);
+    writer.write(state.depthFailOp);
+    writer.write(state.compareOp);
+  }
+  writeUnlessDynamic(writer, dynamicStates,
+                     RHIDynamicState::StencilCompareMask, state.compareMask);
+  writeUnlessDynamic(writer, dynamicStates, RHIDynamicState::StencilWriteMask,
+                     state.writeMask);
+  writeUnlessDynamic(writer, dynamicStates, RHIDynamicState::StencilReference,
+                     state.reference);
+}
+
+void writeShaderStage(StateKeyWriter& writer,
+                      const RHIPipelineShaderStageCreateInfo& stage) {
+  writer.write(stage.stage);
+  writer.write(stage.module);
+  writer.writeBytes(stage.name, stage.name ? std::strlen(stage.name) : 0);
+  const auto* specialization = stage.specializationInfo;
+  writer.write(specialization != nullptr);
+  if (specialization) {
+    writer.write(specialization->mapEntryCount);
+    for (auto i = 0U; i < specialization->mapEntryCount; i++) {
+      const auto& entry = specialization->pMapEntries[i];
+      writer.write(entry.constantID);
+      writer.write(entry.offset);
+      writer.write(entry.size);
+    }
+    writer.writeBytes(specialization->pData, specialization->dataSize);
+  }
+}
+
+// Sorted so the order dynamic states are listed in does not matter.
+std::vector<RHIDynamicState> writeDynamicStates(
+    StateKeyWriter& writer,
+    const RHIGraphicsPipelineCreateInfo& createInfo) {
+  std::vector<RHIDynamicState> dynamicStates;
+  if (const auto* dynamic = createInfo.dynamicStateCreateInfo) {
+    dynamicStates.assign(dynamic->dynamicStates,
+                         dynamic->dynamicStates + dynamic->dynamicStateCount);
+    std::sort(dynamicStates.begin(), dynamicStates.end());
+  }
+  writer.write(dynamicStates.size());
+  for (auto state : dynamicStates) {
+    writer.write(state);
+  }
+  return dynamicStates;
+}
+
+void writeVertexInputState(
+    StateKeyWriter& writer,
+    const RHIVertexInputStateCreateInfo* vertexInput) {
+  writer.write(vertexInput != nullptr);
+  if (vertexInput) {
+    writer.write(vertexInput->vertexBindingDescriptionCount);
+    for (auto i = 0U; i < vertexInput->vertexBindingDescriptionCount; i++) {
+      const auto& binding = vertexInput->vertexBindingDescriptions[i];
+      writer.write(binding.binding);
+      writer.write(binding.stride);
+      writer.write(binding.inputRate);
+    }
+    writer.write(vertexInput->vertexAttributeDescriptionCount);
+    for (auto i = 0U; i < vertexInput->vertexAttributeDescriptionCount; i++) {
+      const auto& attribute = vertexInput->vertexAttributeDescriptions[i];
+      writer.write(attribute.location);
+      writer.write(attribute.binding);
+      writer.write(attribute.format);
+      writer.write(attribute.offset);
+    }
+  }
+}
+
+void writeInputAssemblyState(
+    StateKeyWriter& writer,
+    const RHIInputAssemblyStateCreateInfo* inputAssembly,
+    std::span<const RHIDynamicState> dynamicStates) {
+  writer.write(inputAssembly != nullptr);
+  if (inputAssembly) {
+    if (isDynamic(dynamicStates, RHIDynamicState::PrimitiveTopology)) {
+      writer.write(getTopologyClass(inputAssembly->topology));
+    } else {
+      writer.write(inputAssembly->topology);
+    }
+    writeUnlessDynamic(writer, dynamicStates,
+                       RHIDynamicState::PrimitiveRestartEnable,
+                       inputAssembly->primitiveRestartEnabled);
+  }
+}
+
+void writeViewportState(StateKeyWriter& writer,
+                        const RHIViewportStateCreateInfo* viewport,
+                        std::span<const RHIDynamicState> dynamicStates) {
+  writer.write(viewport != nullptr);
+  if (viewport) {
+    writer.write(viewport->viewportCount);
+    if (!isDynamic(dynamicStates, RHIDynamicState::Viewport) &&
+        viewport->viewports) {
+      for (auto i = 0U; i < viewport->viewportCount; i++) {
+        const auto& value = viewport->viewports[i];
+        writer.write(value.x);
+        writer.write(value.y);
+        writer.write(value.width);
+        writer.write(value.height);
+        writer.write(value.minDepth);
+        writer.write(value.maxDepth);
+      }
+    }
+    writer.write(viewport->scissorCount);
+    if (!isDynamic(dynamicStates, RHIDynamicState::Scissor) &&
+        viewport->scissors) {
+      for (auto i = 0U; i < viewport->scissorCount; i++) {
+        const auto& value = viewport->scissors[i];
+        writer.write(value.offset.x);
+        writer.write(value.offset.y);
+        writer.write(value.extend.width);
+        writer.write(value.extend.height);
+      }
+    }
+  }
+}
+
+void writeRasterizationState(
+    StateKeyWriter& writer,
+    const RHIRasterizationStateCreateInfo* rasterization,
+    std::span<const RHIDynamicState> dynamicStates) {
+  writer.write(rasterization != nullptr);
+  if (rasterization) {
+    writer.write(rasterization->depthClampEnable);
+    writeUnlessDynamic(writer, dynamicStates,
+                       RHIDynamicState::RasterizerDiscardEnable,
+                       rasterization->rasterizerDiscardEnable);
+    writer.write(rasterization->polygonMode);
+    writeUnlessDynamic(writer, dynamicStates, RHIDynamicState::CullMode,
+                       rasterization->cullMode);
+    writeUnlessDynamic(writer, dynamicStates, RHIDynamicState::FrontFace,
+                       rasterization->frontFace);
+    writeUnlessDynamic(writer, dynamicStates, RHIDynamicState::DepthBiasEnable,
+                       rasterization->depthBiasEnable);
+    if (!isDynamic(dynamicStates, RHIDynamicState::DepthBias)) {
+      writer.write(rasterization->depthBiasConstantFactor);
+      writer.write(rasterization->depthBiasClamp);
+      writer.write(rasterization->depthBiasSlopeFactor);
+    }
+    writeUnlessDynamic(writer, dynamicStates, RHIDynamicState::LineWidth,
+                       rasterization->lineWidth);
+  }
+}
+
+void writeMultisampleState(
+    StateKeyWriter& writer,
+    const RHIMultisampleStateCreateInfo* multisample) {
+  writer.write(multisample != nullptr);
+  if (multisample) {
+    writer.write(multisample->rasterizationSamples);
+    writer.write(multisample->sampleShadingEnable);
+    writer.write(multisample->minSampleShading);
+    const auto sampleMaskWords =
+        (static_cast<uint32_t>(multisample->rasterizationSamples) + 31) / 32;
+    writer.write(multisample->sampleMask != nullptr);
+    if (multisample->sampleMask) {
+      writer.writeBytes(multisample->sampleMask,
+                        sampleMaskWords * sizeof(RHISampleMask));
+    }
+    writer.write(multisample->alphaToCoverageEnable);
+    writer.write(multisample->alphaToOneEnable);
+  }
+}
+
+void writeDepthStencilState(
+    StateKeyWriter& writer,
+    const RHIDepthStencilStateCreateInfo* depthStencil,
+    std::span<const RHIDynamicState> dynamicStates) {
+  writer.write(depthStencil != nullptr);
+  if (depthStencil) {
+    writeUnlessDynamic(writer, dynamicStates, RHIDynamicState::DepthTestEnable,
+                       depthStencil->depthTestEnable);
+    writeUnlessDynamic(writer, dynamicStates,
+                       RHIDynamicState::DepthWriteEnable,
+                       depthStencil->depthWriteEnable);
+    writeUnlessDynamic(writer, dynamicStates, RHIDynamicState::DepthCompareOp,
+                       depthStencil->depthCompareOp);
+    writeUnlessDynamic(writer, dynamicStates,
+                       RHIDynamicState::DepthBoundsTestEnable,
+                       depthStencil->depthBoundsTestEnable);
+    writeUnlessDynamic(writer, dynamicStates,
+                       RHIDynamicState::StencilTestEnable,
+                       depthStencil->stencilTestEnable);
+    writeStencilOpState(writer, depthStencil->front, dynamicStates);
+    writeStencilOpState(writer, depthStencil->back, dynamicStates);
+    if (!isDynamic(dynamicStates, RHIDynamicState::DepthBounds)) {
+      writer.write(depthStencil->minDepthBounds);
+      writer.write(depthStencil->maxDepthBounds);
+    }
+  }
+}
+
+void writeColorBlendState(
+    StateKeyWriter& writer,
+    const RHIColorBlendStateCreateInfo* colorBlend,
+    std::span<const RHIDynamicState> dynamicStates) {
+  writer.write(colorBlend != nullptr);
+  if (colorBlend) {
+    writer.write(colorBlend->logicOpEnable);
+    writer.write(colorBlend->logicOp);
+    writer.write(colorBlend->attachmentCount);
+    for (auto i = 0U; i < colorBlend->attachmentCount; i++) {
+      const auto& attachment = colorBlend->attachments[i];
+      writeUnlessDynamic(writer, dynamicStates,
+                         RHIDynamicState::ColorBlendEnableEXT,
+                         attachment.blendEnable);
+      writer.write(attachment.srcColorBlendFactor);
+      writer.write(attachment.dstColorBlendFactor);
+      writer.write(attachment.colorBlendOp);
+      writer.write(attachment.srcAlphaBlendFactor);
+      writer.write(attachment.dstAlphaBlendFactor);
+      writer.write(attachment.alphaBlendOp);
+      writer.write(attachment.colorWriteMask);
+    }
+    if (!isDynamic(dynamicStates, RHIDynamicState::BlendConstants)) {
+      for (auto constant : colorBlend->blendConstants) {
+        writer.write(constant);
+      }
+    }
+  }
+}
+
+void writeRenderTargets(StateKeyWriter& writer,
+                        const RHIGraphicsPipelineCreateInfo& createInfo) {
+  const auto* rendering = createInfo.renderingCreateInfo;
+  writer.write(rendering != nullptr);
+  if (rendering) {
+    writer.write(rendering->colorAttachmentCount);
+    for (auto i = 0U; i < rendering->colorAttachmentCount; i++) {
+      writer.write(rendering->colorAttachmentFormats[i]);
+    }
+    writer.write(rendering->depthAttachmentFormat);
+    writer.write(rendering->stencilAttachmentFormat);
+  } else {
+    writer.write(createInfo.renderPass);
+    writer.write(createInfo.subpass);
+  }
+}
+
+// Writes the stages of one kind, fragment or the ones before it.
+void writeShaderStages(StateKeyWriter& writer,
+                       const RHIGraphicsPipelineCreateInfo& createInfo,
+                       bool fragment) {
+  for (auto i = 0U; i < createInfo.stageCount; i++) {
+    const auto& stage = createInfo.shaderStageCreateInfo[i];
+    if ((stage.stage == RHIShaderStageFlag::Fragment) == fragment) {
+      writeShaderStage(writer, stage);
+    }
+  }
+}
+
+constexpr std::array<RHIGraphicsPipelineLibraryFlag,
+                     PipelineStateCache::LibraryPartCount>
+    libraryParts = {
+        RHIGraphicsPipelineLibraryFlag::VertexInputInterface,
+        RHIGraphicsPipelineLibraryFlag::PreRasterizationShaders,
+        RHIGraphicsPipelineLibraryFlag::FragmentShader,
+        RHIGraphicsPipelineLibraryFlag::FragmentOutputInterface,
+};
+
+void writeGraphicsPipelineState(
+    StateKeyWriter& writer,
+    const RHIGraphicsPipelineCreateInfo& createInfo,
+    std::span<const RHIDynamicState> dynamicStates) {
+  writer.write(createInfo.stageCount);
+  for (auto i = 0U; i < createInfo.stageCount; i++) {
+    writeShaderStage(writer, createInfo.shaderStageCreateInfo[i]);
+  }
+  writeVertexInputState(writer, createInfo.vertexInputStateCreateInfo);
+  writeInputAssemblyState(writer, createInfo.inputAssemblyStateCreateInfo,
+                          dynamicStates);
+  writeViewportState(writer, createInfo.viewportStateCreateInfo,
+                     dynamicStates);
+  writeRasterizationState(writer, createInfo.rasterizationStateCreateInfo,
+                          dynamicStates);
+  writeMultisampleState(writer, createInfo.multisampleStateCreateInfo);
+  writeDepthStencilState(writer, createInfo.depthStencilStateCreateInfo,
+                         dynamicStates);
+  writeColorBlendState(writer, createInfo.colorBlendStateCreateInfo,
+                       dynamicStates);
+  // The base pipeline only hints the driver and does not change the result.
+  writer.write(createInfo.pipelineLayout);
+  writeRenderTargets(writer, createInfo);
+}
+}  // namespace
+
+std::string makeGraphicsPipelineStateKey(
+    const RHIGraphicsPipelineCreateInfo& createInfo) {
+  auto writer = StateKeyWriter{};
+  const auto dynamicStates = writeDynamicStates(writer, createInfo);
+  writeGraphicsPipelineState(writer, createInfo, dynamicStates);
+  return writer.take();
+}
+
+std::string makeGraphicsPipelineLibraryKey(
+    const RHIGraphicsPipelineCreateInfo& createInfo,
+    RHIGraphicsPipelineLibraryFlag part) {
+  auto writer = StateKeyWriter{};
+  writer.write(part);
+  const auto dynamicStates = writeDynamicStates(writer, createInfo);
+  switch (part) {
+    case RHIGraphicsPipelineLibraryFlag::VertexInputInterface:
+      writeVertexInputState(writer, createInfo.vertexInputStateCreateInfo);
+      writeInputAssemblyState(
+          writer, createInfo.inputAssemblyStateCreateInfo, dynamicStates);
+      return writer.take();
+    case RHIGraphicsPipelineLibraryFlag::PreRasterizationShaders:
+      writeShaderStages(writer, createInfo, false);
+      writeViewportState(writer, createInfo.viewportStateCreateInfo,
+                         dynamicStates);
+      writeRasterizationState(
+          writer, createInfo.rasterizationStateCreateInfo, dynamicStates);
+      writer.write(createInfo.pipelineLayout);
+      break;
+    case RHIGraphicsPipelineLibraryFlag::FragmentShader:
+      writeShaderStages(writer, createInfo, true);
+      writeMultisampleState(writer, createInfo.multisampleStateCreateInfo);
+      writeDepthStencilState(writer, createInfo.depthStencilStateCreateInfo,
+                             dynamicStates);
+      writer.write(createInfo.pipelineLayout);
+      break;
+    case RHIGraphicsPipelineLibraryFlag::FragmentOutputInterface:
+      writeMultisampleState(writer, createInfo.multisampleStateCreateInfo);
+      writeColorBlendState(writer, createInfo.colorBlendStateCreateInfo,
+                           dynamicStates);
+      break;
+  }
+  writeRenderTargets(writer, createInfo);
+  return writer.take();
+}
+
+PipelineStateCache::PipelineStateCache(std::shared_ptr<RHI> rhi,
+                                       std::shared_ptr<ThreadPool> threadPool)
+    : rhi(std::move(rhi)), threadPool(std::move(threadPool)) {
+  useLibraries = this->rhi->supportsGraphicsPipelineLibrary();
+}
+
+PipelineStateCache::~PipelineStateCache() {
+  // The links read libraries owned by the cache.
+  for (auto& pending : pendingOptimizations) {
+    pending.optimized.wait();
+  }
+}
+
+RHIPipeline* PipelineStateCache::getOrCreate(
+    const RHIGraphicsPipelineCreateInfo& createInfo) {
+  auto key = makeGraphicsPipelineStateKey(createInfo);
+  {
+    std::shared_lock lock(mutex);
+    if (auto entry = entries.find(key); entry != entries.end()) {
+      auto pipeline = entry->second;
+      lock.unlock();
+      hits++;
+      if (pipeline.get()) {
+        recordStaticState(createInfo, false);
+      }
+      return pipeline.get();
+    }
+  }
+
+  std::promise<RHIPipeline*> promise;
+  {
+    std::unique_lock lock(mutex);
+    // Another thread may have started on the same state meanwhile.
+    if (auto entry = entries.find(key); entry != entries.end()) {
+      auto pipeline = entry->second;
+      lock.unlock();
+      hits++;
+      if (pipeline.get()) {
+        recordStaticState(createInfo, false);
+      }
+      return pipeline.get();
+    }
+    entries.emplace(key, promise.get_future().share());
+  }
+  misses++;
+
+  std::array<std::string, LibraryPartCount> libraryKeys;
+  auto pipeline = useLibraries ? linkFromLibraries(createInfo, libraryKeys)
+                               : rhi->createGraphicsPipeline(createInfo);
+  auto* result = pipeline.get();
+  {
+    std::unique_lock lock(mutex);
+    if (pipeline) {
+      if (useLibraries) {
+        pipelineLibraryKeys.emplace(result, std::move(libraryKeys));
+      }
+      pipelines.push_back(std::move(pipeline));
+    } else {
+      // Not cached, so a later request tries again.
+      entries.erase(key);
+      LOG_ERROR("PipelineStateCache::getOrCreate create pipeline failed.");
+    }
+  }
+  promise.set_value(result);
+  if (result) {
+    recordStaticState(createInfo, true);
+  }
+  return result;
+}
+
+void PipelineStateCache::recordStaticState(
+    const RHIGraphicsPipelineCreateInfo& createInfo,
+    bool created) {
+  auto writer = StateKeyWriter{};
+  writeGraphicsPipelineState(writer, createInfo, {});
+  const auto hash = std::hash<std::string>{}(writer.take());
+  std::lock_guard lock(staticStateMutex);
+  if (staticStates.insert(hash).second && !created) {
+    pipelinesAvoided++;
+  }
+}
+
+std::unique_ptr<RHIPipeline> PipelineStateCache::linkFromLibraries(
+    const RHIGraphicsPipelineCreateInfo& createInfo,
+    std::array<std::string, LibraryPartCount>& libraryKeys) {
+  std::array<RHIPipeline*, LibraryPartCount> partLibraries;
+  for (auto i = 0U; i < LibraryPartCount; i++) {
+    libraryKeys[i] =
+        makeGraphicsPipelineLibraryKey(createInfo, libraryParts[i]);
+    partLibraries[i] =
+        getOrCreateLibrary(createInfo, libraryParts[i], libraryKeys[i]);
+    if (!partLibraries[i]) {
+      return nullptr;
+    }
+  }
+
+  auto pipeline = rhi->linkGraphicsPipelineLibraries(
+      partLibraries, createInfo.pipelineLayout, false);
+  if (pipeline && threadPool) {
+    auto optimized = threadPool->submit(
+        [rhi = rhi.get(), partLibraries,
+         pipelineLayout = createInfo.pipelineLayout] {
+          return rhi->linkGraphicsPipelineLibraries(partLibraries,
+                                                    pipelineLayout, true);
+        });
+    std::unique_lock lock(mutex);
+    pendingOptimizations.push_back(PendingOptimization{
+        .pipeline = pipeline.get(),
+        .optimized = std::move(optimized),
+        .libraries = partLibraries,
+    });
+  }
+  return pipeline;
+}
+
+RHIPipeline* PipelineStateCache::getOrCreateLibrary(
+    const RHIGraphicsPipelineCreateInfo& createInfo,
+    RHIGraphicsPipelineLibraryFlag part,
+    const std::string& key) {
+  std::promise<RHIPipeline*> promise;
+  {
+    std::unique_lock lock(mutex);
+    if (auto entry = libraryEntries.find(key); entry != libraryEntries.end()) {
+      auto library = entry->second;
+      lock.unlock();
+      return library.get();
+    }
+    libraryEntries.emplace(key, promise.get_future().share());
+  }
+
+  auto library = rhi->createGraphicsPipelineLibrary(createInfo, part);
+  auto* result = library.get();
+  {
+    std::unique_lock lock(mutex);
+    if (library) {
+      libraries.push_back(std::move(library));
+    } else {
+      libraryEntries.erase(key);
+      LOG_ERROR("PipelineStateCache::getOrCreate create library failed.");
+    }
+  }
+  promise.set_value(result);
+  return result;
+}
+
+void PipelineStateCache::evict(RHIPipeline* pipeline) {
+  std::unique_lock lock(mutex);
+  std::erase_if(entries, [pipeline](const auto& entry) {
+    const auto& future = entry.second;
+    return future.wait_for(std::chrono::seconds(0)) ==
+               std::future_status::ready &&
+           future.get() == pipeline;
+  });
+  for (auto& pending : pendingOptimizations) {
+    if (pending.pipeline == pipeline) {
+      pending.pipeline = nullptr;
+    }
+  }
+  std::vector<std::shared_ptr<RHIPipeline>> retired;
+  // Its shader libraries key the modules about to be destroyed by
+  // address, later pipelines compile their own. The interface parts hold
+  // no modules and stay shared.
+  if (auto keys = pipelineLibraryKeys.find(pipeline);
+      keys != pipelineLibraryKeys.end()) {
+    for (auto i = 0U; i < LibraryPartCount; i++) {
+      if (libraryParts[i] !=
+              RHIGraphicsPipelineLibraryFlag::PreRasterizationShaders &&
+          libraryParts[i] != RHIGraphicsPipelineLibraryFlag::FragmentShader) {
+        continue;
+      }
+      auto entry = libraryEntries.find(keys->second[i]);
+      if (entry == libraryEntries.end()) {
+        // Evicted with an earlier pipeline sharing it.
+        continue;
+      }
+      auto* library = entry->second.get();
+      libraryEntries.erase(entry);
+      auto owned = std::find_if(
+          libraries.begin(), libraries.end(),
+          [library](const auto& owned) { return owned.get() == library; });
+      if (owned == libraries.end()) {
+        continue;
+      }
+      const auto reading =
+          std::ranges::any_of(pendingOptimizations, [library](const auto& p) {
+            return std::ranges::find(p.libraries, library) !=
+                   p.libraries.end();
+          });
+      if (reading) {
+        retiredLibraries.push_back(std::move(*owned));
+      } else {
+        retired.push_back(std::move(*owned));
+      }
+      libraries.erase(owned);
+    }
+    pipelineLibraryKeys.erase(keys);
+  }
+  auto owned = std::find_if(
+      pipelines.begin(), pipelines.end(),
+      [pipeline](const auto& owned) { return owned.get() == pipeline; });
+  if (owned != pipelines.end()) {
+    retired.push_back(std::move(*owned));
+    pipelines.erase(owned);
+  }
+  lock.unlock();
+  for (auto& pipeline : retired) {
+    rhi->deferRelease([rhi = rhi.get(), pipeline] {
+      rhi->destoryPipeline(pipeline.get());
+    });
+  }
+}
+
+void PipelineStateCache::collectOptimizedPipelines() {
+  std::vector<PendingOptimization> finished;
+  {
+    std::unique_lock lock(mutex);
+    auto ready = std::stable_partition(
+        pendingOptimizations.begin(), pendingOptimizations.end(),
+        [](const auto& pending) {
+          return pending.optimized.wait_for(std::chrono::seconds(0)) !=
+                 std::future_status::ready;
+        });
+    std::move(ready, pendingOptimizations.end(),
+              std::back_inserter(finished));
+    pendingOptimizations.erase(ready, pendingOptimizations.end());
+    // Evicted libraries no link reads anymore.
+    for (auto library = retiredLibraries.begin();
+         library != retiredLibraries.end();) {
+      const auto reading = std::ranges::any_of(
+          pendingOptimizations, [library = library->get()](const auto& p) {
+            return std::ranges::find(p.libraries, library) !=
+                   p.libraries.end();
+          });
+      if (reading) {
+        ++library;
+        continue;
+      }
+      std::shared_ptr<RHIPipeline> retired = std::move(*library);
+      library = retiredLibraries.erase(library);
+      rhi->deferRelease([rhi = rhi.get(), retired] {
+        rhi->destoryPipeline(retired.get());
+      });
+    }
+  }
+
+  for (auto& pending : finished) {
+    std::shared_ptr<RHIPipeline> retired = pending.optimized.get();
+    if (!retired) {
+      // The fast link keeps serving.
+      continue;
+    }
+    if (pending.pipeline) {
+      // The optimized handle moves into the pointer callers hold, the fast
+      // one may still be used by the frames in flight.
+      rhi->swapPipelines(pending.pipeline, retired.get());
+      optimizedPipelines++;
+    }
+    rhi->deferRelease([rhi = rhi.get(), retired] {
+      rhi->destoryPipeline(retired.get());
+    });
+  }
+}
+
+PipelineCreationBenchmarkResult PipelineStateCache::benchmark(
+    const RHIGraphicsPipelineCreateInfo& createInfo,
+    uint32_t iterations) {
+  using Clock = std::chrono::steady_clock;
+  auto elapsedMs = [](Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start)
+        .count();
+  };
+  auto result = PipelineCreationBenchmarkResult{.iterations = iterations};
+  if (iterations == 0) {
+    return result;
+  }
+  const auto supportsLibraries = rhi->supportsGraphicsPipelineLibrary();
+  if (!supportsLibraries) {
+    LOG_WARN("PipelineStateCache::benchmark graphics pipeline libraries "
+             "are unsupported, only monolithic creation is timed.");
+  }
+
+  for (auto i = 0U; i < iterations; i++) {
+    auto start = Clock::now();
+    auto monolithic = rhi->createGraphicsPipeline(createInfo);
+    result.monolithicMs += elapsedMs(start);
+    if (monolithic) {
+      rhi->destoryPipeline(monolithic.get());
+    }
+    if (!supportsLibraries) {
+      continue;
+    }
+
+    std::array<std::unique_ptr<RHIPipeline>, LibraryPartCount> partLibraries;
+    std::array<RHIPipeline*, LibraryPartCount> libraryHandles;
+    start = Clock::now();
+    for (auto part = 0U; part < LibraryPartCount; part++) {
+      partLibraries[part] =
+          rhi->createGraphicsPipelineLibrary(createInfo, libraryParts[part]);
+      libraryHandles[part] = partLibraries[part].get();
+    }
+    result.librariesMs += elapsedMs(start);
+    if (std::ranges::find(libraryHandles, nullptr) == libraryHandles.end()) {
+      start = Clock::now();
+      auto fastLinked = rhi->linkGraphicsPipelineLibraries(
+          libraryHandles, createInfo.pipelineLayout, false);
+      result.fastLinkMs += elapsedMs(start);
+      start = Clock::now();
+      auto optimized = rhi->linkGraphicsPipelineLibraries(
+          libraryHandles, createInfo.pipelineLayout, true);
+      result.optimizedLinkMs += elapsedMs(start);
+      for (auto* linked : {fastLinked.get(), optimized.get()}) {
+        if (linked) {
+          rhi->destoryPipeline(linked);
+        }
+      }
+    }
+    for (auto* library : libraryHandles) {
+      if (library) {
+        rhi->destoryPipeline(library);
+      }
+    }
+  }
+
+  result.monolithicMs /= iterations;
+  result.librariesMs /= iterations;
+  result.fastLinkMs /= iterations;
+  result.optimizedLinkMs /= iterations;
+  return result;
+}
+
+PipelineStateCacheStatistics PipelineStateCache::getStatistics() const {
+  std::shared_lock lock(mutex);
+  std::lock_guard staticStateLock(staticStateMutex);
+  return PipelineStateCacheStatistics{
+      .hits = hits,
+      .misses = misses,
+      .pipelineCount = static_cast<uint32_t>(pipelines.size()),
+      .libraryCount = static_cast<uint32_t>(libraries.size()),
+      .optimizedPipelines = optimizedPipelines,
+      .pipelinesAvoided = pipelinesAvoided,
+  };
+}
+
+}  // namespace Sparrow
@@ -0,0 +1,142 @@
+#ifndef SPARROWENGINE_PIPELINE_STATE_CACHE_H
+#define SPARROWENGINE_PIPELINE_STATE_CACHE_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "RHI/rhi_struct.h"
+
+namespace Sparrow {
+class RHI;
+class ThreadPool;
+
+// Canonical byte encoding of everything that makes two graphics pipelines
+// different: shader modules, entry points and specialization data, vertex
+// layout, fixed function state, pipeline layout and either the render pass
+// or the dynamic rendering attachment formats. Fields are written one by
+// one so padding never leaks in, and state the pipeline declares dynamic
+// is left out, a dynamic topology only keeps its class. Render passes
+// compare by object, so compatible passes must be shared to share
+// pipelines.
+std::string makeGraphicsPipelineStateKey(
+    const RHIGraphicsPipelineCreateInfo& createInfo);
+
+// Key of the state one graphics pipeline library part is compiled from.
+// Pipelines sharing e.g. their vertex layout share that library.
+std::string makeGraphicsPipelineLibraryKey(
+    const RHIGraphicsPipelineCreateInfo& createInfo,
+    RHIGraphicsPipelineLibraryFlag part);
+
+struct PipelineStateCacheStatistics {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint32_t pipelineCount = 0;
+  uint32_t libraryCount = 0;
+  // Fast linked pipelines replaced by their optimized link.
+  uint64_t optimizedPipelines = 0;
+  // Requests with fixed function state no earlier one had that still hit
+  // an existing pipeline, because the differing state is dynamic.
+  uint64_t pipelinesAvoided = 0;
+};
+
+// Average times of creating one pipeline from scratch each way.
+struct PipelineCreationBenchmarkResult {
+  uint32_t iterations = 0;
+  double monolithicMs = 0.0;
+  // Compiling the four libraries.
+  double librariesMs = 0.0;
+  double fastLinkMs = 0.0;
+  double optimizedLinkMs = 0.0;
+};
+
+// Deduplicates graphics pipelines by their full state. Lookups take a
+// shared lock on a hash map. The first request for a state creates the
+// pipeline outside the lock, concurrent requests for the same state wait
+// for it instead of creating their own.
+//
+// With graphics pipeline library support a missing pipeline is linked
+// from four separately cached parts instead, so a new material only
+// compiles the parts no earlier pipeline had and links them without
+// optimization. The optimized link then runs on the thread pool and
+// replaces the fast one in collectOptimizedPipelines, the pointer handed
+// out stays the same.
+class PipelineStateCache {
+ public:
+  static constexpr size_t LibraryPartCount = 4;
+
+  explicit PipelineStateCache(std::shared_ptr<RHI> rhi,
+                              std::shared_ptr<ThreadPool> threadPool = nullptr);
+  ~PipelineStateCache();
+
+  // Returns nullptr if creating the pipeline failed. Pipelines are owned
+  // by the cache and live as long as it.
+  RHIPipeline* getOrCreate(const RHIGraphicsPipelineCreateInfo& createInfo);
+  // Forgets the pipeline and destroys it once the frames in flight
+  // finished. Needed before destroying a shader module it was created from,
+  // a later module at the same address would hit the stale entry.
+  void evict(RHIPipeline* pipeline);
+  // Swaps finished optimized links into their pipelines. Call on the render
+  // thread while no command buffer is being recorded.
+  void collectOptimizedPipelines();
+
+  // Creates and destroys pipelines of the state both ways, bypassing the
+  // cache. The RHI pipeline cache still serves repeated compiles, so the
+  // first call gives the cold numbers.
+  PipelineCreationBenchmarkResult benchmark(
+      const RHIGraphicsPipelineCreateInfo& createInfo,
+      uint32_t iterations = 1);
+  PipelineStateCacheStatistics getStatistics() const;
+
+ private:
+  struct PendingOptimization {
+    // Null once the pipeline was evicted.
+    RHIPipeline* pipeline;
+    std::future<std::unique_ptr<RHIPipeline>> optimized;
+    // Read by the link until it finished.
+    std::array<RHIPipeline*, LibraryPartCount> libraries;
+  };
+
+  std::unique_ptr<RHIPipeline> linkFromLibraries(
+      const RHIGraphicsPipelineCreateInfo& createInfo,
+      std::array<std::string, LibraryPartCount>& libraryKeys);
+  void recordStaticState(const RHIGraphicsPipelineCreateInfo& createInfo,
+                         bool created);
+  RHIPipeline* getOrCreateLibrary(
+      const RHIGraphicsPipelineCreateInfo& createInfo,
+      RHIGraphicsPipelineLibraryFlag part,
+      const std::string& key);
+
+  std::shared_ptr<RHI> rhi;
+  std::shared_ptr<ThreadPool> threadPool;
+  bool useLibraries = false;
+  mutable std::shared_mutex mutex;
+  std::unordered_map<std::string, std::shared_future<RHIPipeline*>> entries;
+  std::vector<std::unique_ptr<RHIPipeline>> pipelines;
+  std::unordered_map<std::string, std::shared_future<RHIPipeline*>>
+      libraryEntries;
+  std::vector<std::unique_ptr<RHIPipeline>> libraries;
+  // Evicted while pending optimized links still read them.
+  std::vector<std::unique_ptr<RHIPipeline>> retiredLibraries;
+  std::unordered_map<RHIPipeline*, std::array<std::string, LibraryPartCount>>
+      pipelineLibraryKeys;
+  std::vector<PendingOptimization> pendingOptimizations;
+  std::atomic<uint64_t> hits = 0;
+  std::atomic<uint64_t> misses = 0;
+  uint64_t optimizedPipelines = 0;
+  // Hashes of the requested states with dynamic state included.
+  mutable std::mutex staticStateMutex;
+  std::unordered_set<size_t> staticStates;
+  uint64_t pipelinesAvoided = 0;
+};
+
+}  // namespace Sparrow
+
+#endif  // SPARROWENGINE_PIPELINE_STATE_CACHE_H
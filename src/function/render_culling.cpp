@@ -0,0 +1,466 @@
+#include "render_culling.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <tuple>
+#include "RHI/rhi.h"
+#include "function/render_system.h"
+
+namespace Sparrow {
+
+void GPUCullingPass::initialize(const GPUCullingPassInitInfo& initInfo) {
+  rhi = initInfo.rhi;
+  shaderCompiler = initInfo.shaderCompiler;
+  instanceBuffer = initInfo.instanceBuffer;
+  maxInstanceCount = std::max(initInfo.maxInstanceCount, 1U);
+  lodBuffer = initInfo.lodBuffer;
+  lodCount = std::max(initInfo.lodCount, 1U);
+  lodSelection = initInfo.lodSelection;
+
+  createPipeline();
+  createBuffers();
+  createPlaceholderPyramid();
+  createLODStateBuffer();
+  pyramidView = placeholderPyramidView.get();
+  updateDescriptorSets();
+  pyramidDescriptorStale.assign(rhi->getMaxFramesInFlight(), false);
+}
+
+void GPUCullingPass::setInstanceCount(uint32_t count) {
+  instanceCount = std::min(count, maxInstanceCount);
+}
+
+void GPUCullingPass::setDepthPyramid(RHIImageView* imageView,
+                                     RHIImageLayout imageLayout,
+                                     uint32_t width,
+                                     uint32_t height,
+                                     uint32_t mipLevels) {
+  pyramidView = imageView ? imageView : placeholderPyramidView.get();
+  pyramidLayout = imageView ? imageLayout : RHIImageLayout::ReadOnlyOptimal;
+  occlusionEnabled = imageView != nullptr;
+  // Nothing has been rendered into the new pyramid yet.
+  hasPreviousViewProjection = false;
+  pyramidSize = glm::vec4(static_cast<float>(width),
+                          static_cast<float>(height),
+                          static_cast<float>(mipLevels), 0.0f);
+  // Frames in flight still sample the previous pyramid through their sets,
+  // each frame rewrites its own the next time it culls.
+  std::fill(pyramidDescriptorStale.begin(), pyramidDescriptorStale.end(),
+            true);
+}
+
+void GPUCullingPass::cull(RHICommandBuffer* commandBuffer,
+                          const glm::mat4& viewProjection,
+                          float lodScale) {
+  const auto frameIndex = rhi->getCurrentFrameIndex();
+  if (pyramidDescriptorStale[frameIndex]) {
+    updatePyramidDescriptorSet(frameIndex);
+    pyramidDescriptorStale[frameIndex] = false;
+  }
+
+  auto cullingData = CullingData{
+      .viewProjection = viewProjection,
+      .previousViewProjection = hasPreviousViewProjection
+                                    ? previousViewProjection
+                                    : viewProjection,
+      .pyramidSize = pyramidSize,
+      .lodParameters = glm::vec4(lodScale, lodSelection.errorThreshold,
+                                 lodSelection.hysteresis, 0.0f),
+      .instanceCount = instanceCount,
+      .occlusionEnabled = occlusionEnabled && hasPreviousViewProjection,
+  };
+  extractFrustumPlanes(viewProjection, cullingData.frustumPlanes);
+  std::memcpy(uniformBuffersMappedMemories[frameIndex], &cullingData,
+              sizeof(cullingData));
+
+  auto drawCountBuffer = drawCountBuffers[frameIndex].get();
+  auto drawCommandBuffer = drawCommandBuffers[frameIndex].get();
+
+  const auto resetTransition = RHIBufferTransition{
+      .buffer = drawCountBuffer,
+      .usage = RHIResourceUsage::TransferDst,
+  };
+  rhi->cmdTransitionResources(commandBuffer, {}, {&resetTransition, 1});
+  rhi->cmdFillBuffer(commandBuffer, drawCountBuffer, 0, sizeof(uint32_t), 0);
+
+  std::array<RHIBufferTransition, 3> cullTransitions = {
+      RHIBufferTransition{
+          .buffer = drawCountBuffer,
+          .usage = RHIResourceUsage::ComputeShaderReadWrite,
+      },
+      RHIBufferTransition{
+          .buffer = drawCommandBuffer,
+          .usage = RHIResourceUsage::ComputeShaderWrite,
+      },
+      // LOD states are carried over from the previous frame's culling.
+      RHIBufferTransition{
+          .buffer = lodStateBuffer.get(),
+          .usage = RHIResourceUsage::ComputeShaderReadWrite,
+      },
+  };
+  rhi->cmdTransitionResources(commandBuffer, {}, cullTransitions);
+  rhi->cmdBindPipeline(commandBuffer, RHIPipelineBindPoint::Compute,
+                       pipeline.get());
+  rhi->cmdBindDescriptorSets(commandBuffer, RHIPipelineBindPoint::Compute,
+                             pipelineLayout.get(), 0, 1,
+                             descriptorSets[frameIndex].get(), 0, nullptr);
+  rhi->cmdDispatch(commandBuffer, (instanceCount + 63) / 64, 1, 1);
+
+  std::array<RHIBufferTransition, 2> indirectTransitions = {
+      RHIBufferTransition{
+          .buffer = drawCommandBuffer,
+          .usage = RHIResourceUsage::IndirectArgument,
+      },
+      RHIBufferTransition{
+          .buffer = drawCountBuffer,
+          .usage = RHIResourceUsage::IndirectArgument,
+      },
+  };
+  rhi->cmdTransitionResources(commandBuffer, {}, indirectTransitions);
+
+  previousViewProjection = viewProjection;
+  hasPreviousViewProjection = true;
+}
+
+void GPUCullingPass::draw(RHICommandBuffer* commandBuffer) {
+  const auto frameIndex = rhi->getCurrentFrameIndex();
+  rhi->cmdDrawIndexedIndirectCount(
+      commandBuffer, drawCommandBuffers[frameIndex].get(), 0,
+      drawCountBuffers[frameIndex].get(), 0, maxInstanceCount,
+      sizeof(RHIDrawIndexedIndirectCommand));
+}
+
+void GPUCullingPass::createPipeline() {
+  auto cullCode = RenderSystem::loadShader(shaderCompiler.get(), "cull.comp");
+  cullShader = rhi->createShaderModule(cullCode);
+
+  std::array<RHIDescriptorSetLayoutBinding, 7> bindings = {
+      RHIDescriptorSetLayoutBinding{
+          .binding = 0,
+          .descriptorType = RHIDescriptorType::UniformBuffer,
+          .descriptorCount = 1,
+          .stageFlags = RHIShaderStageFlag::Compute,
+      },
+      RHIDescriptorSetLayoutBinding{
+          .binding = 1,
+          .descriptorType = RHIDescriptorType::StorageBuffer,
+          .descriptorCount = 1,
+          .stageFlags = RHIShaderStageFlag::Compute,
+      },
+      RHIDescriptorSetLayoutBinding{
+          .binding = 2,
+          .descriptorType = RHIDescriptorType::StorageBuffer,
+          .descriptorCount = 1,
+          .stageFlags = RHIShaderStageFlag::Compute,
+      },
+      RHIDescriptorSetLayoutBinding{
+          .binding = 3,
+          .descriptorType = RHIDescriptorType::StorageBuffer,
+          .descriptorCount = 1,
+          .stageFlags = RHIShaderStageFlag::Compute,
+      },
+      RHIDescriptorSetLayoutBinding{
+          .binding = 4,
+          .descriptorType = RHIDescriptorType::CombinedImageSampler,
+          .descriptorCount = 1,
+          .stageFlags = RHIShaderStageFlag::Compute,
+      },
+      RHIDescriptorSetLayoutBinding{
+          .binding = 5,
+          .descriptorType = RHIDescriptorType::StorageBuffer,
+          .descriptorCount = 1,
+          .stageFlags = RHIShaderStageFlag::Compute,
+      },
+      RHIDescriptorSetLayoutBinding{
+          .binding = 6,
+          .descriptorType = RHIDescriptorType::StorageBuffer,
+          .descriptorCount = 1,
+          .stageFlags = RHIShaderStageFlag::Compute,
+      },
+  };
+  auto descriptorSetLayoutCreateInfo = RHIDescriptorSetLayoutCreateInfo{
+      .bindingCount = bindings.size(),
+      .bindings = bindings.data(),
+  };
+  descriptorSetLayout =
+      rhi->createDescriptorSetLayout(descriptorSetLayoutCreateInfo);
+  descriptorSets = rhi->allocateDescriptorSets(RHIDescriptorSetAllocateInfo{
+      .descriptorSetCount = rhi->getMaxFramesInFlight(),
+      .setLayouts = descriptorSetLayout.get(),
+  });
+
+  auto* setLayout = descriptorSetLayout.get();
+  pipelineLayout = rhi->createPipelineLayout(RHIPipelineLayoutCreateInfo{
+      .setLayoutCount = 1,
+      .setLayouts = &setLayout,
+  });
+
+  pipeline = createCullPipeline(cullShader.get());
+}
+
+std::unique_ptr<RHIPipeline> GPUCullingPass::createCullPipeline(
+    RHIShader* shader) {
+  return rhi->createComputePipeline(RHIComputePipelineCreateInfo{
+      .stage =
+          {
+              .stage = RHIShaderStageFlag::Compute,
+              .module = shader,
+              .name = "main",
+          },
+      .pipelineLayout = pipelineLayout.get(),
+  });
+}
+
+bool GPUCullingPass::reloadShader(std::span<char> code) {
+  auto shader = rhi->createShaderModule(code);
+  if (!shader) {
+    return false;
+  }
+  auto newPipeline = createCullPipeline(shader.get());
+  if (!newPipeline) {
+    rhi->destoryShaderModule(shader.get());
+    return false;
+  }
+
+  // Frames in flight may still dispatch the previous pipeline.
+  std::shared_ptr<RHIPipeline> previousPipeline = std::move(pipeline);
+  rhi->deferRelease([rhi = rhi.get(), previousPipeline] {
+    rhi->destoryPipeline(previousPipeline.get());
+  });
+  rhi->destoryShaderModule(cullShader.get());
+  cullShader = std::move(shader);
+  pipeline = std::move(newPipeline);
+  return true;
+}
+
+void GPUCullingPass::createBuffers() {
+  const auto maxFramesInFlight = rhi->getMaxFramesInFlight();
+
+  drawCommandBuffers.resize(maxFramesInFlight);
+  drawCommandBufferMemories.resize(maxFramesInFlight);
+  drawCountBuffers.resize(maxFramesInFlight);
+  drawCountBufferMemories.resize(maxFramesInFlight);
+  uniformBuffers.resize(maxFramesInFlight);
+  uniformBufferMemories.resize(maxFramesInFlight);
+  uniformBuffersMappedMemories.resize(maxFramesInFlight);
+
+  for (auto i = 0; i < maxFramesInFlight; i++) {
+    std::tie(drawCommandBuffers[i], drawCommandBufferMemories[i]) =
+        rhi->createBuffer(
+            RHIBufferCreateInfo{
+                .size = sizeof(RHIDrawIndexedIndirectCommand) *
+                        maxInstanceCount,
+                .usage = RHIBufferUsageFlag::StorageBuffer |
+                         RHIBufferUsageFlag::IndirectBuffer,
+            },
+            RHIMemoryPropertyFlag::DeviceLocal);
+    std::tie(drawCountBuffers[i], drawCountBufferMemories[i]) =
+        rhi->createBuffer(
+            RHIBufferCreateInfo{
+                .size = sizeof(uint32_t),
+                .usage = RHIBufferUsageFlag::StorageBuffer |
+                         RHIBufferUsageFlag::IndirectBuffer |
+                         RHIBufferUsageFlag::TransferDst,
+            },
+            RHIMemoryPropertyFlag::DeviceLocal);
+    std::tie(uniformBuffers[i], uniformBufferMemories[i]) = rhi->createBuffer(
+        RHIBufferCreateInfo{
+            .size = sizeof(CullingData),
+            .usage = RHIBufferUsageFlag::UniformBuffer,
+        },
+        RHIMemoryPropertyFlag::HostVisible |
+            RHIMemoryPropertyFlag::HostCoherent);
+    uniformBuffersMappedMemories[i] =
+        rhi->mapMemory(uniformBufferMemories[i].get(), 0, sizeof(CullingData));
+  }
+}
+
+void GPUCullingPass::createPlaceholderPyramid() {
+  float farthestDepth[2] = {1.0f, 1.0f};
+  std::tie(placeholderPyramid, placeholderPyramidView,
+           placeholderPyramidMemory) =
+      rhi->createImageAndCopyData(
+          RHIImageCreateInfo{
+              .width = 1,
+              .height = 1,
+              .format = RHIFormat::R32G32Sfloat,
+              .tiling = RHIImageTiling::Optimal,
+              .imageUsageFlags =
+                  RHIImageUsageFlag::TransferDst | RHIImageUsageFlag::Sampled,
+              .memoryPropertyFlags = RHIMemoryPropertyFlag::DeviceLocal,
+              .arrayLayers = 1,
+              .mipLevels = 1,
+          },
+          farthestDepth, sizeof(farthestDepth));
+
+  pyramidSampler = rhi->createSampler(RHISamplerCreateInfo{
+      .magFilter = RHIFilter::Nearest,
+      .minFilter = RHIFilter::Nearest,
+      .mipmapMode = RHISamplerMipmapMode::Nearest,
+      .addressModeU = RHISamplerAddressMode::ClampToEdge,
+      .addressModeV = RHISamplerAddressMode::ClampToEdge,
+      .addressModeW = RHISamplerAddressMode::ClampToEdge,
+      .anisotropyEnable = RHIFalse,
+      .compareEnable = RHIFalse,
+      .compareOp = RHICompareOp::Always,
+      .minLod = 0.0f,
+      .maxLod = 16.0f,
+      .borderColor = RHIBorderColor::FloatOpaqueWhite,
+  });
+}
+
+void GPUCullingPass::createLODStateBuffer() {
+  const auto bufferSize = sizeof(uint32_t) * maxInstanceCount;
+  std::tie(lodStateBuffer, lodStateBufferMemory) = rhi->createBuffer(
+      RHIBufferCreateInfo{
+          .size = bufferSize,
+          .usage = RHIBufferUsageFlag::StorageBuffer |
+                   RHIBufferUsageFlag::TransferDst,
+      },
+      RHIMemoryPropertyFlag::DeviceLocal);
+
+  // Every instance starts at its finest level.
+  auto oneTimeCommandBuffer = rhi->beginOneTimeCommandBuffer();
+  rhi->cmdFillBuffer(oneTimeCommandBuffer.get(), lodStateBuffer.get(), 0,
+                     bufferSize, 0);
+  rhi->endOneTimeCommandBuffer(oneTimeCommandBuffer.get());
+}
+
+void GPUCullingPass::updateDescriptorSets() {
+  const auto maxFramesInFlight = rhi->getMaxFramesInFlight();
+
+  auto instanceBufferInfo = RHIDescriptorBufferInfo{
+      .buffer = instanceBuffer,
+      .offset = 0,
+      .range = sizeof(RenderInstance) * maxInstanceCount,
+  };
+  auto lodBufferInfo = RHIDescriptorBufferInfo{
+      .buffer = lodBuffer,
+      .offset = 0,
+      .range = sizeof(MeshLOD) * lodCount,
+  };
+  auto lodStateBufferInfo = RHIDescriptorBufferInfo{
+      .buffer = lodStateBuffer.get(),
+      .offset = 0,
+      .range = sizeof(uint32_t) * maxInstanceCount,
+  };
+  auto pyramidImageInfo = RHIDescriptorImageInfo{
+      .sampler = pyramidSampler.get(),
+      .imageView = pyramidView,
+      .imageLayout = pyramidLayout,
+  };
+
+  std::vector<RHIDescriptorBufferInfo> bufferInfos;
+  std::vector<RHIWriteDescriptorSet> writeDescriptorSets;
+  bufferInfos.reserve(maxFramesInFlight * 3);
+  writeDescriptorSets.reserve(maxFramesInFlight * 7);
+
+  for (auto i = 0; i < maxFramesInFlight; i++) {
+    bufferInfos.push_back(RHIDescriptorBufferInfo{
+        .buffer = uniformBuffers[i].get(),
+        .offset = 0,
+        .range = sizeof(CullingData),
+    });
+    auto uniformBufferInfo = &bufferInfos.back();
+    bufferInfos.push_back(RHIDescriptorBufferInfo{
+        .buffer = drawCommandBuffers[i].get(),
+        .offset = 0,
+        .range = sizeof(RHIDrawIndexedIndirectCommand) * maxInstanceCount,
+    });
+    auto drawCommandBufferInfo = &bufferInfos.back();
+    bufferInfos.push_back(RHIDescriptorBufferInfo{
+        .buffer = drawCountBuffers[i].get(),
+        .offset = 0,
+        .range = sizeof(uint32_t),
+    });
+    auto drawCountBufferInfo = &bufferInfos.back();
+
+    auto descriptorSet = descriptorSets[i].get();
+    writeDescriptorSets.push_back(RHIWriteDescriptorSet{
+        .dstSet = descriptorSet,
+        .dstBinding = 0,
+        .descriptorCount = 1,
+        .descriptorType = RHIDescriptorType::UniformBuffer,
+        .bufferInfo = uniformBufferInfo,
+    });
+    writeDescriptorSets.push_back(RHIWriteDescriptorSet{
+        .dstSet = descriptorSet,
+        .dstBinding = 1,
+        .descriptorCount = 1,
+        .descriptorType = RHIDescriptorType::StorageBuffer,
+        .bufferInfo = &instanceBufferInfo,
+    });
+    writeDescriptorSets.push_back(RHIWriteDescriptorSet{
+        .dstSet = descriptorSet,
+        .dstBinding = 2,
+        .descriptorCount = 1,
+        .descriptorType = RHIDescriptorType::StorageBuffer,
+        .bufferInfo = drawCommandBufferInfo,
+    });
+    writeDescriptorSets.push_back(RHIWriteDescriptorSet{
+        .dstSet = descriptorSet,
+        .dstBinding = 3,
+        .descriptorCount = 1,
+        .descriptorType = RHIDescriptorType::StorageBuffer,
+        .bufferInfo = drawCountBufferInfo,
+    });
+    writeDescriptorSets.push_back(RHIWriteDescriptorSet{
+        .dstSet = descriptorSet,
+        .dstBinding = 4,
+        .descriptorCount = 1,
+        .descriptorType = RHIDescriptorType::CombinedImageSampler,
+        .imageInfo = &pyramidImageInfo,
+    });
+    writeDescriptorSets.push_back(RHIWriteDescriptorSet{
+        .dstSet = descriptorSet,
+        .dstBinding = 5,
+        .descriptorCount = 1,
+        .descriptorType = RHIDescriptorType::StorageBuffer,
+        .bufferInfo = &lodBufferInfo,
+    });
+    writeDescriptorSets.push_back(RHIWriteDescriptorSet{
+        .dstSet = descriptorSet,
+        .dstBinding = 6,
+        .descriptorCount = 1,
+        .descriptorType = RHIDescriptorType::StorageBuffer,
+        .bufferInfo = &lodStateBufferInfo,
+    });
+  }
+  rhi->updateDescriptorSets(writeDescriptorSets);
+}
+
+void GPUCullingPass::updatePyramidDescriptorSet(uint32_t frameIndex) {
+  auto pyramidImageInfo = RHIDescriptorImageInfo{
+      .sampler = pyramidSampler.get(),
+      .imageView = pyramidView,
+      .imageLayout = pyramidLayout,
+  };
+  auto writeDescriptorSet = RHIWriteDescriptorSet{
+      .dstSet = descriptorSets[frameIndex].get(),
+      .dstBinding = 4,
+      .descriptorCount = 1,
+      .descriptorType = RHIDescriptorType::CombinedImageSampler,
+      .imageInfo = &pyramidImageInfo,
+  };
+  rhi->updateDescriptorSets({&writeDescriptorSet, 1});
+}
+
+void GPUCullingPass::extractFrustumPlanes(const glm::mat4& viewProjection,
+                                          glm::vec4 (&planes)[6]) {
+  // Gribb-Hartmann extraction for a [0, 1] clip space depth range.
+  auto row = [&viewProjection](int i) {
+    return glm::vec4(viewProjection[0][i], viewProjection[1][i],
+                     viewProjection[2][i], viewProjection[3][i]);
+  };
+  planes[0] = row(3) + row(0);
+  planes[1] = row(3) - row(0);
+  planes[2] = row(3) + row(1);
+  planes[3] = row(3) - row(1);
+  planes[4] = row(2);
+  planes[5] = row(3) - row(2);
+  for (auto& plane : planes) {
+    plane /= glm::length(glm::vec3(plane));
+  }
+}
+
+}  // namespace Sparrow
@@ -0,0 +1,133 @@
+#ifndef SPARROWENGINE_RENDER_CULLING_H
+#define SPARROWENGINE_RENDER_CULLING_H
+
+#include <memory>
+#include <span>
+#include <vector>
+#include "RHI/rhi_struct.h"
+#include "mesh_lod.h"
+#include "render_mesh.h"
+
+namespace Sparrow {
+class RHI;
+class ShaderCompiler;
+
+// Mirrors the CullingData uniform block of cull.comp (std140).
+struct CullingData {
+  glm::mat4 viewProjection;
+  glm::mat4 previousViewProjection;
+  glm::vec4 frustumPlanes[6];
+  glm::vec4 pyramidSize;  // Width, height and mip count of the pyramid.
+  // Pixels per object-space unit at view depth one, error threshold and
+  // hysteresis of the LOD selection.
+  glm::vec4 lodParameters;
+  uint32_t instanceCount;
+  uint32_t occlusionEnabled;
+  uint32_t padding[2];
+};
+
+struct GPUCullingPassInitInfo {
+  std::shared_ptr<RHI> rhi;
+  // Storage buffer holding up to `maxInstanceCount` RenderInstances.
+  RHIBuffer* instanceBuffer = nullptr;
+  uint32_t maxInstanceCount = 0;
+  // Storage buffer holding the MeshLOD table the instances point into.
+  RHIBuffer* lodBuffer = nullptr;
+  uint32_t lodCount = 0;
+  MeshLODSelectionSettings lodSelection;
+  // Compiles the shader from source when set, the SPIR-V built with the
+  // engine is loaded otherwise.
+  std::shared_ptr<ShaderCompiler> shaderCompiler;
+};
+
+// Culls instances against the view frustum and the previous frame's depth
+// pyramid in a compute shader, then writes the survivors as a compacted
+// list of indexed indirect draws plus a draw count. Each survivor is drawn
+// with the level of detail its projected error allows, the level picked
+// last frame is kept per instance for hysteresis.
+class GPUCullingPass {
+ public:
+  void initialize(const GPUCullingPassInitInfo& initInfo);
+
+  void setInstanceCount(uint32_t count);
+  // Enables occlusion culling. The pyramid's .g channel holds the farthest
+  // depth of each texel, mip 0 covering the whole depth attachment. The
+  // pyramid is assumed to be empty until the next `cull`. Frames already
+  // recorded keep using the previous one.
+  void setDepthPyramid(RHIImageView* imageView,
+                       RHIImageLayout imageLayout,
+                       uint32_t width,
+                       uint32_t height,
+                       uint32_t mipLevels);
+
+  // Records the culling dispatch, must be outside of a render pass.
+  // `lodScale` is the number of pixels one object-space unit covers at a
+  // view depth of one.
+  void cull(RHICommandBuffer* commandBuffer,
+            const glm::mat4& viewProjection,
+            float lodScale);
+  // Records the indirect draw of everything that survived `cull`.
+  void draw(RHICommandBuffer* commandBuffer);
+
+  // Replaces the culling pipeline with one built from new SPIR-V, the
+  // previous one is released after the frames in flight. Returns false and
+  // keeps the current pipeline if creation failed.
+  bool reloadShader(std::span<char> code);
+
+ private:
+  void createPipeline();
+  std::unique_ptr<RHIPipeline> createCullPipeline(RHIShader* shader);
+  void createBuffers();
+  void createPlaceholderPyramid();
+  void createLODStateBuffer();
+  void updateDescriptorSets();
+  void updatePyramidDescriptorSet(uint32_t frameIndex);
+
+  static void extractFrustumPlanes(const glm::mat4& viewProjection,
+                                   glm::vec4 (&planes)[6]);
+
+  std::shared_ptr<RHI> rhi;
+  std::shared_ptr<ShaderCompiler> shaderCompiler;
+  RHIBuffer* instanceBuffer = nullptr;
+  uint32_t maxInstanceCount = 0;
+  uint32_t instanceCount = 0;
+  RHIBuffer* lodBuffer = nullptr;
+  uint32_t lodCount = 0;
+  MeshLODSelectionSettings lodSelection;
+
+  std::unique_ptr<RHIShader> cullShader;
+  std::unique_ptr<RHIDescriptorSetLayout> descriptorSetLayout;
+  std::vector<std::unique_ptr<RHIDescriptorSet>> descriptorSets;
+  std::unique_ptr<RHIPipelineLayout> pipelineLayout;
+  std::unique_ptr<RHIPipeline> pipeline;
+
+  std::vector<std::unique_ptr<RHIBuffer>> drawCommandBuffers;
+  std::vector<std::unique_ptr<RHIDeviceMemory>> drawCommandBufferMemories;
+  std::vector<std::unique_ptr<RHIBuffer>> drawCountBuffers;
+  std::vector<std::unique_ptr<RHIDeviceMemory>> drawCountBufferMemories;
+  std::vector<std::unique_ptr<RHIBuffer>> uniformBuffers;
+  std::vector<std::unique_ptr<RHIDeviceMemory>> uniformBufferMemories;
+  std::vector<void*> uniformBuffersMappedMemories;
+  // Level each instance was drawn with last time, shared by all frames.
+  std::unique_ptr<RHIBuffer> lodStateBuffer;
+  std::unique_ptr<RHIDeviceMemory> lodStateBufferMemory;
+
+  // 1x1 far-plane pyramid bound until a real one is provided.
+  std::unique_ptr<RHIImage> placeholderPyramid;
+  std::unique_ptr<RHIImageView> placeholderPyramidView;
+  std::unique_ptr<RHIDeviceMemory> placeholderPyramidMemory;
+  std::unique_ptr<RHISampler> pyramidSampler;
+  RHIImageView* pyramidView = nullptr;
+  RHIImageLayout pyramidLayout = RHIImageLayout::ReadOnlyOptimal;
+  glm::vec4 pyramidSize = {1.0f, 1.0f, 1.0f, 0.0f};
+  // Per frame in flight, whether its set still binds an older pyramid.
+  std::vector<bool> pyramidDescriptorStale;
+  bool occlusionEnabled = false;
+
+  glm::mat4 previousViewProjection = glm::mat4(1.0f);
+  bool hasPreviousViewProjection = false;
+};
+
+}  // namespace Sparrow
+
+#endif  // SPARROWENGINE_RENDER_CULLING_H
@@ -256,6 +256,7 @@ enum class RHIDynamicState {
   RasterizerDiscardEnable = 1000377001,
   DepthBiasEnable = 1000377002,
   PrimitiveRestartEnable = 1000377004,
+  ColorBlendEnableEXT = 1000455010,
   ViewportWScalingNV = 1000087000,
   DiscardRectangleEXT = 1000099000,
   SampleLocationsEXT = 1000143000,
@@ -442,6 +443,36 @@ enum class RHIImageLayout {
   // TODO
 };
 
+// Values match VkPresentModeKHR.
+enum class RHIPresentMode {
+  Immediate = 0,
+  Mailbox = 1,
+  Fifo = 2,
+  FifoRelaxed = 3,
+};
+
+// How a resource is about to be used. The RHI derives the pipeline stages,
+// accesses and image layout from it. Buffer only usages leave image
+// layouts alone, Undefined declares nothing.
+enum class RHIResourceUsage {
+  Undefined,
+  TransferSrc,
+  TransferDst,
+  IndirectArgument,
+  VertexBuffer,
+  IndexBuffer,
+  UniformBuffer,
+  VertexShaderRead,
+  FragmentShaderSampled,
+  ComputeShaderRead,
+  ComputeShaderWrite,
+  ComputeShaderReadWrite,
+  ComputeShaderSampledDepth,
+  ColorAttachment,
+  DepthAttachment,
+  Present,
+};
+
 enum class RHIPipelineBindPoint {
   Graphics = 0,
   Compute = 1,
@@ -676,6 +707,27 @@ enum class RHIImageCreateFlag {
   SplitInstanceBindRegionsKHR = RHIImageCreateFlag::SplitInstanceBindRegions,
 };
 
+enum class RHIImageViewType {
+  Type1D = 0,
+  Type2D = 1,
+  Type3D = 2,
+  Cube = 3,
+  Type1DArray = 4,
+  Type2DArray = 5,
+  CubeArray = 6,
+};
+
+enum class RHIImageAspectFlag : RHIFlag {
+  Color = 0x00000001,
+  Depth = 0x00000002,
+  Stencil = 0x00000004,
+  Metadata = 0x00000008,
+  Plane0 = 0x00000010,
+  Plane1 = 0x00000020,
+  Plane2 = 0x00000040,
+  None = 0,
+};
+
 enum class RHIBorderColor {
   FloatTransparentBlack = 0,
   IntTransparentBlack = 1,
@@ -708,6 +760,13 @@ enum class RHIFilter {
   CubicIMG = RHIFilter::CubicEXT
 };
 
+enum class RHIGraphicsPipelineLibraryFlag : RHIFlag {
+  VertexInputInterface = 0x00000001,
+  PreRasterizationShaders = 0x00000002,
+  FragmentShader = 0x00000004,
+  FragmentOutputInterface = 0x00000008,
+};
+
 template <typename EnumType>
 struct RHIFlagEnum : public std::false_type {};
 
@@ -746,5 +805,7 @@ DEF_RHI_FLAG_ENUM_TYPE(RHIBufferUsageFlag);
 DEF_RHI_FLAG_ENUM_TYPE(RHIMemoryPropertyFlag);
 DEF_RHI_FLAG_ENUM_TYPE(RHIImageUsageFlag);
 DEF_RHI_FLAG_ENUM_TYPE(RHIImageCreateFlag);
+DEF_RHI_FLAG_ENUM_TYPE(RHIImageAspectFlag);
+DEF_RHI_FLAG_ENUM_TYPE(RHIGraphicsPipelineLibraryFlag);
 }  // namespace Sparrow
 #endif
\ No newline at end of file
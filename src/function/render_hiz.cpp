@@ -0,0 +1,372 @@
+#include "render_hiz.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <tuple>
+#include "RHI/rhi.h"
+#include "function/render_system.h"
+
+namespace Sparrow {
+
+void HiZPass::initialize(const HiZPassInitInfo& initInfo) {
+  rhi = initInfo.rhi;
+  shaderCompiler = initInfo.shaderCompiler;
+  width = std::max(initInfo.width, 1U);
+  height = std::max(initInfo.height, 1U);
+
+  const auto depthFormat = rhi->getDepthImageInfo().format;
+  if (depthFormat == RHIFormat::D16UnormS8Uint ||
+      depthFormat == RHIFormat::D24UnormS8Uint ||
+      depthFormat == RHIFormat::D32SfloatS8Uint) {
+    depthAspect = RHIImageAspectFlag::Depth | RHIImageAspectFlag::Stencil;
+  }
+
+  createPipelines();
+  createPyramid();
+  mipDescriptorSetsStale.assign(rhi->getMaxFramesInFlight(), true);
+}
+
+bool HiZPass::resize(uint32_t newWidth, uint32_t newHeight) {
+  newWidth = std::max(newWidth, 1U);
+  newHeight = std::max(newHeight, 1U);
+  if (newWidth == width && newHeight == height) {
+    return false;
+  }
+
+  destroyPyramid();
+  width = newWidth;
+  height = newHeight;
+  createPyramid();
+  // Frames in flight still bind their sets, each frame rewrites its own
+  // the next time it builds.
+  std::fill(mipDescriptorSetsStale.begin(), mipDescriptorSetsStale.end(),
+            true);
+  return true;
+}
+
+void HiZPass::build(RHICommandBuffer* commandBuffer) {
+  const auto frameIndex = rhi->getCurrentFrameIndex();
+  updateDepthDescriptorSet(frameIndex);
+  if (mipDescriptorSetsStale[frameIndex]) {
+    updateMipDescriptorSets(frameIndex);
+    mipDescriptorSetsStale[frameIndex] = false;
+  }
+
+  // Previous pyramid contents are consumed by the culling pass earlier in
+  // the frame, so they can be discarded.
+  std::array<RHIImageTransition, 2> beginTransitions = {
+      RHIImageTransition{
+          .image = rhi->getDepthImageInfo().image,
+          .subresourceRange = {.aspectMask = depthAspect},
+          .usage = RHIResourceUsage::ComputeShaderSampledDepth,
+      },
+      RHIImageTransition{
+          .image = pyramid.get(),
+          .subresourceRange = {.levelCount = 1},
+          .usage = RHIResourceUsage::ComputeShaderWrite,
+          .discard = true,
+      },
+  };
+  rhi->cmdTransitionResources(commandBuffer, beginTransitions, {});
+
+  rhi->cmdBindPipeline(commandBuffer, RHIPipelineBindPoint::Compute,
+                       depthReducePipeline.get());
+  rhi->cmdBindDescriptorSets(commandBuffer, RHIPipelineBindPoint::Compute,
+                             pipelineLayout.get(), 0, 1,
+                             depthDescriptorSets[frameIndex].get(), 0, nullptr);
+  rhi->cmdDispatch(commandBuffer, (width + 7) / 8, (height + 7) / 8, 1);
+
+  for (auto level = 0U; level < mipLevels; level++) {
+    if (level + 1 == mipLevels) {
+      // The lower levels are read already, only the last one needs a
+      // barrier before the next frame's culling samples the pyramid.
+      const auto readTransition = RHIImageTransition{
+          .image = pyramid.get(),
+          .usage = RHIResourceUsage::ComputeShaderRead,
+      };
+      rhi->cmdTransitionResources(commandBuffer, {&readTransition, 1}, {});
+      break;
+    }
+
+    // Both land in one barrier command before the dispatch.
+    std::array<RHIImageTransition, 2> levelTransitions = {
+        RHIImageTransition{
+            .image = pyramid.get(),
+            .subresourceRange = {.baseMipLevel = level, .levelCount = 1},
+            .usage = RHIResourceUsage::ComputeShaderRead,
+        },
+        RHIImageTransition{
+            .image = pyramid.get(),
+            .subresourceRange = {.baseMipLevel = level + 1, .levelCount = 1},
+            .usage = RHIResourceUsage::ComputeShaderWrite,
+            .discard = true,
+        },
+    };
+    rhi->cmdTransitionResources(commandBuffer, levelTransitions, {});
+
+    if (level == 0) {
+      rhi->cmdBindPipeline(commandBuffer, RHIPipelineBindPoint::Compute,
+                           mipReducePipeline.get());
+    }
+    rhi->cmdBindDescriptorSets(commandBuffer, RHIPipelineBindPoint::Compute,
+                               pipelineLayout.get(), 0, 1,
+                               getMipDescriptorSet(frameIndex, level), 0,
+                               nullptr);
+    const auto levelWidth = std::max(width >> (level + 1), 1U);
+    const auto levelHeight = std::max(height >> (level + 1), 1U);
+    rhi->cmdDispatch(commandBuffer, (levelWidth + 7) / 8,
+                     (levelHeight + 7) / 8, 1);
+  }
+}
+
+void HiZPass::createPipelines() {
+  auto reduceCode = RenderSystem::loadShader(shaderCompiler.get(),
+                                             "hiz_reduce.comp");
+  reduceShader = rhi->createShaderModule(reduceCode);
+
+  std::array<RHIDescriptorSetLayoutBinding, 2> bindings = {
+      RHIDescriptorSetLayoutBinding{
+          .binding = 0,
+          .descriptorType = RHIDescriptorType::CombinedImageSampler,
+          .descriptorCount = 1,
+          .stageFlags = RHIShaderStageFlag::Compute,
+      },
+      RHIDescriptorSetLayoutBinding{
+          .binding = 1,
+          .descriptorType = RHIDescriptorType::StorageImage,
+          .descriptorCount = 1,
+          .stageFlags = RHIShaderStageFlag::Compute,
+      },
+  };
+  auto descriptorSetLayoutCreateInfo = RHIDescriptorSetLayoutCreateInfo{
+      .bindingCount = bindings.size(),
+      .bindings = bindings.data(),
+  };
+  descriptorSetLayout =
+      rhi->createDescriptorSetLayout(descriptorSetLayoutCreateInfo);
+  depthDescriptorSets =
+      rhi->allocateDescriptorSets(RHIDescriptorSetAllocateInfo{
+          .descriptorSetCount = rhi->getMaxFramesInFlight(),
+          .setLayouts = descriptorSetLayout.get(),
+      });
+  mipDescriptorSets = rhi->allocateDescriptorSets(RHIDescriptorSetAllocateInfo{
+      .descriptorSetCount = rhi->getMaxFramesInFlight() * (MaxMipLevels - 1),
+      .setLayouts = descriptorSetLayout.get(),
+  });
+
+  auto* setLayout = descriptorSetLayout.get();
+  pipelineLayout = rhi->createPipelineLayout(RHIPipelineLayoutCreateInfo{
+      .setLayoutCount = 1,
+      .setLayouts = &setLayout,
+  });
+
+  depthReducePipeline = createReducePipeline(reduceShader.get(), RHITrue);
+  mipReducePipeline = createReducePipeline(reduceShader.get(), RHIFalse);
+
+  sampler = rhi->createSampler(RHISamplerCreateInfo{
+      .magFilter = RHIFilter::Nearest,
+      .minFilter = RHIFilter::Nearest,
+      .mipmapMode = RHISamplerMipmapMode::Nearest,
+      .addressModeU = RHISamplerAddressMode::ClampToEdge,
+      .addressModeV = RHISamplerAddressMode::ClampToEdge,
+      .addressModeW = RHISamplerAddressMode::ClampToEdge,
+      .anisotropyEnable = RHIFalse,
+      .compareEnable = RHIFalse,
+      .compareOp = RHICompareOp::Always,
+      .minLod = 0.0f,
+      .maxLod = 0.0f,
+      .borderColor = RHIBorderColor::FloatOpaqueWhite,
+  });
+}
+
+std::unique_ptr<RHIPipeline> HiZPass::createReducePipeline(
+    RHIShader* shader,
+    RHIBool32 sourceIsDepth) {
+  // Both variants share the shader, the specialization constant selects
+  // whether the source is the depth attachment or a pyramid level.
+  auto sourceIsDepthEntry = RHISpecializationMapEntry{
+      .constantID = 0,
+      .offset = 0,
+      .size = sizeof(RHIBool32),
+  };
+  auto specializationInfo = RHISpecializationInfo{
+      .mapEntryCount = 1,
+      .pMapEntries = &sourceIsDepthEntry,
+      .dataSize = sizeof(sourceIsDepth),
+      .pData = &sourceIsDepth,
+  };
+  return rhi->createComputePipeline(RHIComputePipelineCreateInfo{
+      .stage =
+          {
+              .stage = RHIShaderStageFlag::Compute,
+              .module = shader,
+              .name = "main",
+              .specializationInfo = &specializationInfo,
+          },
+      .pipelineLayout = pipelineLayout.get(),
+  });
+}
+
+bool HiZPass::reloadShader(std::span<char> code) {
+  auto shader = rhi->createShaderModule(code);
+  if (!shader) {
+    return false;
+  }
+  auto depthPipeline = createReducePipeline(shader.get(), RHITrue);
+  auto mipPipeline = createReducePipeline(shader.get(), RHIFalse);
+  if (!depthPipeline || !mipPipeline) {
+    for (auto* pipeline : {depthPipeline.get(), mipPipeline.get()}) {
+      if (pipeline) {
+        rhi->destoryPipeline(pipeline);
+      }
+    }
+    rhi->destoryShaderModule(shader.get());
+    return false;
+  }
+
+  // Frames in flight may still dispatch the previous pipelines.
+  std::shared_ptr<RHIPipeline> previousDepthPipeline =
+      std::move(depthReducePipeline);
+  std::shared_ptr<RHIPipeline> previousMipPipeline =
+      std::move(mipReducePipeline);
+  rhi->deferRelease(
+      [rhi = rhi.get(), previousDepthPipeline, previousMipPipeline] {
+        rhi->destoryPipeline(previousDepthPipeline.get());
+        rhi->destoryPipeline(previousMipPipeline.get());
+      });
+  rhi->destoryShaderModule(reduceShader.get());
+  reduceShader = std::move(shader);
+  depthReducePipeline = std::move(depthPipeline);
+  mipReducePipeline = std::move(mipPipeline);
+  return true;
+}
+
+void HiZPass::createPyramid() {
+  mipLevels = std::min<uint32_t>(std::bit_width(std::max(width, height)),
+                                 MaxMipLevels);
+
+  std::tie(pyramid, pyramidMemory) = rhi->createImage(RHIImageCreateInfo{
+      .width = width,
+      .height = height,
+      .format = RHIFormat::R32G32Sfloat,
+      .tiling = RHIImageTiling::Optimal,
+      .imageUsageFlags = RHIImageUsageFlag::Storage | RHIImageUsageFlag::Sampled,
+      .memoryPropertyFlags = RHIMemoryPropertyFlag::DeviceLocal,
+      .arrayLayers = 1,
+      .mipLevels = mipLevels,
+  });
+
+  pyramidView = rhi->createImageView(RHIImageViewCreateInfo{
+      .image = pyramid.get(),
+      .viewType = RHIImageViewType::Type2D,
+      .format = RHIFormat::R32G32Sfloat,
+      .subresourceRange = {.levelCount = mipLevels, .layerCount = 1},
+  });
+
+  mipViews.resize(mipLevels);
+  for (auto level = 0U; level < mipLevels; level++) {
+    mipViews[level] = rhi->createImageView(RHIImageViewCreateInfo{
+        .image = pyramid.get(),
+        .viewType = RHIImageViewType::Type2D,
+        .format = RHIFormat::R32G32Sfloat,
+        .subresourceRange = {.baseMipLevel = level,
+                             .levelCount = 1,
+                             .layerCount = 1},
+    });
+  }
+}
+
+void HiZPass::destroyPyramid() {
+  // Frames in flight may still reduce into or sample the pyramid, so it is
+  // released after them.
+  auto views = std::make_shared<std::vector<std::unique_ptr<RHIImageView>>>(
+      std::move(mipViews));
+  views->push_back(std::move(pyramidView));
+  std::shared_ptr<RHIImage> image = std::move(pyramid);
+  std::shared_ptr<RHIDeviceMemory> memory = std::move(pyramidMemory);
+  rhi->deferRelease([rhi = rhi.get(), views, image, memory] {
+    for (auto& view : *views) {
+      rhi->destoryImageView(view.get());
+    }
+    rhi->destoryImage(image.get());
+    rhi->freeMemory(memory.get());
+  });
+  mipViews.clear();
+}
+
+RHIDescriptorSet* HiZPass::getMipDescriptorSet(uint32_t frameIndex,
+                                              uint32_t level) const {
+  return mipDescriptorSets[frameIndex * (MaxMipLevels - 1) + level].get();
+}
+
+void HiZPass::updateMipDescriptorSets(uint32_t frameIndex) {
+  if (mipLevels < 2) {
+    return;
+  }
+
+  std::vector<RHIDescriptorImageInfo> imageInfos;
+  std::vector<RHIWriteDescriptorSet> writeDescriptorSets;
+  imageInfos.reserve((mipLevels - 1) * 2);
+  writeDescriptorSets.reserve((mipLevels - 1) * 2);
+
+  for (auto level = 0U; level + 1 < mipLevels; level++) {
+    imageInfos.push_back(RHIDescriptorImageInfo{
+        .sampler = sampler.get(),
+        .imageView = mipViews[level].get(),
+        .imageLayout = RHIImageLayout::General,
+    });
+    auto sourceInfo = &imageInfos.back();
+    imageInfos.push_back(RHIDescriptorImageInfo{
+        .imageView = mipViews[level + 1].get(),
+        .imageLayout = RHIImageLayout::General,
+    });
+    auto destinationInfo = &imageInfos.back();
+
+    writeDescriptorSets.push_back(RHIWriteDescriptorSet{
+        .dstSet = getMipDescriptorSet(frameIndex, level),
+        .dstBinding = 0,
+        .descriptorCount = 1,
+        .descriptorType = RHIDescriptorType::CombinedImageSampler,
+        .imageInfo = sourceInfo,
+    });
+    writeDescriptorSets.push_back(RHIWriteDescriptorSet{
+        .dstSet = getMipDescriptorSet(frameIndex, level),
+        .dstBinding = 1,
+        .descriptorCount = 1,
+        .descriptorType = RHIDescriptorType::StorageImage,
+        .imageInfo = destinationInfo,
+    });
+  }
+  rhi->updateDescriptorSets(writeDescriptorSets);
+}
+
+void HiZPass::updateDepthDescriptorSet(uint32_t frameIndex) {
+  auto sourceInfo = RHIDescriptorImageInfo{
+      .sampler = sampler.get(),
+      .imageView = rhi->getDepthImageInfo().imageView,
+      .imageLayout = RHIImageLayout::DepthStencilReadOnlyOptimal,
+  };
+  auto destinationInfo = RHIDescriptorImageInfo{
+      .imageView = mipViews[0].get(),
+      .imageLayout = RHIImageLayout::General,
+  };
+  std::array<RHIWriteDescriptorSet, 2> writeDescriptorSets = {
+      RHIWriteDescriptorSet{
+          .dstSet = depthDescriptorSets[frameIndex].get(),
+          .dstBinding = 0,
+          .descriptorCount = 1,
+          .descriptorType = RHIDescriptorType::CombinedImageSampler,
+          .imageInfo = &sourceInfo,
+      },
+      RHIWriteDescriptorSet{
+          .dstSet = depthDescriptorSets[frameIndex].get(),
+          .dstBinding = 1,
+          .descriptorCount = 1,
+          .descriptorType = RHIDescriptorType::StorageImage,
+          .imageInfo = &destinationInfo,
+      },
+  };
+  rhi->updateDescriptorSets(writeDescriptorSets);
+}
+
+}  // namespace Sparrow
@@ -0,0 +1,93 @@
+#ifndef SPARROWENGINE_RENDER_HIZ_H
+#define SPARROWENGINE_RENDER_HIZ_H
+
+#include <memory>
+#include <span>
+#include <vector>
+#include "RHI/rhi_struct.h"
+
+namespace Sparrow {
+class RHI;
+class ShaderCompiler;
+
+struct HiZPassInitInfo {
+  std::shared_ptr<RHI> rhi;
+  uint32_t width = 0;
+  uint32_t height = 0;
+  // Compiles the shader from source when set, the SPIR-V built with the
+  // engine is loaded otherwise.
+  std::shared_ptr<ShaderCompiler> shaderCompiler;
+};
+
+// Reduces the depth attachment into a mip chain of (nearest, farthest) depth
+// pairs stored as RG32F. Level 0 has the resolution of the depth attachment
+// and every following level halves it, so a texel of level N bounds the
+// depth of the 2^N x 2^N pixels below it.
+class HiZPass {
+ public:
+  static constexpr uint32_t MaxMipLevels = 16;
+
+  void initialize(const HiZPassInitInfo& initInfo);
+
+  // Recreates the pyramid when the depth attachment changed size. Returns
+  // true if it did, the previous views are released once the frames in
+  // flight finished and must not be used by new ones.
+  bool resize(uint32_t width, uint32_t height);
+
+  // Records the reduction, must be outside of a render pass and after the
+  // depth attachment has been written. Leaves the depth attachment in
+  // DepthStencilReadOnlyOptimal and the pyramid in General.
+  void build(RHICommandBuffer* commandBuffer);
+
+  // Replaces the reduction pipelines with ones built from new SPIR-V, the
+  // previous ones are released after the frames in flight. Returns false
+  // and keeps the current pipelines if creation failed.
+  bool reloadShader(std::span<char> code);
+
+  // View of every level, to be sampled with a nearest filter in General.
+  RHIImageView* getPyramidView() const { return pyramidView.get(); }
+  uint32_t getWidth() const { return width; }
+  uint32_t getHeight() const { return height; }
+  uint32_t getMipLevels() const { return mipLevels; }
+
+ private:
+  void createPipelines();
+  std::unique_ptr<RHIPipeline> createReducePipeline(RHIShader* shader,
+                                                    RHIBool32 sourceIsDepth);
+  void createPyramid();
+  void destroyPyramid();
+  RHIDescriptorSet* getMipDescriptorSet(uint32_t frameIndex,
+                                        uint32_t level) const;
+  void updateMipDescriptorSets(uint32_t frameIndex);
+  void updateDepthDescriptorSet(uint32_t frameIndex);
+
+  std::shared_ptr<RHI> rhi;
+  std::shared_ptr<ShaderCompiler> shaderCompiler;
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t mipLevels = 0;
+  RHIImageAspectFlag depthAspect = RHIImageAspectFlag::Depth;
+
+  std::unique_ptr<RHIShader> reduceShader;
+  std::unique_ptr<RHIDescriptorSetLayout> descriptorSetLayout;
+  // The depth attachment is recreated with the swap chain, so the set
+  // reading it is rewritten every frame and needs one per frame in flight.
+  std::vector<std::unique_ptr<RHIDescriptorSet>> depthDescriptorSets;
+  // Set i of a frame reduces level i into level i + 1. Each frame has its
+  // own so that a resize never rewrites sets a frame in flight uses.
+  std::vector<std::unique_ptr<RHIDescriptorSet>> mipDescriptorSets;
+  std::vector<bool> mipDescriptorSetsStale;
+  std::unique_ptr<RHIPipelineLayout> pipelineLayout;
+  std::unique_ptr<RHIPipeline> depthReducePipeline;
+  std::unique_ptr<RHIPipeline> mipReducePipeline;
+  std::unique_ptr<RHISampler> sampler;
+
+  std::unique_ptr<RHIImage> pyramid;
+  std::unique_ptr<RHIDeviceMemory> pyramidMemory;
+  std::unique_ptr<RHIImageView> pyramidView;
+  std::vector<std::unique_ptr<RHIImageView>> mipViews;
+};
+
+}  // namespace Sparrow
+
+#endif  // SPARROWENGINE_RENDER_HIZ_H
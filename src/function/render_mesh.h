@@ -15,6 +15,7 @@ struct Vertex {
   glm::vec3 position;
   glm::vec3 color;
   glm::vec2 texCoord;
+  glm::vec3 normal;
 
   static RHIVertexBindingDescription getBindingDescription() {
     return RHIVertexBindingDescription{.binding = 0,
@@ -22,9 +23,9 @@ struct Vertex {
                                        .inputRate = RHIVertexInputRate::Vertex};
   }
 
-  static std::array<RHIVertexAttributeDescription, 3>
+  static std::array<RHIVertexAttributeDescription, 4>
   getAttributeDescription() {
-    std::array<RHIVertexAttributeDescription, 3> descriptions;
+    std::array<RHIVertexAttributeDescription, 4> descriptions;
 
     descriptions[0] = RHIVertexAttributeDescription{
         .location = 0,
@@ -47,6 +48,13 @@ struct Vertex {
         .offset = offsetof(Vertex, texCoord),
     };
 
+    descriptions[3] = RHIVertexAttributeDescription{
+        .location = 3,
+        .binding = 0,
+        .format = RHIFormat::R32G32B32Sfloat,
+        .offset = offsetof(Vertex, normal),
+    };
+
     return descriptions;
   }
 };
@@ -57,6 +65,35 @@ struct Transform {
   glm::mat4 projection;
 };
 
+// Per-instance data shared by the vertex shader and the culling shader,
+// laid out as std430.
+struct RenderInstance {
+  glm::mat4 model;
+  glm::vec4 boundingSphere;  // Object-space center and radius.
+  // Dequantization of the mesh's packed positions, see VertexQuantization.
+  // positionScale.w is 1 when the mesh's normals are octahedral.
+  glm::vec4 positionOffset;
+  glm::vec4 positionScale;
+  uint32_t indexCount;
+  uint32_t firstIndex;
+  int32_t vertexOffset;
+  uint32_t padding;
+  // Range of the mesh's levels of detail in the LOD table, LOD 0 being the
+  // full index range above. No LODs when `lodCount` is zero.
+  uint32_t firstLOD;
+  uint32_t lodCount;
+  uint32_t lodPadding[2];
+};
+
+// One level of detail, an index range into the mesh's index buffer, laid
+// out as std430.
+struct MeshLOD {
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  float error;  // Object-space geometric deviation from LOD 0.
+  uint32_t padding;
+};
+
 }  // namespace Sparrow
 
 #endif
\ No newline at end of file
@@ -0,0 +1,204 @@
+#include "render_queue.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include "RHI/rhi.h"
+#include "function/geometry_pool.h"
+#include "utils/thread_pool.h"
+
+namespace Sparrow {
+
+namespace {
+constexpr uint32_t PassBits = 4;
+constexpr uint32_t LayerBits = 4;
+constexpr uint32_t PipelineBits = 11;
+constexpr uint32_t MaterialBits = 12;
+constexpr uint32_t DepthBits = 32;
+
+constexpr uint32_t RadixBits = 8;
+constexpr uint32_t RadixSize = 1 << RadixBits;
+// Below this many entries a single thread sorts faster than it can hand
+// out chunks.
+constexpr size_t ParallelSortThreshold = 1 << 14;
+constexpr size_t MinEntriesPerChunk = 1 << 12;
+
+uint64_t field(uint64_t value, uint32_t bits) {
+  return value & ((uint64_t{1} << bits) - 1);
+}
+
+// Non-negative floats order like their bit patterns.
+uint32_t depthBits(float depth) {
+  return std::bit_cast<uint32_t>(std::max(depth, 0.0f));
+}
+}  // namespace
+
+uint64_t encodeSortKey(const RenderSortKeyFields& fields) {
+  auto key = field(fields.pass, PassBits);
+  key = (key << LayerBits) | field(fields.layer, LayerBits);
+  key = (key << 1) | (fields.translucent ? 1 : 0);
+  const auto state = (field(fields.pipeline, PipelineBits) << MaterialBits) |
+                     field(fields.material, MaterialBits);
+  if (fields.translucent) {
+    const auto depth = ~depthBits(fields.depth);
+    key = (key << DepthBits) | depth;
+    key = (key << (PipelineBits + MaterialBits)) | state;
+  } else {
+    key = (key << (PipelineBits + MaterialBits)) | state;
+    key = (key << DepthBits) | depthBits(fields.depth);
+  }
+  return key;
+}
+
+void radixSortByKey(std::vector<RenderQueueEntry>& entries,
+                    std::vector<RenderQueueEntry>& scratch,
+                    ThreadPool* threadPool) {
+  const auto count = entries.size();
+  if (count < 2) {
+    return;
+  }
+  auto differingBits = uint64_t{0};
+  for (const auto& entry : entries) {
+    differingBits |= entry.key ^ entries.front().key;
+  }
+  if (differingBits == 0) {
+    return;
+  }
+
+  auto chunkCount = size_t{1};
+  if (threadPool && count >= ParallelSortThreshold) {
+    chunkCount = std::min(threadPool->size() + 1, count / MinEntriesPerChunk);
+  }
+  const auto chunkSize = (count + chunkCount - 1) / chunkCount;
+  std::vector<std::array<uint32_t, RadixSize>> chunkOffsets(chunkCount);
+  scratch.resize(count);
+
+  for (auto shift = 0U; shift < 64; shift += RadixBits) {
+    if (field(differingBits >> shift, RadixBits) == 0) {
+      continue;
+    }
+    auto digit = [shift](const RenderQueueEntry& entry) {
+      return static_cast<uint32_t>(field(entry.key >> shift, RadixBits));
+    };
+
+    auto countDigits = [&](size_t chunk) {
+      auto& histogram = chunkOffsets[chunk];
+      histogram.fill(0);
+      const auto end = std::min((chunk + 1) * chunkSize, count);
+      for (auto i = chunk * chunkSize; i < end; i++) {
+        histogram[digit(entries[i])]++;
+      }
+    };
+    // Chunks scatter each digit after the earlier chunks' entries of the
+    // same digit, keeping the sort stable.
+    auto scatter = [&](size_t chunk) {
+      auto& offsets = chunkOffsets[chunk];
+      const auto end = std::min((chunk + 1) * chunkSize, count);
+      for (auto i = chunk * chunkSize; i < end; i++) {
+        scratch[offsets[digit(entries[i])]++] = entries[i];
+      }
+    };
+
+    if (chunkCount > 1) {
+      threadPool->parallelFor(chunkCount, countDigits);
+    } else {
+      countDigits(0);
+    }
+    auto offset = 0U;
+    for (auto value = 0U; value < RadixSize; value++) {
+      for (auto& offsets : chunkOffsets) {
+        const auto valueCount = offsets[value];
+        offsets[value] = offset;
+        offset += valueCount;
+      }
+    }
+    if (chunkCount > 1) {
+      threadPool->parallelFor(chunkCount, scatter);
+    } else {
+      scatter(0);
+    }
+    entries.swap(scratch);
+  }
+}
+
+void RenderQueue::initialize(const RenderQueueInitInfo& initInfo) {
+  rhi = initInfo.rhi;
+  threadPool = initInfo.threadPool;
+}
+
+void RenderQueue::clear() {
+  commands.clear();
+  entries.clear();
+}
+
+void RenderQueue::push(uint64_t key, const RenderCommand& command) {
+  entries.push_back(RenderQueueEntry{
+      .key = key,
+      .command = static_cast<uint32_t>(commands.size()),
+  });
+  commands.push_back(command);
+}
+
+void RenderQueue::sort() {
+  const auto start = std::chrono::steady_clock::now();
+  radixSortByKey(entries, scratch, threadPool.get());
+  statistics.sortMs = std::chrono::duration<double, std::milli>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+}
+
+void RenderQueue::record(RHICommandBuffer* commandBuffer) {
+  const auto sortMs = statistics.sortMs;
+  statistics = RenderQueueStatistics{.sortMs = sortMs};
+
+  RHIPipeline* boundPipeline = nullptr;
+  RHIDescriptorSet* boundDescriptorSet = nullptr;
+  uint32_t boundDynamicOffset = 0;
+  GeometryPool* boundGeometry = nullptr;
+  for (const auto& entry : entries) {
+    const auto& command = commands[entry.command];
+    if (command.pipeline != boundPipeline) {
+      rhi->cmdBindPipeline(commandBuffer, RHIPipelineBindPoint::Graphics,
+                           command.pipeline);
+      boundPipeline = command.pipeline;
+      statistics.pipelineBinds++;
+    } else {
+      statistics.pipelineBindsSkipped++;
+    }
+    // Slices of one uniform ring share the set and differ in the offset.
+    if (command.descriptorSet != boundDescriptorSet ||
+        (command.dynamicOffsetCount > 0 &&
+         command.dynamicOffset != boundDynamicOffset)) {
+      rhi->cmdBindDescriptorSets(commandBuffer, RHIPipelineBindPoint::Graphics,
+                                 command.pipelineLayout, 0, 1,
+                                 command.descriptorSet,
+                                 command.dynamicOffsetCount,
+                                 &command.dynamicOffset);
+      boundDescriptorSet = command.descriptorSet;
+      boundDynamicOffset = command.dynamicOffset;
+      statistics.descriptorSetBinds++;
+    } else {
+      statistics.descriptorSetBindsSkipped++;
+    }
+    if (command.geometry != boundGeometry) {
+      command.geometry->bind(commandBuffer);
+      boundGeometry = command.geometry;
+      statistics.geometryBinds++;
+    } else {
+      statistics.geometryBindsSkipped++;
+    }
+    if (command.pushConstantSize > 0) {
+      rhi->cmdPushConstants(commandBuffer, command.pipelineLayout,
+                            command.pushConstantStages, 0,
+                            command.pushConstantSize,
+                            command.pushConstants.data());
+      statistics.pushConstantUpdates++;
+    }
+    rhi->cmdDrawIndexed(commandBuffer, command.indexCount,
+                        command.instanceCount, command.firstIndex,
+                        command.vertexOffset, command.firstInstance);
+    statistics.drawCount++;
+  }
+}
+
+}  // namespace Sparrow
@@ -0,0 +1,111 @@
+#ifndef SPARROWENGINE_RENDER_QUEUE_H
+#define SPARROWENGINE_RENDER_QUEUE_H
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "RHI/rhi_struct.h"
+
+namespace Sparrow {
+class RHI;
+class ThreadPool;
+class GeometryPool;
+
+// Fields of a draw's 64-bit sort key, most significant first. Opaque draws
+// sort by state, then front to back. Translucent draws sort back to front
+// before state, since blending needs the order.
+//
+//   opaque:      pass:4 layer:4 0:1 pipeline:11 material:12 depth:32
+//   translucent: pass:4 layer:4 1:1 ~depth:32 pipeline:11 material:12
+struct RenderSortKeyFields {
+  uint32_t pass = 0;
+  uint32_t layer = 0;
+  bool translucent = false;
+  uint32_t pipeline = 0;
+  uint32_t material = 0;
+  // View space depth, larger is farther.
+  float depth = 0.0f;
+};
+
+uint64_t encodeSortKey(const RenderSortKeyFields& fields);
+
+struct RenderCommand {
+  // Null when drawing with shader objects the caller bound.
+  RHIPipeline* pipeline = nullptr;
+  RHIPipelineLayout* pipelineLayout = nullptr;
+  RHIDescriptorSet* descriptorSet = nullptr;
+  // Offset of the set's dynamic uniform buffer, if it has one.
+  uint32_t dynamicOffsetCount = 0;
+  uint32_t dynamicOffset = 0;
+  // Per-draw data pushed at offset 0 of the layout's push constant range
+  // before the draw, nothing is pushed if the size is zero.
+  RHIShaderStageFlag pushConstantStages = {};
+  uint32_t pushConstantSize = 0;
+  std::array<uint32_t, 4> pushConstants = {};
+  GeometryPool* geometry = nullptr;
+  uint32_t indexCount = 0;
+  uint32_t instanceCount = 1;
+  uint32_t firstIndex = 0;
+  int32_t vertexOffset = 0;
+  uint32_t firstInstance = 0;
+};
+
+struct RenderQueueEntry {
+  uint64_t key;
+  uint32_t command;
+};
+
+// Stable LSD radix sort of `entries` by key, 8 bits per pass. Passes over
+// bytes every key shares are skipped. Large queues count and scatter in
+// chunks on the thread pool. `scratch` is reused between calls.
+void radixSortByKey(std::vector<RenderQueueEntry>& entries,
+                    std::vector<RenderQueueEntry>& scratch,
+                    ThreadPool* threadPool);
+
+struct RenderQueueStatistics {
+  uint32_t drawCount = 0;
+  uint32_t pipelineBinds = 0;
+  uint32_t pipelineBindsSkipped = 0;
+  uint32_t descriptorSetBinds = 0;
+  uint32_t descriptorSetBindsSkipped = 0;
+  uint32_t geometryBinds = 0;
+  uint32_t geometryBindsSkipped = 0;
+  uint32_t pushConstantUpdates = 0;
+  double sortMs = 0.0;
+};
+
+struct RenderQueueInitInfo {
+  std::shared_ptr<RHI> rhi;
+  std::shared_ptr<ThreadPool> threadPool;
+};
+
+// Collects a frame's draws with their sort keys, sorts them and records
+// them, binding pipeline, descriptor set and geometry only when they
+// differ from the previous draw's.
+class RenderQueue {
+ public:
+  void initialize(const RenderQueueInitInfo& initInfo);
+
+  void clear();
+  void push(uint64_t key, const RenderCommand& command);
+  void sort();
+  // Records the draws in key order, call inside the render pass after
+  // setting the dynamic state.
+  void record(RHICommandBuffer* commandBuffer);
+
+  size_t size() const { return entries.size(); }
+  // Counts of the last sort and record.
+  const RenderQueueStatistics& getStatistics() const { return statistics; }
+
+ private:
+  std::shared_ptr<RHI> rhi;
+  std::shared_ptr<ThreadPool> threadPool;
+  std::vector<RenderCommand> commands;
+  std::vector<RenderQueueEntry> entries, scratch;
+  RenderQueueStatistics statistics;
+};
+
+}  // namespace Sparrow
+
+#endif  // SPARROWENGINE_RENDER_QUEUE_H
@@ -3,61 +3,121 @@
 //
 
 #include "render_system.h"
+#include <algorithm>
+#include <cmath>
 #include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <chrono>
+#include <limits>
+#include <sstream>
+#include <utility>
 #include "RHI/vulkan/vulkan_rhi.h"
 #include "RHI/vulkan/vulkan_rhi_resource.h"
 #include "RHI/vulkan/vulkan_utils.h"
+#include "function/geometry_pool.h"
+#include "function/pipeline_layout_cache.h"
+#include "function/pipeline_state_cache.h"
+#include "function/render_culling.h"
+#include "function/mesh_optimizer.h"
+#include "function/render_hiz.h"
+#include "function/render_queue.h"
+#include "function/render_target_cache.h"
 #include "function/render_resource.h"
+#include "function/shader_compiler.h"
+#include "function/shader_hot_reloader.h"
+#include "function/shader_permutation.h"
+#include "function/shader_reflection.h"
+#include "function/software_occlusion.h"
+#include "function/uniform_ring_buffer.h"
 #include "function/window_system.h"
+#include "utils/log.h"
+#include "utils/thread_pool.h"
 
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
 namespace Sparrow {
+RenderSystem::RenderSystem() = default;
+
+RenderSystem::~RenderSystem() {
+  // Workers may still be creating pipelines from the members.
+  waitForGraphicsPipelines();
+  if (rhi) {
+    const auto barriers = rhi->getBarrierStatistics();
+    LOG_FMT("Last frame declared {} resource usages, recorded {} barriers "
+            "in {} batches, {} merged",
+            barriers.transitionCount, barriers.barrierCount,
+            barriers.batchCount, barriers.mergedCount);
+  }
+  if (pipelineStateCache) {
+    const auto statistics = pipelineStateCache->getStatistics();
+    LOG_FMT("Pipeline state cache created {} pipelines, dynamic state "
+            "avoided {}",
+            statistics.misses, statistics.pipelinesAvoided);
+  }
+}
+
 void RenderSystem::initialize(const RenderSystemInitInfo& initInfo) {
-  const auto rhiInitInfo = RHIInitInfo{.windowSystem = initInfo.windowSystem};
+  const auto rhiInitInfo = RHIInitInfo{
+      .windowSystem = initInfo.windowSystem,
+      .presentMode = initInfo.presentMode,
+      .swapChainImageCount = initInfo.swapChainImageCount,
+      .maxFramesInFlight = initInfo.maxFramesInFlight,
+      .lowLatency = initInfo.lowLatency,
+  };
   rhi = std::make_shared<VulkanRHI>();
   rhi->initialize(rhiInitInfo);
+  enableGPUCulling = initInfo.enableGPUCulling;
+  if (enableGPUCulling && !rhi->supportsDrawIndirectCount()) {
+    LOG_WARN("RenderSystem::initialize indirect draw count is unsupported, "
+             "culling on the CPU instead.");
+    enableGPUCulling = false;
+  }
+  enableHiZ = initInfo.enableHiZ;
+  enableSoftwareOcclusion = initInfo.enableSoftwareOcclusion;
+  enableMeshLOD = initInfo.enableMeshLOD;
+  vertexFormat = initInfo.vertexFormat;
+  meshLODSelection = initInfo.meshLODSelection;
+  useDynamicRendering =
+      initInfo.enableDynamicRendering && rhi->supportsDynamicRendering();
+  threadPool = initInfo.threadPool;
+  instanceCount = std::max(initInfo.instanceCount, 1U);
+  maxInstanceCount = std::max(initInfo.maxInstanceCount, instanceCount);
+  materialRenderState = initInfo.materialRenderState;
+  if (initInfo.enableExtendedDynamicState) {
+    dynamicStateSupport = rhi->getExtendedDynamicStateSupport();
+  }
+  useShaderObjects = initInfo.enableShaderObjects && useDynamicRendering &&
+                     rhi->supportsShaderObject();
+  if (initInfo.enableShaderObjects && !useShaderObjects) {
+    LOG_WARN("RenderSystem shader objects are unsupported, drawing with "
+             "pipelines.");
+  }
+
+  if (initInfo.enableRuntimeShaderCompilation ||
+      initInfo.enableShaderHotReload) {
+    shaderCompiler = std::make_shared<ShaderCompiler>();
+    shaderCompiler->initialize(ShaderCompilerInitInfo{
+        .sourceDirectory = SHADER_SOURCE_DIR,
+        .cacheDirectory = SHADER_CACHE_DIR,
+    });
+  }
 
-  auto vertexCode = readFile("shader.vert.spv");
-  auto fragmentCode = readFile("shader.frag.spv");
+  auto vertexCode = loadShader(shaderCompiler.get(), "shader.vert");
+  auto fragmentCode = loadShader(shaderCompiler.get(), "shader.frag");
 
   vertexShader = rhi->createShaderModule(vertexCode);
   fragmentShader = rhi->createShaderModule(fragmentCode);
-
-  RHIPipelineShaderStageCreateInfo vertexPipelineShaderStageCreateInfo = {
-      .stage = RHIShaderStageFlag::Vertex,
-      .module = vertexShader.get(),
-      .name = "main"};
-
-  RHIPipelineShaderStageCreateInfo fragmentPipelineShaderStageCreateInfo = {
-      .stage = RHIShaderStageFlag::Fragment,
-      .module = fragmentShader.get(),
-      .name = "main"};
-  RHIPipelineShaderStageCreateInfo shaderStages[] = {
-      vertexPipelineShaderStageCreateInfo,
-      fragmentPipelineShaderStageCreateInfo};
-
-  auto bindingDescription = Vertex::getBindingDescription();
-  auto attributeDescriptions = Vertex::getAttributeDescription();
-  auto vertexInputStateCreateInfo = RHIVertexInputStateCreateInfo{
-      .vertexBindingDescriptionCount = 1,
-      .vertexBindingDescriptions = &bindingDescription,
-      .vertexAttributeDescriptionCount = attributeDescriptions.size(),
-      .vertexAttributeDescriptions = attributeDescriptions.data(),
-  };
-
-  auto inputAssemblyCreateInfo = RHIInputAssemblyStateCreateInfo{
-      .topology = RHIPrimitiveTopology::TriangleList,
-      .primitiveRestartEnabled = RHIFalse,
-  };
+  vertexReflection = reflectShader(vertexCode).value_or(ShaderReflection{});
+  fragmentReflection =
+      reflectShader(fragmentCode).value_or(ShaderReflection{});
+  vertexShaderCode = std::move(vertexCode);
+  fragmentShaderCode = std::move(fragmentCode);
 
   const auto swapChainInfo = rhi->getSwapChainInfo();
-  const auto maxFrameInFlight = rhi->getMaxFramesInFlight();
 
   float swapChainWidth = swapChainInfo.extent.width;
   float swapChainHeight = swapChainInfo.extent.height;
@@ -69,57 +129,6 @@ void RenderSystem::initialize(const RenderSystemInitInfo& initInfo) {
                          .minDepth = 0.0f,
                          .maxDepth = 1.0f};
   scissor = RHIRect2D{.extend = swapChainInfo.extent};
-  auto viewportStateCreateInfo =
-      RHIViewportStateCreateInfo{.viewportCount = 1,
-                                 .viewports = &viewport,
-                                 .scissorCount = 1,
-                                 .scissors = &scissor};
-
-  RHIDynamicState dynamicStates[] = {RHIDynamicState::Viewport,
-                                     RHIDynamicState::Scissor};
-  auto dynamicStateCreateInfo = RHIDynamicStateCreateInfo{
-      .dynamicStateCount = 2,
-      .dynamicStates = dynamicStates,
-  };
-
-  auto rasterizationStateCreateInfo = RHIRasterizationStateCreateInfo{
-      .rasterizerDiscardEnable = RHIFalse,
-      .polygonMode = RHIPolygonMode::Fill,
-      .cullMode = RHICullMode::Back,
-      .frontFace = RHIFrontFace::CounterClockwise,
-      .depthBiasEnable = RHIFalse,
-      .depthBiasConstantFactor = 0.0f,
-      .depthBiasClamp = 0.0f,
-      .depthBiasSlopeFactor = 0.0f,
-      .lineWidth = 1.0f,
-  };
-
-  auto multiSamplingCreateInfo = RHIMultisampleStateCreateInfo{
-      .rasterizationSamples = RHISampleCount::Count1,
-      .sampleShadingEnable = RHIFalse,
-      .minSampleShading = 1.0f,
-      .sampleMask = nullptr,
-      .alphaToCoverageEnable = RHIFalse,
-      .alphaToOneEnable = RHIFalse,
-  };
-
-  auto colorBlendAttachment = RHIColorBlendAttachmentState{
-      .blendEnable = RHIFalse,
-      .srcColorBlendFactor = RHIBlendFactor::One,
-      .dstColorBlendFactor = RHIBlendFactor::Zero,
-      .colorBlendOp = RHIBlendOp::Add,
-      .srcAlphaBlendFactor = RHIBlendFactor::One,
-      .dstAlphaBlendFactor = RHIBlendFactor::Zero,
-      .alphaBlendOp = RHIBlendOp::Add,
-      .colorWriteMask = RHIColorComponentFlag::AllBits,
-  };
-
-  auto colorBlendStateCreateInfo =
-      RHIColorBlendStateCreateInfo{.logicOpEnable = RHIFalse,
-                                   .logicOp = RHILogicOp::Copy,
-                                   .attachmentCount = 1,
-                                   .attachments = &colorBlendAttachment,
-                                   .blendConstants = {0.0f, 0.0f, 0.0f, 0.0f}};
 
   auto colorAttachmentDesciption = RHIAttachmentDescription{
       .format = swapChainInfo.imageFormat,
@@ -139,7 +148,9 @@ void RenderSystem::initialize(const RenderSystemInitInfo& initInfo) {
       .format = depthImageInfo.format,
       .samples = RHISampleCount::Count1,
       .loadOp = RHIAttachmentLoadOp::Clear,
-      .storeOp = RHIAttachmentStoreOp::DontCare,
+      // The depth pyramid is reduced from it after the pass.
+      .storeOp = enableHiZ ? RHIAttachmentStoreOp::Store
+                           : RHIAttachmentStoreOp::DontCare,
       .stencilLoadOp = RHIAttachmentLoadOp::DontCare,
       .stencilStoreOp = RHIAttachmentStoreOp::DontCare,
       .initialLayout = RHIImageLayout::Undefined,
@@ -159,8 +170,11 @@ void RenderSystem::initialize(const RenderSystemInitInfo& initInfo) {
   auto subpassDependency = RHISubpassDependency{
       .srcSubpass = RHISubpassExternal,
       .dstSubpass = 0,
+      // Compute covers the previous frame's depth pyramid reduction reading
+      // the depth attachment.
       .srcStageMask = RHIPipelineStageFlag::ColorAttachmentOutput |
-                      RHIPipelineStageFlag::EarlyFragmentTests,
+                      RHIPipelineStageFlag::EarlyFragmentTests |
+                      RHIPipelineStageFlag::ComputeShader,
       .dstStageMask = RHIPipelineStageFlag::ColorAttachmentOutput |
                       RHIPipelineStageFlag::EarlyFragmentTests,
       .srcAccessMask = RHIAccessFlag::None,
@@ -179,117 +193,87 @@ void RenderSystem::initialize(const RenderSystemInitInfo& initInfo) {
                               .dependencyCount = 1,
                               .dependencies = &subpassDependency};
 
-  auto depthStencilCreateInfo = RHIDepthStencilStateCreateInfo{
-    .depthTestEnable = RHITrue,
-    .depthWriteEnable = RHITrue,
-    .depthCompareOp = RHICompareOp::Less,
-    .depthBoundsTestEnable = RHIFalse,
-    .stencilTestEnable = RHIFalse,
-    .front = {},
-    .back = {},
-    .minDepthBounds = 0.0f,
-    .maxDepthBounds = 1.0f,
-  };
-
-  auto uboLayoutBinding = RHIDescriptorSetLayoutBinding{
-      .binding = 0,
-      .descriptorType = RHIDescriptorType::UniformBuffer,
-      .descriptorCount = 1,
-      .stageFlags = RHIShaderStageFlag::Vertex,
-      .immutableSamplers = nullptr,
-  };
-  auto sampleLayoutBinding = RHIDescriptorSetLayoutBinding{
-      .binding = 1,
-      .descriptorType = RHIDescriptorType::CombinedImageSampler,
-      .descriptorCount = 1,
-      .stageFlags = RHIShaderStageFlag::Fragment,
-      .immutableSamplers = nullptr,
-  };
-  std::array<RHIDescriptorSetLayoutBinding, 2> bindings = {uboLayoutBinding,
-                                                           sampleLayoutBinding};
-
-  auto descriptorSetLayoutCreateInfo = RHIDescriptorSetLayoutCreateInfo{
-      .bindingCount = bindings.size(),
-      .bindings = bindings.data(),
-  };
+  pipelineLayoutCache = std::make_unique<PipelineLayoutCache>(rhi);
+  auto graphicsLayout =
+      reflectGraphicsLayout(vertexReflection, fragmentReflection);
+  if (!graphicsLayout.pipelineLayout || graphicsLayout.setLayouts.empty()) {
+    throw std::runtime_error("failed to create the pipeline layout!");
+  }
+  checkVertexInputs(vertexReflection);
+  descriptorSetLayout = graphicsLayout.setLayouts.front();
+  piplineLayout = graphicsLayout.pipelineLayout;
 
-  descriptorSetLayout =
-      rhi->createDescriptorSetLayout(descriptorSetLayoutCreateInfo);
-  descriptorSets = rhi->allocateDescriptorSets(RHIDescriptorSetAllocateInfo{
+  // Nothing in the set differs between frames in flight.
+  auto sets = rhi->allocateDescriptorSets(RHIDescriptorSetAllocateInfo{
       .descriptorPool = RHIDescriptorPool{},  // TODO: use outer resource
-      .descriptorSetCount = maxFrameInFlight,
-      .setLayouts = descriptorSetLayout.get(),
+      .descriptorSetCount = 1,
+      .setLayouts = descriptorSetLayout,
   });
+  descriptorSet = std::move(sets.front());
 
-  auto pipelineLayoutCreateInfo = RHIPipelineLayoutCreateInfo{
-      .setLayoutCount = 1,
-      .setLayouts = descriptorSetLayout.get(),
-      .pushConstantRangeCount = 0,
-      .pushConstantRanges = nullptr,
-  };
-
-  renderPass = rhi->createRenderPass(renderPassCreateInfo);
-  piplineLayout = rhi->createPipelineLayout(pipelineLayoutCreateInfo);
+  if (!useDynamicRendering) {
+    renderTargetCache = std::make_unique<RenderTargetCache>(rhi);
+    renderPass = renderTargetCache->getRenderPass(renderPassCreateInfo);
+  }
 
-  framebuffers.reserve(swapChainInfo.imageViewsSize);
-  for (auto i = 0U; i < swapChainInfo.imageViewsSize; i++) {
-    std::array<RHIImageView*, 2> attachments = {rhi->getSwapChainImageView(i),
-                                                depthImageInfo.imageView};
-    auto framebufferCreateInfo = RHIFramebufferCreateInfo{
-        .renderPass = renderPass.get(),
-        .attachmentCount = attachments.size(),
-        .attachments = attachments.data(),
-        .width = swapChainInfo.extent.width,
-        .height = swapChainInfo.extent.height,
-        .layers = 1,
-    };
-    framebuffers.push_back(rhi->createFramebuffer(framebufferCreateInfo));
-  }
-
-  auto grpahicPipelineCreateInfo = RHIGraphicsPipelineCreateInfo{
-      .stageCount = 2,
-      .shaderStageCreateInfo = shaderStages,
-      .dynamicStateCreateInfo = &dynamicStateCreateInfo,
-      .vertexInputStateCreateInfo = &vertexInputStateCreateInfo,
-      .inputAssemblyStateCreateInfo = &inputAssemblyCreateInfo,
-      .viewportStateCreateInfo = &viewportStateCreateInfo,
-      .rasterizationStateCreateInfo = &rasterizationStateCreateInfo,
-      .multisampleStateCreateInfo = &multiSamplingCreateInfo,
-      .depthStencilStateCreateInfo = &depthStencilCreateInfo,
-      .colorBlendStateCreateInfo = &colorBlendStateCreateInfo,
-      .pipelineLayout = piplineLayout.get(),
-      .renderPass = renderPass.get(),
-      .subpass = 0,
-      .basePipelineHandle = nullptr,
-      .basePipelineIndex = -1,
-  };
+  if (depthImageInfo.format == RHIFormat::D16UnormS8Uint ||
+      depthImageInfo.format == RHIFormat::D24UnormS8Uint ||
+      depthImageInfo.format == RHIFormat::D32SfloatS8Uint) {
+    depthAspect = RHIImageAspectFlag::Depth | RHIImageAspectFlag::Stencil;
+  }
 
-  vertices = {{{-0.5f, -0.5f, 0.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f}},
-              {{0.5f, -0.5f, 0.0f}, {0.0f, 1.0f, 0.0f}, {1.0f, 0.0f}},
-              {{0.5f, 0.5f, 0.0f}, {0.0f, 0.0f, 1.0f}, {1.0f, 1.0f}},
-              {{-0.5f, 0.5f, 0.0f}, {1.0f, 1.0f, 1.0f}, {0.0f, 1.0f}},
+  // Both quads face +Z.
+  const auto up = glm::vec3(0.0f, 0.0f, 1.0f);
+  vertices = {{{-0.5f, -0.5f, 0.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f}, up},
+              {{0.5f, -0.5f, 0.0f}, {0.0f, 1.0f, 0.0f}, {1.0f, 0.0f}, up},
+              {{0.5f, 0.5f, 0.0f}, {0.0f, 0.0f, 1.0f}, {1.0f, 1.0f}, up},
+              {{-0.5f, 0.5f, 0.0f}, {1.0f, 1.0f, 1.0f}, {0.0f, 1.0f}, up},
 
-              {{-0.5f, -0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f}},
-              {{0.5f, -0.5f, -0.5f}, {0.0f, 1.0f, 0.0f}, {1.0f, 0.0f}},
-              {{0.5f, 0.5f, -0.5f}, {0.0f, 0.0f, 1.0f}, {1.0f, 1.0f}},
-              {{-0.5f, 0.5f, -0.5f}, {1.0f, 1.0f, 1.0f}, {0.0f, 1.0f}}};
+              {{-0.5f, -0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f}, up},
+              {{0.5f, -0.5f, -0.5f}, {0.0f, 1.0f, 0.0f}, {1.0f, 0.0f}, up},
+              {{0.5f, 0.5f, -0.5f}, {0.0f, 0.0f, 1.0f}, {1.0f, 1.0f}, up},
+              {{-0.5f, 0.5f, -0.5f}, {1.0f, 1.0f, 1.0f}, {0.0f, 1.0f}, up}};
 
   indices = {0, 1, 2, 2, 3, 0, 4, 5, 6, 6, 7, 4};
-
-  auto [_vertexBuffer, _vertexBufferMemory] = createVertexBuffer(vertices);
-  auto [_indexBuffer, _indexBufferMemory] = createIndexBuffer(indices);
-  auto [_uniformBuffers, _uniformBufferMemories, _uniformBufferMappedMemories] =
-      createUniformBuffers();
+  cookMeshes();
+  createMeshLODs();
+  const auto packedVertices = packVertices(vertices, vertexFormat);
+  vertexQuantization = packedVertices.quantization;
+  LOG_FMT("Vertex buffer packed to {} bytes per vertex, {} -> {} bytes",
+          packedVertices.stride, sizeof(Vertex) * vertices.size(),
+          packedVertices.data.size());
+
+  geometryPool = std::make_unique<GeometryPool>();
+  geometryPool->initialize(GeometryPoolInitInfo{
+      .rhi = rhi,
+      .vertexStride = packedVertices.stride,
+      .indexType = indexType,
+  });
+  meshGeometry = geometryPool->allocate(packedVertices.data, indices);
+  const auto& geometry = geometryPool->getAllocation(meshGeometry);
+  // Levels were cooked into the mesh's own index range.
+  for (auto& lod : meshLODs) {
+    lod.firstIndex += geometry.firstIndex;
+  }
+  const auto geometryStatistics = geometryPool->getStatistics();
+  LOG_FMT("Geometry pool holds {} meshes, {}/{} vertices, {}/{} indices",
+          geometryStatistics.meshCount, geometryStatistics.usedVertices,
+          geometryStatistics.vertexCapacity, geometryStatistics.usedIndices,
+          geometryStatistics.indexCapacity);
+  createInstances();
+
+  auto [_instanceBuffer, _instanceBufferMemory] =
+      createInstanceBuffer(instances, maxInstanceCount);
+  auto [_meshLODBuffer, _meshLODBufferMemory] = createMeshLODBuffer(meshLODs);
   auto [_textureImage, _textureImageView, _textureImageMemory] =
       createTextureImage();
 
-  vertexBuffer = std::move(_vertexBuffer);
-  vertexBufferMemory = std::move(_vertexBufferMemory);
-  indexBuffer = std::move(_indexBuffer);
-  indexBufferMemory = std::move(_indexBufferMemory);
-  uniformBuffers = std::move(_uniformBuffers);
-  uniformBufferMemories = std::move(_uniformBufferMemories);
-  uniformBuffersMappedMemories = std::move(_uniformBufferMappedMemories);
+  instanceBuffer = std::move(_instanceBuffer);
+  instanceBufferMemory = std::move(_instanceBufferMemory);
+  meshLODBuffer = std::move(_meshLODBuffer);
+  meshLODBufferMemory = std::move(_meshLODBufferMemory);
+  uniformRing = std::make_unique<UniformRingBuffer>();
+  uniformRing->initialize(UniformRingBufferInitInfo{.rhi = rhi});
   textureImage = std::move(_textureImage);
   textureImageView = std::move(_textureImageView);
   textureImageMemory = std::move(_textureImageMemory);
@@ -312,64 +296,855 @@ void RenderSystem::initialize(const RenderSystemInitInfo& initInfo) {
       .unnormalizedCoordinates = RHIFalse,
   });
 
-  std::vector<RHIDescriptorBufferInfo> bufferInfos;
-  std::vector<RHIDescriptorImageInfo> imageInfos;
-  std::vector<RHIWriteDescriptorSet> writeDescriptorSets;
-  std::vector<RHIWriteDescriptorSet> samplerWriteDescriptorSets;
-  bufferInfos.reserve(maxFrameInFlight);
-  imageInfos.reserve(maxFrameInFlight);
-  writeDescriptorSets.reserve(maxFrameInFlight);
-  samplerWriteDescriptorSets.reserve(maxFrameInFlight);
-
-  for (auto i = 0; i < maxFrameInFlight; i++) {
-    bufferInfos.push_back(RHIDescriptorBufferInfo{
-        .buffer = uniformBuffers[i].get(),
-        .offset = 0,
-        .range = sizeof(Transform),
+  auto uniformBufferInfo = RHIDescriptorBufferInfo{
+      .buffer = uniformRing->getBuffer(),
+      .offset = 0,
+      .range = sizeof(Transform),
+  };
+  auto textureImageInfo = RHIDescriptorImageInfo{
+      .sampler = textureSampler.get(),
+      .imageView = textureImageView.get(),
+      .imageLayout = RHIImageLayout::ReadOnlyOptimal,
+  };
+  auto instanceBufferInfo = RHIDescriptorBufferInfo{
+      .buffer = instanceBuffer.get(),
+      .offset = 0,
+      .range = sizeof(RenderInstance) * maxInstanceCount,
+  };
+  std::array<RHIWriteDescriptorSet, 3> writeDescriptorSets = {
+      RHIWriteDescriptorSet{
+          .dstSet = descriptorSet.get(),
+          .dstBinding = 0,
+          .dstArrayElement = 0,
+          .descriptorCount = 1,
+          .descriptorType = RHIDescriptorType::UniformBufferDynamic,
+          .imageInfo = nullptr,
+          .bufferInfo = &uniformBufferInfo,
+          .texelBufferView = nullptr,
+      },
+      RHIWriteDescriptorSet{
+          .dstSet = descriptorSet.get(),
+          .dstBinding = 1,
+          .dstArrayElement = 0,
+          .descriptorCount = 1,
+          .descriptorType = RHIDescriptorType::CombinedImageSampler,
+          .imageInfo = &textureImageInfo,
+          .bufferInfo = nullptr,
+          .texelBufferView = nullptr,
+      },
+      RHIWriteDescriptorSet{
+          .dstSet = descriptorSet.get(),
+          .dstBinding = 2,
+          .dstArrayElement = 0,
+          .descriptorCount = 1,
+          .descriptorType = RHIDescriptorType::StorageBuffer,
+          .imageInfo = nullptr,
+          .bufferInfo = &instanceBufferInfo,
+          .texelBufferView = nullptr,
+      },
+  };
+  rhi->updateDescriptorSets(writeDescriptorSets);
+
+  if (enableGPUCulling) {
+    gpuCullingPass = std::make_unique<GPUCullingPass>();
+    gpuCullingPass->initialize(GPUCullingPassInitInfo{
+        .rhi = rhi,
+        .instanceBuffer = instanceBuffer.get(),
+        .maxInstanceCount = maxInstanceCount,
+        .lodBuffer = meshLODBuffer.get(),
+        .lodCount = static_cast<uint32_t>(meshLODs.size()),
+        .lodSelection = meshLODSelection,
+        .shaderCompiler = shaderCompiler,
     });
+    gpuCullingPass->setInstanceCount(instances.size());
+  }
 
-    imageInfos.push_back(RHIDescriptorImageInfo{
-        .sampler = textureSampler.get(),
-        .imageView = textureImageView.get(),
-        .imageLayout = RHIImageLayout::ReadOnlyOptimal,
+  if (enableSoftwareOcclusion) {
+    createOccluders();
+    softwareOcclusion = std::make_unique<SoftwareOcclusionCuller>();
+    softwareOcclusion->initialize(SoftwareOcclusionInitInfo{
+        .threadPool = threadPool,
     });
+  }
+
+  renderQueue = std::make_unique<RenderQueue>();
+  renderQueue->initialize(RenderQueueInitInfo{
+      .rhi = rhi,
+      .threadPool = threadPool,
+  });
 
-    writeDescriptorSets.push_back(RHIWriteDescriptorSet{
-        .dstSet = descriptorSets[i].get(),
-        .dstBinding = 0,
-        .dstArrayElement = 0,
-        .descriptorCount = 1,
-        .descriptorType = RHIDescriptorType::UniformBuffer,
-        .imageInfo = nullptr,
-        .bufferInfo = &bufferInfos[i],
-        .texelBufferView = nullptr,
+  if (enableHiZ) {
+    hiZPass = std::make_unique<HiZPass>();
+    hiZPass->initialize(HiZPassInitInfo{
+        .rhi = rhi,
+        .width = swapChainInfo.extent.width,
+        .height = swapChainInfo.extent.height,
+        .shaderCompiler = shaderCompiler,
     });
+    if (enableGPUCulling) {
+      gpuCullingPass->setDepthPyramid(
+          hiZPass->getPyramidView(), RHIImageLayout::General,
+          hiZPass->getWidth(), hiZPass->getHeight(), hiZPass->getMipLevels());
+    }
+  }
 
-    samplerWriteDescriptorSets.push_back(RHIWriteDescriptorSet{
-        .dstSet = descriptorSets[i].get(),
-        .dstBinding = 1,
-        .dstArrayElement = 0,
-        .descriptorCount = 1,
-        .descriptorType = RHIDescriptorType::CombinedImageSampler,
-        .imageInfo = &imageInfos[i],
-        .bufferInfo = nullptr,
-        .texelBufferView = nullptr,
+  pipelineStateCache = std::make_unique<PipelineStateCache>(rhi, threadPool);
+  graphicsPermutations = std::make_unique<ShaderPermutations>(
+      std::vector<ShaderFeature>{
+          {.name = "TEXTURE", .constantId = 0},
+          {.name = "VERTEX_COLOR", .constantId = 1},
+          {.name = "LIGHTING", .constantId = 2},
+      });
+  materialFeatures =
+      graphicsPermutations->getFeatureMask(initInfo.materialFeatures);
+  if (useShaderObjects) {
+    // Every variant shares the state, only the shaders differ.
+    shaderObjectState = std::make_unique<GraphicsPipelineState>();
+    fillGraphicsPipelineState(
+        GraphicsPipelineVariant{
+            .features = materialFeatures,
+            .colorFormat = swapChainInfo.imageFormat,
+            .depthFormat = depthImageInfo.format,
+        },
+        *shaderObjectState);
+    shaderObjectState->viewport.viewports = &viewport;
+    shaderObjectState->viewport.scissors = &scissor;
+  } else {
+    // Compiled on the thread pool, frames skip drawing until one is ready.
+    if (initInfo.enablePipelineWarmUp) {
+      pipelineWarmUpPath =
+          std::filesystem::path(SHADER_CACHE_DIR) / "pipeline_warmup.txt";
+      warmUpGraphicsPipelines();
+    }
+    requestGraphicsPipeline(FallbackFeatures);
+    requestGraphicsPipeline(materialFeatures);
+  }
+
+  if (initInfo.enableShaderHotReload) {
+    shaderHotReloader = std::make_unique<ShaderHotReloader>();
+    shaderHotReloader->initialize(ShaderHotReloaderInitInfo{
+        .threadPool = threadPool,
+        .shaderCompiler = shaderCompiler,
+        .sourceDirectory = SHADER_SOURCE_DIR,
     });
+    shaderHotReloader->watch("shader.vert");
+    shaderHotReloader->watch("shader.frag");
+    if (enableGPUCulling) {
+      shaderHotReloader->watch("cull.comp");
+    }
+    if (enableHiZ) {
+      shaderHotReloader->watch("hiz_reduce.comp");
+    }
   }
-  rhi->updateDescriptorSets(writeDescriptorSets);
-  rhi->updateDescriptorSets(samplerWriteDescriptorSets);
+}
+
+RHIPipeline* RenderSystem::getGraphicsPipeline(ShaderFeatureMask features) {
+  auto pipeline = graphicsPipelines.find(features);
+  if (pipeline == graphicsPipelines.end()) {
+    requestGraphicsPipeline(features);
+    return nullptr;
+  }
+  const auto& future = pipeline->second;
+  if (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+    return nullptr;
+  }
+  return future.get();
+}
+
+void RenderSystem::requestGraphicsPipeline(ShaderFeatureMask features) {
+  if (graphicsPipelines.contains(features)) {
+    return;
+  }
+  const auto variant = GraphicsPipelineVariant{
+      .features = features,
+      .vertexShader = vertexShader.get(),
+      .fragmentShader = fragmentShader.get(),
+      .colorFormat = rhi->getSwapChainInfo().imageFormat,
+      .depthFormat = rhi->getDepthImageInfo().format,
+  };
+  graphicsPipelines.emplace(
+      features,
+      threadPool->submit([this, variant] {
+        return createGraphicsPipeline(variant);
+      }).share());
+  recordPipelineWarmUp(features);
+}
+
+void RenderSystem::waitForGraphicsPipelines() {
+  for (const auto& [features, pipeline] : graphicsPipelines) {
+    pipeline.wait();
+  }
+  for (const auto& retired : retiredGraphicsShaders) {
+    for (const auto& [features, pipeline] : retired.pipelines) {
+      pipeline.wait();
+    }
+  }
+}
+
+void RenderSystem::warmUpGraphicsPipelines() {
+  std::ifstream file(pipelineWarmUpPath);
+  std::string line;
+  while (std::getline(file, line)) {
+    std::istringstream stream(line);
+    std::string kind;
+    if (!(stream >> kind) || kind != "graphics") {
+      continue;
+    }
+    std::vector<std::string> names;
+    for (std::string name; stream >> name;) {
+      names.push_back(std::move(name));
+    }
+    const auto features = graphicsPermutations->getFeatureMask(names);
+    warmUpFeatures.insert(features);
+    requestGraphicsPipeline(features);
+  }
+}
+
+void RenderSystem::recordPipelineWarmUp(ShaderFeatureMask features) {
+  if (pipelineWarmUpPath.empty() || !warmUpFeatures.insert(features).second) {
+    return;
+  }
+  std::error_code error;
+  std::filesystem::create_directories(pipelineWarmUpPath.parent_path(), error);
+  std::ofstream file(pipelineWarmUpPath, std::ios::app);
+  file << "graphics";
+  for (const auto& name : graphicsPermutations->getFeatureNames(features)) {
+    file << ' ' << name;
+  }
+  file << '\n';
+}
+
+void RenderSystem::fillGraphicsPipelineState(
+    const GraphicsPipelineVariant& variant,
+    GraphicsPipelineState& state) const {
+  // Both stages get every constant, ones a stage does not declare are
+  // ignored.
+  state.specialization =
+      graphicsPermutations->getSpecialization(variant.features);
+  state.specializationInfo = state.specialization.getInfo();
+  state.shaderStages = {
+      RHIPipelineShaderStageCreateInfo{
+          .stage = RHIShaderStageFlag::Vertex,
+          .module = variant.vertexShader,
+          .name = "main",
+          .specializationInfo = &state.specializationInfo},
+      RHIPipelineShaderStageCreateInfo{
+          .stage = RHIShaderStageFlag::Fragment,
+          .module = variant.fragmentShader,
+          .name = "main",
+          .specializationInfo = &state.specializationInfo},
+  };
+
+  state.bindingDescription = vertexFormat.getBindingDescription();
+  state.attributeDescriptions = vertexFormat.getAttributeDescription();
+  state.vertexInput = RHIVertexInputStateCreateInfo{
+      .vertexBindingDescriptionCount = 1,
+      .vertexBindingDescriptions = &state.bindingDescription,
+      .vertexAttributeDescriptionCount =
+          static_cast<uint32_t>(state.attributeDescriptions.size()),
+      .vertexAttributeDescriptions = state.attributeDescriptions.data(),
+  };
+
+  // The material state is also written where it is dynamic, the driver
+  // ignores it there.
+  const auto& renderState = materialRenderState;
+  state.inputAssembly = RHIInputAssemblyStateCreateInfo{
+      .topology = renderState.topology,
+      .primitiveRestartEnabled =
+          renderState.primitiveRestartEnable ? RHITrue : RHIFalse,
+  };
+
+  // Both are dynamic, only the counts are used.
+  state.viewport = RHIViewportStateCreateInfo{.viewportCount = 1,
+                                              .viewports = nullptr,
+                                              .scissorCount = 1,
+                                              .scissors = nullptr};
+
+  state.dynamicStates = getGraphicsDynamicStates();
+  state.dynamicState = RHIDynamicStateCreateInfo{
+      .dynamicStateCount = static_cast<uint32_t>(state.dynamicStates.size()),
+      .dynamicStates = state.dynamicStates.data(),
+  };
+
+  state.rasterization = RHIRasterizationStateCreateInfo{
+      .rasterizerDiscardEnable = RHIFalse,
+      .polygonMode = RHIPolygonMode::Fill,
+      .cullMode = renderState.cullMode,
+      .frontFace = renderState.frontFace,
+      .depthBiasEnable = RHIFalse,
+      .depthBiasConstantFactor = 0.0f,
+      .depthBiasClamp = 0.0f,
+      .depthBiasSlopeFactor = 0.0f,
+      .lineWidth = 1.0f,
+  };
+
+  state.multisample = RHIMultisampleStateCreateInfo{
+      .rasterizationSamples = RHISampleCount::Count1,
+      .sampleShadingEnable = RHIFalse,
+      .minSampleShading = 1.0f,
+      .sampleMask = nullptr,
+      .alphaToCoverageEnable = RHIFalse,
+      .alphaToOneEnable = RHIFalse,
+  };
+
+  state.colorBlendAttachment = RHIColorBlendAttachmentState{
+      .blendEnable = renderState.blendEnable ? RHITrue : RHIFalse,
+      .srcColorBlendFactor = RHIBlendFactor::SrcAlpha,
+      .dstColorBlendFactor = RHIBlendFactor::OneMinusSrcAlpha,
+      .colorBlendOp = RHIBlendOp::Add,
+      .srcAlphaBlendFactor = RHIBlendFactor::One,
+      .dstAlphaBlendFactor = RHIBlendFactor::Zero,
+      .alphaBlendOp = RHIBlendOp::Add,
+      .colorWriteMask = RHIColorComponentFlag::AllBits,
+  };
+
+  state.colorBlend =
+      RHIColorBlendStateCreateInfo{.logicOpEnable = RHIFalse,
+                                   .logicOp = RHILogicOp::Copy,
+                                   .attachmentCount = 1,
+                                   .attachments = &state.colorBlendAttachment,
+                                   .blendConstants = {0.0f, 0.0f, 0.0f, 0.0f}};
+
+  state.depthStencil = RHIDepthStencilStateCreateInfo{
+    .depthTestEnable = renderState.depthTestEnable ? RHITrue : RHIFalse,
+    .depthWriteEnable = renderState.depthWriteEnable ? RHITrue : RHIFalse,
+    .depthCompareOp = renderState.depthCompareOp,
+    .depthBoundsTestEnable = RHIFalse,
+    .stencilTestEnable = RHIFalse,
+    .front = {},
+    .back = {},
+    .minDepthBounds = 0.0f,
+    .maxDepthBounds = 1.0f,
+  };
+
+  state.colorFormat = variant.colorFormat;
+  state.rendering = RHIPipelineRenderingCreateInfo{
+      .colorAttachmentCount = 1,
+      .colorAttachmentFormats = &state.colorFormat,
+      .depthAttachmentFormat = variant.depthFormat,
+  };
+
+  state.createInfo = RHIGraphicsPipelineCreateInfo{
+      .stageCount = static_cast<uint32_t>(state.shaderStages.size()),
+      .shaderStageCreateInfo = state.shaderStages.data(),
+      .dynamicStateCreateInfo = &state.dynamicState,
+      .vertexInputStateCreateInfo = &state.vertexInput,
+      .inputAssemblyStateCreateInfo = &state.inputAssembly,
+      .viewportStateCreateInfo = &state.viewport,
+      .rasterizationStateCreateInfo = &state.rasterization,
+      .multisampleStateCreateInfo = &state.multisample,
+      .depthStencilStateCreateInfo = &state.depthStencil,
+      .colorBlendStateCreateInfo = &state.colorBlend,
+      .pipelineLayout = piplineLayout,
+      .renderPass = renderPass,
+      .subpass = 0,
+      .basePipelineHandle = nullptr,
+      .basePipelineIndex = -1,
+      .renderingCreateInfo = useDynamicRendering ? &state.rendering : nullptr,
+  };
+}
+
+RHIPipeline* RenderSystem::createGraphicsPipeline(
+    const GraphicsPipelineVariant& variant) {
+  GraphicsPipelineState state;
+  fillGraphicsPipelineState(variant, state);
+  return pipelineStateCache->getOrCreate(state.createInfo);
+}
+
+RenderSystem::GraphicsShaderObjects RenderSystem::createGraphicsShaderObjects(
+    ShaderFeatureMask features) {
+  // Shader objects are linked to no layout, each gets the one the
+  // descriptor set is bound with.
+  const auto reflection =
+      mergeGraphicsReflection(vertexReflection, fragmentReflection);
+  if (!reflection) {
+    return {};
+  }
+  const auto layout = pipelineLayoutCache->getOrCreate(*reflection);
+  const auto specialization =
+      graphicsPermutations->getSpecialization(features);
+  const auto specializationInfo = specialization.getInfo();
+  auto createInfo = RHIShaderObjectCreateInfo{
+      .stage = RHIShaderStageFlag::Vertex,
+      .nextStage = RHIShaderStageFlag::Fragment,
+      .code = vertexShaderCode,
+      .name = "main",
+      .setLayoutCount = static_cast<uint32_t>(layout.setLayouts.size()),
+      .setLayouts = layout.setLayouts.data(),
+      .pushConstantRangeCount =
+          static_cast<uint32_t>(reflection->pushConstantRanges.size()),
+      .pushConstantRanges = reflection->pushConstantRanges.data(),
+      .specializationInfo = &specializationInfo,
+  };
+  GraphicsShaderObjects shaders;
+  shaders.vertex = rhi->createShaderObject(createInfo);
+  createInfo.stage = RHIShaderStageFlag::Fragment;
+  createInfo.nextStage = {};
+  createInfo.code = fragmentShaderCode;
+  shaders.fragment = rhi->createShaderObject(createInfo);
+  return shaders;
+}
 
-  graphicsPipeline = rhi->createGraphicsPipeline(grpahicPipelineCreateInfo);
+const RenderSystem::GraphicsShaderObjects*
+RenderSystem::getGraphicsShaderObjects(ShaderFeatureMask features) {
+  auto shaders = graphicsShaderObjects.find(features);
+  if (shaders == graphicsShaderObjects.end()) {
+    shaders = graphicsShaderObjects
+                  .emplace(features, createGraphicsShaderObjects(features))
+                  .first;
+    if (!shaders->second.vertex || !shaders->second.fragment) {
+      LOG_ERROR_FMT("RenderSystem creating the shader objects of {} failed.",
+                    features);
+    }
+  }
+  if (!shaders->second.vertex || !shaders->second.fragment) {
+    return nullptr;
+  }
+  return &shaders->second;
+}
+
+void RenderSystem::releaseGraphicsShaderObjects() {
+  graphicsShaders = nullptr;
+  for (auto& [features, shaders] : graphicsShaderObjects) {
+    // Frames in flight may still draw with them.
+    std::shared_ptr<RHIShaderObject> vertex = std::move(shaders.vertex);
+    std::shared_ptr<RHIShaderObject> fragment = std::move(shaders.fragment);
+    rhi->deferRelease([rhi = rhi.get(), vertex, fragment] {
+      for (auto* shader : {vertex.get(), fragment.get()}) {
+        if (shader) {
+          rhi->destoryShaderObject(shader);
+        }
+      }
+    });
+  }
+  graphicsShaderObjects.clear();
+}
+
+void RenderSystem::bindGraphicsShaders(RHICommandBuffer* commandBuffer) {
+  const std::array<RHIShaderStageFlag, 2> stages = {
+      RHIShaderStageFlag::Vertex, RHIShaderStageFlag::Fragment};
+  const std::array<RHIShaderObject*, 2> shaders = {
+      graphicsShaders->vertex.get(), graphicsShaders->fragment.get()};
+  rhi->cmdBindShaders(commandBuffer, stages, shaders);
+  rhi->cmdSetGraphicsState(commandBuffer, shaderObjectState->createInfo);
+}
+
+void RenderSystem::runBenchmarks() {
+  const auto viewProjection =
+      transform.projection * transform.view * transform.model;
+  // Drawing with GPU culling leaves the CPU culler uncreated.
+  auto culler = std::make_unique<SoftwareOcclusionCuller>();
+  culler->initialize(SoftwareOcclusionInitInfo{.threadPool = threadPool});
+  if (!softwareOcclusion) {
+    createOccluders();
+  }
+  culler->benchmark(getOccluders(), instances, viewProjection);
+
+  const auto vertexResult =
+      benchmarkVertexFormat(vertices, indices, vertexFormat);
+  LOG_FMT(
+      "Vertex format {} -> {} bytes per vertex, {} -> {} bytes fetched per "
+      "draw, read {:.3f} -> {:.3f} ms, max error position {:.2e} color "
+      "{:.2e} texcoord {:.2e} normal {:.2e} rad",
+      vertexResult.fullStride, vertexResult.packedStride,
+      vertexResult.fullFetchedBytes, vertexResult.packedFetchedBytes,
+      vertexResult.fullReadMs, vertexResult.packedReadMs,
+      vertexResult.maxPositionError, vertexResult.maxColorError,
+      vertexResult.maxTexCoordError, vertexResult.maxNormalError);
+
+  GraphicsPipelineState state;
+  fillGraphicsPipelineState(
+      GraphicsPipelineVariant{
+          .features = materialFeatures,
+          .vertexShader = vertexShader.get(),
+          .fragmentShader = fragmentShader.get(),
+          .colorFormat = rhi->getSwapChainInfo().imageFormat,
+          .depthFormat = rhi->getDepthImageInfo().format,
+      },
+      state);
+  const auto pipelineResult = pipelineStateCache->benchmark(state.createInfo);
+  LOG_FMT(
+      "Material pipeline created in {:.3f} ms, from libraries {:.3f} ms "
+      "compiling, {:.3f} ms fast link, {:.3f} ms optimized link",
+      pipelineResult.monolithicMs, pipelineResult.librariesMs,
+      pipelineResult.fastLinkMs, pipelineResult.optimizedLinkMs);
+
+  const auto firstUseResult = benchmarkFirstUse();
+  LOG_FMT(
+      "First use of {} variants: pipelines {:.3f} ms average, {:.3f} ms max, "
+      "shader objects {:.3f} ms average, {:.3f} ms max",
+      firstUseResult.variantCount, firstUseResult.pipelineAverageMs,
+      firstUseResult.pipelineMaxMs, firstUseResult.shaderObjectAverageMs,
+      firstUseResult.shaderObjectMaxMs);
+
+  const auto cullingResult = benchmarkGPUCulling(1U << 20);
+  LOG_FMT("GPU culling of {} instances took {:.3f} ms",
+          cullingResult.instanceCount, cullingResult.cullMs);
+}
+
+GPUCullingBenchmarkResult RenderSystem::benchmarkGPUCulling(
+    uint32_t fieldSize,
+    uint32_t iterations) {
+  using Clock = std::chrono::steady_clock;
+  auto elapsedMs = [](Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start)
+        .count();
+  };
+  auto result = GPUCullingBenchmarkResult{.instanceCount = fieldSize};
+  if (fieldSize == 0 || iterations == 0) {
+    return result;
+  }
+  auto field = createInstanceField(fieldSize);
+  auto [fieldBuffer, fieldBufferMemory] =
+      createInstanceBuffer(field, fieldSize);
+  // The draw command buffer and the draw count bound it are sized for
+  // every instance of the field.
+  auto cullingPass = std::make_unique<GPUCullingPass>();
+  cullingPass->initialize(GPUCullingPassInitInfo{
+      .rhi = rhi,
+      .instanceBuffer = fieldBuffer.get(),
+      .maxInstanceCount = fieldSize,
+      .lodBuffer = meshLODBuffer.get(),
+      .lodCount = static_cast<uint32_t>(meshLODs.size()),
+      .lodSelection = meshLODSelection,
+      .shaderCompiler = shaderCompiler,
+  });
+  cullingPass->setInstanceCount(fieldSize);
+
+  const auto viewProjection =
+      transform.projection * transform.view * transform.model;
+  auto emptyMs = 0.0;
+  for (auto i = 0U; i < iterations; i++) {
+    auto start = Clock::now();
+    auto commandBuffer = rhi->beginOneTimeCommandBuffer();
+    rhi->endOneTimeCommandBuffer(commandBuffer.get());
+    emptyMs += elapsedMs(start);
+
+    start = Clock::now();
+    commandBuffer = rhi->beginOneTimeCommandBuffer();
+    cullingPass->cull(commandBuffer.get(), viewProjection, getLODScale());
+    rhi->endOneTimeCommandBuffer(commandBuffer.get());
+    result.cullMs += elapsedMs(start);
+  }
+  result.cullMs = std::max(result.cullMs - emptyMs, 0.0) / iterations;
+
+  rhi->destoryBuffer(fieldBuffer.get());
+  rhi->freeMemory(fieldBufferMemory.get());
+  return result;
+}
+
+FirstUseBenchmarkResult RenderSystem::benchmarkFirstUse() {
+  using Clock = std::chrono::steady_clock;
+  auto elapsedMs = [](Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start)
+        .count();
+  };
+  // Workers may still be creating pipelines from the modules.
+  waitForGraphicsPipelines();
+  const auto variantCount =
+      1U << graphicsPermutations->getFeatures().size();
+  auto result = FirstUseBenchmarkResult{.variantCount = variantCount};
+  const auto swapChainInfo = rhi->getSwapChainInfo();
+  for (ShaderFeatureMask features = 0; features < variantCount; features++) {
+    GraphicsPipelineState state;
+    fillGraphicsPipelineState(
+        GraphicsPipelineVariant{
+            .features = features,
+            .vertexShader = vertexShader.get(),
+            .fragmentShader = fragmentShader.get(),
+            .colorFormat = swapChainInfo.imageFormat,
+            .depthFormat = rhi->getDepthImageInfo().format,
+        },
+        state);
+    // The driver's own pipeline cache may still serve variants it saw.
+    auto start = Clock::now();
+    auto pipeline = rhi->createGraphicsPipeline(state.createInfo);
+    const auto pipelineMs = elapsedMs(start);
+    result.pipelineAverageMs += pipelineMs;
+    result.pipelineMaxMs = std::max(result.pipelineMaxMs, pipelineMs);
+    if (pipeline) {
+      rhi->destoryPipeline(pipeline.get());
+    }
+
+    if (!rhi->supportsShaderObject()) {
+      continue;
+    }
+    start = Clock::now();
+    auto shaders = createGraphicsShaderObjects(features);
+    const auto shaderObjectMs = elapsedMs(start);
+    result.shaderObjectAverageMs += shaderObjectMs;
+    result.shaderObjectMaxMs =
+        std::max(result.shaderObjectMaxMs, shaderObjectMs);
+    for (auto* shader : {shaders.vertex.get(), shaders.fragment.get()}) {
+      if (shader) {
+        rhi->destoryShaderObject(shader);
+      }
+    }
+  }
+  result.pipelineAverageMs /= variantCount;
+  result.shaderObjectAverageMs /= variantCount;
+  return result;
+}
+
+std::vector<RHIDynamicState> RenderSystem::getGraphicsDynamicStates() const {
+  std::vector<RHIDynamicState> dynamicStates = {RHIDynamicState::Viewport,
+                                                RHIDynamicState::Scissor};
+  if (dynamicStateSupport.extendedDynamicState) {
+    dynamicStates.insert(dynamicStates.end(),
+                         {
+                             RHIDynamicState::PrimitiveTopology,
+                             RHIDynamicState::CullMode,
+                             RHIDynamicState::FrontFace,
+                             RHIDynamicState::DepthTestEnable,
+                             RHIDynamicState::DepthWriteEnable,
+                             RHIDynamicState::DepthCompareOp,
+                         });
+  }
+  if (dynamicStateSupport.extendedDynamicState2) {
+    dynamicStates.push_back(RHIDynamicState::PrimitiveRestartEnable);
+  }
+  if (dynamicStateSupport.colorBlend) {
+    dynamicStates.push_back(RHIDynamicState::ColorBlendEnableEXT);
+  }
+  return dynamicStates;
+}
+
+void RenderSystem::setMaterialRenderState(RHICommandBuffer* commandBuffer) {
+  const auto& renderState = materialRenderState;
+  if (dynamicStateSupport.extendedDynamicState) {
+    rhi->cmdSetPrimitiveTopology(commandBuffer, renderState.topology);
+    rhi->cmdSetCullMode(commandBuffer, renderState.cullMode);
+    rhi->cmdSetFrontFace(commandBuffer, renderState.frontFace);
+    rhi->cmdSetDepthTestEnable(commandBuffer, renderState.depthTestEnable);
+    rhi->cmdSetDepthWriteEnable(commandBuffer, renderState.depthWriteEnable);
+    rhi->cmdSetDepthCompareOp(commandBuffer, renderState.depthCompareOp);
+  }
+  if (dynamicStateSupport.extendedDynamicState2) {
+    rhi->cmdSetPrimitiveRestartEnable(commandBuffer,
+                                      renderState.primitiveRestartEnable);
+  }
+  if (dynamicStateSupport.colorBlend) {
+    const RHIBool32 blendEnable = renderState.blendEnable ? RHITrue : RHIFalse;
+    rhi->cmdSetColorBlendEnable(commandBuffer, 0, 1, &blendEnable);
+  }
 }
 
 void RenderSystem::tick(float deltaTime) {
-  rhi->beforePass();
-  updateUniformBuffer(
-      uniformBuffersMappedMemories[rhi->getCurrentFrameIndex()]);
+  if (!rhi->beforePass()) {
+    return;
+  }
+  if (shaderHotReloader) {
+    reloadShaders();
+  }
+  pipelineStateCache->collectOptimizedPipelines();
+  if (useShaderObjects) {
+    graphicsShaders = getGraphicsShaderObjects(materialFeatures);
+  } else {
+    graphicsPipeline = getGraphicsPipeline(materialFeatures);
+    if (!graphicsPipeline) {
+      graphicsPipeline = getRetiredGraphicsPipeline(materialFeatures);
+    }
+    if (!graphicsPipeline) {
+      graphicsPipeline = getGraphicsPipeline(FallbackFeatures);
+    }
+    releaseRetiredGraphicsShaders();
+  }
+  uniformRing->beginFrame(rhi->getCurrentFrameIndex());
+  updateUniformBuffer();
   auto commandBuffer = rhi->getCurrentCommandBuffer();
   recordCommandBuffer(commandBuffer);
   rhi->submitRendering();
-  rhi->waitIdle();
+}
+
+void RenderSystem::reloadShaders() {
+  for (auto& shader : shaderHotReloader->poll()) {
+    bool reloaded = false;
+    if (shader.name == "cull.comp") {
+      reloaded = gpuCullingPass->reloadShader(shader.code);
+    } else if (shader.name == "hiz_reduce.comp") {
+      reloaded = hiZPass->reloadShader(shader.code);
+    } else if (shader.name == "shader.vert") {
+      reloaded =
+          reloadGraphicsShader(vertexShader, vertexReflection, shader.code);
+    } else {
+      reloaded = reloadGraphicsShader(fragmentShader, fragmentReflection,
+                                      shader.code);
+    }
+    if (reloaded) {
+      LOG_FMT("Reloaded {}", shader.name);
+    } else {
+      LOG_ERROR_FMT("Reloading {} failed.", shader.name);
+    }
+  }
+}
+
+bool RenderSystem::reloadGraphicsShader(std::unique_ptr<RHIShader>& module,
+                                        ShaderReflection& reflection,
+                                        std::span<char> code) {
+  auto newReflection = reflectShader(code);
+  if (!newReflection) {
+    return false;
+  }
+  const auto isVertex = &reflection == &vertexReflection;
+  auto layout = reflectGraphicsLayout(
+      isVertex ? *newReflection : vertexReflection,
+      isVertex ? fragmentReflection : *newReflection);
+  // The descriptor set is allocated with the old layout.
+  if (layout.pipelineLayout != piplineLayout) {
+    LOG_ERROR("RenderSystem::reloadGraphicsShader the shader's resources "
+              "changed, which needs a restart.");
+    return false;
+  }
+  if (isVertex && !checkVertexInputs(*newReflection)) {
+    return false;
+  }
+
+  auto newModule = rhi->createShaderModule(code);
+  if (!newModule) {
+    return false;
+  }
+  auto previousModule = std::exchange(module, std::move(newModule));
+  reflection = std::move(*newReflection);
+  if (useShaderObjects) {
+    // Created again from the new code at the next frame.
+    (isVertex ? vertexShaderCode : fragmentShaderCode)
+        .assign(code.begin(), code.end());
+    releaseGraphicsShaderObjects();
+    // Frames in flight may still reference the previous module.
+    std::shared_ptr<RHIShader> retired = std::move(previousModule);
+    rhi->deferRelease([rhi = rhi.get(), retired] {
+      rhi->destoryShaderModule(retired.get());
+    });
+    return true;
+  }
+  // Workers may still be compiling variants of the previous module. They
+  // are drawn with until the material's new variant is ready.
+  retiredGraphicsShaders.push_back(RetiredGraphicsShaders{
+      .module = std::move(previousModule),
+      .pipelines = std::exchange(graphicsPipelines, {}),
+  });
+  requestGraphicsPipeline(materialFeatures);
+  return true;
+}
+
+RHIPipeline* RenderSystem::getRetiredGraphicsPipeline(
+    ShaderFeatureMask features) const {
+  for (auto retired = retiredGraphicsShaders.rbegin();
+       retired != retiredGraphicsShaders.rend(); ++retired) {
+    auto pipeline = retired->pipelines.find(features);
+    if (pipeline != retired->pipelines.end() &&
+        pipeline->second.wait_for(std::chrono::seconds(0)) ==
+            std::future_status::ready &&
+        pipeline->second.get()) {
+      return pipeline->second.get();
+    }
+  }
+  return nullptr;
+}
+
+void RenderSystem::releaseRetiredGraphicsShaders() {
+  if (retiredGraphicsShaders.empty() ||
+      !getGraphicsPipeline(materialFeatures)) {
+    return;
+  }
+  for (auto retired = retiredGraphicsShaders.begin();
+       retired != retiredGraphicsShaders.end();) {
+    const auto compiling =
+        std::ranges::any_of(retired->pipelines, [](const auto& pipeline) {
+          return pipeline.second.wait_for(std::chrono::seconds(0)) !=
+                 std::future_status::ready;
+        });
+    if (compiling) {
+      ++retired;
+      continue;
+    }
+    // The cache is keyed by module, so the variants have to leave it
+    // before the module is destroyed and its address reused.
+    for (const auto& [features, pipeline] : retired->pipelines) {
+      if (pipeline.get()) {
+        pipelineStateCache->evict(pipeline.get());
+      }
+    }
+    std::shared_ptr<RHIShader> module = std::move(retired->module);
+    rhi->deferRelease([rhi = rhi.get(), module] {
+      rhi->destoryShaderModule(module.get());
+    });
+    retired = retiredGraphicsShaders.erase(retired);
+  }
+}
+
+std::optional<ShaderReflection> RenderSystem::mergeGraphicsReflection(
+    const ShaderReflection& vertex,
+    const ShaderReflection& fragment) {
+  auto reflection = vertex;
+  if (!reflection.merge(fragment)) {
+    return std::nullopt;
+  }
+  // Points at the uniform ring, the transform's slice is picked by the
+  // dynamic offset at bind time.
+  reflection.setDescriptorType(0, 0, RHIDescriptorType::UniformBufferDynamic);
+  return reflection;
+}
+
+ReflectedPipelineLayout RenderSystem::reflectGraphicsLayout(
+    const ShaderReflection& vertex,
+    const ShaderReflection& fragment) {
+  const auto reflection = mergeGraphicsReflection(vertex, fragment);
+  if (!reflection) {
+    return {};
+  }
+  return pipelineLayoutCache->getOrCreate(*reflection);
+}
+
+bool RenderSystem::checkVertexInputs(const ShaderReflection& reflection) {
+  // Packed encodings are expanded to float, so only the locations have to
+  // match.
+  const auto attributes = vertexFormat.getAttributeDescription();
+  auto matches = true;
+  for (const auto& input : reflection.vertexInputs) {
+    if (std::ranges::none_of(attributes, [&input](const auto& attribute) {
+          return attribute.location == input.location;
+        })) {
+      LOG_ERROR_FMT("RenderSystem vertex input {} at location {} has no "
+                    "attribute.",
+                    input.name, input.location);
+      matches = false;
+    }
+  }
+  return matches;
+}
+
+const RenderQueueStatistics& RenderSystem::getRenderQueueStatistics() const {
+  return renderQueue->getStatistics();
+}
+
+void RenderSystem::waitForNextFrame() {
+  rhi->waitForNextFrame();
+}
+
+bool RenderSystem::setPresentMode(RHIPresentMode mode) {
+  const auto supportedModes = rhi->getSupportedPresentModes();
+  if (std::ranges::find(supportedModes, mode) == supportedModes.end()) {
+    LOG_WARN_FMT("RenderSystem::setPresentMode present mode {} is "
+                 "unsupported, keeping the current one.",
+                 static_cast<int>(mode));
+    return false;
+  }
+  rhi->setPresentMode(mode);
+  return true;
+}
+
+void RenderSystem::setLowLatency(bool enabled) {
+  rhi->setLowLatency(enabled);
+}
+
+RHIFrameLatencyStatistics RenderSystem::getFrameLatencyStatistics() const {
+  return rhi->getFrameLatencyStatistics();
+}
+
+PipelineStateCacheStatistics RenderSystem::getPipelineStateCacheStatistics()
+    const {
+  return pipelineStateCache->getStatistics();
 }
 
 std::vector<char> RenderSystem::readFile(const std::string& filename) {
@@ -391,12 +1166,38 @@ std::vector<char> RenderSystem::readFile(const std::string& filename) {
   return buffer;
 }
 
+std::vector<char> RenderSystem::loadShader(ShaderCompiler* shaderCompiler,
+                                           const std::string& name) {
+  if (shaderCompiler) {
+    if (auto code = shaderCompiler->compile(name)) {
+      return std::move(*code);
+    }
+    LOG_WARN_FMT("Loading the prebuilt {} instead.", name);
+  }
+  return readFile(name + ".spv");
+}
+
 std::tuple<std::unique_ptr<RHIBuffer>, std::unique_ptr<RHIDeviceMemory>>
-RenderSystem::createIndexBuffer(std::span<uint16_t> indices) {
-  auto bufferSize = sizeof(indices[0]) * indices.size();
+RenderSystem::createInstanceBuffer(std::span<RenderInstance> instances,
+                                   uint32_t capacity) {
+  // Sized for the instance budget so the culling pass can keep its
+  // descriptors when instances are added later.
+  auto bufferCreateInfo =
+      RHIBufferCreateInfo{.size = sizeof(RenderInstance) * capacity,
+                          .usage = RHIBufferUsageFlag::TransferDst |
+                                   RHIBufferUsageFlag::StorageBuffer,
+                          .sharingMode = RHISharingMode::Exclusive};
+  auto [instanceBuffer, instanceBufferMemory] =
+      rhi->createBuffer(bufferCreateInfo, RHIMemoryPropertyFlag::DeviceLocal);
+
+  const auto instanceCount = std::min<size_t>(instances.size(), capacity);
+  if (instanceCount == 0) {
+    return std::make_tuple(std::move(instanceBuffer),
+                           std::move(instanceBufferMemory));
+  }
 
   auto stagingBufferCreateInfo = RHIBufferCreateInfo{
-      .size = bufferSize,
+      .size = sizeof(RenderInstance) * instanceCount,
       .usage = RHIBufferUsageFlag::TransferSrc,
       .sharingMode = RHISharingMode::Exclusive,
   };
@@ -405,46 +1206,35 @@ RenderSystem::createIndexBuffer(std::span<uint16_t> indices) {
       RHIMemoryPropertyFlag::HostVisible | RHIMemoryPropertyFlag::HostCoherent);
   auto stagingBufferMappedMemory = rhi->mapMemory(stagingBufferMemory.get(), 0,
                                                   stagingBufferCreateInfo.size);
-  std::memcpy(stagingBufferMappedMemory, indices.data(),
+  std::memcpy(stagingBufferMappedMemory, instances.data(),
               stagingBufferCreateInfo.size);
   rhi->unmapMemory(stagingBufferMemory.get());
 
-  auto indexBufferCreateInfo =
-      RHIBufferCreateInfo{.size = bufferSize,
-                          .usage = RHIBufferUsageFlag::TransferDst |
-                                   RHIBufferUsageFlag::IndexBuffer,
-                          .sharingMode = RHISharingMode::Exclusive};
-
-  auto [indexBuffer, indexBufferMemory] = rhi->createBuffer(
-      indexBufferCreateInfo, RHIMemoryPropertyFlag::DeviceLocal);
-
-  auto copyRegion =
-      RHIBufferCopy{.srcOffset = 0, .dstOffset = 0, .size = bufferSize};
+  auto copyRegion = RHIBufferCopy{
+      .srcOffset = 0, .dstOffset = 0, .size = stagingBufferCreateInfo.size};
 
   auto oneTimeCommandBuffer = rhi->beginOneTimeCommandBuffer();
   rhi->cmdCopyBuffer(oneTimeCommandBuffer.get(), stagingBuffer.get(),
-                     indexBuffer.get(), {&copyRegion, 1});
+                     instanceBuffer.get(), {&copyRegion, 1});
   rhi->endOneTimeCommandBuffer(oneTimeCommandBuffer.get());
   rhi->destoryBuffer(stagingBuffer.get());
   rhi->freeMemory(stagingBufferMemory.get());
-  return std::make_tuple(std::move(indexBuffer), std::move(indexBufferMemory));
+  return std::make_tuple(std::move(instanceBuffer),
+                         std::move(instanceBufferMemory));
 }
 
 std::tuple<std::unique_ptr<RHIBuffer>, std::unique_ptr<RHIDeviceMemory>>
-RenderSystem::createVertexBuffer(std::span<Vertex> vertices) {
-  // Create vertex buffer
+RenderSystem::createMeshLODBuffer(std::span<MeshLOD> lods) {
   auto bufferCreateInfo =
-      RHIBufferCreateInfo{.size = sizeof(Vertex) * vertices.size(),
+      RHIBufferCreateInfo{.size = sizeof(MeshLOD) * lods.size(),
                           .usage = RHIBufferUsageFlag::TransferDst |
-                                   RHIBufferUsageFlag::VertexBuffer,
+                                   RHIBufferUsageFlag::StorageBuffer,
                           .sharingMode = RHISharingMode::Exclusive};
-
-  auto [vertexBuffer, vertexBufferMemory] =
+  auto [lodBuffer, lodBufferMemory] =
       rhi->createBuffer(bufferCreateInfo, RHIMemoryPropertyFlag::DeviceLocal);
 
-  // Create Staging buffer
   auto stagingBufferCreateInfo = RHIBufferCreateInfo{
-      .size = sizeof(Vertex) * vertices.size(),
+      .size = bufferCreateInfo.size,
       .usage = RHIBufferUsageFlag::TransferSrc,
       .sharingMode = RHISharingMode::Exclusive,
   };
@@ -453,7 +1243,7 @@ RenderSystem::createVertexBuffer(std::span<Vertex> vertices) {
       RHIMemoryPropertyFlag::HostVisible | RHIMemoryPropertyFlag::HostCoherent);
   auto stagingBufferMappedMemory = rhi->mapMemory(stagingBufferMemory.get(), 0,
                                                   stagingBufferCreateInfo.size);
-  std::memcpy(stagingBufferMappedMemory, vertices.data(),
+  std::memcpy(stagingBufferMappedMemory, lods.data(),
               stagingBufferCreateInfo.size);
   rhi->unmapMemory(stagingBufferMemory.get());
 
@@ -462,46 +1252,11 @@ RenderSystem::createVertexBuffer(std::span<Vertex> vertices) {
 
   auto oneTimeCommandBuffer = rhi->beginOneTimeCommandBuffer();
   rhi->cmdCopyBuffer(oneTimeCommandBuffer.get(), stagingBuffer.get(),
-                     vertexBuffer.get(), {&copyRegion, 1});
+                     lodBuffer.get(), {&copyRegion, 1});
   rhi->endOneTimeCommandBuffer(oneTimeCommandBuffer.get());
   rhi->destoryBuffer(stagingBuffer.get());
   rhi->freeMemory(stagingBufferMemory.get());
-  return std::make_tuple(std::move(vertexBuffer),
-                         std::move(vertexBufferMemory));
-}
-
-std::tuple<std::vector<std::unique_ptr<RHIBuffer>>,
-           std::vector<std::unique_ptr<RHIDeviceMemory>>,
-           std::vector<void*>>
-RenderSystem::createUniformBuffers() {
-  std::vector<std::unique_ptr<RHIBuffer>> uniformBuffers;
-  std::vector<std::unique_ptr<RHIDeviceMemory>> uniformBufferMemorys;
-  std::vector<void*> uniformBuffersMapped;
-
-  RHIDeviceSize bufferSize = sizeof(Transform);
-  const auto maxFramesInFlight = rhi->getMaxFramesInFlight();
-
-  uniformBuffers.resize(maxFramesInFlight);
-  uniformBufferMemorys.resize(maxFramesInFlight);
-  uniformBuffersMapped.resize(maxFramesInFlight);
-
-  auto bufferCreateInfo = RHIBufferCreateInfo{
-      .size = bufferSize,
-      .usage = RHIBufferUsageFlag::UniformBuffer,
-      .sharingMode = RHISharingMode::Exclusive,
-  };
-  for (auto i = 0; i < maxFramesInFlight; i++) {
-    auto [buffer, deviceMemory] = rhi->createBuffer(
-        bufferCreateInfo, RHIMemoryPropertyFlag::HostVisible |
-                              RHIMemoryPropertyFlag::HostCoherent);
-    uniformBuffersMapped[i] = rhi->mapMemory(deviceMemory.get(), 0, bufferSize);
-    uniformBuffers[i] = std::move(buffer);
-    uniformBufferMemorys[i] = std::move(deviceMemory);
-  }
-
-  return std::make_tuple(std::move(uniformBuffers),
-                         std::move(uniformBufferMemorys),
-                         std::move(uniformBuffersMapped));
+  return std::make_tuple(std::move(lodBuffer), std::move(lodBufferMemory));
 }
 
 std::tuple<std::unique_ptr<RHIImage>,
@@ -529,14 +1284,14 @@ RenderSystem::createTextureImage() {
                          std::move(imageMemory));
 }
 
-void RenderSystem::updateUniformBuffer(void* mappedMemory) {
+void RenderSystem::updateUniformBuffer() {
   static auto startTime = std::chrono::high_resolution_clock::now();
   auto currentTime = std::chrono::high_resolution_clock::now();
   auto swapChainInfo = rhi->getSwapChainInfo();
   float time = std::chrono::duration<float, std::chrono::seconds::period>(
                    currentTime - startTime)
                    .count();
-  auto ubo = Transform{
+  transform = Transform{
       .model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f),
                            glm::vec3(0.0f, 0.0f, 1.0f)),
       .view =
@@ -547,48 +1302,372 @@ void RenderSystem::updateUniformBuffer(void* mappedMemory) {
           swapChainInfo.extent.width / (float)swapChainInfo.extent.height, 0.1f,
           10.0f),
   };
-  ubo.projection[1][1] *= -1;
-  std::memcpy(mappedMemory, &ubo, sizeof(ubo));
+  transform.projection[1][1] *= -1;
+  // A failed allocation hands back no offset, binding 0 would read
+  // another frame's region.
+  const auto allocation = uniformRing->push(transform);
+  transformOffset = allocation.data
+                        ? std::optional<uint32_t>(allocation.offset)
+                        : std::nullopt;
 };
 
+void RenderSystem::cookMeshes() {
+  const auto statistics = cookMesh(vertices, indices);
+  indexType = statistics.indexType;
+  LOG_FMT(
+      "Mesh cooked: {} -> {} vertices, {}-bit indices, ACMR {:.3f} -> {:.3f}, "
+      "ATVR {:.3f} -> {:.3f}",
+      statistics.vertexCountBefore, statistics.vertexCountAfter,
+      indexType == RHIIndexType::Uint16 ? 16 : 32, statistics.before.acmr,
+      statistics.after.acmr, statistics.before.atvr, statistics.after.atvr);
+}
+
+void RenderSystem::createMeshLODs() {
+  const auto meshIndexCount = static_cast<uint32_t>(indices.size());
+  meshLODs = {MeshLOD{
+      .firstIndex = 0,
+      .indexCount = meshIndexCount,
+      .error = 0.0f,
+  }};
+  if (!enableMeshLOD) {
+    return;
+  }
+
+  // The coarser levels reuse the mesh's vertices and are appended to its
+  // index list.
+  auto chain = generateMeshLODChain(vertices, indices);
+  for (auto lod = 1U; lod < chain.indices.size(); lod++) {
+    auto& lodIndices = chain.indices[lod];
+    // Collapses scatter the cooked triangle order.
+    optimizeVertexCache(lodIndices, vertices.size());
+    meshLODs.push_back(MeshLOD{
+        .firstIndex = static_cast<uint32_t>(indices.size()),
+        .indexCount = static_cast<uint32_t>(lodIndices.size()),
+        .error = chain.errors[lod],
+    });
+    indices.insert(indices.end(), lodIndices.begin(), lodIndices.end());
+  }
+}
+
+void RenderSystem::createInstances() {
+  instances = createInstanceField(instanceCount);
+}
+
+std::vector<RenderInstance> RenderSystem::createInstanceField(
+    uint32_t count) const {
+  auto boundsMin = glm::vec3(std::numeric_limits<float>::max());
+  auto boundsMax = glm::vec3(std::numeric_limits<float>::lowest());
+  for (const auto& vertex : vertices) {
+    boundsMin = glm::min(boundsMin, vertex.position);
+    boundsMax = glm::max(boundsMax, vertex.position);
+  }
+  const auto center = (boundsMin + boundsMax) * 0.5f;
+  auto radius = 0.0f;
+  for (const auto& vertex : vertices) {
+    radius = std::max(radius, glm::distance(center, vertex.position));
+  }
+
+  // A single copy stays at the origin.
+  const auto side = static_cast<uint32_t>(
+      std::ceil(std::sqrt(static_cast<double>(count))));
+  const auto spacing = std::max(radius * 3.0f, 1e-3f);
+  const auto gridOffset = (static_cast<float>(side) - 1.0f) * 0.5f;
+  const auto vertexOffset =
+      geometryPool->getAllocation(meshGeometry).vertexOffset;
+  std::vector<RenderInstance> field;
+  field.reserve(count);
+  for (auto i = 0U; i < count; i++) {
+    const auto position =
+        glm::vec3(static_cast<float>(i % side) - gridOffset,
+                  static_cast<float>(i / side) - gridOffset, 0.0f) *
+        spacing;
+    field.push_back(RenderInstance{
+        .model = glm::translate(glm::mat4(1.0f), position),
+        .boundingSphere = glm::vec4(center, radius),
+        .positionOffset = glm::vec4(vertexQuantization.positionOffset, 0.0f),
+        .positionScale =
+            glm::vec4(vertexQuantization.positionScale,
+                      vertexQuantization.octahedralNormals ? 1.0f : 0.0f),
+        .indexCount = meshLODs.front().indexCount,
+        .firstIndex = meshLODs.front().firstIndex,
+        .vertexOffset = vertexOffset,
+        .firstLOD = 0,
+        .lodCount = static_cast<uint32_t>(meshLODs.size()),
+    });
+  }
+  return field;
+}
+
+void RenderSystem::createOccluders() {
+  occluderPositions.clear();
+  occluderPositions.reserve(vertices.size());
+  for (const auto& vertex : vertices) {
+    occluderPositions.push_back(vertex.position);
+  }
+}
+
+std::vector<OccluderMesh> RenderSystem::getOccluders() const {
+  // Instance offsets point into the geometry pool, the CPU copies only
+  // hold the one mesh.
+  const auto& geometry = geometryPool->getAllocation(meshGeometry);
+  std::vector<OccluderMesh> occluders;
+  occluders.reserve(instances.size());
+  for (const auto& instance : instances) {
+    occluders.push_back(OccluderMesh{
+        .positions = std::span<const glm::vec3>(occluderPositions).subspan(
+            instance.vertexOffset - geometry.vertexOffset),
+        .indices = std::span<const uint32_t>(indices).subspan(
+            instance.firstIndex - geometry.firstIndex, instance.indexCount),
+        .model = instance.model,
+    });
+  }
+  return occluders;
+}
+
+void RenderSystem::cullInstancesOnCPU(const glm::mat4& viewProjection) {
+  // Every instance doubles as an occluder, the test of its bounding sphere
+  // always lies in front of its own surface.
+  const auto occluders = getOccluders();
+  softwareOcclusion->clear();
+  softwareOcclusion->renderOccluders(occluders, viewProjection);
+  softwareOcclusion->testInstances(instances, viewProjection,
+                                   instanceVisibility);
+}
+
+void RenderSystem::selectInstanceLODs(const glm::mat4& viewProjection) {
+  const auto lodScale = getLODScale();
+  instanceLODs.resize(instances.size(), 0);
+  for (auto i = 0U; i < instances.size(); i++) {
+    const auto& instance = instances[i];
+    if (instance.lodCount == 0) {
+      continue;
+    }
+    const auto center =
+        instance.model * glm::vec4(glm::vec3(instance.boundingSphere), 1.0f);
+    const auto scale = std::max({glm::length(glm::vec3(instance.model[0])),
+                                 glm::length(glm::vec3(instance.model[1])),
+                                 glm::length(glm::vec3(instance.model[2]))});
+    // Clamped so objects crossing the near plane get the finest level.
+    const auto depth = std::max((viewProjection * center).w, 1e-4f);
+    instanceLODs[i] = selectMeshLOD(
+        std::span<const MeshLOD>(meshLODs).subspan(instance.firstLOD,
+                                                   instance.lodCount),
+        lodScale * scale / depth, instanceLODs[i], meshLODSelection);
+  }
+}
+
+void RenderSystem::queueInstanceDraws(const glm::mat4& viewProjection,
+                                      RHIDescriptorSet* descriptorSet) {
+  renderQueue->clear();
+  for (auto i = 0U; i < instances.size(); i++) {
+    if (enableSoftwareOcclusion && !instanceVisibility[i]) {
+      continue;
+    }
+    const auto& instance = instances[i];
+    auto indexCount = instance.indexCount;
+    auto firstIndex = instance.firstIndex;
+    if (instance.lodCount > 0) {
+      const auto& lod = meshLODs[instance.firstLOD + instanceLODs[i]];
+      indexCount = lod.indexCount;
+      firstIndex = lod.firstIndex;
+    }
+    const auto center =
+        instance.model * glm::vec4(glm::vec3(instance.boundingSphere), 1.0f);
+    // One opaque pipeline and material for now.
+    const auto key = encodeSortKey(RenderSortKeyFields{
+        .depth = (viewProjection * center).w,
+    });
+    renderQueue->push(key, RenderCommand{
+                               .pipeline = graphicsPipeline,
+                               .pipelineLayout = piplineLayout,
+                               .descriptorSet = descriptorSet,
+                               .dynamicOffsetCount = 1,
+                               .dynamicOffset = *transformOffset,
+                               .pushConstantStages = RHIShaderStageFlag::Vertex,
+                               .pushConstantSize = sizeof(uint32_t),
+                               .pushConstants = {i},
+                               .geometry = geometryPool.get(),
+                               .indexCount = indexCount,
+                               .firstIndex = firstIndex,
+                               .vertexOffset = instance.vertexOffset,
+                           });
+  }
+}
+
+float RenderSystem::getLODScale() const {
+  // Pixels covered by one unit at view depth one, vertically.
+  const auto swapChainInfo = rhi->getSwapChainInfo();
+  return std::abs(transform.projection[1][1]) *
+         static_cast<float>(swapChainInfo.extent.height) * 0.5f;
+}
+
 void RenderSystem::recordCommandBuffer(RHICommandBuffer* commandBuffer) {
   auto swapChainInfo = rhi->getSwapChainInfo();
   auto imageIndex = rhi->getCurrentSwapChainImageIndex();
   rhi->beginCommandBuffer(commandBuffer, nullptr);
 
+  // The swapchain may have been recreated with a new size.
+  viewport.width = static_cast<float>(swapChainInfo.extent.width);
+  viewport.height = static_cast<float>(swapChainInfo.extent.height);
+  scissor.extend = swapChainInfo.extent;
+
+  if (enableHiZ && hiZPass->resize(swapChainInfo.extent.width,
+                                   swapChainInfo.extent.height)) {
+    if (enableGPUCulling) {
+      gpuCullingPass->setDepthPyramid(
+          hiZPass->getPyramidView(), RHIImageLayout::General,
+          hiZPass->getWidth(), hiZPass->getHeight(), hiZPass->getMipLevels());
+    }
+  }
+
+  const auto viewProjection =
+      transform.projection * transform.view * transform.model;
+  if (enableGPUCulling) {
+    gpuCullingPass->cull(commandBuffer, viewProjection, getLODScale());
+  } else {
+    if (enableSoftwareOcclusion) {
+      cullInstancesOnCPU(viewProjection);
+    }
+    selectInstanceLODs(viewProjection);
+  }
+
+  beginMainPass(commandBuffer, imageIndex);
+  rhi->cmdSetViewport(commandBuffer, 0, 1, &viewport);
+  rhi->cmdSetScissor(commandBuffer, 0, 1, &scissor);
+  if (graphicsShaders) {
+    bindGraphicsShaders(commandBuffer);
+  }
+  setMaterialRenderState(commandBuffer);
+  // Nothing is drawn until a variant finished compiling.
+  const auto canDraw =
+      (graphicsPipeline || graphicsShaders) && transformOffset.has_value();
+  if (canDraw && enableGPUCulling) {
+    if (graphicsPipeline) {
+      rhi->cmdBindPipeline(commandBuffer, RHIPipelineBindPoint::Graphics,
+                           graphicsPipeline);
+    }
+    // Every mesh lives in the pool, draws only differ in their offsets.
+    geometryPool->bind(commandBuffer);
+    rhi->cmdBindDescriptorSets(commandBuffer, RHIPipelineBindPoint::Graphics,
+                               piplineLayout, 0, 1,
+                               descriptorSet.get(), 1, &*transformOffset);
+    // The culling pass writes each instance into its draw's firstInstance.
+    const uint32_t instanceBase = 0;
+    rhi->cmdPushConstants(commandBuffer, piplineLayout,
+                          RHIShaderStageFlag::Vertex, 0, sizeof(instanceBase),
+                          &instanceBase);
+    gpuCullingPass->draw(commandBuffer);
+  } else if (canDraw) {
+    queueInstanceDraws(viewProjection, descriptorSet.get());
+    renderQueue->sort();
+    renderQueue->record(commandBuffer);
+  }
+  endMainPass(commandBuffer, imageIndex);
+
+  if (enableHiZ) {
+    hiZPass->build(commandBuffer);
+  }
+  rhi->endCommandBuffer(commandBuffer);
+}
+
+void RenderSystem::beginMainPass(RHICommandBuffer* commandBuffer,
+                                 uint32_t imageIndex) {
+  const auto swapChainInfo = rhi->getSwapChainInfo();
+  const auto depthImageInfo = rhi->getDepthImageInfo();
+  const auto renderArea = RHIRect2D{
+      .offset = {0, 0},
+      .extend = swapChainInfo.extent,
+  };
   std::array<RHIClearValue, 2> clearValues = {
       RHIClearValue{.color = {{0.0f, 0.0f, 0.0f, 1.0f}}},
       RHIClearValue{.depthStencil = {1.0f, 0}},
   };
-  auto renderPassBeginInfo =
-      RHIRenderPassBeginInfo{.renderPass = renderPass.get(),
-                             .frameBuffer = framebuffers[imageIndex].get(),
-                             .renderArea =
-                                 {
-                                     .offset = {0, 0},
-                                     .extend = swapChainInfo.extent,
-                                 },
-                             .clearValueCount = clearValues.size(),
-                             .clearValue = clearValues.data()};
-  rhi->cmdBeginRenderPass(commandBuffer, &renderPassBeginInfo,
-                          RHISubpassContents::Inline);
-  rhi->cmdBindPipeline(commandBuffer, RHIPipelineBindPoint::Graphics,
-                       graphicsPipeline.get());
-
-  RHIBuffer* vertexBuffers[] = {vertexBuffer.get()};
-  RHIDeviceSize offsets[] = {0};
-  rhi->cmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
-  rhi->cmdBindIndexBuffer(commandBuffer, indexBuffer.get(), 0,
-                          RHIIndexType::Uint16);
-  rhi->cmdBindDescriptorSets(commandBuffer, RHIPipelineBindPoint::Graphics,
-                             piplineLayout.get(), 0, 1,
-                             descriptorSets[imageIndex].get(), 0, nullptr);
-  rhi->cmdSetViewport(commandBuffer, 0, 1, &viewport);
-  rhi->cmdSetScissor(commandBuffer, 0, 1, &scissor);
-  //   rhi->cmdDraw(commandBuffer, 3, 1, 0, 0);
-  rhi->cmdDrawIndexed(commandBuffer, indices.size(), 1, 0, 0, 0);
-  rhi->cmdEndRenderPass(commandBuffer);
-  rhi->endCommandBuffer(commandBuffer);
+
+  if (!useDynamicRendering) {
+    // Cached, a new framebuffer is only created after a resize.
+    std::array<RHIImageView*, 2> attachments = {
+        rhi->getSwapChainImageView(imageIndex), depthImageInfo.imageView};
+    auto* framebuffer =
+        renderTargetCache->getFramebuffer(RHIFramebufferCreateInfo{
+            .renderPass = renderPass,
+            .attachmentCount = attachments.size(),
+            .attachments = attachments.data(),
+            .width = swapChainInfo.extent.width,
+            .height = swapChainInfo.extent.height,
+            .layers = 1,
+        });
+    auto renderPassBeginInfo = RHIRenderPassBeginInfo{
+        .renderPass = renderPass,
+        .frameBuffer = framebuffer,
+        .renderArea = renderArea,
+        .clearValueCount = clearValues.size(),
+        .clearValue = clearValues.data(),
+    };
+    rhi->cmdBeginRenderPass(commandBuffer, &renderPassBeginInfo,
+                            RHISubpassContents::Inline);
+    return;
+  }
+
+  // The transitions the render pass did through its attachment layouts.
+  // Both images are cleared, so their previous contents are discarded.
+  std::array<RHIImageTransition, 2> transitions = {
+      RHIImageTransition{
+          .image = rhi->getSwapChainImage(imageIndex),
+          .usage = RHIResourceUsage::ColorAttachment,
+          .discard = true,
+      },
+      RHIImageTransition{
+          .image = depthImageInfo.image,
+          .subresourceRange = {.aspectMask = depthAspect},
+          .usage = RHIResourceUsage::DepthAttachment,
+          .discard = true,
+      },
+  };
+  rhi->cmdTransitionResources(commandBuffer, transitions, {});
+
+  const auto colorAttachment = RHIRenderingAttachmentInfo{
+      .imageView = rhi->getSwapChainImageView(imageIndex),
+      .imageLayout = RHIImageLayout::ColorAttachmentOptimal,
+      .loadOp = RHIAttachmentLoadOp::Clear,
+      .storeOp = RHIAttachmentStoreOp::Store,
+      .clearValue = clearValues[0],
+  };
+  const auto depthAttachment = RHIRenderingAttachmentInfo{
+      .imageView = depthImageInfo.imageView,
+      .imageLayout = RHIImageLayout::DepthStencilAttachmentOptimal,
+      .loadOp = RHIAttachmentLoadOp::Clear,
+      // The depth pyramid is reduced from it after the pass.
+      .storeOp = enableHiZ ? RHIAttachmentStoreOp::Store
+                           : RHIAttachmentStoreOp::DontCare,
+      .clearValue = clearValues[1],
+  };
+  const auto renderingInfo = RHIRenderingInfo{
+      .renderArea = renderArea,
+      .layerCount = 1,
+      .colorAttachmentCount = 1,
+      .colorAttachments = &colorAttachment,
+      .depthAttachment = &depthAttachment,
+  };
+  rhi->cmdBeginRendering(commandBuffer, &renderingInfo);
+}
+
+void RenderSystem::endMainPass(RHICommandBuffer* commandBuffer,
+                               uint32_t imageIndex) {
+  const auto presentTransition = RHIImageTransition{
+      .image = rhi->getSwapChainImage(imageIndex),
+      .usage = RHIResourceUsage::Present,
+  };
+  if (!useDynamicRendering) {
+    rhi->cmdEndRenderPass(commandBuffer);
+    // The render pass did the final transitions itself.
+    const auto depthImage = rhi->getDepthImageInfo().image;
+    rhi->setImageUsage(presentTransition.image, {}, presentTransition.usage);
+    rhi->setImageUsage(depthImage, {.aspectMask = depthAspect},
+                       RHIResourceUsage::DepthAttachment);
+    return;
+  }
+  rhi->cmdEndRendering(commandBuffer);
+  rhi->cmdTransitionResources(commandBuffer, {&presentTransition, 1}, {});
 }
 
 }  // namespace Sparrow
\ No newline at end of file
@@ -4,75 +4,371 @@
 #ifndef SPARROWENGINE_RENDER_SYSTEM_H
 #define SPARROWENGINE_RENDER_SYSTEM_H
 
+#include <array>
+#include <filesystem>
+#include <future>
 #include <memory>
+#include <optional>
 #include <span>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include "RHI/rhi_struct.h"
+#include "geometry_pool.h"
+#include "mesh_lod.h"
 #include "render_mesh.h"
+#include "shader_permutation.h"
+#include "shader_reflection.h"
+#include "vertex_format.h"
 
 namespace Sparrow {
 class WindowSystem;
 class RHI;
+class ThreadPool;
+
+class GPUCullingPass;
+class HiZPass;
+class PipelineLayoutCache;
+class PipelineStateCache;
+class RenderQueue;
+class RenderTargetCache;
+struct ReflectedPipelineLayout;
+struct PipelineStateCacheStatistics;
+struct RenderQueueStatistics;
+class ShaderCompiler;
+class ShaderHotReloader;
+class SoftwareOcclusionCuller;
+struct OccluderMesh;
+class UniformRingBuffer;
+
+// Fixed function state a material draws with. Where the device supports
+// extended dynamic state it is set while recording, so materials that only
+// differ here share their pipelines.
+struct MaterialRenderState {
+  RHIPrimitiveTopology topology = RHIPrimitiveTopology::TriangleList;
+  bool primitiveRestartEnable = false;
+  RHICullMode cullMode = RHICullMode::Back;
+  RHIFrontFace frontFace = RHIFrontFace::CounterClockwise;
+  bool depthTestEnable = true;
+  bool depthWriteEnable = true;
+  RHICompareOp depthCompareOp = RHICompareOp::Less;
+  // Blends by source alpha.
+  bool blendEnable = false;
+};
+
+// Creation times of every graphics variant, the hitch its first draw
+// would take without warm up.
+struct FirstUseBenchmarkResult {
+  uint32_t variantCount = 0;
+  double pipelineAverageMs = 0.0;
+  double pipelineMaxMs = 0.0;
+  // Vertex and fragment shader object together, 0 without support.
+  double shaderObjectAverageMs = 0.0;
+  double shaderObjectMaxMs = 0.0;
+};
+
+struct GPUCullingBenchmarkResult {
+  uint32_t instanceCount = 0;
+  // Submitting and waiting for the culling dispatch, less the same for an
+  // empty command buffer.
+  double cullMs = 0.0;
+};
 
 struct RenderSystemInitInfo {
   std::shared_ptr<WindowSystem> windowSystem;
+  std::shared_ptr<ThreadPool> threadPool;
+  bool enableGPUCulling = true;
+  bool enableHiZ = true;
+  // Tests instances against CPU rasterized occluders when drawing without
+  // GPU culling.
+  bool enableSoftwareOcclusion = true;
+  // Generates simplified levels of the mesh and draws each instance with
+  // the coarsest one whose projected error stays under the threshold.
+  bool enableMeshLOD = true;
+  MeshLODSelectionSettings meshLODSelection;
+  // Renders with attachments given at record time where the device
+  // supports it, falling back to render pass and framebuffer objects.
+  bool enableDynamicRendering = true;
+  // Layout of the vertex buffer, the cooked Vertex data is packed into it
+  // at upload.
+  VertexFormat vertexFormat = VertexFormat::compact();
+  // Copies of the mesh laid out on a grid, maxInstanceCount grows to hold
+  // them.
+  uint32_t instanceCount = 1;
+  uint32_t maxInstanceCount = 1024;
+  // Swapchain and frame pacing, see RHIInitInfo.
+  RHIPresentMode presentMode = RHIPresentMode::Mailbox;
+  uint32_t swapChainImageCount = 0;
+  uint32_t maxFramesInFlight = 3;
+  bool lowLatency = false;
+  // Features of the main shaders the material turns on, by name. The
+  // fragment shader declares TEXTURE, VERTEX_COLOR and LIGHTING.
+  std::vector<std::string> materialFeatures = {"TEXTURE"};
+  MaterialRenderState materialRenderState;
+  // Sets the material's render state while recording where the device
+  // supports it instead of creating a pipeline per state.
+  bool enableExtendedDynamicState = true;
+  // Draws with shader objects and all state set while recording instead
+  // of pipelines, so no variant waits for a pipeline compile. Needs
+  // dynamic rendering, falls back to pipelines without support.
+  bool enableShaderObjects = false;
+  // Compiles the variants earlier runs used at startup, and records new
+  // ones for the next run.
+  bool enablePipelineWarmUp = true;
+  // Compiles shaders from GLSL at startup through an on-disk SPIR-V cache
+  // instead of loading the SPIR-V built with the engine.
+  bool enableRuntimeShaderCompilation = false;
+  // Recompiles shaders whose GLSL source changed while running and swaps
+  // in their pipelines, implies enableRuntimeShaderCompilation.
+  bool enableShaderHotReload = false;
 };
 
 class RenderSystem {
  public:
-  RenderSystem() = default;
+  RenderSystem();
+  ~RenderSystem();
   void initialize(const RenderSystemInitInfo& initInfo);
+  // Blocks until the next frame can be recorded, call before sampling
+  // input for it.
+  void waitForNextFrame();
   void tick(float deltaTime);
+  // Binds and draws of the last frame recorded without GPU culling.
+  const RenderQueueStatistics& getRenderQueueStatistics() const;
+  // Takes effect at the next frame. Modes the surface does not support are
+  // ignored, returning false.
+  bool setPresentMode(RHIPresentMode mode);
+  void setLowLatency(bool enabled);
+  RHIFrameLatencyStatistics getFrameLatencyStatistics() const;
+  PipelineStateCacheStatistics getPipelineStateCacheStatistics() const;
+  // Runs the benchmarks on the scene of the last frame and logs their
+  // results. Blocks, call between frames.
+  void runBenchmarks();
+  // Creates and destroys every variant once as a pipeline, bypassing the
+  // cache, and as shader objects. Blocks, call between frames.
+  FirstUseBenchmarkResult benchmarkFirstUse();
+  // Culls a grid of `fieldSize` copies of the mesh on the GPU with a
+  // culling pass sized for them. Blocks, call between frames.
+  GPUCullingBenchmarkResult benchmarkGPUCulling(uint32_t fieldSize,
+                                                uint32_t iterations = 10);
 
- private:
   static std::vector<char> readFile(const std::string& filename);
+  // Compiles `name` with shaderCompiler if given, falling back to the
+  // prebuilt SPIR-V.
+  static std::vector<char> loadShader(ShaderCompiler* shaderCompiler,
+                                      const std::string& name);
+
+ private:
   std::shared_ptr<RHI> rhi;
 
   std::tuple<std::unique_ptr<RHIBuffer>, std::unique_ptr<RHIDeviceMemory>>
-  createIndexBuffer(std::span<uint16_t> indices);
+  createInstanceBuffer(std::span<RenderInstance> instances,
+                       uint32_t capacity);
 
   std::tuple<std::unique_ptr<RHIBuffer>, std::unique_ptr<RHIDeviceMemory>>
-  createVertexBuffer(std::span<struct Vertex> vertices);
-
-  std::tuple<std::vector<std::unique_ptr<RHIBuffer>>,
-             std::vector<std::unique_ptr<RHIDeviceMemory>>,
-             std::vector<void*>>
-  createUniformBuffers();
+  createMeshLODBuffer(std::span<MeshLOD> lods);
 
   std::tuple<std::unique_ptr<RHIImage>,
              std::unique_ptr<RHIImageView>,
              std::unique_ptr<RHIDeviceMemory>>
   createTextureImage();
 
-  void updateUniformBuffer(void* mappedMemory);
+  void updateUniformBuffer();
+  void cookMeshes();
+  void createMeshLODs();
+  void createInstances();
+  // `count` copies of the mesh on a square grid centered at the origin.
+  std::vector<RenderInstance> createInstanceField(uint32_t count) const;
+  void createOccluders();
+  // Every instance as an occluder, pointing into occluderPositions.
+  std::vector<OccluderMesh> getOccluders() const;
+  void cullInstancesOnCPU(const glm::mat4& viewProjection);
+  void selectInstanceLODs(const glm::mat4& viewProjection);
+  void queueInstanceDraws(const glm::mat4& viewProjection,
+                          RHIDescriptorSet* descriptorSet);
+  float getLODScale() const;
+
+  // What a graphics pipeline is created from besides the state fixed at
+  // initialization, taken on the render thread for the workers.
+  struct GraphicsPipelineVariant {
+    ShaderFeatureMask features = 0;
+    RHIShader* vertexShader = nullptr;
+    RHIShader* fragmentShader = nullptr;
+    RHIFormat colorFormat = RHIFormat::Undefined;
+    RHIFormat depthFormat = RHIFormat::Undefined;
+  };
+  // Drawn with while the material's variant compiles.
+  static constexpr ShaderFeatureMask FallbackFeatures = 0;
+
+  // What a graphics pipeline create info points at. createInfo points
+  // into the struct, so it is neither copied nor moved.
+  struct GraphicsPipelineState {
+    GraphicsPipelineState() = default;
+    GraphicsPipelineState(const GraphicsPipelineState&) = delete;
+    GraphicsPipelineState& operator=(const GraphicsPipelineState&) = delete;
+
+    ShaderSpecialization specialization;
+    RHISpecializationInfo specializationInfo;
+    std::array<RHIPipelineShaderStageCreateInfo, 2> shaderStages;
+    RHIVertexBindingDescription bindingDescription;
+    std::array<RHIVertexAttributeDescription, 4> attributeDescriptions;
+    RHIVertexInputStateCreateInfo vertexInput;
+    RHIInputAssemblyStateCreateInfo inputAssembly;
+    RHIViewportStateCreateInfo viewport;
+    std::vector<RHIDynamicState> dynamicStates;
+    RHIDynamicStateCreateInfo dynamicState;
+    RHIRasterizationStateCreateInfo rasterization;
+    RHIMultisampleStateCreateInfo multisample;
+    RHIColorBlendAttachmentState colorBlendAttachment;
+    RHIColorBlendStateCreateInfo colorBlend;
+    RHIDepthStencilStateCreateInfo depthStencil;
+    RHIFormat colorFormat = RHIFormat::Undefined;
+    RHIPipelineRenderingCreateInfo rendering;
+    RHIGraphicsPipelineCreateInfo createInfo;
+  };
+  // The stages of a variant, drawn with in place of its pipeline.
+  struct GraphicsShaderObjects {
+    std::unique_ptr<RHIShaderObject> vertex;
+    std::unique_ptr<RHIShaderObject> fragment;
+  };
+
+  void fillGraphicsPipelineState(const GraphicsPipelineVariant& variant,
+                                 GraphicsPipelineState& state) const;
+  RHIPipeline* createGraphicsPipeline(const GraphicsPipelineVariant& variant);
+  GraphicsShaderObjects createGraphicsShaderObjects(
+      ShaderFeatureMask features);
+  // Creates the variant's shader objects the first time, null if that
+  // failed.
+  const GraphicsShaderObjects* getGraphicsShaderObjects(
+      ShaderFeatureMask features);
+  void releaseGraphicsShaderObjects();
+  void bindGraphicsShaders(RHICommandBuffer* commandBuffer);
+  // Viewport and scissor, and the material state the device can set.
+  std::vector<RHIDynamicState> getGraphicsDynamicStates() const;
+  void setMaterialRenderState(RHICommandBuffer* commandBuffer);
+  // Returns nullptr until the variant finished compiling, requesting it
+  // the first time.
+  RHIPipeline* getGraphicsPipeline(ShaderFeatureMask features);
+  void requestGraphicsPipeline(ShaderFeatureMask features);
+  // The newest ready variant of a module hot reload replaced.
+  RHIPipeline* getRetiredGraphicsPipeline(ShaderFeatureMask features) const;
+  // Once the material's variant of the current modules is ready.
+  void releaseRetiredGraphicsShaders();
+  void waitForGraphicsPipelines();
+  void warmUpGraphicsPipelines();
+  void recordPipelineWarmUp(ShaderFeatureMask features);
+  void reloadShaders();
+  bool reloadGraphicsShader(std::unique_ptr<RHIShader>& module,
+                            ShaderReflection& reflection,
+                            std::span<char> code);
+  // Empty if the stages declare conflicting resources.
+  std::optional<ShaderReflection> mergeGraphicsReflection(
+      const ShaderReflection& vertex,
+      const ShaderReflection& fragment);
+  ReflectedPipelineLayout reflectGraphicsLayout(
+      const ShaderReflection& vertex,
+      const ShaderReflection& fragment);
+  // Logs vertex inputs the vertex format has no attribute for.
+  bool checkVertexInputs(const ShaderReflection& reflection);
 
   void recordCommandBuffer(RHICommandBuffer* commandBuffer);
+  void beginMainPass(RHICommandBuffer* commandBuffer, uint32_t imageIndex);
+  void endMainPass(RHICommandBuffer* commandBuffer, uint32_t imageIndex);
   RHIViewport viewport;
   RHIRect2D scissor;
   std::vector<Vertex> vertices;
-  std::vector<uint16_t> indices;
+  VertexFormat vertexFormat;
+  VertexQuantization vertexQuantization;
+  std::vector<uint32_t> indices;
+  RHIIndexType indexType = RHIIndexType::Uint16;
+  std::vector<RenderInstance> instances;
+  Transform transform;
 
   std::unique_ptr<RHIShader> vertexShader, fragmentShader;
-  std::unique_ptr<RHIDescriptorSetLayout> descriptorSetLayout;
-  std::vector<std::unique_ptr<RHIDescriptorSet>> descriptorSets;
-  std::unique_ptr<RHIRenderPass> renderPass;
-  std::unique_ptr<RHIPipelineLayout> piplineLayout;
-  std::vector<std::unique_ptr<RHIFramebuffer>> framebuffers;
-  std::unique_ptr<RHIPipeline> graphicsPipeline;
+  // SPIR-V of the modules, shader objects are created from it.
+  std::vector<char> vertexShaderCode, fragmentShaderCode;
+  ShaderReflection vertexReflection, fragmentReflection;
+  std::shared_ptr<ShaderCompiler> shaderCompiler;
+  std::unique_ptr<ShaderHotReloader> shaderHotReloader;
+  std::unique_ptr<PipelineLayoutCache> pipelineLayoutCache;
+  // Owned by pipelineLayoutCache.
+  RHIDescriptorSetLayout* descriptorSetLayout = nullptr;
+  std::unique_ptr<RHIDescriptorSet> descriptorSet;
+  bool useDynamicRendering = false;
+  RHIImageAspectFlag depthAspect = RHIImageAspectFlag::Depth;
+  // Only used without dynamic rendering.
+  std::unique_ptr<RenderTargetCache> renderTargetCache;
+  // Owned by renderTargetCache.
+  RHIRenderPass* renderPass = nullptr;
+  // Owned by pipelineLayoutCache.
+  RHIPipelineLayout* piplineLayout = nullptr;
+  std::unique_ptr<PipelineStateCache> pipelineStateCache;
+  std::unique_ptr<ShaderPermutations> graphicsPermutations;
+  ShaderFeatureMask materialFeatures = 0;
+  MaterialRenderState materialRenderState;
+  // What of the material state is dynamic, all false when disabled.
+  RHIExtendedDynamicStateSupport dynamicStateSupport;
+  // Variants requested so far, owned by pipelineStateCache.
+  std::unordered_map<ShaderFeatureMask, std::shared_future<RHIPipeline*>>
+      graphicsPipelines;
+  // Drawn with this frame, the material's variant or the fallback. Null
+  // if neither is ready.
+  RHIPipeline* graphicsPipeline = nullptr;
+  // A module hot reload replaced and the variants requested from it.
+  struct RetiredGraphicsShaders {
+    std::unique_ptr<RHIShader> module;
+    std::unordered_map<ShaderFeatureMask, std::shared_future<RHIPipeline*>>
+        pipelines;
+  };
+  std::vector<RetiredGraphicsShaders> retiredGraphicsShaders;
+  bool useShaderObjects = false;
+  // Variants drawn with so far, failed ones hold nulls.
+  std::unordered_map<ShaderFeatureMask, GraphicsShaderObjects>
+      graphicsShaderObjects;
+  // Drawn with this frame instead of graphicsPipeline.
+  const GraphicsShaderObjects* graphicsShaders = nullptr;
+  // Set while recording with the shader objects, viewport and scissor
+  // point at the members.
+  std::unique_ptr<GraphicsPipelineState> shaderObjectState;
+  std::filesystem::path pipelineWarmUpPath;
+  std::unordered_set<ShaderFeatureMask> warmUpFeatures;
 
-  std::unique_ptr<RHIBuffer> indexBuffer, vertexBuffer;
-  std::unique_ptr<RHIDeviceMemory> indexBufferMemory, vertexBufferMemory;
+  std::unique_ptr<GeometryPool> geometryPool;
+  GeometryHandle meshGeometry = 0;
+  std::unique_ptr<RHIBuffer> instanceBuffer;
+  std::unique_ptr<RHIDeviceMemory> instanceBufferMemory;
 
-  std::vector<std::unique_ptr<RHIBuffer>> uniformBuffers;
-  std::vector<std::unique_ptr<RHIDeviceMemory>> uniformBufferMemories;
-  std::vector<void*> uniformBuffersMappedMemories;
+  std::unique_ptr<UniformRingBuffer> uniformRing;
+  // Dynamic offset of this frame's transform in the uniform ring, unset
+  // if the ring was full. Nothing is drawn then.
+  std::optional<uint32_t> transformOffset;
 
   std::unique_ptr<RHIImage> textureImage;
   std::unique_ptr<RHIImageView> textureImageView;
   std::unique_ptr<RHIDeviceMemory> textureImageMemory;
   std::unique_ptr<RHISampler> textureSampler;
 
+  bool enableGPUCulling = true;
+  bool enableHiZ = true;
+  uint32_t instanceCount = 1;
+  uint32_t maxInstanceCount = 0;
+  std::unique_ptr<GPUCullingPass> gpuCullingPass;
+  std::unique_ptr<HiZPass> hiZPass;
+  std::unique_ptr<RenderQueue> renderQueue;
+
+  std::shared_ptr<ThreadPool> threadPool;
+  bool enableSoftwareOcclusion = true;
+  std::unique_ptr<SoftwareOcclusionCuller> softwareOcclusion;
+  std::vector<glm::vec3> occluderPositions;
+  std::vector<uint8_t> instanceVisibility;
+
+  bool enableMeshLOD = true;
+  MeshLODSelectionSettings meshLODSelection;
+  std::vector<MeshLOD> meshLODs;
+  // Level each instance is drawn with when culling on the CPU.
+  std::vector<uint32_t> instanceLODs;
+  std::unique_ptr<RHIBuffer> meshLODBuffer;
+  std::unique_ptr<RHIDeviceMemory> meshLODBufferMemory;
 };
 
 }  // namespace Sparrow
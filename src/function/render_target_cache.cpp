@@ -0,0 +1,164 @@
+#include "render_target_cache.h"
+#include <algorithm>
+#include <iostream>
+#include "RHI/rhi.h"
+#include "utils/log.h"
+#include "utils/state_key_writer.h"
+
+namespace Sparrow {
+
+namespace {
+void writeAttachmentReferences(StateKeyWriter& writer,
+                               uint32_t count,
+                               const RHIAttachmentReference* references) {
+  writer.write(references != nullptr);
+  if (references) {
+    for (auto i = 0U; i < count; i++) {
+      writer.write(references[i].attachment);
+      writer.write(references[i].layout);
+    }
+  }
+}
+}  // namespace
+
+std::string makeRenderPassKey(const RHIRenderPassCreateInfo& createInfo) {
+  auto writer = StateKeyWriter{};
+  writer.write(createInfo.attachmentCount);
+  for (auto i = 0U; i < createInfo.attachmentCount; i++) {
+    const auto& attachment = createInfo.attachments[i];
+    writer.write(attachment.flag);
+    writer.write(attachment.format);
+    writer.write(attachment.samples);
+    writer.write(attachment.loadOp);
+    writer.write(attachment.storeOp);
+    writer.write(attachment.stencilLoadOp);
+    writer.write(attachment.stencilStoreOp);
+    writer.write(attachment.initialLayout);
+    writer.write(attachment.finalLayout);
+  }
+
+  writer.write(createInfo.subpassCount);
+  for (auto i = 0U; i < createInfo.subpassCount; i++) {
+    const auto& subpass = createInfo.subpasses[i];
+    writer.write(subpass.flags);
+    writer.write(subpass.pipelineBindPoint);
+    writer.write(subpass.inputAttachmentCount);
+    writeAttachmentReferences(writer, subpass.inputAttachmentCount,
+                              subpass.inputAttachments);
+    writer.write(subpass.colorAttachmentCount);
+    writeAttachmentReferences(writer, subpass.colorAttachmentCount,
+                              subpass.colorAttachments);
+    writeAttachmentReferences(writer, subpass.colorAttachmentCount,
+                              subpass.resolveAttachments);
+    writeAttachmentReferences(writer, 1, subpass.depthStencilAttachment);
+    writer.writeBytes(subpass.preserveAttachments,
+                      subpass.preserveAttachmentCount * sizeof(uint32_t));
+  }
+
+  writer.write(createInfo.dependencyCount);
+  for (auto i = 0U; i < createInfo.dependencyCount; i++) {
+    const auto& dependency = createInfo.dependencies[i];
+    writer.write(dependency.srcSubpass);
+    writer.write(dependency.dstSubpass);
+    writer.write(dependency.srcStageMask);
+    writer.write(dependency.dstStageMask);
+    writer.write(dependency.srcAccessMask);
+    writer.write(dependency.dstAccessMask);
+    writer.write(dependency.dependencyFlags);
+  }
+  return writer.take();
+}
+
+std::string makeFramebufferKey(const RHIFramebufferCreateInfo& createInfo) {
+  auto writer = StateKeyWriter{};
+  writer.write(createInfo.renderPass);
+  writer.write(createInfo.attachmentCount);
+  for (auto i = 0U; i < createInfo.attachmentCount; i++) {
+    writer.write(createInfo.attachments[i]);
+  }
+  writer.write(createInfo.width);
+  writer.write(createInfo.height);
+  writer.write(createInfo.layers);
+  return writer.take();
+}
+
+RenderTargetCache::RenderTargetCache(std::shared_ptr<RHI> rhi)
+    : rhi(std::move(rhi)) {
+  imageViewDestroyListenerId = this->rhi->addImageViewDestroyListener(
+      [this](RHIImageView* imageView) { evictImageView(imageView); });
+}
+
+RenderTargetCache::~RenderTargetCache() {
+  rhi->removeImageViewDestroyListener(imageViewDestroyListenerId);
+  for (auto& [key, entry] : framebuffers) {
+    rhi->destoryFramebuffer(entry.framebuffer.get());
+  }
+}
+
+RHIRenderPass* RenderTargetCache::getRenderPass(
+    const RHIRenderPassCreateInfo& createInfo) {
+  auto key = makeRenderPassKey(createInfo);
+  if (auto entry = renderPasses.find(key); entry != renderPasses.end()) {
+    statistics.renderPassHits++;
+    return entry->second.get();
+  }
+  statistics.renderPassMisses++;
+  auto renderPass = rhi->createRenderPass(createInfo);
+  if (!renderPass) {
+    LOG_ERROR("RenderTargetCache::getRenderPass create render pass failed.");
+    return nullptr;
+  }
+  auto* result = renderPass.get();
+  renderPasses.emplace(std::move(key), std::move(renderPass));
+  statistics.renderPassCount = static_cast<uint32_t>(renderPasses.size());
+  return result;
+}
+
+RHIFramebuffer* RenderTargetCache::getFramebuffer(
+    const RHIFramebufferCreateInfo& createInfo) {
+  auto key = makeFramebufferKey(createInfo);
+  if (auto entry = framebuffers.find(key); entry != framebuffers.end()) {
+    statistics.framebufferHits++;
+    return entry->second.framebuffer.get();
+  }
+  statistics.framebufferMisses++;
+  auto framebufferCreateInfo = createInfo;
+  auto framebuffer = rhi->createFramebuffer(framebufferCreateInfo);
+  if (!framebuffer) {
+    LOG_ERROR("RenderTargetCache::getFramebuffer create framebuffer failed.");
+    return nullptr;
+  }
+  auto* result = framebuffer.get();
+  framebuffers.emplace(
+      std::move(key),
+      FramebufferEntry{
+          .framebuffer = std::move(framebuffer),
+          .attachments = std::vector<RHIImageView*>(
+              createInfo.attachments,
+              createInfo.attachments + createInfo.attachmentCount),
+      });
+  statistics.framebufferCount = static_cast<uint32_t>(framebuffers.size());
+  return result;
+}
+
+void RenderTargetCache::evictImageView(RHIImageView* imageView) {
+  for (auto it = framebuffers.begin(); it != framebuffers.end();) {
+    const auto& attachments = it->second.attachments;
+    if (std::find(attachments.begin(), attachments.end(), imageView) ==
+        attachments.end()) {
+      ++it;
+      continue;
+    }
+    // Frames in flight may still render with the framebuffer.
+    std::shared_ptr<RHIFramebuffer> framebuffer =
+        std::move(it->second.framebuffer);
+    rhi->deferRelease([rhi = rhi.get(), framebuffer] {
+      rhi->destoryFramebuffer(framebuffer.get());
+    });
+    it = framebuffers.erase(it);
+    statistics.framebufferEvictions++;
+  }
+  statistics.framebufferCount = static_cast<uint32_t>(framebuffers.size());
+}
+
+}  // namespace Sparrow
@@ -0,0 +1,70 @@
+#ifndef SPARROWENGINE_RENDER_TARGET_CACHE_H
+#define SPARROWENGINE_RENDER_TARGET_CACHE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "RHI/rhi_struct.h"
+
+namespace Sparrow {
+class RHI;
+
+// Canonical keys of the state a render pass or framebuffer is made of.
+// Render passes key on attachment formats, samples, load/store ops and
+// layouts, subpasses and dependencies. Framebuffers key on their render
+// pass, attachment views and size.
+std::string makeRenderPassKey(const RHIRenderPassCreateInfo& createInfo);
+std::string makeFramebufferKey(const RHIFramebufferCreateInfo& createInfo);
+
+struct RenderTargetCacheStatistics {
+  uint64_t renderPassHits = 0;
+  uint64_t renderPassMisses = 0;
+  uint64_t framebufferHits = 0;
+  uint64_t framebufferMisses = 0;
+  uint64_t framebufferEvictions = 0;
+  uint32_t renderPassCount = 0;
+  uint32_t framebufferCount = 0;
+};
+
+// Creates each distinct render pass and framebuffer once and returns the
+// cached object afterwards, so passes can look them up every frame. A
+// framebuffer is forgotten as soon as one of its image views is destroyed
+// and released after the frames using it, the next lookup after a resize
+// creates it again.
+class RenderTargetCache {
+ public:
+  explicit RenderTargetCache(std::shared_ptr<RHI> rhi);
+  ~RenderTargetCache();
+
+  RenderTargetCache(const RenderTargetCache&) = delete;
+  RenderTargetCache& operator=(const RenderTargetCache&) = delete;
+
+  // Returned objects are owned by the cache. Returns nullptr if creation
+  // failed.
+  RHIRenderPass* getRenderPass(const RHIRenderPassCreateInfo& createInfo);
+  RHIFramebuffer* getFramebuffer(const RHIFramebufferCreateInfo& createInfo);
+
+  void evictImageView(RHIImageView* imageView);
+
+  const RenderTargetCacheStatistics& getStatistics() const {
+    return statistics;
+  }
+
+ private:
+  struct FramebufferEntry {
+    std::unique_ptr<RHIFramebuffer> framebuffer;
+    std::vector<RHIImageView*> attachments;
+  };
+
+  std::shared_ptr<RHI> rhi;
+  uint32_t imageViewDestroyListenerId = 0;
+  std::unordered_map<std::string, std::unique_ptr<RHIRenderPass>> renderPasses;
+  std::unordered_map<std::string, FramebufferEntry> framebuffers;
+  RenderTargetCacheStatistics statistics;
+};
+
+}  // namespace Sparrow
+
+#endif  // SPARROWENGINE_RENDER_TARGET_CACHE_H
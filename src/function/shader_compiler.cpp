@@ -0,0 +1,343 @@
+#include "shader_compiler.h"
+#include <glslang/Public/ResourceLimits.h>
+#include <glslang/Public/ShaderLang.h>
+#include <glslang/SPIRV/GlslangToSpv.h>
+#include <glslang/build_info.h>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <system_error>
+#include "utils/log.h"
+#include "utils/state_key_writer.h"
+
+namespace Sparrow {
+
+namespace {
+// Target every compilation uses, part of the cache key.
+constexpr const char* compilerOptions = "vulkan1.0 spirv1.0";
+constexpr int defaultVersion = 100;
+const auto compilerMessages =
+    static_cast<EShMessages>(EShMsgSpvRules | EShMsgVulkanRules);
+
+std::optional<std::string> readText(const std::filesystem::path& path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open()) {
+    return std::nullopt;
+  }
+  std::ostringstream stream;
+  stream << file.rdbuf();
+  return stream.str();
+}
+
+std::optional<std::vector<char>> readBinary(
+    const std::filesystem::path& path) {
+  std::ifstream file(path, std::ios::ate | std::ios::binary);
+  if (!file.is_open()) {
+    return std::nullopt;
+  }
+  std::vector<char> code(static_cast<size_t>(file.tellg()));
+  file.seekg(0);
+  file.read(code.data(), static_cast<std::streamsize>(code.size()));
+  return code;
+}
+
+// FNV-1a, stable across runs and platforms unlike std::hash.
+uint64_t hashBytes(const std::string& bytes) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (const auto byte : bytes) {
+    hash ^= static_cast<uint8_t>(byte);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+std::optional<EShLanguage> getStage(const std::filesystem::path& path) {
+  const auto extension = path.extension();
+  if (extension == ".vert") {
+    return EShLangVertex;
+  }
+  if (extension == ".tesc") {
+    return EShLangTessControl;
+  }
+  if (extension == ".tese") {
+    return EShLangTessEvaluation;
+  }
+  if (extension == ".geom") {
+    return EShLangGeometry;
+  }
+  if (extension == ".frag") {
+    return EShLangFragment;
+  }
+  if (extension == ".comp") {
+    return EShLangCompute;
+  }
+  return std::nullopt;
+}
+
+bool isIdentifier(const std::string& name) {
+  if (name.empty() || std::isdigit(static_cast<unsigned char>(name[0]))) {
+    return false;
+  }
+  return std::ranges::all_of(name, [](char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+  });
+}
+
+// The defines as preprocessor lines, nullopt if one could inject others.
+std::optional<std::string> makePreamble(
+    std::span<const ShaderDefine> defines) {
+  std::string preamble = "#extension GL_GOOGLE_include_directive : enable\n";
+  for (const auto& define : defines) {
+    if (!isIdentifier(define.name) ||
+        define.value.find_first_of("\r\n") != std::string::npos) {
+      LOG_ERROR_FMT("ShaderCompiler invalid define {}.", define.name);
+      return std::nullopt;
+    }
+    preamble += std::format("#define {} {}\n", define.name, define.value);
+  }
+  return preamble;
+}
+
+// Resolves `#include "name"` next to the including file, then in the
+// include directories, and `#include <name>` in the include directories
+// only. Files are read once, so preprocessing and compiling see the same
+// text.
+class Includer : public glslang::TShader::Includer {
+ public:
+  explicit Includer(const std::vector<std::filesystem::path>& directories)
+      : directories(directories) {}
+
+  IncludeResult* includeLocal(const char* headerName,
+                              const char* includerName,
+                              size_t inclusionDepth) override {
+    const auto candidate =
+        std::filesystem::path(includerName).parent_path() / headerName;
+    if (std::filesystem::exists(candidate)) {
+      return include(candidate);
+    }
+    return includeSystem(headerName, includerName, inclusionDepth);
+  }
+
+  IncludeResult* includeSystem(const char* headerName,
+                               const char* /*includerName*/,
+                               size_t /*inclusionDepth*/) override {
+    for (const auto& directory : directories) {
+      const auto candidate = directory / headerName;
+      if (std::filesystem::exists(candidate)) {
+        return include(candidate);
+      }
+    }
+    return nullptr;
+  }
+
+  void releaseInclude(IncludeResult* result) override { delete result; }
+
+  const std::map<std::filesystem::path, std::string>& getFiles() const {
+    return files;
+  }
+
+ private:
+  IncludeResult* include(const std::filesystem::path& candidate) {
+    const auto path = candidate.lexically_normal();
+    auto file = files.find(path);
+    if (file == files.end()) {
+      auto text = readText(path);
+      if (!text) {
+        return nullptr;
+      }
+      file = files.emplace(path, std::move(*text)).first;
+    }
+    return new IncludeResult(path.string(), file->second.data(),
+                             file->second.size(), nullptr);
+  }
+
+  const std::vector<std::filesystem::path>& directories;
+  // Node based, the results point into it.
+  std::map<std::filesystem::path, std::string> files;
+};
+
+struct ShaderSource {
+  std::string path;
+  std::string text;
+  std::string preamble;
+};
+
+void setSource(glslang::TShader& shader,
+               EShLanguage stage,
+               const ShaderSource& source) {
+  const char* text = source.text.data();
+  const auto length = static_cast<int>(source.text.size());
+  const char* name = source.path.c_str();
+  shader.setStringsWithLengthsAndNames(&text, &length, &name, 1);
+  shader.setPreamble(source.preamble.c_str());
+  shader.setEnvInput(glslang::EShSourceGlsl, stage, glslang::EShClientVulkan,
+                     defaultVersion);
+  shader.setEnvClient(glslang::EShClientVulkan,
+                      glslang::EShTargetVulkan_1_0);
+  shader.setEnvTarget(glslang::EShTargetSpv, glslang::EShTargetSpv_1_0);
+}
+}  // namespace
+
+ShaderCompiler::~ShaderCompiler() {
+  if (processInitialized) {
+    glslang::FinalizeProcess();
+  }
+}
+
+void ShaderCompiler::initialize(const ShaderCompilerInitInfo& initInfo) {
+  sourceDirectory = initInfo.sourceDirectory;
+  includeDirectories = initInfo.includeDirectories;
+  cacheDirectory = initInfo.cacheDirectory;
+  // Reference counted by glslang, other users in the process are fine.
+  processInitialized = glslang::InitializeProcess();
+  if (!processInitialized) {
+    LOG_ERROR("ShaderCompiler initializing glslang failed.");
+  }
+  compilerVersion =
+      std::format("glslang {}.{}.{}{}", GLSLANG_VERSION_MAJOR,
+                  GLSLANG_VERSION_MINOR, GLSLANG_VERSION_PATCH,
+                  GLSLANG_VERSION_FLAVOR);
+
+  std::error_code error;
+  std::filesystem::create_directories(cacheDirectory, error);
+  if (error) {
+    LOG_ERROR_FMT("ShaderCompiler creating {} failed: {}",
+                  cacheDirectory.string(), error.message());
+  }
+}
+
+std::optional<std::vector<char>> ShaderCompiler::compile(
+    const std::string& name,
+    std::span<const ShaderDefine> defines) {
+  const auto path = (sourceDirectory / name).lexically_normal();
+  const auto stage = getStage(path);
+  auto text = readText(path);
+  auto preamble = makePreamble(defines);
+  if (!processInitialized || !stage || !text || !preamble) {
+    LOG_ERROR_FMT("ShaderCompiler cannot compile {}.", name);
+    failures++;
+    return std::nullopt;
+  }
+  const auto source = ShaderSource{
+      .path = path.string(),
+      .text = std::move(*text),
+      .preamble = std::move(*preamble),
+  };
+
+  const auto* resources = GetDefaultResources();
+  Includer includer(includeDirectories);
+  std::string preprocessed;
+  {
+    glslang::TShader shader(*stage);
+    setSource(shader, *stage, source);
+    const auto preprocessSucceeded = shader.preprocess(
+        resources, defaultVersion, ENoProfile, false, false,
+        compilerMessages, &preprocessed, includer);
+    // Also when it failed, fixing an include has to be noticed.
+    {
+      std::lock_guard lock(includesMutex);
+      auto& nameIncludes = includes[name];
+      for (const auto& [includePath, includeText] : includer.getFiles()) {
+        nameIncludes.insert(includePath);
+      }
+    }
+    if (!preprocessSucceeded) {
+      LOG_ERROR_FMT("ShaderCompiler preprocessing {} failed:\n{}", name,
+                    shader.getInfoLog());
+      failures++;
+      return std::nullopt;
+    }
+  }
+
+  const auto hash = hashBytes(makeCacheKey(name, preprocessed, defines));
+  const auto cachePath = cacheDirectory / std::format("{:016x}.spv", hash);
+  if (auto code = readBinary(cachePath)) {
+    cacheHits++;
+    return code;
+  }
+
+  compilations++;
+  glslang::TShader shader(*stage);
+  setSource(shader, *stage, source);
+  glslang::TProgram program;
+  auto compiled = shader.parse(resources, defaultVersion, false,
+                               compilerMessages, includer);
+  if (compiled) {
+    program.addShader(&shader);
+    compiled = program.link(compilerMessages);
+  }
+  if (!compiled) {
+    LOG_ERROR_FMT("ShaderCompiler compiling {} failed:\n{}{}", name,
+                  shader.getInfoLog(), program.getInfoLog());
+    failures++;
+    return std::nullopt;
+  }
+  std::vector<uint32_t> spirv;
+  glslang::GlslangToSpv(*program.getIntermediate(*stage), spirv);
+  std::vector<char> code(spirv.size() * sizeof(uint32_t));
+  std::memcpy(code.data(), spirv.data(), code.size());
+
+  // Written under a name no other process picks and renamed into place,
+  // so readers never see a partly written file.
+  std::random_device random;
+  const auto suffix = (static_cast<uint64_t>(random()) << 32) | random();
+  auto writePath = cacheDirectory / std::format("{:016x}.{:016x}.tmp",
+                                                hash, suffix);
+  {
+    std::ofstream file(writePath, std::ios::binary);
+    file.write(code.data(), static_cast<std::streamsize>(code.size()));
+  }
+  std::error_code error;
+  std::filesystem::rename(writePath, cachePath, error);
+  if (error) {
+    LOG_WARN_FMT("ShaderCompiler caching {} failed: {}", name,
+                 error.message());
+    std::filesystem::remove(writePath, error);
+  }
+  return code;
+}
+
+ShaderCompilerStatistics ShaderCompiler::getStatistics() const {
+  return ShaderCompilerStatistics{
+      .cacheHits = cacheHits,
+      .compilations = compilations,
+      .failures = failures,
+  };
+}
+
+std::vector<std::filesystem::path> ShaderCompiler::getIncludes(
+    const std::string& name) const {
+  std::lock_guard lock(includesMutex);
+  auto nameIncludes = includes.find(name);
+  if (nameIncludes == includes.end()) {
+    return {};
+  }
+  return {nameIncludes->second.begin(), nameIncludes->second.end()};
+}
+
+std::string ShaderCompiler::makeCacheKey(
+    const std::string& name,
+    const std::string& source,
+    std::span<const ShaderDefine> defines) const {
+  const auto stage = std::filesystem::path(name).extension().string();
+  const std::string options = compilerOptions;
+  StateKeyWriter writer;
+  writer.writeBytes(compilerVersion.data(), compilerVersion.size());
+  writer.writeBytes(options.data(), options.size());
+  writer.writeBytes(stage.data(), stage.size());
+  writer.writeBytes(source.data(), source.size());
+  writer.write(defines.size());
+  for (const auto& define : defines) {
+    writer.writeBytes(define.name.data(), define.name.size());
+    writer.writeBytes(define.value.data(), define.value.size());
+  }
+  return writer.take();
+}
+
+}  // namespace Sparrow
@@ -0,0 +1,81 @@
+#ifndef SPARROWENGINE_SHADER_COMPILER_H
+#define SPARROWENGINE_SHADER_COMPILER_H
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace Sparrow {
+
+struct ShaderCompilerInitInfo {
+  std::filesystem::path sourceDirectory;
+  // Searched after the directory of the including file.
+  std::vector<std::filesystem::path> includeDirectories;
+  std::filesystem::path cacheDirectory;
+};
+
+struct ShaderDefine {
+  // An identifier, the value must not span lines. Defines that break
+  // either fail the compilation.
+  std::string name;
+  std::string value;
+};
+
+struct ShaderCompilerStatistics {
+  uint64_t cacheHits = 0;
+  uint64_t compilations = 0;
+  uint64_t failures = 0;
+};
+
+// Compiles GLSL to SPIR-V at runtime with glslang. Sources are
+// preprocessed first, so the cache key covers every file a shader pulls in
+// and the defines. SPIR-V is cached on disk under a hash of the
+// preprocessed source and the compiler version, a variant compiled once is
+// read back on every later launch. compile is safe to call from several
+// threads.
+class ShaderCompiler {
+ public:
+  ShaderCompiler() = default;
+  ShaderCompiler(const ShaderCompiler&) = delete;
+  ShaderCompiler& operator=(const ShaderCompiler&) = delete;
+  ~ShaderCompiler();
+
+  void initialize(const ShaderCompilerInitInfo& initInfo);
+
+  // name is the source file name, its extension gives the stage.
+  std::optional<std::vector<char>> compile(
+      const std::string& name,
+      std::span<const ShaderDefine> defines = {});
+
+  ShaderCompilerStatistics getStatistics() const;
+  // Every file compilations of name included so far, directly or not.
+  std::vector<std::filesystem::path> getIncludes(
+      const std::string& name) const;
+
+ private:
+  std::string makeCacheKey(const std::string& name,
+                           const std::string& source,
+                           std::span<const ShaderDefine> defines) const;
+
+  std::filesystem::path sourceDirectory;
+  std::vector<std::filesystem::path> includeDirectories;
+  std::filesystem::path cacheDirectory;
+  std::string compilerVersion;
+  bool processInitialized = false;
+  std::atomic<uint64_t> cacheHits = 0;
+  std::atomic<uint64_t> compilations = 0;
+  std::atomic<uint64_t> failures = 0;
+  mutable std::mutex includesMutex;
+  std::map<std::string, std::set<std::filesystem::path>> includes;
+};
+
+}  // namespace Sparrow
+
+#endif  // SPARROWENGINE_SHADER_COMPILER_H
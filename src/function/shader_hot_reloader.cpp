@@ -0,0 +1,182 @@
+#include "shader_hot_reloader.h"
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include <system_error>
+#include "function/shader_compiler.h"
+#include "utils/log.h"
+#include "utils/thread_pool.h"
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace Sparrow {
+
+ShaderHotReloader::~ShaderHotReloader() {
+#ifdef __linux__
+  if (notifyFd >= 0) {
+    close(notifyFd);
+  }
+#endif
+}
+
+void ShaderHotReloader::initialize(const ShaderHotReloaderInitInfo& initInfo) {
+  threadPool = initInfo.threadPool;
+  shaderCompiler = initInfo.shaderCompiler;
+  sourceDirectory = initInfo.sourceDirectory;
+  pollInterval = initInfo.pollInterval;
+  lastPollTime = std::chrono::steady_clock::now();
+#ifdef __linux__
+  notifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (notifyFd < 0) {
+    LOG_WARN("ShaderHotReloader inotify is unavailable, polling instead.");
+  }
+#endif
+}
+
+void ShaderHotReloader::watch(const std::string& name) {
+  auto& shader = shaders.emplace_back(WatchedShader{.name = name});
+  updateFiles(shader);
+}
+
+void ShaderHotReloader::updateFiles(WatchedShader& shader) {
+  auto paths = shaderCompiler->getIncludes(shader.name);
+  paths.push_back((sourceDirectory / shader.name).lexically_normal());
+  for (const auto& path : paths) {
+    if (shader.files.contains(path)) {
+      continue;
+    }
+    std::error_code error;
+    const auto lastWriteTime = std::filesystem::last_write_time(path, error);
+    if (error) {
+      LOG_WARN_FMT("ShaderHotReloader cannot watch {}: {}", path.string(),
+                   error.message());
+    }
+    shader.files.emplace(path, lastWriteTime);
+    watchDirectory(path.parent_path());
+  }
+}
+
+void ShaderHotReloader::watchDirectory(const std::filesystem::path& directory) {
+#ifdef __linux__
+  if (notifyFd < 0 ||
+      std::ranges::find(watchedDirectories, directory,
+                        &decltype(watchedDirectories)::value_type::second) !=
+          watchedDirectories.end()) {
+    return;
+  }
+  // Editors often save by renaming a new file over the old one, which a
+  // watch on the file itself would not survive.
+  const auto descriptor = inotify_add_watch(notifyFd, directory.c_str(),
+                                            IN_CLOSE_WRITE | IN_MOVED_TO);
+  if (descriptor < 0) {
+    LOG_WARN_FMT("ShaderHotReloader cannot watch {}.", directory.string());
+    return;
+  }
+  watchedDirectories.emplace(descriptor, directory);
+#endif
+}
+
+std::vector<ReloadedShader> ShaderHotReloader::poll() {
+  std::vector<ReloadedShader> reloaded;
+  for (auto& shader : shaders) {
+    if (!shader.compilation.valid() ||
+        shader.compilation.wait_for(std::chrono::seconds(0)) !=
+            std::future_status::ready) {
+      continue;
+    }
+    if (auto code = shader.compilation.get()) {
+      reloaded.push_back(ReloadedShader{
+          .name = shader.name,
+          .code = std::move(*code),
+      });
+    }
+    updateFiles(shader);
+    if (shader.changedWhileCompiling) {
+      shader.changedWhileCompiling = false;
+      startCompilation(shader);
+    }
+  }
+
+  const auto changedFiles = findChangedFiles();
+  if (changedFiles.empty()) {
+    return reloaded;
+  }
+  for (auto& shader : shaders) {
+    const auto changed = std::ranges::any_of(
+        shader.files,
+        [&](const auto& file) { return changedFiles.contains(file.first); });
+    if (!changed) {
+      continue;
+    }
+    if (shader.compilation.valid()) {
+      shader.changedWhileCompiling = true;
+    } else {
+      startCompilation(shader);
+    }
+  }
+  return reloaded;
+}
+
+std::set<std::filesystem::path> ShaderHotReloader::findChangedFiles() {
+  if (notifyFd >= 0) {
+    return readFileEvents();
+  }
+  std::set<std::filesystem::path> changedFiles;
+  const auto now = std::chrono::steady_clock::now();
+  if (now - lastPollTime < pollInterval) {
+    return changedFiles;
+  }
+  lastPollTime = now;
+  for (auto& shader : shaders) {
+    for (auto& [path, lastWriteTime] : shader.files) {
+      std::error_code error;
+      const auto writeTime = std::filesystem::last_write_time(path, error);
+      // Editors may replace the file while saving, it is looked at again
+      // next time.
+      if (error || writeTime == lastWriteTime) {
+        continue;
+      }
+      lastWriteTime = writeTime;
+      changedFiles.insert(path);
+    }
+  }
+  return changedFiles;
+}
+
+std::set<std::filesystem::path> ShaderHotReloader::readFileEvents() {
+  std::set<std::filesystem::path> changedFiles;
+#ifdef __linux__
+  alignas(inotify_event) std::array<char, 4096> buffer;
+  for (;;) {
+    const auto length = read(notifyFd, buffer.data(), buffer.size());
+    // Nothing left, the descriptor does not block.
+    if (length <= 0) {
+      break;
+    }
+    for (auto offset = 0; offset < length;) {
+      const auto* event =
+          reinterpret_cast<const inotify_event*>(buffer.data() + offset);
+      offset += sizeof(inotify_event) + event->len;
+      auto directory = watchedDirectories.find(event->wd);
+      if (event->len == 0 || directory == watchedDirectories.end()) {
+        continue;
+      }
+      changedFiles.insert((directory->second / event->name).lexically_normal());
+    }
+  }
+#endif
+  return changedFiles;
+}
+
+void ShaderHotReloader::startCompilation(WatchedShader& shader) {
+  LOG_FMT("Recompiling {}", shader.name);
+  shader.compilation = threadPool->submit(
+      [shaderCompiler = shaderCompiler, name = shader.name] {
+        return shaderCompiler->compile(name);
+      });
+}
+
+}  // namespace Sparrow
@@ -0,0 +1,82 @@
+#ifndef SPARROWENGINE_SHADER_HOT_RELOADER_H
+#define SPARROWENGINE_SHADER_HOT_RELOADER_H
+
+#include <chrono>
+#include <filesystem>
+#include <future>
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace Sparrow {
+class ShaderCompiler;
+class ThreadPool;
+
+struct ShaderHotReloaderInitInfo {
+  std::shared_ptr<ThreadPool> threadPool;
+  // Compiles what changed, its cache keeps the result for the next start.
+  std::shared_ptr<ShaderCompiler> shaderCompiler;
+  std::filesystem::path sourceDirectory;
+  // Only used where file change notifications are unavailable.
+  std::chrono::milliseconds pollInterval = std::chrono::milliseconds(250);
+};
+
+struct ReloadedShader {
+  // Source file name, such as shader.vert.
+  std::string name;
+  std::vector<char> code;
+};
+
+// Watches GLSL sources and the files they include, and recompiles the
+// shaders whose files changed to SPIR-V on the thread pool. On Linux the
+// directories holding them are watched with inotify, elsewhere the
+// modification times are polled.
+class ShaderHotReloader {
+ public:
+  ShaderHotReloader() = default;
+  ShaderHotReloader(const ShaderHotReloader&) = delete;
+  ShaderHotReloader& operator=(const ShaderHotReloader&) = delete;
+  ~ShaderHotReloader();
+
+  void initialize(const ShaderHotReloaderInitInfo& initInfo);
+
+  void watch(const std::string& name);
+  // Starts compiling shaders that changed and returns the ones whose
+  // compilation succeeded since the last call. Never waits for a compiler.
+  std::vector<ReloadedShader> poll();
+
+ private:
+  struct WatchedShader {
+    std::string name;
+    // The source and its includes, with their modification times.
+    std::map<std::filesystem::path, std::filesystem::file_time_type> files;
+    std::future<std::optional<std::vector<char>>> compilation;
+    // Saved again while compiling, compiled once more afterwards.
+    bool changedWhileCompiling = false;
+  };
+
+  // Picks up the includes of the last compilation.
+  void updateFiles(WatchedShader& shader);
+  void watchDirectory(const std::filesystem::path& directory);
+  std::set<std::filesystem::path> findChangedFiles();
+  std::set<std::filesystem::path> readFileEvents();
+  void startCompilation(WatchedShader& shader);
+
+  std::shared_ptr<ThreadPool> threadPool;
+  std::shared_ptr<ShaderCompiler> shaderCompiler;
+  std::filesystem::path sourceDirectory;
+  std::chrono::milliseconds pollInterval{};
+  std::chrono::steady_clock::time_point lastPollTime;
+  std::vector<WatchedShader> shaders;
+  // inotify instance and the directories it watches by descriptor, -1
+  // when polling.
+  int notifyFd = -1;
+  std::map<int, std::filesystem::path> watchedDirectories;
+};
+
+}  // namespace Sparrow
+
+#endif  // SPARROWENGINE_SHADER_HOT_RELOADER_H
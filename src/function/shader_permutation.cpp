@@ -0,0 +1,83 @@
+#include "shader_permutation.h"
+#include <algorithm>
+#include <iostream>
+#include "utils/log.h"
+
+namespace Sparrow {
+
+ShaderPermutations::ShaderPermutations(std::vector<ShaderFeature> features)
+    : features(std::move(features)) {
+  if (this->features.size() > MaxFeatures) {
+    LOG_ERROR_FMT("ShaderPermutations {} features exceed the mask, the "
+                  "ones after {} are dropped.",
+                  this->features.size(), MaxFeatures);
+    this->features.resize(MaxFeatures);
+  }
+}
+
+ShaderFeatureMask ShaderPermutations::getFeatureMask(
+    std::span<const std::string> names) const {
+  ShaderFeatureMask mask = 0;
+  for (const auto& name : names) {
+    auto feature = std::ranges::find(features, name, &ShaderFeature::name);
+    if (feature == features.end()) {
+      LOG_WARN_FMT("ShaderPermutations unknown feature {}.", name);
+      continue;
+    }
+    mask |= 1U << (feature - features.begin());
+  }
+  return mask;
+}
+
+ShaderSpecialization ShaderPermutations::getSpecialization(
+    ShaderFeatureMask mask) const {
+  ShaderSpecialization specialization;
+  for (auto i = 0U; i < features.size(); i++) {
+    if (!features[i].constantId) {
+      continue;
+    }
+    specialization.mapEntries.push_back(RHISpecializationMapEntry{
+        .constantID = *features[i].constantId,
+        .offset = static_cast<uint32_t>(specialization.data.size() *
+                                        sizeof(RHIBool32)),
+        .size = sizeof(RHIBool32),
+    });
+    specialization.data.push_back(mask & (1U << i) ? RHITrue : RHIFalse);
+  }
+  return specialization;
+}
+
+std::vector<ShaderDefine> ShaderPermutations::getDefines(
+    ShaderFeatureMask mask) const {
+  std::vector<ShaderDefine> defines;
+  for (auto i = 0U; i < features.size(); i++) {
+    if (!features[i].constantId && (mask & (1U << i))) {
+      defines.push_back(ShaderDefine{.name = features[i].name});
+    }
+  }
+  return defines;
+}
+
+ShaderFeatureMask ShaderPermutations::getDefineMask(
+    ShaderFeatureMask mask) const {
+  ShaderFeatureMask defineMask = 0;
+  for (auto i = 0U; i < features.size(); i++) {
+    if (!features[i].constantId) {
+      defineMask |= 1U << i;
+    }
+  }
+  return mask & defineMask;
+}
+
+std::vector<std::string> ShaderPermutations::getFeatureNames(
+    ShaderFeatureMask mask) const {
+  std::vector<std::string> names;
+  for (auto i = 0U; i < features.size(); i++) {
+    if (mask & (1U << i)) {
+      names.push_back(features[i].name);
+    }
+  }
+  return names;
+}
+
+}  // namespace Sparrow
@@ -0,0 +1,71 @@
+#ifndef SPARROWENGINE_SHADER_PERMUTATION_H
+#define SPARROWENGINE_SHADER_PERMUTATION_H
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+#include "RHI/rhi_struct.h"
+#include "shader_compiler.h"
+
+namespace Sparrow {
+
+// One bit per feature, in the order the features were declared.
+using ShaderFeatureMask = uint32_t;
+
+struct ShaderFeature {
+  // Also the name of the define, or of the constant in the shader.
+  std::string name;
+  // Bool specialization constant the feature sets. Without one it is a
+  // define, each combination of those needs its own module from the
+  // runtime compiler.
+  std::optional<uint32_t> constantId;
+};
+
+// Specialization constants of one permutation. Owns what getInfo points
+// at, so it has to outlive the pipeline creation using it.
+struct ShaderSpecialization {
+  std::vector<RHISpecializationMapEntry> mapEntries;
+  std::vector<RHIBool32> data;
+
+  RHISpecializationInfo getInfo() const {
+    return RHISpecializationInfo{
+        .mapEntryCount = static_cast<uint32_t>(mapEntries.size()),
+        .pMapEntries = mapEntries.data(),
+        .dataSize = data.size() * sizeof(RHIBool32),
+        .pData = data.data(),
+    };
+  }
+};
+
+// The feature toggles shaders expose to materials. A material picks
+// features by name, every combination becomes a variant with the
+// disabled branches compiled out instead of tested per invocation.
+// Pipelines of a variant are deduplicated by the PipelineStateCache,
+// whose key covers the specialization data.
+class ShaderPermutations {
+ public:
+  static constexpr uint32_t MaxFeatures = 32;
+
+  explicit ShaderPermutations(std::vector<ShaderFeature> features);
+
+  // Unknown names are logged and ignored.
+  ShaderFeatureMask getFeatureMask(std::span<const std::string> names) const;
+  // Every specialization constant feature, set from the mask.
+  ShaderSpecialization getSpecialization(ShaderFeatureMask mask) const;
+  // The define features the mask enables, for ShaderCompiler::compile.
+  std::vector<ShaderDefine> getDefines(ShaderFeatureMask mask) const;
+  // The part of the mask that needs a module of its own.
+  ShaderFeatureMask getDefineMask(ShaderFeatureMask mask) const;
+  std::vector<std::string> getFeatureNames(ShaderFeatureMask mask) const;
+
+  const std::vector<ShaderFeature>& getFeatures() const { return features; }
+
+ private:
+  std::vector<ShaderFeature> features;
+};
+
+}  // namespace Sparrow
+
+#endif  // SPARROWENGINE_SHADER_PERMUTATION_H
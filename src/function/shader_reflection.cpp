@@ -0,0 +1,581 @@
+#include "shader_reflection.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <tuple>
+#include <unordered_map>
+#include "utils/log.h"
+
+namespace Sparrow {
+
+namespace {
+// The parts of the SPIR-V grammar reflection looks at.
+namespace Spv {
+constexpr uint32_t Magic = 0x07230203;
+constexpr uint32_t HeaderWordCount = 5;
+
+constexpr uint32_t OpName = 5;
+constexpr uint32_t OpEntryPoint = 15;
+constexpr uint32_t OpTypeInt = 21;
+constexpr uint32_t OpTypeFloat = 22;
+constexpr uint32_t OpTypeVector = 23;
+constexpr uint32_t OpTypeMatrix = 24;
+constexpr uint32_t OpTypeImage = 25;
+constexpr uint32_t OpTypeSampler = 26;
+constexpr uint32_t OpTypeSampledImage = 27;
+constexpr uint32_t OpTypeArray = 28;
+constexpr uint32_t OpTypeRuntimeArray = 29;
+constexpr uint32_t OpTypeStruct = 30;
+constexpr uint32_t OpTypePointer = 32;
+constexpr uint32_t OpConstant = 43;
+constexpr uint32_t OpVariable = 59;
+constexpr uint32_t OpDecorate = 71;
+constexpr uint32_t OpMemberDecorate = 72;
+constexpr uint32_t OpTypeAccelerationStructure = 5341;
+
+constexpr uint32_t DecorationBufferBlock = 3;
+constexpr uint32_t DecorationArrayStride = 6;
+constexpr uint32_t DecorationMatrixStride = 7;
+constexpr uint32_t DecorationBuiltIn = 11;
+constexpr uint32_t DecorationLocation = 30;
+constexpr uint32_t DecorationBinding = 33;
+constexpr uint32_t DecorationDescriptorSet = 34;
+constexpr uint32_t DecorationOffset = 35;
+
+constexpr uint32_t StorageClassUniformConstant = 0;
+constexpr uint32_t StorageClassInput = 1;
+constexpr uint32_t StorageClassUniform = 2;
+constexpr uint32_t StorageClassPushConstant = 9;
+constexpr uint32_t StorageClassStorageBuffer = 12;
+
+constexpr uint32_t DimBuffer = 5;
+constexpr uint32_t DimSubpassData = 6;
+}  // namespace Spv
+
+struct SpvType {
+  uint32_t opcode = 0;
+  // Operands after the result id.
+  std::vector<uint32_t> operands;
+};
+
+struct SpvMember {
+  uint32_t offset = 0;
+  uint32_t matrixStride = 0;
+};
+
+struct SpvId {
+  std::string name;
+  std::optional<uint32_t> set;
+  std::optional<uint32_t> binding;
+  std::optional<uint32_t> location;
+  bool builtIn = false;
+  bool bufferBlock = false;
+  uint32_t arrayStride = 0;
+  std::vector<SpvMember> members;
+};
+
+struct SpvVariable {
+  uint32_t id = 0;
+  uint32_t pointerType = 0;
+  uint32_t storageClass = 0;
+};
+
+class SpvModule {
+ public:
+  bool parse(std::span<const char> code);
+  ShaderReflection reflect() const;
+
+ private:
+  std::optional<RHIDescriptorType> getDescriptorType(uint32_t typeId,
+                                                     uint32_t storageClass)
+      const;
+  uint32_t getArrayLength(uint32_t typeId) const;
+  uint32_t getTypeSize(uint32_t typeId, uint32_t matrixStride) const;
+  RHIFormat getVertexFormat(uint32_t typeId) const;
+  const SpvType* findType(uint32_t id) const;
+  uint32_t unwrapArray(uint32_t typeId) const;
+  SpvMember& member(uint32_t id, uint32_t index);
+
+  RHIShaderStageFlag stage = {};
+  std::unordered_map<uint32_t, SpvType> types;
+  std::unordered_map<uint32_t, uint32_t> constants;
+  std::unordered_map<uint32_t, SpvId> ids;
+  std::vector<SpvVariable> variables;
+};
+
+std::string readString(std::span<const uint32_t> words) {
+  std::string string(words.size() * sizeof(uint32_t), '\0');
+  std::memcpy(string.data(), words.data(), string.size());
+  string.resize(std::strlen(string.c_str()));
+  return string;
+}
+
+RHIShaderStageFlag getStage(uint32_t executionModel) {
+  switch (executionModel) {
+    case 0:
+      return RHIShaderStageFlag::Vertex;
+    case 1:
+      return RHIShaderStageFlag::TessellationControl;
+    case 2:
+      return RHIShaderStageFlag::TessellationEvaluation;
+    case 3:
+      return RHIShaderStageFlag::Geometry;
+    case 4:
+      return RHIShaderStageFlag::Fragment;
+    case 5:
+      return RHIShaderStageFlag::Compute;
+    default:
+      return {};
+  }
+}
+
+bool SpvModule::parse(std::span<const char> code) {
+  if (code.size() % sizeof(uint32_t) != 0 ||
+      code.size() < Spv::HeaderWordCount * sizeof(uint32_t)) {
+    return false;
+  }
+  // Copied, the bytes need not be aligned for uint32_t.
+  std::vector<uint32_t> words(code.size() / sizeof(uint32_t));
+  std::memcpy(words.data(), code.data(), code.size());
+  if (words[0] != Spv::Magic) {
+    return false;
+  }
+
+  auto position = Spv::HeaderWordCount;
+  while (position < words.size()) {
+    const auto wordCount = words[position] >> 16;
+    const auto opcode = words[position] & 0xFFFF;
+    if (wordCount == 0 || position + wordCount > words.size()) {
+      return false;
+    }
+    const auto operands =
+        std::span<const uint32_t>(words).subspan(position + 1, wordCount - 1);
+    position += wordCount;
+
+    switch (opcode) {
+      case Spv::OpName:
+        if (operands.size() >= 2) {
+          ids[operands[0]].name = readString(operands.subspan(1));
+        }
+        break;
+      case Spv::OpEntryPoint:
+        // Modules with several entry points are reflected as the first.
+        if (operands.size() >= 1 && stage == RHIShaderStageFlag{}) {
+          stage = getStage(operands[0]);
+        }
+        break;
+      case Spv::OpTypeInt:
+      case Spv::OpTypeFloat:
+      case Spv::OpTypeVector:
+      case Spv::OpTypeMatrix:
+      case Spv::OpTypeImage:
+      case Spv::OpTypeSampler:
+      case Spv::OpTypeSampledImage:
+      case Spv::OpTypeArray:
+      case Spv::OpTypeRuntimeArray:
+      case Spv::OpTypeStruct:
+      case Spv::OpTypePointer:
+      case Spv::OpTypeAccelerationStructure:
+        if (operands.size() >= 1) {
+          types[operands[0]] = SpvType{
+              .opcode = opcode,
+              .operands = {operands.begin() + 1, operands.end()},
+          };
+        }
+        break;
+      case Spv::OpConstant:
+        // Only 32 bit constants size arrays.
+        if (operands.size() == 3) {
+          constants[operands[1]] = operands[2];
+        }
+        break;
+      case Spv::OpVariable:
+        if (operands.size() >= 3) {
+          variables.push_back(SpvVariable{
+              .id = operands[1],
+              .pointerType = operands[0],
+              .storageClass = operands[2],
+          });
+        }
+        break;
+      case Spv::OpDecorate: {
+        if (operands.size() < 2) {
+          break;
+        }
+        auto& id = ids[operands[0]];
+        const auto value = operands.size() >= 3 ? operands[2] : 0;
+        switch (operands[1]) {
+          case Spv::DecorationBufferBlock:
+            id.bufferBlock = true;
+            break;
+          case Spv::DecorationArrayStride:
+            id.arrayStride = value;
+            break;
+          case Spv::DecorationBuiltIn:
+            id.builtIn = true;
+            break;
+          case Spv::DecorationLocation:
+            id.location = value;
+            break;
+          case Spv::DecorationBinding:
+            id.binding = value;
+            break;
+          case Spv::DecorationDescriptorSet:
+            id.set = value;
+            break;
+        }
+        break;
+      }
+      case Spv::OpMemberDecorate: {
+        if (operands.size() < 4) {
+          break;
+        }
+        if (operands[2] == Spv::DecorationOffset) {
+          member(operands[0], operands[1]).offset = operands[3];
+        } else if (operands[2] == Spv::DecorationMatrixStride) {
+          member(operands[0], operands[1]).matrixStride = operands[3];
+        }
+        break;
+      }
+    }
+  }
+  return true;
+}
+
+SpvMember& SpvModule::member(uint32_t id, uint32_t index) {
+  auto& members = ids[id].members;
+  if (members.size() <= index) {
+    members.resize(index + 1);
+  }
+  return members[index];
+}
+
+const SpvType* SpvModule::findType(uint32_t id) const {
+  auto type = types.find(id);
+  return type == types.end() ? nullptr : &type->second;
+}
+
+uint32_t SpvModule::unwrapArray(uint32_t typeId) const {
+  const auto* type = findType(typeId);
+  while (type && (type->opcode == Spv::OpTypeArray ||
+                  type->opcode == Spv::OpTypeRuntimeArray)) {
+    typeId = type->operands[0];
+    type = findType(typeId);
+  }
+  return typeId;
+}
+
+uint32_t SpvModule::getArrayLength(uint32_t typeId) const {
+  const auto* type = findType(typeId);
+  if (!type || type->opcode != Spv::OpTypeArray) {
+    if (type && type->opcode == Spv::OpTypeRuntimeArray) {
+      LOG_WARN("reflectShader runtime descriptor arrays are reflected as "
+               "one descriptor.");
+    }
+    return 1;
+  }
+  auto length = constants.find(type->operands[1]);
+  const auto elementLength = getArrayLength(type->operands[0]);
+  return (length == constants.end() ? 1 : length->second) * elementLength;
+}
+
+std::optional<RHIDescriptorType> SpvModule::getDescriptorType(
+    uint32_t typeId,
+    uint32_t storageClass) const {
+  if (storageClass == Spv::StorageClassStorageBuffer) {
+    return RHIDescriptorType::StorageBuffer;
+  }
+  if (storageClass == Spv::StorageClassUniform) {
+    auto id = ids.find(typeId);
+    const auto bufferBlock = id != ids.end() && id->second.bufferBlock;
+    return bufferBlock ? RHIDescriptorType::StorageBuffer
+                       : RHIDescriptorType::UniformBuffer;
+  }
+  if (storageClass != Spv::StorageClassUniformConstant) {
+    return std::nullopt;
+  }
+
+  const auto* type = findType(typeId);
+  if (!type) {
+    return std::nullopt;
+  }
+  switch (type->opcode) {
+    case Spv::OpTypeSampler:
+      return RHIDescriptorType::Sampler;
+    case Spv::OpTypeSampledImage:
+      return RHIDescriptorType::CombinedImageSampler;
+    case Spv::OpTypeAccelerationStructure:
+      return RHIDescriptorType::AccelerationStructureKHR;
+    case Spv::OpTypeImage: {
+      // Sampled type, dim, depth, arrayed, multisampled, sampled.
+      if (type->operands.size() < 6) {
+        return std::nullopt;
+      }
+      const auto dim = type->operands[1];
+      const auto storage = type->operands[5] == 2;
+      if (dim == Spv::DimBuffer) {
+        return storage ? RHIDescriptorType::StorageTexelBuffer
+                       : RHIDescriptorType::UniformTexelBuffer;
+      }
+      if (dim == Spv::DimSubpassData) {
+        return RHIDescriptorType::InputAttachment;
+      }
+      return storage ? RHIDescriptorType::StorageImage
+                     : RHIDescriptorType::SampledImage;
+    }
+    default:
+      return std::nullopt;
+  }
+}
+
+uint32_t SpvModule::getTypeSize(uint32_t typeId, uint32_t matrixStride) const {
+  const auto* type = findType(typeId);
+  if (!type) {
+    return 0;
+  }
+  switch (type->opcode) {
+    case Spv::OpTypeInt:
+    case Spv::OpTypeFloat:
+      return type->operands[0] / 8;
+    case Spv::OpTypeVector:
+      return getTypeSize(type->operands[0], 0) * type->operands[1];
+    case Spv::OpTypeMatrix: {
+      const auto columnSize =
+          matrixStride ? matrixStride : getTypeSize(type->operands[0], 0);
+      return columnSize * type->operands[1];
+    }
+    case Spv::OpTypeArray: {
+      auto length = constants.find(type->operands[1]);
+      auto id = ids.find(typeId);
+      const auto stride = id != ids.end() && id->second.arrayStride
+                              ? id->second.arrayStride
+                              : getTypeSize(type->operands[0], matrixStride);
+      return length == constants.end() ? 0 : stride * length->second;
+    }
+    case Spv::OpTypeStruct: {
+      auto id = ids.find(typeId);
+      uint32_t size = 0;
+      for (auto i = 0U; i < type->operands.size(); i++) {
+        SpvMember member;
+        if (id != ids.end() && i < id->second.members.size()) {
+          member = id->second.members[i];
+        }
+        size = std::max(
+            size,
+            member.offset + getTypeSize(type->operands[i],
+                                        member.matrixStride));
+      }
+      return size;
+    }
+    default:
+      return 0;
+  }
+}
+
+RHIFormat SpvModule::getVertexFormat(uint32_t typeId) const {
+  const auto* type = findType(typeId);
+  if (!type) {
+    return RHIFormat::Undefined;
+  }
+  auto componentCount = 1U;
+  if (type->opcode == Spv::OpTypeVector) {
+    componentCount = type->operands[1];
+    type = findType(type->operands[0]);
+    if (!type) {
+      return RHIFormat::Undefined;
+    }
+  }
+  if (componentCount < 1 || componentCount > 4 || type->operands[0] != 32) {
+    return RHIFormat::Undefined;
+  }
+
+  // Formats of one 32 bit type are 3 apart, R32 to R32G32B32A32.
+  RHIFormat first = RHIFormat::Undefined;
+  if (type->opcode == Spv::OpTypeFloat) {
+    first = RHIFormat::R32Sfloat;
+  } else if (type->opcode == Spv::OpTypeInt) {
+    first = type->operands[1] ? RHIFormat::R32Sint : RHIFormat::R32Uint;
+  } else {
+    return RHIFormat::Undefined;
+  }
+  return static_cast<RHIFormat>(static_cast<uint32_t>(first) +
+                                (componentCount - 1) * 3);
+}
+
+ShaderReflection SpvModule::reflect() const {
+  ShaderReflection reflection{.stageFlags = stage};
+  for (const auto& variable : variables) {
+    const auto* pointer = findType(variable.pointerType);
+    if (!pointer || pointer->opcode != Spv::OpTypePointer) {
+      continue;
+    }
+    const auto pointeeType = pointer->operands[1];
+    auto id = ids.find(variable.id);
+    const auto* decorations = id == ids.end() ? nullptr : &id->second;
+
+    if (variable.storageClass == Spv::StorageClassPushConstant) {
+      const auto* block = findType(pointeeType);
+      auto blockId = ids.find(pointeeType);
+      if (!block || blockId == ids.end() ||
+          blockId->second.members.empty()) {
+        continue;
+      }
+      uint32_t offset = UINT32_MAX;
+      for (const auto& member : blockId->second.members) {
+        offset = std::min(offset, member.offset);
+      }
+      reflection.pushConstantRanges.push_back(RHIPushConstantRange{
+          .stageFlags = stage,
+          .offset = offset,
+          .size = getTypeSize(pointeeType, 0) - offset,
+      });
+      continue;
+    }
+
+    if (variable.storageClass == Spv::StorageClassInput) {
+      if (stage != RHIShaderStageFlag::Vertex || !decorations ||
+          decorations->builtIn || !decorations->location) {
+        continue;
+      }
+      reflection.vertexInputs.push_back(ShaderVertexInput{
+          .location = *decorations->location,
+          .format = getVertexFormat(pointeeType),
+          .name = decorations->name,
+      });
+      continue;
+    }
+
+    if (!decorations || !decorations->binding) {
+      continue;
+    }
+    const auto elementType = unwrapArray(pointeeType);
+    auto descriptorType =
+        getDescriptorType(elementType, variable.storageClass);
+    if (!descriptorType) {
+      continue;
+    }
+    reflection.descriptorBindings.push_back(ShaderDescriptorBinding{
+        .set = decorations->set.value_or(0),
+        .binding = *decorations->binding,
+        .descriptorType = *descriptorType,
+        .descriptorCount = getArrayLength(pointeeType),
+        .stageFlags = stage,
+        .name = decorations->name,
+    });
+  }
+
+  std::ranges::sort(reflection.descriptorBindings,
+                    [](const auto& left, const auto& right) {
+                      return std::tie(left.set, left.binding) <
+                             std::tie(right.set, right.binding);
+                    });
+  std::ranges::sort(reflection.vertexInputs,
+                    [](const auto& left, const auto& right) {
+                      return left.location < right.location;
+                    });
+  return reflection;
+}
+}  // namespace
+
+bool ShaderReflection::merge(const ShaderReflection& other) {
+  auto findBinding = [this](const ShaderDescriptorBinding& binding) {
+    return std::ranges::find_if(
+        descriptorBindings, [&binding](const auto& descriptorBinding) {
+          return descriptorBinding.set == binding.set &&
+                 descriptorBinding.binding == binding.binding;
+        });
+  };
+  // Checked first so a conflict leaves the reflection untouched.
+  for (const auto& binding : other.descriptorBindings) {
+    auto existing = findBinding(binding);
+    if (existing == descriptorBindings.end()) {
+      continue;
+    }
+    if (existing->descriptorType != binding.descriptorType ||
+        existing->descriptorCount != binding.descriptorCount) {
+      LOG_ERROR_FMT("ShaderReflection::merge set {} binding {} differs "
+                    "between stages.",
+                    binding.set, binding.binding);
+      return false;
+    }
+  }
+
+  stageFlags = stageFlags | other.stageFlags;
+  for (const auto& binding : other.descriptorBindings) {
+    auto existing = findBinding(binding);
+    if (existing == descriptorBindings.end()) {
+      // Only the other stage declares it, it keeps that stage's flags.
+      descriptorBindings.push_back(binding);
+    } else {
+      existing->stageFlags = existing->stageFlags | binding.stageFlags;
+    }
+  }
+  std::ranges::sort(descriptorBindings,
+                    [](const auto& left, const auto& right) {
+                      return std::tie(left.set, left.binding) <
+                             std::tie(right.set, right.binding);
+                    });
+
+  for (const auto& range : other.pushConstantRanges) {
+    auto existing = std::ranges::find_if(
+        pushConstantRanges, [&range](const auto& pushConstantRange) {
+          return pushConstantRange.offset == range.offset &&
+                 pushConstantRange.size == range.size;
+        });
+    if (existing == pushConstantRanges.end()) {
+      pushConstantRanges.push_back(range);
+    } else {
+      existing->stageFlags = existing->stageFlags | range.stageFlags;
+    }
+  }
+
+  if (vertexInputs.empty()) {
+    vertexInputs = other.vertexInputs;
+  }
+  return true;
+}
+
+bool ShaderReflection::setDescriptorType(uint32_t set,
+                                         uint32_t binding,
+                                         RHIDescriptorType descriptorType) {
+  for (auto& descriptorBinding : descriptorBindings) {
+    if (descriptorBinding.set == set && descriptorBinding.binding == binding) {
+      descriptorBinding.descriptorType = descriptorType;
+      return true;
+    }
+  }
+  return false;
+}
+
+uint32_t ShaderReflection::getSetCount() const {
+  return descriptorBindings.empty() ? 0 : descriptorBindings.back().set + 1;
+}
+
+std::vector<RHIDescriptorSetLayoutBinding>
+ShaderReflection::getSetLayoutBindings(uint32_t set) const {
+  std::vector<RHIDescriptorSetLayoutBinding> bindings;
+  for (const auto& descriptorBinding : descriptorBindings) {
+    if (descriptorBinding.set != set) {
+      continue;
+    }
+    bindings.push_back(RHIDescriptorSetLayoutBinding{
+        .binding = descriptorBinding.binding,
+        .descriptorType = descriptorBinding.descriptorType,
+        .descriptorCount = descriptorBinding.descriptorCount,
+        .stageFlags = descriptorBinding.stageFlags,
+        .immutableSamplers = nullptr,
+    });
+  }
+  return bindings;
+}
+
+std::optional<ShaderReflection> reflectShader(std::span<const char> code) {
+  SpvModule module;
+  if (!module.parse(code)) {
+    LOG_ERROR("reflectShader code is not SPIR-V.");
+    return std::nullopt;
+  }
+  return module.reflect();
+}
+
+}  // namespace Sparrow
@@ -0,0 +1,63 @@
+#ifndef SPARROWENGINE_SHADER_REFLECTION_H
+#define SPARROWENGINE_SHADER_REFLECTION_H
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+#include "RHI/rhi_struct.h"
+
+namespace Sparrow {
+
+struct ShaderDescriptorBinding {
+  uint32_t set = 0;
+  uint32_t binding = 0;
+  RHIDescriptorType descriptorType = RHIDescriptorType::UniformBuffer;
+  uint32_t descriptorCount = 1;
+  RHIShaderStageFlag stageFlags = {};
+  std::string name;
+};
+
+struct ShaderVertexInput {
+  uint32_t location = 0;
+  // Undefined for types a vertex attribute cannot have.
+  RHIFormat format = RHIFormat::Undefined;
+  std::string name;
+};
+
+// Resources a shader module, or the stages of a pipeline once merged,
+// declare. Reflected from the SPIR-V so layouts no longer have to be kept
+// in line with the shaders by hand.
+struct ShaderReflection {
+  // Every stage merged in, bindings and ranges carry their own.
+  RHIShaderStageFlag stageFlags = {};
+  // Sorted by set, then binding. Each has the stages declaring it.
+  std::vector<ShaderDescriptorBinding> descriptorBindings;
+  // One range per block, stages declaring the same range share it.
+  std::vector<RHIPushConstantRange> pushConstantRanges;
+  // Of the vertex stage, sorted by location.
+  std::vector<ShaderVertexInput> vertexInputs;
+
+  // Adds another stage of the same pipeline, a binding only gets the other
+  // stage's flag if that stage declares it too. Returns false and leaves
+  // the reflection unchanged if both declare a binding with different
+  // types.
+  bool merge(const ShaderReflection& other);
+  // SPIR-V cannot tell dynamic buffers from static ones, the pipeline
+  // picks them here. Returns false if there is no such binding.
+  bool setDescriptorType(uint32_t set,
+                         uint32_t binding,
+                         RHIDescriptorType descriptorType);
+  uint32_t getSetCount() const;
+  // Bindings of `set` in layout form.
+  std::vector<RHIDescriptorSetLayoutBinding> getSetLayoutBindings(
+      uint32_t set) const;
+};
+
+// Returns nullopt if the code is not valid SPIR-V.
+std::optional<ShaderReflection> reflectShader(std::span<const char> code);
+
+}  // namespace Sparrow
+
+#endif  // SPARROWENGINE_SHADER_REFLECTION_H
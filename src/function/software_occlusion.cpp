@@ -0,0 +1,501 @@
+#include "software_occlusion.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include "utils/log.h"
+#include "utils/thread_pool.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SPARROW_OCCLUSION_SSE2 1
+#include <emmintrin.h>
+#else
+#define SPARROW_OCCLUSION_SSE2 0
+#endif
+
+namespace Sparrow {
+
+namespace {
+// Geometry closer than this in clip space w is treated as crossing the near
+// plane.
+constexpr float NearEpsilon = 1e-5f;
+// Instances tested per thread pool task.
+constexpr size_t InstancesPerTask = 64;
+
+glm::vec4 worldBoundingSphere(const RenderInstance& instance) {
+  const auto& model = instance.model;
+  const auto center = glm::vec3(
+      model * glm::vec4(glm::vec3(instance.boundingSphere), 1.0f));
+  const auto scale = std::max({glm::length(glm::vec3(model[0])),
+                               glm::length(glm::vec3(model[1])),
+                               glm::length(glm::vec3(model[2]))});
+  return glm::vec4(center, instance.boundingSphere.w * scale);
+}
+
+double elapsedMs(std::chrono::steady_clock::time_point start,
+                 std::chrono::steady_clock::time_point end) {
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+}  // namespace
+
+void SoftwareOcclusionCuller::initialize(
+    const SoftwareOcclusionInitInfo& initInfo) {
+  threadPool = initInfo.threadPool;
+  tilesX = (std::max(initInfo.width, 1U) + TileWidth - 1) / TileWidth;
+  tilesY = (std::max(initInfo.height, 1U) + TileHeight - 1) / TileHeight;
+  width = tilesX * TileWidth;
+  height = tilesY * TileHeight;
+  tiles.resize(tilesX * tilesY);
+  clear();
+}
+
+void SoftwareOcclusionCuller::clear() {
+  std::fill(tiles.begin(), tiles.end(),
+            Tile{.mask = 0, .zMax0 = 1.0f, .zMax1 = 0.0f});
+}
+
+void SoftwareOcclusionCuller::renderOccluders(
+    std::span<const OccluderMesh> occluders,
+    const glm::mat4& viewProjection) {
+  setupTriangles(occluders, viewProjection);
+  if (triangles.empty()) {
+    return;
+  }
+
+  // Every band owns its tile rows, so no two threads touch the same tile.
+  // Twice as many bands as threads evens out uneven triangle density.
+  const auto threadCount = threadPool ? threadPool->size() + 1 : 1;
+  const auto bandCount =
+      std::min<size_t>(tilesY, threadCount > 1 ? threadCount * 2 : 1);
+  const auto rowsPerBand = (tilesY + bandCount - 1) / bandCount;
+  auto rasterize = [this, rowsPerBand](size_t band) {
+    const auto firstTileY = static_cast<uint32_t>(band * rowsPerBand);
+    if (firstTileY < tilesY) {
+      rasterizeBand(firstTileY,
+                    std::min<uint32_t>(firstTileY + rowsPerBand, tilesY) - 1);
+    }
+  };
+  if (threadPool) {
+    threadPool->parallelFor(bandCount, rasterize);
+  } else {
+    rasterize(0);
+  }
+}
+
+bool SoftwareOcclusionCuller::isVisible(
+    const glm::vec3& center,
+    float radius,
+    const glm::mat4& viewProjection) const {
+  auto rect = ScreenRect{};
+  auto crossesNearPlane = false;
+  if (!projectSphere(center, radius, viewProjection, rect, crossesNearPlane)) {
+    return false;
+  }
+  return crossesNearPlane || isRectVisible(rect);
+}
+
+void SoftwareOcclusionCuller::testInstances(
+    std::span<const RenderInstance> instances,
+    const glm::mat4& viewProjection,
+    std::vector<uint8_t>& visibility) const {
+  visibility.resize(instances.size());
+  auto test = [&](size_t task) {
+    const auto begin = task * InstancesPerTask;
+    const auto end = std::min(begin + InstancesPerTask, instances.size());
+    for (auto i = begin; i < end; i++) {
+      const auto sphere = worldBoundingSphere(instances[i]);
+      visibility[i] =
+          isVisible(glm::vec3(sphere), sphere.w, viewProjection) ? 1 : 0;
+    }
+  };
+
+  const auto taskCount =
+      (instances.size() + InstancesPerTask - 1) / InstancesPerTask;
+  if (threadPool) {
+    threadPool->parallelFor(taskCount, test);
+  } else {
+    for (auto task = 0U; task < taskCount; task++) {
+      test(task);
+    }
+  }
+}
+
+SoftwareOcclusionBenchmarkResult SoftwareOcclusionCuller::benchmark(
+    std::span<const OccluderMesh> occluders,
+    std::span<const RenderInstance> instances,
+    const glm::mat4& viewProjection) {
+  using Clock = std::chrono::steady_clock;
+  auto result = SoftwareOcclusionBenchmarkResult{
+      .testedCount = static_cast<uint32_t>(instances.size()),
+  };
+
+  auto start = Clock::now();
+  clear();
+  renderOccluders(occluders, viewProjection);
+  auto rasterized = Clock::now();
+  std::vector<uint8_t> maskedVisibility;
+  testInstances(instances, viewProjection, maskedVisibility);
+  auto tested = Clock::now();
+  result.maskedRasterizeMs = elapsedMs(start, rasterized);
+  result.maskedTestMs = elapsedMs(rasterized, tested);
+
+  // The reference shares the triangle setup, but rasterizes and tests
+  // every pixel on a single thread.
+  start = Clock::now();
+  setupTriangles(occluders, viewProjection);
+  const auto depthBuffer = rasterizeBruteForce();
+  rasterized = Clock::now();
+  std::vector<uint8_t> bruteForceVisibility(instances.size());
+  for (auto i = 0U; i < instances.size(); i++) {
+    const auto sphere = worldBoundingSphere(instances[i]);
+    auto rect = ScreenRect{};
+    auto crossesNearPlane = false;
+    if (projectSphere(glm::vec3(sphere), sphere.w, viewProjection, rect,
+                      crossesNearPlane)) {
+      bruteForceVisibility[i] =
+          crossesNearPlane || isRectVisibleBruteForce(rect, depthBuffer);
+    }
+  }
+  tested = Clock::now();
+  result.bruteForceRasterizeMs = elapsedMs(start, rasterized);
+  result.bruteForceTestMs = elapsedMs(rasterized, tested);
+
+  for (auto i = 0U; i < instances.size(); i++) {
+    result.maskedVisibleCount += maskedVisibility[i];
+    result.bruteForceVisibleCount += bruteForceVisibility[i];
+    if (bruteForceVisibility[i] && !maskedVisibility[i]) {
+      result.falselyOccludedCount++;
+    }
+  }
+
+  LOG_FMT(
+      "Software occlusion {}x{}, {} triangles, {} instances: masked {:.3f} + "
+      "{:.3f} ms ({} visible), brute force {:.3f} + {:.3f} ms ({} visible), "
+      "{} falsely occluded",
+      width, height, triangles.size(), result.testedCount,
+      result.maskedRasterizeMs, result.maskedTestMs, result.maskedVisibleCount,
+      result.bruteForceRasterizeMs, result.bruteForceTestMs,
+      result.bruteForceVisibleCount, result.falselyOccludedCount);
+  return result;
+}
+
+void SoftwareOcclusionCuller::setupTriangles(
+    std::span<const OccluderMesh> occluders,
+    const glm::mat4& viewProjection) {
+  triangles.clear();
+  std::vector<glm::vec4> clipPositions;
+
+  for (const auto& occluder : occluders) {
+    const auto modelViewProjection = viewProjection * occluder.model;
+    clipPositions.resize(occluder.positions.size());
+    for (auto i = 0U; i < occluder.positions.size(); i++) {
+      clipPositions[i] =
+          modelViewProjection * glm::vec4(occluder.positions[i], 1.0f);
+    }
+
+    for (auto i = 0U; i + 2 < occluder.indices.size(); i += 3) {
+      const auto i0 = occluder.indices[i];
+      const auto i1 = occluder.indices[i + 1];
+      const auto i2 = occluder.indices[i + 2];
+      if (i0 >= clipPositions.size() || i1 >= clipPositions.size() ||
+          i2 >= clipPositions.size()) {
+        continue;
+      }
+      const glm::vec4 clip[3] = {clipPositions[i0], clipPositions[i1],
+                                 clipPositions[i2]};
+
+      // Losing an occluder only costs culling efficiency, so triangles
+      // crossing the near plane are dropped rather than clipped.
+      if (clip[0].w <= NearEpsilon || clip[1].w <= NearEpsilon ||
+          clip[2].w <= NearEpsilon) {
+        continue;
+      }
+      auto outside = [&clip](auto predicate) {
+        return predicate(clip[0]) && predicate(clip[1]) && predicate(clip[2]);
+      };
+      if (outside([](const glm::vec4& v) { return v.x < -v.w; }) ||
+          outside([](const glm::vec4& v) { return v.x > v.w; }) ||
+          outside([](const glm::vec4& v) { return v.y < -v.w; }) ||
+          outside([](const glm::vec4& v) { return v.y > v.w; }) ||
+          outside([](const glm::vec4& v) { return v.z > v.w; })) {
+        continue;
+      }
+
+      glm::vec3 screen[3];
+      for (auto k = 0; k < 3; k++) {
+        const auto ndc = glm::vec3(clip[k]) / clip[k].w;
+        screen[k] = glm::vec3((ndc.x * 0.5f + 0.5f) * width,
+                              (ndc.y * 0.5f + 0.5f) * height, ndc.z);
+      }
+
+      const auto area = (screen[2].x - screen[0].x) *
+                            (screen[1].y - screen[0].y) -
+                        (screen[2].y - screen[0].y) *
+                            (screen[1].x - screen[0].x);
+      if (area == 0.0f) {
+        continue;
+      }
+      // Occluders are rasterized double sided.
+      if (area < 0.0f) {
+        std::swap(screen[1], screen[2]);
+      }
+
+      const auto minX = std::min({screen[0].x, screen[1].x, screen[2].x});
+      const auto maxX = std::max({screen[0].x, screen[1].x, screen[2].x});
+      const auto minY = std::min({screen[0].y, screen[1].y, screen[2].y});
+      const auto maxY = std::max({screen[0].y, screen[1].y, screen[2].y});
+      if (maxX < 0.0f || minX >= width || maxY < 0.0f || minY >= height) {
+        continue;
+      }
+
+      auto triangle = ScreenTriangle{};
+      for (auto k = 0; k < 3; k++) {
+        const auto& a = screen[k];
+        const auto& b = screen[(k + 1) % 3];
+        triangle.edgeA[k] = b.y - a.y;
+        triangle.edgeB[k] = a.x - b.x;
+        triangle.edgeC[k] = -(triangle.edgeA[k] * a.x + triangle.edgeB[k] * a.y);
+      }
+
+      const auto d1 = screen[1] - screen[0];
+      const auto d2 = screen[2] - screen[0];
+      const auto normal = glm::cross(d1, d2);
+      triangle.depthA = -normal.x / normal.z;
+      triangle.depthB = -normal.y / normal.z;
+      triangle.depthC = screen[0].z - triangle.depthA * screen[0].x -
+                        triangle.depthB * screen[0].y;
+      triangle.minDepth =
+          std::max(std::min({screen[0].z, screen[1].z, screen[2].z}), 0.0f);
+      triangle.maxDepth = std::max({screen[0].z, screen[1].z, screen[2].z});
+
+      triangle.minPixelX = static_cast<uint32_t>(std::max(minX, 0.0f));
+      triangle.minPixelY = static_cast<uint32_t>(std::max(minY, 0.0f));
+      triangle.maxPixelX = static_cast<uint32_t>(std::min(maxX, width - 1.0f));
+      triangle.maxPixelY =
+          static_cast<uint32_t>(std::min(maxY, height - 1.0f));
+      triangle.minTileX = triangle.minPixelX / TileWidth;
+      triangle.minTileY = triangle.minPixelY / TileHeight;
+      triangle.maxTileX = triangle.maxPixelX / TileWidth;
+      triangle.maxTileY = triangle.maxPixelY / TileHeight;
+      triangles.push_back(triangle);
+    }
+  }
+}
+
+void SoftwareOcclusionCuller::rasterizeBand(uint32_t firstTileY,
+                                            uint32_t lastTileY) {
+  for (const auto& triangle : triangles) {
+    if (triangle.maxTileY < firstTileY || triangle.minTileY > lastTileY) {
+      continue;
+    }
+    const auto beginTileY = std::max(triangle.minTileY, firstTileY);
+    const auto endTileY = std::min(triangle.maxTileY, lastTileY);
+    for (auto tileY = beginTileY; tileY <= endTileY; tileY++) {
+      for (auto tileX = triangle.minTileX; tileX <= triangle.maxTileX;
+           tileX++) {
+        auto& tile = tiles[tileY * tilesX + tileX];
+
+        // The depth plane is linear, so its extremes over the pixel centers
+        // of the tile lie on the corners.
+        const auto left = tileX * TileWidth + 0.5f;
+        const auto right = left + TileWidth - 1.0f;
+        const auto top = tileY * TileHeight + 0.5f;
+        const auto bottom = top + TileHeight - 1.0f;
+        const auto depthX0 = triangle.depthA * left;
+        const auto depthX1 = triangle.depthA * right;
+        const auto depthY0 = triangle.depthB * top + triangle.depthC;
+        const auto depthY1 = triangle.depthB * bottom + triangle.depthC;
+        const auto nearest =
+            std::max(std::min(depthX0, depthX1) + std::min(depthY0, depthY1),
+                     triangle.minDepth);
+        const auto farthest =
+            std::min(std::max(depthX0, depthX1) + std::max(depthY0, depthY1),
+                     triangle.maxDepth);
+        if (nearest >= tile.zMax0) {
+          continue;
+        }
+
+        const auto coverage = computeCoverage(triangle, tileX, tileY);
+        if (coverage != 0) {
+          updateTile(tile, coverage, std::clamp(farthest, 0.0f, 1.0f));
+        }
+      }
+    }
+  }
+}
+
+uint32_t SoftwareOcclusionCuller::computeCoverage(
+    const ScreenTriangle& triangle,
+    uint32_t tileX,
+    uint32_t tileY) const {
+  const auto left = tileX * TileWidth + 0.5f;
+  const auto top = tileY * TileHeight + 0.5f;
+  uint32_t coverage = 0;
+
+#if SPARROW_OCCLUSION_SSE2
+  static_assert(TileWidth == 8, "Two SSE lanes of four pixels per row.");
+  const auto zero = _mm_setzero_ps();
+  const auto leftColumns =
+      _mm_add_ps(_mm_set1_ps(left), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+  const auto rightColumns = _mm_add_ps(leftColumns, _mm_set1_ps(4.0f));
+  for (auto row = 0U; row < TileHeight; row++) {
+    const auto y = top + row;
+    auto insideLeft = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    auto insideRight = insideLeft;
+    for (auto k = 0; k < 3; k++) {
+      const auto edgeA = _mm_set1_ps(triangle.edgeA[k]);
+      const auto rowValue =
+          _mm_set1_ps(triangle.edgeB[k] * y + triangle.edgeC[k]);
+      insideLeft = _mm_and_ps(
+          insideLeft,
+          _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA, leftColumns), rowValue),
+                       zero));
+      insideRight = _mm_and_ps(
+          insideRight,
+          _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA, rightColumns), rowValue),
+                       zero));
+    }
+    const auto rowMask = static_cast<uint32_t>(_mm_movemask_ps(insideLeft)) |
+                         static_cast<uint32_t>(_mm_movemask_ps(insideRight))
+                             << 4;
+    coverage |= rowMask << (row * TileWidth);
+  }
+#else
+  for (auto row = 0U; row < TileHeight; row++) {
+    const auto y = top + row;
+    for (auto column = 0U; column < TileWidth; column++) {
+      const auto x = left + column;
+      auto inside = true;
+      for (auto k = 0; k < 3 && inside; k++) {
+        inside = triangle.edgeA[k] * x + triangle.edgeB[k] * y +
+                     triangle.edgeC[k] >=
+                 0.0f;
+      }
+      if (inside) {
+        coverage |= 1U << (row * TileWidth + column);
+      }
+    }
+  }
+#endif
+  return coverage;
+}
+
+void SoftwareOcclusionCuller::updateTile(Tile& tile,
+                                         uint32_t coverage,
+                                         float depth) {
+  // Start a new working layer when the triangle is much closer than the
+  // current one, keeping the reference layer as the conservative bound.
+  const auto workingDistance = tile.zMax1 - depth;
+  const auto layerDistance = tile.zMax0 - tile.zMax1;
+  if (workingDistance > layerDistance) {
+    tile.zMax1 = 0.0f;
+    tile.mask = 0;
+  }
+
+  tile.zMax1 = std::max(tile.zMax1, depth);
+  tile.mask |= coverage;
+
+  // A fully covered working layer bounds the whole tile.
+  if (tile.mask == ~0U) {
+    tile.zMax0 = std::min(tile.zMax0, tile.zMax1);
+    tile.zMax1 = 0.0f;
+    tile.mask = 0;
+  }
+}
+
+bool SoftwareOcclusionCuller::projectSphere(const glm::vec3& center,
+                                            float radius,
+                                            const glm::mat4& viewProjection,
+                                            ScreenRect& rect,
+                                            bool& crossesNearPlane) const {
+  crossesNearPlane = false;
+  auto boxMin = glm::vec3(std::numeric_limits<float>::max());
+  auto boxMax = glm::vec3(std::numeric_limits<float>::lowest());
+  for (auto i = 0; i < 8; i++) {
+    const auto corner =
+        center + radius * glm::vec3((i & 1) == 0 ? -1.0f : 1.0f,
+                                    (i & 2) == 0 ? -1.0f : 1.0f,
+                                    (i & 4) == 0 ? -1.0f : 1.0f);
+    const auto clip = viewProjection * glm::vec4(corner, 1.0f);
+    if (clip.w <= NearEpsilon) {
+      crossesNearPlane = true;
+      return true;
+    }
+    const auto ndc = glm::vec3(clip) / clip.w;
+    const auto screen = glm::vec3((ndc.x * 0.5f + 0.5f) * width,
+                                  (ndc.y * 0.5f + 0.5f) * height, ndc.z);
+    boxMin = glm::min(boxMin, screen);
+    boxMax = glm::max(boxMax, screen);
+  }
+
+  if (boxMax.x < 0.0f || boxMin.x >= width || boxMax.y < 0.0f ||
+      boxMin.y >= height || boxMin.z > 1.0f) {
+    return false;
+  }
+  rect = ScreenRect{
+      .minPixelX = static_cast<uint32_t>(std::max(boxMin.x, 0.0f)),
+      .minPixelY = static_cast<uint32_t>(std::max(boxMin.y, 0.0f)),
+      .maxPixelX = static_cast<uint32_t>(std::min(boxMax.x, width - 1.0f)),
+      .maxPixelY = static_cast<uint32_t>(std::min(boxMax.y, height - 1.0f)),
+      .minDepth = std::max(boxMin.z, 0.0f),
+  };
+  return true;
+}
+
+bool SoftwareOcclusionCuller::isRectVisible(const ScreenRect& rect) const {
+  for (auto tileY = rect.minPixelY / TileHeight;
+       tileY <= rect.maxPixelY / TileHeight; tileY++) {
+    for (auto tileX = rect.minPixelX / TileWidth;
+         tileX <= rect.maxPixelX / TileWidth; tileX++) {
+      if (rect.minDepth <= tiles[tileY * tilesX + tileX].zMax0) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+std::vector<float> SoftwareOcclusionCuller::rasterizeBruteForce() const {
+  std::vector<float> depthBuffer(width * height, 1.0f);
+  for (const auto& triangle : triangles) {
+    for (auto pixelY = triangle.minPixelY; pixelY <= triangle.maxPixelY;
+         pixelY++) {
+      const auto y = pixelY + 0.5f;
+      for (auto pixelX = triangle.minPixelX; pixelX <= triangle.maxPixelX;
+           pixelX++) {
+        const auto x = pixelX + 0.5f;
+        auto inside = true;
+        for (auto k = 0; k < 3 && inside; k++) {
+          inside = triangle.edgeA[k] * x + triangle.edgeB[k] * y +
+                       triangle.edgeC[k] >=
+                   0.0f;
+        }
+        if (!inside) {
+          continue;
+        }
+        const auto depth = std::clamp(
+            triangle.depthA * x + triangle.depthB * y + triangle.depthC,
+            triangle.minDepth, triangle.maxDepth);
+        auto& stored = depthBuffer[pixelY * width + pixelX];
+        stored = std::min(stored, depth);
+      }
+    }
+  }
+  return depthBuffer;
+}
+
+bool SoftwareOcclusionCuller::isRectVisibleBruteForce(
+    const ScreenRect& rect,
+    const std::vector<float>& depthBuffer) const {
+  for (auto pixelY = rect.minPixelY; pixelY <= rect.maxPixelY; pixelY++) {
+    for (auto pixelX = rect.minPixelX; pixelX <= rect.maxPixelX; pixelX++) {
+      if (rect.minDepth <= depthBuffer[pixelY * width + pixelX]) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+}  // namespace Sparrow
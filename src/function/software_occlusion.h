@@ -0,0 +1,128 @@
+#ifndef SPARROWENGINE_SOFTWARE_OCCLUSION_H
+#define SPARROWENGINE_SOFTWARE_OCCLUSION_H
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+#include "glm/glm.hpp"
+#include "render_mesh.h"
+
+namespace Sparrow {
+class ThreadPool;
+
+struct OccluderMesh {
+  std::span<const glm::vec3> positions;
+  std::span<const uint32_t> indices;
+  glm::mat4 model = glm::mat4(1.0f);
+};
+
+struct SoftwareOcclusionInitInfo {
+  std::shared_ptr<ThreadPool> threadPool;
+  // Resolution of the coarse buffer, rounded up to whole tiles.
+  uint32_t width = 256;
+  uint32_t height = 128;
+};
+
+struct SoftwareOcclusionBenchmarkResult {
+  double maskedRasterizeMs = 0.0;
+  double maskedTestMs = 0.0;
+  double bruteForceRasterizeMs = 0.0;
+  double bruteForceTestMs = 0.0;
+  uint32_t testedCount = 0;
+  uint32_t maskedVisibleCount = 0;
+  uint32_t bruteForceVisibleCount = 0;
+  // Objects the masked buffer hides although the exact depth buffer shows
+  // them, anything but zero is a bug.
+  uint32_t falselyOccludedCount = 0;
+};
+
+// Masked software occlusion culling after Andersson et al. Occluders are
+// rasterized into tiles of 8x4 pixels that keep a 32-bit coverage mask of
+// the working layer and two max depths instead of per-pixel depth. A tile
+// is only ever compared as a whole, so its farthest depth is all a test
+// needs. Tile rows are split into bands rasterized in parallel.
+class SoftwareOcclusionCuller {
+ public:
+  static constexpr uint32_t TileWidth = 8;
+  static constexpr uint32_t TileHeight = 4;
+
+  void initialize(const SoftwareOcclusionInitInfo& initInfo);
+
+  void clear();
+  void renderOccluders(std::span<const OccluderMesh> occluders,
+                       const glm::mat4& viewProjection);
+
+  // True when some part of the world space sphere may be visible.
+  bool isVisible(const glm::vec3& center,
+                 float radius,
+                 const glm::mat4& viewProjection) const;
+  // Writes one flag per instance, testing its bounding sphere.
+  void testInstances(std::span<const RenderInstance> instances,
+                     const glm::mat4& viewProjection,
+                     std::vector<uint8_t>& visibility) const;
+
+  // Runs the same occluders and instances through the masked buffer and
+  // a full resolution depth buffer and compares speed and results.
+  SoftwareOcclusionBenchmarkResult benchmark(
+      std::span<const OccluderMesh> occluders,
+      std::span<const RenderInstance> instances,
+      const glm::mat4& viewProjection);
+
+ private:
+  struct Tile {
+    uint32_t mask;
+    // Farthest depth of the whole tile.
+    float zMax0;
+    // Farthest depth of the pixels in `mask`.
+    float zMax1;
+  };
+
+  // Edge functions and depth plane in pixel coordinates, wound so that
+  // covered pixels have all three edge functions non-negative.
+  struct ScreenTriangle {
+    float edgeA[3], edgeB[3], edgeC[3];
+    float depthA, depthB, depthC;
+    float minDepth, maxDepth;
+    uint32_t minTileX, minTileY, maxTileX, maxTileY;
+    uint32_t minPixelX, minPixelY, maxPixelX, maxPixelY;
+  };
+
+  struct ScreenRect {
+    uint32_t minPixelX, minPixelY, maxPixelX, maxPixelY;
+    float minDepth;
+  };
+
+  void setupTriangles(std::span<const OccluderMesh> occluders,
+                      const glm::mat4& viewProjection);
+  void rasterizeBand(uint32_t firstTileY, uint32_t lastTileY);
+  uint32_t computeCoverage(const ScreenTriangle& triangle,
+                           uint32_t tileX,
+                           uint32_t tileY) const;
+  static void updateTile(Tile& tile, uint32_t coverage, float depth);
+
+  // False when the sphere is entirely off screen, the rect is left
+  // untouched when the sphere crosses the near plane.
+  bool projectSphere(const glm::vec3& center,
+                     float radius,
+                     const glm::mat4& viewProjection,
+                     ScreenRect& rect,
+                     bool& crossesNearPlane) const;
+  bool isRectVisible(const ScreenRect& rect) const;
+
+  std::vector<float> rasterizeBruteForce() const;
+  bool isRectVisibleBruteForce(const ScreenRect& rect,
+                               const std::vector<float>& depthBuffer) const;
+
+  std::shared_ptr<ThreadPool> threadPool;
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t tilesX = 0;
+  uint32_t tilesY = 0;
+  std::vector<Tile> tiles;
+  std::vector<ScreenTriangle> triangles;
+};
+
+}  // namespace Sparrow
+
+#endif  // SPARROWENGINE_SOFTWARE_OCCLUSION_H
@@ -0,0 +1,63 @@
+#include "uniform_ring_buffer.h"
+#include <algorithm>
+#include <iostream>
+#include <tuple>
+#include "RHI/rhi.h"
+#include "utils/log.h"
+
+namespace Sparrow {
+
+namespace {
+RHIDeviceSize alignUp(RHIDeviceSize value, RHIDeviceSize alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+}  // namespace
+
+void UniformRingBuffer::initialize(const UniformRingBufferInitInfo& initInfo) {
+  rhi = initInfo.rhi;
+  alignment = std::max<RHIDeviceSize>(
+      rhi->getMinUniformBufferOffsetAlignment(), 1);
+  frameCapacity = alignUp(std::max<RHIDeviceSize>(initInfo.frameCapacity, 1),
+                          alignment);
+
+  const auto size = frameCapacity * rhi->getMaxFramesInFlight();
+  std::tie(buffer, memory) = rhi->createBuffer(
+      RHIBufferCreateInfo{
+          .size = size,
+          .usage = RHIBufferUsageFlag::UniformBuffer,
+          .sharingMode = RHISharingMode::Exclusive,
+      },
+      RHIMemoryPropertyFlag::HostVisible | RHIMemoryPropertyFlag::HostCoherent);
+  mappedMemory = static_cast<std::byte*>(rhi->mapMemory(memory.get(), 0, size));
+  beginFrame(0);
+}
+
+void UniformRingBuffer::beginFrame(uint32_t frameIndex) {
+  frameBegin = frameCapacity * frameIndex;
+  frameUsed = 0;
+  statistics.usedBytes = 0;
+  statistics.allocationCount = 0;
+  statistics.failedAllocationCount = 0;
+}
+
+UniformAllocation UniformRingBuffer::allocate(RHIDeviceSize size) {
+  const auto offset = alignUp(frameUsed, alignment);
+  if (size == 0 || offset + size > frameCapacity) {
+    if (statistics.failedAllocationCount++ == 0) {
+      LOG_ERROR_FMT("UniformRingBuffer::allocate {} bytes exceed the {} "
+                    "bytes left this frame.",
+                    size, frameCapacity - std::min(offset, frameCapacity));
+    }
+    return {};
+  }
+  frameUsed = offset + size;
+  statistics.usedBytes = frameUsed;
+  statistics.allocationCount++;
+  statistics.peakUsedBytes = std::max(statistics.peakUsedBytes, frameUsed);
+  return UniformAllocation{
+      .data = mappedMemory + frameBegin + offset,
+      .offset = static_cast<uint32_t>(frameBegin + offset),
+  };
+}
+
+}  // namespace Sparrow
@@ -0,0 +1,80 @@
+#ifndef SPARROWENGINE_UNIFORM_RING_BUFFER_H
+#define SPARROWENGINE_UNIFORM_RING_BUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include "RHI/rhi_struct.h"
+
+namespace Sparrow {
+class RHI;
+
+struct UniformRingBufferInitInfo {
+  std::shared_ptr<RHI> rhi;
+  // Bytes a frame can allocate, rounded up to the offset alignment.
+  RHIDeviceSize frameCapacity = 64 * 1024;
+};
+
+// A slice of the ring. `data` is mapped and write only, `offset` is the
+// dynamic offset to bind it with. `data` is null if the frame ran out of
+// space, `offset` must not be bound then.
+struct UniformAllocation {
+  void* data = nullptr;
+  uint32_t offset = 0;
+};
+
+struct UniformRingBufferStatistics {
+  // Of the current frame.
+  RHIDeviceSize usedBytes = 0;
+  uint32_t allocationCount = 0;
+  uint32_t failedAllocationCount = 0;
+  // Largest usedBytes of any frame so far.
+  RHIDeviceSize peakUsedBytes = 0;
+};
+
+// One persistently mapped uniform buffer with a region per frame in
+// flight. Allocations are bumped from the current frame's region, aligned
+// to minUniformBufferOffsetAlignment, and the region is reused when its
+// frame comes round again, after the RHI waited for its last submission.
+// Everything shares the buffer, so one UniformBufferDynamic descriptor
+// whose range covers the largest slice serves every draw and pass, each
+// binding it with its allocation's offset.
+class UniformRingBuffer {
+ public:
+  void initialize(const UniformRingBufferInitInfo& initInfo);
+
+  // Starts allocating from the frame's region, dropping what the frame
+  // allocated last time.
+  void beginFrame(uint32_t frameIndex);
+  UniformAllocation allocate(RHIDeviceSize size);
+  template <typename T>
+  UniformAllocation push(const T& value) {
+    auto allocation = allocate(sizeof(T));
+    if (allocation.data) {
+      std::memcpy(allocation.data, &value, sizeof(T));
+    }
+    return allocation;
+  }
+
+  RHIBuffer* getBuffer() const { return buffer.get(); }
+  RHIDeviceSize getAlignment() const { return alignment; }
+  const UniformRingBufferStatistics& getStatistics() const {
+    return statistics;
+  }
+
+ private:
+  std::shared_ptr<RHI> rhi;
+  RHIDeviceSize alignment = 1;
+  RHIDeviceSize frameCapacity = 0;
+  std::unique_ptr<RHIBuffer> buffer;
+  std::unique_ptr<RHIDeviceMemory> memory;
+  std::byte* mappedMemory = nullptr;
+  RHIDeviceSize frameBegin = 0;
+  RHIDeviceSize frameUsed = 0;
+  UniformRingBufferStatistics statistics;
+};
+
+}  // namespace Sparrow
+
+#endif  // SPARROWENGINE_UNIFORM_RING_BUFFER_H
@@ -0,0 +1,363 @@
+#include "vertex_format.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include "mesh_optimizer.h"
+#include "utils/log.h"
+
+namespace Sparrow {
+
+namespace {
+uint32_t getPositionSize(VertexPositionEncoding encoding) {
+  // Packed positions take four components, three-component 16-bit formats
+  // are not guaranteed to be supported as vertex input.
+  return encoding == VertexPositionEncoding::Float32 ? sizeof(glm::vec3)
+                                                     : sizeof(uint32_t) * 2;
+}
+
+uint32_t getColorSize(VertexColorEncoding encoding) {
+  return encoding == VertexColorEncoding::Float32 ? sizeof(glm::vec3)
+                                                  : sizeof(uint32_t);
+}
+
+uint32_t getTexCoordSize(VertexTexCoordEncoding encoding) {
+  return encoding == VertexTexCoordEncoding::Float32 ? sizeof(glm::vec2)
+                                                     : sizeof(uint32_t);
+}
+
+uint32_t getNormalSize(VertexNormalEncoding encoding) {
+  return encoding == VertexNormalEncoding::Float32 ? sizeof(glm::vec3)
+                                                   : sizeof(uint32_t);
+}
+
+RHIFormat getPositionFormat(VertexPositionEncoding encoding) {
+  switch (encoding) {
+    case VertexPositionEncoding::Float32:
+      return RHIFormat::R32G32B32Sfloat;
+    case VertexPositionEncoding::Half:
+      return RHIFormat::R16G16B16A16Sfloat;
+    case VertexPositionEncoding::Snorm16:
+      return RHIFormat::R16G16B16A16Snorm;
+  }
+  return RHIFormat::R32G32B32Sfloat;
+}
+
+template <typename T>
+void writeAttribute(std::byte* destination, const T& value) {
+  std::memcpy(destination, &value, sizeof(T));
+}
+
+template <typename T>
+T readAttribute(const std::byte* source) {
+  T value;
+  std::memcpy(&value, source, sizeof(T));
+  return value;
+}
+
+using Clock = std::chrono::high_resolution_clock;
+
+double elapsedMs(Clock::time_point start, Clock::time_point end) {
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+}  // namespace
+
+uint32_t VertexFormat::getStride() const {
+  return getPositionSize(position) + getColorSize(color) +
+         getTexCoordSize(texCoord) + getNormalSize(normal);
+}
+
+RHIVertexBindingDescription VertexFormat::getBindingDescription() const {
+  return RHIVertexBindingDescription{.binding = 0,
+                                     .stride = getStride(),
+                                     .inputRate = RHIVertexInputRate::Vertex};
+}
+
+std::array<RHIVertexAttributeDescription, 4>
+VertexFormat::getAttributeDescription() const {
+  std::array<RHIVertexAttributeDescription, 4> descriptions;
+  const auto colorOffset = getPositionSize(position);
+  const auto texCoordOffset = colorOffset + getColorSize(color);
+  const auto normalOffset = texCoordOffset + getTexCoordSize(texCoord);
+
+  descriptions[0] = RHIVertexAttributeDescription{
+      .location = 0,
+      .binding = 0,
+      .format = getPositionFormat(position),
+      .offset = 0,
+  };
+
+  descriptions[1] = RHIVertexAttributeDescription{
+      .location = 1,
+      .binding = 0,
+      .format = color == VertexColorEncoding::Float32
+                    ? RHIFormat::R32G32B32Sfloat
+                    : RHIFormat::R8G8B8A8Unorm,
+      .offset = colorOffset,
+  };
+
+  descriptions[2] = RHIVertexAttributeDescription{
+      .location = 2,
+      .binding = 0,
+      .format = texCoord == VertexTexCoordEncoding::Float32
+                    ? RHIFormat::R32G32Sfloat
+                    : RHIFormat::R16G16Sfloat,
+      .offset = texCoordOffset,
+  };
+
+  descriptions[3] = RHIVertexAttributeDescription{
+      .location = 3,
+      .binding = 0,
+      .format = normal == VertexNormalEncoding::Float32
+                    ? RHIFormat::R32G32B32Sfloat
+                    : RHIFormat::R16G16Snorm,
+      .offset = normalOffset,
+  };
+
+  return descriptions;
+}
+
+PackedVertices packVertices(std::span<const Vertex> vertices,
+                            const VertexFormat& format) {
+  auto packedVertices = PackedVertices{
+      .stride = format.getStride(),
+      .vertexCount = static_cast<uint32_t>(vertices.size()),
+  };
+  packedVertices.data.resize(static_cast<size_t>(packedVertices.stride) *
+                             vertices.size());
+
+  auto boundsMin = glm::vec3(std::numeric_limits<float>::max());
+  auto boundsMax = glm::vec3(std::numeric_limits<float>::lowest());
+  for (const auto& vertex : vertices) {
+    boundsMin = glm::min(boundsMin, vertex.position);
+    boundsMax = glm::max(boundsMax, vertex.position);
+  }
+  auto& quantization = packedVertices.quantization;
+  if (!vertices.empty() &&
+      format.position != VertexPositionEncoding::Float32) {
+    quantization.positionOffset = (boundsMin + boundsMax) * 0.5f;
+    if (format.position == VertexPositionEncoding::Snorm16) {
+      // Flat axes keep a non-zero scale so the division stays finite.
+      quantization.positionScale =
+          glm::max((boundsMax - boundsMin) * 0.5f,
+                   glm::vec3(std::numeric_limits<float>::min()));
+    }
+  }
+  quantization.octahedralNormals =
+      format.normal == VertexNormalEncoding::Octahedral;
+
+  const auto colorOffset = getPositionSize(format.position);
+  const auto texCoordOffset = colorOffset + getColorSize(format.color);
+  const auto normalOffset = texCoordOffset + getTexCoordSize(format.texCoord);
+  for (auto i = 0U; i < vertices.size(); i++) {
+    const auto& vertex = vertices[i];
+    auto destination = packedVertices.data.data() +
+                       static_cast<size_t>(i) * packedVertices.stride;
+
+    const auto position = (vertex.position - quantization.positionOffset) /
+                          quantization.positionScale;
+    switch (format.position) {
+      case VertexPositionEncoding::Float32:
+        writeAttribute(destination, position);
+        break;
+      case VertexPositionEncoding::Half: {
+        const uint32_t packed[2] = {
+            glm::packHalf2x16(glm::vec2(position.x, position.y)),
+            glm::packHalf2x16(glm::vec2(position.z, 1.0f))};
+        writeAttribute(destination, packed);
+        break;
+      }
+      case VertexPositionEncoding::Snorm16: {
+        const uint32_t packed[2] = {
+            glm::packSnorm2x16(glm::vec2(position.x, position.y)),
+            glm::packSnorm2x16(glm::vec2(position.z, 1.0f))};
+        writeAttribute(destination, packed);
+        break;
+      }
+    }
+
+    if (format.color == VertexColorEncoding::Float32) {
+      writeAttribute(destination + colorOffset, vertex.color);
+    } else {
+      writeAttribute(destination + colorOffset,
+                     glm::packUnorm4x8(glm::vec4(vertex.color, 1.0f)));
+    }
+
+    if (format.texCoord == VertexTexCoordEncoding::Float32) {
+      writeAttribute(destination + texCoordOffset, vertex.texCoord);
+    } else {
+      writeAttribute(destination + texCoordOffset,
+                     glm::packHalf2x16(vertex.texCoord));
+    }
+
+    if (format.normal == VertexNormalEncoding::Float32) {
+      writeAttribute(destination + normalOffset, vertex.normal);
+    } else {
+      writeAttribute(destination + normalOffset,
+                     glm::packSnorm2x16(encodeOctahedral(vertex.normal)));
+    }
+  }
+  return packedVertices;
+}
+
+Vertex unpackVertex(const PackedVertices& packedVertices,
+                    const VertexFormat& format,
+                    uint32_t index) {
+  const auto source = packedVertices.data.data() +
+                      static_cast<size_t>(index) * packedVertices.stride;
+  const auto colorOffset = getPositionSize(format.position);
+  const auto texCoordOffset = colorOffset + getColorSize(format.color);
+  const auto normalOffset = texCoordOffset + getTexCoordSize(format.texCoord);
+  auto vertex = Vertex{};
+
+  auto position = glm::vec3(0.0f);
+  switch (format.position) {
+    case VertexPositionEncoding::Float32:
+      position = readAttribute<glm::vec3>(source);
+      break;
+    case VertexPositionEncoding::Half: {
+      const auto packed = readAttribute<std::array<uint32_t, 2>>(source);
+      const auto xy = glm::unpackHalf2x16(packed[0]);
+      position = glm::vec3(xy.x, xy.y, glm::unpackHalf2x16(packed[1]).x);
+      break;
+    }
+    case VertexPositionEncoding::Snorm16: {
+      const auto packed = readAttribute<std::array<uint32_t, 2>>(source);
+      const auto xy = glm::unpackSnorm2x16(packed[0]);
+      position = glm::vec3(xy.x, xy.y, glm::unpackSnorm2x16(packed[1]).x);
+      break;
+    }
+  }
+  const auto& quantization = packedVertices.quantization;
+  vertex.position =
+      position * quantization.positionScale + quantization.positionOffset;
+
+  vertex.color = format.color == VertexColorEncoding::Float32
+                     ? readAttribute<glm::vec3>(source + colorOffset)
+                     : glm::vec3(glm::unpackUnorm4x8(
+                           readAttribute<uint32_t>(source + colorOffset)));
+  vertex.texCoord =
+      format.texCoord == VertexTexCoordEncoding::Float32
+          ? readAttribute<glm::vec2>(source + texCoordOffset)
+          : glm::unpackHalf2x16(
+                readAttribute<uint32_t>(source + texCoordOffset));
+  vertex.normal = format.normal == VertexNormalEncoding::Float32
+                      ? readAttribute<glm::vec3>(source + normalOffset)
+                      : decodeOctahedral(glm::unpackSnorm2x16(
+                            readAttribute<uint32_t>(source + normalOffset)));
+  return vertex;
+}
+
+glm::vec2 encodeOctahedral(const glm::vec3& direction) {
+  const auto n =
+      direction / (std::abs(direction.x) + std::abs(direction.y) +
+                   std::abs(direction.z));
+  if (n.z >= 0.0f) {
+    return glm::vec2(n.x, n.y);
+  }
+  // Fold the lower hemisphere over the diagonals.
+  return glm::vec2((1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+                   (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
+}
+
+glm::vec3 decodeOctahedral(const glm::vec2& encoded) {
+  auto n = glm::vec3(encoded.x, encoded.y,
+                     1.0f - std::abs(encoded.x) - std::abs(encoded.y));
+  const auto fold = std::max(-n.z, 0.0f);
+  n.x += n.x >= 0.0f ? -fold : fold;
+  n.y += n.y >= 0.0f ? -fold : fold;
+  return glm::normalize(n);
+}
+
+VertexFormatBenchmarkResult benchmarkVertexFormat(
+    std::span<const Vertex> vertices,
+    std::span<const uint32_t> indices,
+    const VertexFormat& format) {
+  auto result = VertexFormatBenchmarkResult{};
+  if (vertices.empty()) {
+    return result;
+  }
+
+  auto start = Clock::now();
+  const auto fullVertices = packVertices(vertices, VertexFormat::full());
+  const auto packed = packVertices(vertices, format);
+  result.packMs = elapsedMs(start, Clock::now());
+
+  result.fullStride = fullVertices.stride;
+  result.packedStride = packed.stride;
+  result.fullBytes = fullVertices.data.size();
+  result.packedBytes = packed.data.size();
+  const auto transformCount =
+      analyzeVertexCache(indices, vertices.size()).vertexTransformCount;
+  result.fullFetchedBytes =
+      static_cast<size_t>(transformCount) * fullVertices.stride;
+  result.packedFetchedBytes =
+      static_cast<size_t>(transformCount) * packed.stride;
+
+  // Reads every index the way a draw would, decoding each vertex.
+  auto readAll = [&indices](const PackedVertices& source,
+                            const VertexFormat& sourceFormat) {
+    auto checksum = glm::vec3(0.0f);
+    for (auto index : indices) {
+      const auto vertex = unpackVertex(source, sourceFormat, index);
+      checksum += vertex.position + vertex.color + vertex.normal;
+    }
+    return checksum;
+  };
+  start = Clock::now();
+  const auto fullChecksum = readAll(fullVertices, VertexFormat::full());
+  auto read = Clock::now();
+  result.fullReadMs = elapsedMs(start, read);
+  start = Clock::now();
+  const auto packedChecksum = readAll(packed, format);
+  read = Clock::now();
+  result.packedReadMs = elapsedMs(start, read);
+
+  auto boundsMin = glm::vec3(std::numeric_limits<float>::max());
+  auto boundsMax = glm::vec3(std::numeric_limits<float>::lowest());
+  for (const auto& vertex : vertices) {
+    boundsMin = glm::min(boundsMin, vertex.position);
+    boundsMax = glm::max(boundsMax, vertex.position);
+  }
+  const auto extent = std::max(glm::distance(boundsMin, boundsMax),
+                               std::numeric_limits<float>::min());
+  for (auto i = 0U; i < vertices.size(); i++) {
+    const auto decoded = unpackVertex(packed, format, i);
+    const auto positionError =
+        glm::distance(decoded.position, vertices[i].position) / extent;
+    result.maxPositionError = std::max(result.maxPositionError, positionError);
+    result.maxColorError =
+        std::max(result.maxColorError,
+                 glm::distance(decoded.color, vertices[i].color));
+    result.maxTexCoordError =
+        std::max(result.maxTexCoordError,
+                 glm::length(decoded.texCoord - vertices[i].texCoord));
+    const auto cosine = glm::dot(decoded.normal,
+                                 glm::normalize(vertices[i].normal));
+    result.maxNormalError = std::max(
+        result.maxNormalError, std::acos(std::clamp(cosine, -1.0f, 1.0f)));
+  }
+
+  const auto savedRatio =
+      1.0 - static_cast<double>(result.packedBytes) /
+                static_cast<double>(result.fullBytes);
+  LOG_FMT(
+      "Vertex format {} -> {} bytes per vertex, {} -> {} bytes, {} -> {} "
+      "bytes fetched per draw ({:.1f}% saved), pack {:.3f} ms, read {:.3f} "
+      "-> {:.3f} ms, max error position {:.2e} color {:.2e} uv {:.2e} "
+      "normal {:.2e} rad, checksum delta {:.2e}",
+      result.fullStride, result.packedStride, result.fullBytes,
+      result.packedBytes, result.fullFetchedBytes, result.packedFetchedBytes,
+      savedRatio * 100.0, result.packMs, result.fullReadMs, result.packedReadMs,
+      result.maxPositionError, result.maxColorError, result.maxTexCoordError,
+      result.maxNormalError, glm::distance(fullChecksum, packedChecksum));
+  if (savedRatio < 0.5) {
+    LOG_WARN_FMT("Vertex format saves only {:.1f}% of the vertex memory",
+                 savedRatio * 100.0);
+  }
+  return result;
+}
+
+}  // namespace Sparrow
@@ -0,0 +1,122 @@
+#ifndef SPARROWENGINE_VERTEX_FORMAT_H
+#define SPARROWENGINE_VERTEX_FORMAT_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "RHI/rhi_struct.h"
+#include "glm/glm.hpp"
+#include "render_mesh.h"
+
+namespace Sparrow {
+
+enum class VertexPositionEncoding {
+  Float32,
+  // Relative to the mesh center.
+  Half,
+  // Normalized to the mesh bounds, dequantized with the mesh's offset and
+  // scale.
+  Snorm16,
+};
+
+enum class VertexColorEncoding {
+  Float32,
+  Unorm8,
+};
+
+enum class VertexTexCoordEncoding {
+  Float32,
+  Half,
+};
+
+enum class VertexNormalEncoding {
+  Float32,
+  // Two snorm16 components, decoded by the vertex shader.
+  Octahedral,
+};
+
+// Maps packed positions back to object space, position = packed * scale +
+// offset. Identity for Float32 positions.
+struct VertexQuantization {
+  glm::vec3 positionOffset = glm::vec3(0.0f);
+  glm::vec3 positionScale = glm::vec3(1.0f);
+  bool octahedralNormals = false;
+};
+
+// Encoding of each Vertex attribute in the vertex buffer. Attributes keep
+// their locations, packed ones are expanded to float by the input
+// assembler so shaders only apply the VertexQuantization and unfold
+// octahedral normals.
+struct VertexFormat {
+  VertexPositionEncoding position = VertexPositionEncoding::Float32;
+  VertexColorEncoding color = VertexColorEncoding::Float32;
+  VertexTexCoordEncoding texCoord = VertexTexCoordEncoding::Float32;
+  VertexNormalEncoding normal = VertexNormalEncoding::Float32;
+
+  // Layout of Vertex itself.
+  static VertexFormat full() { return VertexFormat{}; }
+  // 20 bytes per vertex against Vertex's 44.
+  static VertexFormat compact() {
+    return VertexFormat{
+        .position = VertexPositionEncoding::Snorm16,
+        .color = VertexColorEncoding::Unorm8,
+        .texCoord = VertexTexCoordEncoding::Half,
+        .normal = VertexNormalEncoding::Octahedral,
+    };
+  }
+
+  uint32_t getStride() const;
+  RHIVertexBindingDescription getBindingDescription() const;
+  std::array<RHIVertexAttributeDescription, 4> getAttributeDescription() const;
+};
+
+struct PackedVertices {
+  std::vector<std::byte> data;
+  uint32_t stride = 0;
+  uint32_t vertexCount = 0;
+  VertexQuantization quantization;
+};
+
+struct VertexFormatBenchmarkResult {
+  uint32_t fullStride = 0;
+  uint32_t packedStride = 0;
+  size_t fullBytes = 0;
+  size_t packedBytes = 0;
+  // Vertex bytes fetched for one draw, after the post-transform cache.
+  size_t fullFetchedBytes = 0;
+  size_t packedFetchedBytes = 0;
+  double packMs = 0.0;
+  double fullReadMs = 0.0;
+  double packedReadMs = 0.0;
+  // Largest decode error, positions relative to the mesh size.
+  float maxPositionError = 0.0f;
+  float maxColorError = 0.0f;
+  float maxTexCoordError = 0.0f;
+  // Largest angle between a decoded and a source normal, in radians.
+  float maxNormalError = 0.0f;
+};
+
+PackedVertices packVertices(std::span<const Vertex> vertices,
+                            const VertexFormat& format);
+// Decodes one vertex the way the input assembler and vertex shader do.
+Vertex unpackVertex(const PackedVertices& packedVertices,
+                    const VertexFormat& format,
+                    uint32_t index);
+
+// Octahedral mapping of a unit vector to [-1, 1]^2, for normals packed as
+// two snorm16 components. shader.vert mirrors decodeOctahedral.
+glm::vec2 encodeOctahedral(const glm::vec3& direction);
+glm::vec3 decodeOctahedral(const glm::vec2& encoded);
+
+// Packs the mesh with `format` and compares memory, fetched bytes, read
+// speed and precision against the full layout.
+VertexFormatBenchmarkResult benchmarkVertexFormat(
+    std::span<const Vertex> vertices,
+    std::span<const uint32_t> indices,
+    const VertexFormat& format);
+
+}  // namespace Sparrow
+
+#endif  // SPARROWENGINE_VERTEX_FORMAT_H
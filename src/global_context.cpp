@@ -5,14 +5,18 @@
 #include "global_context.h"
 #include "function/render_system.h"
 #include "function/window_system.h"
+#include "utils/thread_pool.h"
 
 namespace Sparrow {
 void GlobalContext::initialize() {
+  threadPool = std::make_shared<ThreadPool>();
+
   windowSystem = std::make_shared<WindowSystem>();
   windowSystem->initialize({.width = 800, .height = 600});
 
   renderSystem = std::make_shared<RenderSystem>();
-  renderSystem->initialize({.windowSystem = windowSystem});
+  renderSystem->initialize(
+      {.windowSystem = windowSystem, .threadPool = threadPool});
 }
 
 GlobalContext gContext;
@@ -10,9 +10,11 @@
 namespace Sparrow {
 class RenderSystem;
 class WindowSystem;
+class ThreadPool;
 
 class GlobalContext {
  public:
+  std::shared_ptr<ThreadPool> threadPool = nullptr;
   std::shared_ptr<RenderSystem> renderSystem = nullptr;
   std::shared_ptr<WindowSystem> windowSystem = nullptr;
 
@@ -1,9 +1,14 @@
 #include <iostream>
+#include <string_view>
 #include "engine.h"
 #include "utils/fixed_string.h"
 #include "utils/log.h"
 
 int main(int argc, char** argv) {
   Sparrow::Engine engine;
+  if (argc > 1 && std::string_view(argv[1]) == "--bench") {
+    engine.runBenchmarks();
+    return 0;
+  }
   engine.startEngine();
 }
@@ -2,10 +2,29 @@
 
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragTexCoord;
+layout(location = 2) in vec3 fragNormal;
 
 layout(location = 0) out vec4 outColor;
 layout(binding = 1) uniform sampler2D texSampler;
 
+// Material features, each variant compiles the disabled branches out.
+layout(constant_id = 0) const bool TEXTURE = true;
+layout(constant_id = 1) const bool VERTEX_COLOR = false;
+layout(constant_id = 2) const bool LIGHTING = false;
+
+const vec3 lightDirection = vec3(0.267, 0.535, 0.802);
+
 void main() {
-    outColor = texture(texSampler, fragTexCoord);
+    vec4 color = vec4(1.0);
+    if (TEXTURE) {
+        color = texture(texSampler, fragTexCoord);
+    }
+    if (VERTEX_COLOR) {
+        color.rgb *= fragColor;
+    }
+    if (LIGHTING) {
+        float diffuse = max(dot(normalize(fragNormal), lightDirection), 0.0);
+        color.rgb *= 0.2 + 0.8 * diffuse;
+    }
+    outColor = color;
 }
\ No newline at end of file
@@ -6,15 +6,59 @@ layout(binding = 0) uniform UniformBufferObject {
     mat4 projection;
 } ubo;
 
+struct Instance {
+    mat4 model;
+    vec4 boundingSphere;
+    vec4 positionOffset;
+    vec4 positionScale;
+    uint indexCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint padding;
+    uint firstLOD;
+    uint lodCount;
+    uint lodPadding0;
+    uint lodPadding1;
+};
+
+layout(std430, binding = 2) readonly buffer InstanceBuffer {
+    Instance instances[];
+};
+
+// Direct draws push their instance, indirect draws push 0 and pass it as
+// firstInstance.
+layout(push_constant) uniform DrawData {
+    uint instanceBase;
+} draw;
+
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec2 inTexCoord;
+layout(location = 3) in vec3 inNormal;
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) out vec3 fragNormal;
+
+// Mirrors decodeOctahedral in vertex_format.cpp.
+vec3 decodeOctahedral(vec2 encoded) {
+    vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float fold = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -fold : fold, n.y >= 0.0 ? -fold : fold);
+    return normalize(n);
+}
 
 void main() {
-    gl_Position = ubo.projection * ubo.view * ubo.model * vec4(inPosition, 1.0);
+    Instance instance = instances[draw.instanceBase + gl_InstanceIndex];
+    // Packed positions arrive normalized, identity for float positions.
+    vec3 position = inPosition * instance.positionScale.xyz + instance.positionOffset.xyz;
+    mat4 model = ubo.model * instance.model;
+    gl_Position = ubo.projection * ubo.view * model * vec4(position, 1.0);
     fragColor = inColor;
     fragTexCoord = inTexCoord;
+    // positionScale.w flags octahedral normals, the missing z reads as 0.
+    vec3 normal = instance.positionScale.w > 0.5 ? decodeOctahedral(inNormal.xy)
+                                                 : inNormal;
+    // Models are uniformly scaled, no inverse transpose needed.
+    fragNormal = mat3(model) * normal;
 }
\ No newline at end of file
@@ -0,0 +1,145 @@
+#ifndef SPARROWENGINE_RANGE_ALLOCATOR_H
+#define SPARROWENGINE_RANGE_ALLOCATOR_H
+
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <unordered_map>
+
+namespace Sparrow {
+
+// Hands out sub-ranges of [0, capacity) in abstract units. Free ranges are
+// kept by offset, so neighbours coalesce on free, and by size, so
+// allocation is best fit in O(log n).
+class RangeAllocator {
+ public:
+  static constexpr uint32_t InvalidOffset =
+      std::numeric_limits<uint32_t>::max();
+
+  explicit RangeAllocator(uint32_t capacity = 0) { reset(capacity); }
+
+  // Forgets every allocation.
+  void reset(uint32_t newCapacity) {
+    capacity = newCapacity;
+    usedSize = 0;
+    freeRangesByOffset.clear();
+    freeRangesBySize.clear();
+    allocatedSizes.clear();
+    if (capacity > 0) {
+      insertFreeRange(0, capacity);
+    }
+  }
+
+  // Returns InvalidOffset when no free range is large enough.
+  uint32_t allocate(uint32_t size) {
+    if (size == 0) {
+      return InvalidOffset;
+    }
+    auto best = freeRangesBySize.lower_bound(size);
+    if (best == freeRangesBySize.end()) {
+      return InvalidOffset;
+    }
+    const auto [rangeSize, offset] = *best;
+    eraseFreeRange(offset, rangeSize);
+    if (rangeSize > size) {
+      insertFreeRange(offset + size, rangeSize - size);
+    }
+    allocatedSizes.emplace(offset, size);
+    usedSize += size;
+    return offset;
+  }
+
+  void free(uint32_t offset) {
+    auto allocation = allocatedSizes.find(offset);
+    if (allocation == allocatedSizes.end()) {
+      return;
+    }
+    auto size = allocation->second;
+    allocatedSizes.erase(allocation);
+    usedSize -= size;
+
+    auto next = freeRangesByOffset.lower_bound(offset);
+    if (next != freeRangesByOffset.begin()) {
+      auto previous = std::prev(next);
+      if (previous->first + previous->second == offset) {
+        offset = previous->first;
+        size += previous->second;
+        eraseFreeRange(previous->first, previous->second);
+      }
+    }
+    next = freeRangesByOffset.lower_bound(offset);
+    if (next != freeRangesByOffset.end() && offset + size == next->first) {
+      size += next->second;
+      eraseFreeRange(next->first, next->second);
+    }
+    insertFreeRange(offset, size);
+  }
+
+  // Extends the capacity, existing allocations keep their offsets.
+  void grow(uint32_t newCapacity) {
+    if (newCapacity <= capacity) {
+      return;
+    }
+    auto offset = capacity;
+    auto size = newCapacity - capacity;
+    if (!freeRangesByOffset.empty()) {
+      auto last = std::prev(freeRangesByOffset.end());
+      if (last->first + last->second == capacity) {
+        offset = last->first;
+        size += last->second;
+        eraseFreeRange(last->first, last->second);
+      }
+    }
+    insertFreeRange(offset, size);
+    capacity = newCapacity;
+  }
+
+  // True when all free space is one range at the end.
+  bool isCompact() const {
+    if (freeRangesByOffset.empty()) {
+      return true;
+    }
+    const auto [offset, size] = *freeRangesByOffset.begin();
+    return freeRangesByOffset.size() == 1 && offset + size == capacity;
+  }
+
+  uint32_t getCapacity() const { return capacity; }
+  uint32_t getUsedSize() const { return usedSize; }
+  uint32_t getAllocationCount() const {
+    return static_cast<uint32_t>(allocatedSizes.size());
+  }
+  uint32_t getFreeRangeCount() const {
+    return static_cast<uint32_t>(freeRangesByOffset.size());
+  }
+  uint32_t getLargestFreeRange() const {
+    return freeRangesBySize.empty() ? 0 : freeRangesBySize.rbegin()->first;
+  }
+
+ private:
+  void insertFreeRange(uint32_t offset, uint32_t size) {
+    freeRangesByOffset.emplace(offset, size);
+    freeRangesBySize.emplace(size, offset);
+  }
+
+  void eraseFreeRange(uint32_t offset, uint32_t size) {
+    freeRangesByOffset.erase(offset);
+    auto [first, last] = freeRangesBySize.equal_range(size);
+    for (auto it = first; it != last; it++) {
+      if (it->second == offset) {
+        freeRangesBySize.erase(it);
+        break;
+      }
+    }
+  }
+
+  uint32_t capacity = 0;
+  uint32_t usedSize = 0;
+  std::map<uint32_t, uint32_t> freeRangesByOffset;
+  std::multimap<uint32_t, uint32_t> freeRangesBySize;
+  std::unordered_map<uint32_t, uint32_t> allocatedSizes;
+};
+
+}  // namespace Sparrow
+
+#endif  // SPARROWENGINE_RANGE_ALLOCATOR_H
@@ -0,0 +1,40 @@
+#ifndef SPARROWENGINE_STATE_KEY_WRITER_H
+#define SPARROWENGINE_STATE_KEY_WRITER_H
+
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+namespace Sparrow {
+
+// Builds a canonical byte key for hash map lookups of object state.
+// Callers write fields one by one, never whole structs, so padding bytes
+// do not make equal states differ.
+class StateKeyWriter {
+ public:
+  template <typename T>
+    requires std::is_arithmetic_v<T> || std::is_enum_v<T> ||
+             std::is_pointer_v<T>
+  void write(T value) {
+    const auto offset = key.size();
+    key.resize(offset + sizeof(T));
+    std::memcpy(key.data() + offset, &value, sizeof(T));
+  }
+
+  // Length prefixed, so adjacent byte ranges cannot alias.
+  void writeBytes(const void* data, size_t size) {
+    write(size);
+    if (size > 0) {
+      key.append(static_cast<const char*>(data), size);
+    }
+  }
+
+  std::string take() { return std::move(key); }
+
+ private:
+  std::string key;
+};
+
+}  // namespace Sparrow
+
+#endif  // SPARROWENGINE_STATE_KEY_WRITER_H
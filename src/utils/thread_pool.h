@@ -0,0 +1,139 @@
+#ifndef SPARROWENGINE_THREAD_POOL_H
+#define SPARROWENGINE_THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace Sparrow {
+
+class ThreadPool {
+ public:
+  explicit ThreadPool(size_t threadCount = defaultThreadCount()) {
+    workers.reserve(threadCount);
+    for (auto i = 0U; i < threadCount; i++) {
+      workers.emplace_back([this](std::stop_token stopToken) {
+        workerLoop(stopToken);
+      });
+    }
+  }
+
+  ~ThreadPool() {
+    for (auto& worker : workers) {
+      worker.request_stop();
+    }
+    condition.notify_all();
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  static size_t defaultThreadCount() {
+    // Leave one hardware thread to the caller, which also takes part in
+    // parallelFor.
+    return std::max(std::thread::hardware_concurrency(), 2U) - 1;
+  }
+
+  size_t size() const { return workers.size(); }
+
+  template <typename F>
+  auto submit(F&& function) -> std::future<std::invoke_result_t<F>> {
+    using ResultType = std::invoke_result_t<F>;
+    auto task = std::make_shared<std::packaged_task<ResultType()>>(
+        std::forward<F>(function));
+    auto future = task->get_future();
+    {
+      std::lock_guard lock(mutex);
+      tasks.emplace([task]() { (*task)(); });
+    }
+    condition.notify_one();
+    return future;
+  }
+
+  // Calls function(i) for every i in [0, count) on the workers and the
+  // calling thread, returning once all calls finished. Safe to call from a
+  // pool task since the caller never waits on work that has not started.
+  template <typename F>
+  void parallelFor(size_t count, F&& function) {
+    if (count == 0) {
+      return;
+    }
+    if (count == 1 || workers.empty()) {
+      for (auto i = 0U; i < count; i++) {
+        function(i);
+      }
+      return;
+    }
+
+    struct State {
+      std::function<void(size_t)> function;
+      size_t count;
+      std::atomic<size_t> next = 0;
+      std::atomic<size_t> finished = 0;
+      std::mutex mutex;
+      std::condition_variable condition;
+
+      void run() {
+        for (auto i = next.fetch_add(1); i < count; i = next.fetch_add(1)) {
+          function(i);
+          if (finished.fetch_add(1) + 1 == count) {
+            std::lock_guard lock(mutex);
+            condition.notify_all();
+          }
+        }
+      }
+    };
+    auto state = std::make_shared<State>();
+    state->function = std::forward<F>(function);
+    state->count = count;
+
+    const auto helperCount = std::min(workers.size(), count - 1);
+    {
+      std::lock_guard lock(mutex);
+      for (auto i = 0U; i < helperCount; i++) {
+        tasks.emplace([state]() { state->run(); });
+      }
+    }
+    condition.notify_all();
+
+    state->run();
+    std::unique_lock lock(state->mutex);
+    state->condition.wait(lock,
+                          [&state]() { return state->finished == state->count; });
+  }
+
+ private:
+  void workerLoop(std::stop_token stopToken) {
+    while (true) {
+      std::function<void()> task;
+      {
+        std::unique_lock lock(mutex);
+        condition.wait(lock, stopToken, [this]() { return !tasks.empty(); });
+        if (tasks.empty()) {
+          return;
+        }
+        task = std::move(tasks.front());
+        tasks.pop();
+      }
+      task();
+    }
+  }
+
+  std::mutex mutex;
+  std::condition_variable_any condition;
+  std::queue<std::function<void()>> tasks;
+  // Declared last so the threads are joined before the queue is destroyed.
+  std::vector<std::jthread> workers;
+};
+
+}  // namespace Sparrow
+
+#endif  // SPARROWENGINE_THREAD_POOL_H
@@ -4,7 +4,7 @@ set_version("0.0.1")
 add_rules("mode.debug", "mode.release")
 
 add_requires("glfw", "glm", "vulkansdk", "stb")
-add_requires("glslang", {configs = {binaryonly = true}})
+add_requires("glslang")
 
 set_warnings("all")
 set_languages("cxx20")
@@ -12,13 +12,15 @@ set_languages("cxx20")
 target("SparrowEngine")
     set_kind("binary")
     add_rules("utils.glsl2spv", {outputdir = "build/shaders"})
-    add_files("src/shader/*.vert", "src/shader/*.frag")
+    add_files("src/shader/*.vert", "src/shader/*.frag", "src/shader/*.comp")
     add_files("src/*.cpp")
     add_files("src/**/*.cpp")
     add_includedirs("./src")
     add_packages("glfw", "glm", "vulkansdk", "stb")
     add_packages("glslang")
     add_defines("SHADER_DIR=\"" .. path.join(os.projectdir(), "build/shaders"):gsub("\\", "/") .. "\"" )
+    add_defines("SHADER_SOURCE_DIR=\"" .. path.join(os.projectdir(), "src/shader"):gsub("\\", "/") .. "\"" )
+    add_defines("SHADER_CACHE_DIR=\"" .. path.join(os.projectdir(), "build/shader_cache"):gsub("\\", "/") .. "\"" )
     add_defines("TEST_TEXTURE_PATH=\"" .. path.join(os.projectdir(), "texture.jpg"):gsub("\\", "/") .. "\"" )
 
 --